@@ -102,6 +102,7 @@ xf_decode_data(xfInfo * xfi, uint8 * data, int data_size)
 {
 	uint16 cmdType;
 	uint32 bitmapDataLength;
+	uint32 frameId;
 	int destLeft;
 	int destTop;
 	int size;
@@ -121,6 +122,15 @@ xf_decode_data(xfInfo * xfi, uint8 * data, int data_size)
 				break;
 
 			case CMDTYPE_FRAME_MARKER:
+				if (GET_UINT16(data, 2) == SURFACECMD_FRAMEACTION_END &&
+					xfi->settings->use_frame_ack)
+				{
+					/* only ack once the X server has drawn the frame,
+					   so the server cannot run ahead of the screen */
+					frameId = GET_UINT32(data, 4);
+					XSync(xfi->display, False);
+					xfi->inst->rdp_send_frame_ack(xfi->inst, frameId);
+				}
 				size = 8;
 				break;
 
@@ -91,6 +91,7 @@ struct xf_info
 	XModifierKeymap * mod_map;
 	RD_BOOL focused;
 	RD_BOOL mouse_into;
+	RD_BOOL reconnected;
 
 	/* XVideo stuff */
 	long xv_port;
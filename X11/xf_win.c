@@ -229,12 +229,15 @@ l_ui_gdi_begin_update(struct rdp_inst * inst)
 {
 	GDI *gdi = GET_GDI(inst);
 	gdi->primary->hdc->hwnd->invalid->null = 1;
+	gdi->primary->hdc->hwnd->ninvalid = 0;
 }
 
 static void
 l_ui_gdi_end_update(struct rdp_inst * inst)
 {
+	int i;
 	XImage * image;
+	HGDI_RGN cinvalid;
 	GDI *gdi = GET_GDI(inst);
 	xfInfo * xfi = GET_XFI(inst);
 
@@ -244,15 +247,18 @@ l_ui_gdi_end_update(struct rdp_inst * inst)
 	image = XCreateImage(xfi->display, xfi->visual, xfi->depth, ZPixmap, 0,
 			(char *) gdi->primary_buffer, gdi->width, gdi->height, xfi->bitmap_pad, 0);
 
-	XPutImage(xfi->display, xfi->backstore, xfi->gc_default, image, 0, 0, 0, 0, gdi->width, gdi->height);
+	/* only the changed rectangles go to the X server */
+	cinvalid = gdi->primary->hdc->hwnd->cinvalid;
+	for (i = 0; i < gdi->primary->hdc->hwnd->ninvalid; i++)
+	{
+		XPutImage(xfi->display, xfi->backstore, xfi->gc_default, image,
+			cinvalid[i].x, cinvalid[i].y, cinvalid[i].x, cinvalid[i].y,
+			cinvalid[i].w, cinvalid[i].h);
 
-	XCopyArea(xfi->display, xfi->backstore, xfi->wnd, xfi->gc_default,
-			gdi->primary->hdc->hwnd->invalid->x,
-			gdi->primary->hdc->hwnd->invalid->y,
-			gdi->primary->hdc->hwnd->invalid->w,
-			gdi->primary->hdc->hwnd->invalid->h,
-			gdi->primary->hdc->hwnd->invalid->x,
-			gdi->primary->hdc->hwnd->invalid->y);
+		XCopyArea(xfi->display, xfi->backstore, xfi->wnd, xfi->gc_default,
+			cinvalid[i].x, cinvalid[i].y, cinvalid[i].w, cinvalid[i].h,
+			cinvalid[i].x, cinvalid[i].y);
+	}
 
 	XFlush(xfi->display);
 
@@ -395,6 +401,27 @@ l_ui_rect(struct rdp_inst * inst, int x, int y, int cx, int cy, uint32 color)
 	}
 }
 
+static void
+l_ui_rects(struct rdp_inst * inst, RD_RECT * rects, int count, uint32 color)
+{
+	XRectangle * xrects;
+	xfInfo * xfi = GET_XFI(inst);
+
+	color = gdi_color_convert(color, inst->settings->server_depth, xfi->bpp, xfi->clrconv);
+
+	XSetFunction(xfi->display, xfi->gc, GXcopy);
+	XSetFillStyle(xfi->display, xfi->gc, FillSolid);
+	XSetForeground(xfi->display, xfi->gc, color);
+
+	xrects = (XRectangle *) rects;
+	XFillRectangles(xfi->display, xfi->drw, xfi->gc, xrects, count);
+
+	if (xfi->drw == xfi->backstore)
+	{
+		XFillRectangles(xfi->display, xfi->wnd, xfi->gc, xrects, count);
+	}
+}
+
 static void
 l_ui_polygon(struct rdp_inst * inst, uint8 opcode, uint8 fillmode, RD_POINT * point,
 	int npoints, RD_BRUSH * brush, uint32 bgcolor, uint32 fgcolor)
@@ -1096,6 +1123,105 @@ l_ui_check_certificate(rdpInst * inst, const char * fingerprint,
 #endif
 }
 
+/* fill runs of same colored rectangles with a single request */
+static int
+xf_fill_rects(struct rdp_inst * inst, RD_ORDER * orders, int count)
+{
+	int index;
+	uint32 color;
+	XRectangle rects[64];
+	xfInfo * xfi = GET_XFI(inst);
+
+	for (index = 0; index < count && index < 64; index++)
+	{
+		if (orders[index].type != RD_ORDER_RECT ||
+			orders[index].u.rect.color != orders[0].u.rect.color)
+			break;
+
+		rects[index].x = orders[index].x;
+		rects[index].y = orders[index].y;
+		rects[index].width = orders[index].cx;
+		rects[index].height = orders[index].cy;
+	}
+
+	color = gdi_color_convert(orders[0].u.rect.color, inst->settings->server_depth, xfi->bpp, xfi->clrconv);
+
+	XSetFunction(xfi->display, xfi->gc, GXcopy);
+	XSetFillStyle(xfi->display, xfi->gc, FillSolid);
+	XSetForeground(xfi->display, xfi->gc, color);
+	XFillRectangles(xfi->display, xfi->drw, xfi->gc, rects, index);
+
+	if (xfi->drw == xfi->backstore)
+	{
+		XFillRectangles(xfi->display, xfi->wnd, xfi->gc, rects, index);
+	}
+
+	return index;
+}
+
+static void
+l_ui_draw_orders(struct rdp_inst * inst, RD_ORDER * orders, int count)
+{
+	int index;
+	RD_ORDER * order;
+
+	index = 0;
+	while (index < count)
+	{
+		order = &orders[index];
+
+		switch (order->type)
+		{
+			case RD_ORDER_RECT:
+				index += xf_fill_rects(inst, order, count - index);
+				continue;
+
+			case RD_ORDER_SET_CLIP:
+				l_ui_set_clip(inst, order->x, order->y, order->cx, order->cy);
+				break;
+
+			case RD_ORDER_RESET_CLIP:
+				l_ui_reset_clip(inst);
+				break;
+
+			case RD_ORDER_DESTBLT:
+				l_ui_destblt(inst, order->opcode, order->x, order->y, order->cx, order->cy);
+				break;
+
+			case RD_ORDER_PATBLT:
+				l_ui_patblt(inst, order->opcode, order->x, order->y, order->cx, order->cy,
+					&order->u.patblt.brush, order->u.patblt.bgcolor, order->u.patblt.fgcolor);
+				break;
+
+			case RD_ORDER_SCREENBLT:
+				l_ui_screenblt(inst, order->opcode, order->x, order->y, order->cx, order->cy,
+					order->u.screenblt.srcx, order->u.screenblt.srcy);
+				break;
+
+			case RD_ORDER_MEMBLT:
+				l_ui_memblt(inst, order->opcode, order->x, order->y, order->cx, order->cy,
+					order->u.memblt.src, order->u.memblt.srcx, order->u.memblt.srcy);
+				break;
+
+			case RD_ORDER_LINE:
+				l_ui_line(inst, order->opcode, order->x, order->y,
+					order->u.line.endx, order->u.line.endy, &order->u.line.pen);
+				break;
+		}
+
+		index++;
+	}
+}
+
+static void
+l_ui_reconnected(struct rdp_inst * inst)
+{
+	xfInfo * xfi;
+
+	xfi = GET_XFI(inst);
+	xfi->reconnected = True;
+}
+
 static int
 xf_register_callbacks(rdpInst * inst)
 {
@@ -1111,6 +1237,7 @@ xf_register_callbacks(rdpInst * inst)
 	inst->ui_destroy_bitmap = l_ui_destroy_bitmap;
 	inst->ui_line = l_ui_line;
 	inst->ui_rect = l_ui_rect;
+	inst->ui_rects = l_ui_rects;
 	inst->ui_polygon = l_ui_polygon;
 	inst->ui_polyline = l_ui_polyline;
 	inst->ui_ellipse = l_ui_ellipse;
@@ -1145,6 +1272,8 @@ xf_register_callbacks(rdpInst * inst)
 	inst->ui_authenticate = l_ui_authenticate;
 	inst->ui_decode = l_ui_decode;
 	inst->ui_check_certificate = l_ui_check_certificate;
+	inst->ui_draw_orders = l_ui_draw_orders;
+	inst->ui_reconnected = l_ui_reconnected;
 	return 0;
 }
 
@@ -1494,6 +1623,8 @@ xf_check_fds(xfInfo * xfi)
 			return 1;
 		}
 	}
+	/* motion coalesced while draining the X queue goes out now */
+	xfi->inst->rdp_send_input_flush(xfi->inst);
 	return 0;
 }
 
@@ -35,6 +35,7 @@
 #include <freerdp/kbd.h>
 #include <freerdp/errinfo.h>
 #include <freerdp/utils/semaphore.h>
+#include <freerdp/utils/event_loop.h>
 #include "xf_types.h"
 #include "xf_win.h"
 #include "xf_keyboard.h"
@@ -74,6 +75,8 @@ set_default_params(xfInfo * xfi)
 	settings->performanceflags =
 		PERF_DISABLE_WALLPAPER | PERF_DISABLE_FULLWINDOWDRAG | PERF_DISABLE_MENUANIMATIONS;
 	settings->mouse_motion = 1;
+	settings->input_latency = 16;
+	settings->auto_reconnect = 3;
 	settings->off_screen_bitmaps = 1;
 	settings->polygon_ellipse_orders = 1;
 	settings->triblt = 0;
@@ -122,17 +125,22 @@ out_args(void)
 		"\t-D: hide window decorations\n"
 		"\t-z: enable bulk compression\n"
 		"\t--gdi: GDI rendering (sw or hw, for software or hardware)\n"
+		"\t--gdi-threads: threads drawing orders in bands with software GDI, default 1\n"
 		"\t-x: performance flags (m, b or l for modem, broadband or lan)\n"
 		"\t-m: don't send mouse motion events\n"
+		"\t--input-latency: ms mouse motion may wait to be sent with other input, default 16\n"
+		"\t--auto-reconnect: attempts to resume a dropped session, default 3, 0 to disable\n"
 		"\t-X: embed into another window with a given XID.\n"
 #ifndef DISABLE_TLS
 		"\t--no-rdp: disable Standard RDP encryption\n"
 		"\t--no-tls: disable TLS encryption\n"
 		"\t--no-nla: disable network level authentication\n"
 		"\t--sec: force protocol security (rdp, tls or nla)\n"
+		"\t--ktls: let the kernel encrypt TLS records when supported\n"
 #endif
 		"\t--plugin: load a virtual channel plugin\n"
 		"\t--no-osb: disable off screen bitmaps, default on\n"
+		"\t--pcache: persistent bitmap cache (raw, or z for compressed cells)\n"
 		"\t--rfx: ask for RemoteFX session\n"
 #ifdef HAVE_XV
 		"\t--xv-port: choose XVideo adaptor port number.\n"
@@ -155,6 +163,7 @@ process_params(xfInfo * xfi, int argc, char ** argv, int * pindex)
 	int i, j;
 	struct passwd * pw;
 	int num_extensions;
+	long num_cpus;
 	int rv;
 
 	set_default_params(xfi);
@@ -380,6 +389,49 @@ process_params(xfInfo * xfi, int argc, char ** argv, int * pindex)
 				return 1;
 			}
 		}
+		else if (strcmp("--gdi-threads", argv[*pindex]) == 0)
+		{
+			*pindex = *pindex + 1;
+			if (*pindex == argc)
+			{
+				printf("missing GDI thread count\n");
+				return 1;
+			}
+			settings->software_gdi_threads = atoi(argv[*pindex]);
+			if (settings->software_gdi_threads < 1)
+			{
+				printf("invalid GDI thread count\n");
+				return 1;
+			}
+			/* more threads than processors only adds switching */
+			num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+			if (num_cpus > 0 && settings->software_gdi_threads > num_cpus)
+				settings->software_gdi_threads = num_cpus;
+		}
+		else if (strcmp("--pcache", argv[*pindex]) == 0)
+		{
+			*pindex = *pindex + 1;
+			if (*pindex == argc)
+			{
+				printf("missing persistent cache format\n");
+				return 1;
+			}
+			if (strcmp("raw", argv[*pindex]) == 0)
+			{
+				settings->bitmap_cache_persist_compress = 0;
+			}
+			else if (strcmp("z", argv[*pindex]) == 0)
+			{
+				settings->bitmap_cache_persist_compress = 1;
+			}
+			else
+			{
+				printf("unknown persistent cache format\n");
+				return 1;
+			}
+			settings->bitmap_cache_persist_enable = 1;
+			settings->bitmap_cache_precache = 1;
+		}
 		else if (strcmp("--no-osb", argv[*pindex]) == 0)
 		{
 			settings->off_screen_bitmaps = 0;
@@ -388,7 +440,7 @@ process_params(xfInfo * xfi, int argc, char ** argv, int * pindex)
 		{
 			settings->rfx_flags = 1;
 			settings->ui_decode_flags = 1;
-			settings->use_frame_ack = 0;
+			settings->use_frame_ack = 1;
 			settings->server_depth = 32;
 			settings->performanceflags = PERF_FLAG_NONE;
 			xfi->codec = XF_CODEC_REMOTEFX;
@@ -397,6 +449,26 @@ process_params(xfInfo * xfi, int argc, char ** argv, int * pindex)
 		{
 			settings->mouse_motion = 0;
 		}
+		else if (strcmp("--input-latency", argv[*pindex]) == 0)
+		{
+			*pindex = *pindex + 1;
+			if (*pindex == argc)
+			{
+				printf("missing input latency\n");
+				exit(XF_EXIT_WRONG_PARAM);
+			}
+			settings->input_latency = atoi(argv[*pindex]);
+		}
+		else if (strcmp("--auto-reconnect", argv[*pindex]) == 0)
+		{
+			*pindex = *pindex + 1;
+			if (*pindex == argc)
+			{
+				printf("missing auto-reconnect attempts\n");
+				exit(XF_EXIT_WRONG_PARAM);
+			}
+			settings->auto_reconnect = atoi(argv[*pindex]);
+		}
 		else if (strcmp("--app", argv[*pindex]) == 0)
 		{
 			*pindex = *pindex + 1;
@@ -478,6 +550,10 @@ process_params(xfInfo * xfi, int argc, char ** argv, int * pindex)
 		{
 			settings->nla_security = 0;
 		}
+		else if (strcmp("--ktls", argv[*pindex]) == 0)
+		{
+			settings->tls_kernel_offload = 1;
+		}
 		else if (strcmp("--sec", argv[*pindex]) == 0)
 		{
 			*pindex = *pindex + 1;
@@ -637,11 +713,9 @@ run_xfreerdp(xfInfo * xfi)
 	void * write_fds[32];
 	int read_count;
 	int write_count;
+	int rdp_read_count;
 	int index;
-	int sck;
-	int max_sck;
-	fd_set rfds;
-	fd_set wfds;
+	EVENT_LOOP * loop;
 	RD_EVENT * event;
 
 	/* create an instance of the library */
@@ -696,6 +770,13 @@ run_xfreerdp(xfInfo * xfi)
 	xf_video_init(xfi);
 	xf_decode_init(xfi);
 
+	loop = event_loop_new();
+	if (loop == NULL)
+	{
+		printf("run_xfreerdp: event_loop_new failed\n");
+		return XF_EXIT_CONN_FAILED;
+	}
+
 	/* program main loop */
 	while (1)
 	{
@@ -707,6 +788,7 @@ run_xfreerdp(xfInfo * xfi)
 			printf("run_xfreerdp: inst->rdp_get_fds failed\n");
 			break;
 		}
+		rdp_read_count = read_count;
 		/* get x fds */
 		if (xf_get_fds(xfi, read_fds, &read_count, write_fds, &write_count) != 0)
 		{
@@ -719,43 +801,23 @@ run_xfreerdp(xfInfo * xfi)
 			printf("run_xfreerdp: freerdp_chanman_get_fds failed\n");
 			break;
 		}
-		max_sck = 0;
-		/* setup read fds */
-		FD_ZERO(&rfds);
-		for (index = 0; index < read_count; index++)
+		/* register the fds, only changes reach the kernel */
+		if (event_loop_set_fds(loop, read_fds, read_count, write_fds, write_count) != 0)
 		{
-			sck = (int)(long) (read_fds[index]);
-			if (sck > max_sck)
-				max_sck = sck;
-			FD_SET(sck, &rfds);
-		}
-		/* setup write fds */
-		FD_ZERO(&wfds);
-		for (index = 0; index < write_count; index++)
-		{
-			sck = (int)(long) (write_fds[index]);
-			if (sck > max_sck)
-				max_sck = sck;
-			FD_SET(sck, &wfds);
+			printf("run_xfreerdp: event_loop_set_fds failed\n");
+			break;
 		}
 		/* exit if nothing to do */
-		if (max_sck == 0)
+		if (event_loop_count(loop) == 0)
 		{
-			printf("run_xfreerdp: max_sck is zero\n");
+			printf("run_xfreerdp: no fds to wait on\n");
 			break;
 		}
 		/* do the wait */
-		if (select(max_sck + 1, &rfds, &wfds, NULL, NULL) == -1)
+		if (event_loop_wait(loop, -1) < 0)
 		{
-			/* these are not really errors */
-			if (!((errno == EAGAIN) ||
-				(errno == EWOULDBLOCK) ||
-				(errno == EINPROGRESS) ||
-				(errno == EINTR))) /* signal occurred */
-			{
-				printf("run_xfreerdp: select failed\n");
-				break;
-			}
+			printf("run_xfreerdp: event_loop_wait failed\n");
+			break;
 		}
 		/* check the libfreerdp fds */
 		if (inst->rdp_check_fds(inst) != 0)
@@ -763,6 +825,13 @@ run_xfreerdp(xfInfo * xfi)
 			printf("run_xfreerdp: inst->rdp_check_fds failed\n");
 			break;
 		}
+		if (xfi->reconnected)
+		{
+			/* forget the closed sockets, the next set_fds registers the new ones */
+			for (index = 0; index < rdp_read_count; index++)
+				event_loop_remove(loop, (int) (long) read_fds[index]);
+			xfi->reconnected = False;
+		}
 		/* check x fds */
 		if (xf_check_fds(xfi) != 0)
 		{
@@ -796,6 +865,8 @@ run_xfreerdp(xfInfo * xfi)
 		}
 	}
 
+	event_loop_free(loop);
+
 	DEBUG_X11("disconnected, reason %d", inst->disc_reason);
 
 	g_disconnect_reason = inst->disc_reason;
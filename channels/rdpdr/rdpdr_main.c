@@ -41,8 +41,6 @@
 
 #include "rdpdr_main.h"
 
-#define MAX(x,y)             (((x) > (y)) ? (x) : (y))
-
 /* called by main thread
    add item to linked list and inform worker thread that there is data */
 static void
@@ -293,15 +291,11 @@ rdpdr_add_async_irp(rdpdrPlugin * plugin, IRP * irp, char * data, int data_size)
 			if (timeout && (plugin->select_timeout == 0 || timeout < plugin->select_timeout))
 			{
 				plugin->select_timeout = timeout;
-				plugin->tv.tv_sec = plugin->select_timeout / 1000;
-				plugin->tv.tv_usec = (plugin->select_timeout % 1000) * 1000;
 				plugin->timeout_fd = irp_file_descriptor(irp);
 			}
 			if (itv_timeout && (plugin->select_timeout == 0 || itv_timeout < plugin->select_timeout))
 			{
 				plugin->select_timeout = itv_timeout;
-				plugin->tv.tv_sec = plugin->select_timeout / 1000;
-				plugin->tv.tv_usec = (plugin->select_timeout % 1000) * 1000;
 				plugin->timeout_fd = irp_file_descriptor(irp);
 			}
 			break;
@@ -319,31 +313,39 @@ rdpdr_add_async_irp(rdpdrPlugin * plugin, IRP * irp, char * data, int data_size)
 static void
 rdpdr_set_fds(rdpdrPlugin * plugin)
 {
-	fd_set *fds = NULL;
 	IRP * pending = NULL;
+	void ** fds;
+	int size;
+	int read_count = 0;
+	int write_count = 0;
+
+	/* reads fill the array from the front, writes from the back */
+	size = irp_queue_size(plugin->queue);
+	fds = (void **) xmalloc(size * sizeof(void *));
 
 	for (pending = irp_queue_first(plugin->queue); pending; pending = irp_queue_next(plugin->queue, pending))
 	{
+		if (irp_file_descriptor(pending) < 0)
+			continue;
+
 		switch (pending->majorFunction)
 		{
 			case IRP_MJ_WRITE:
-				fds = &plugin->writefds;
+				fds[size - ++write_count] = (void *) (long) irp_file_descriptor(pending);
 				break;
 
 			case IRP_MJ_READ:
-				fds = &plugin->readfds;
+				fds[read_count++] = (void *) (long) irp_file_descriptor(pending);
 				break;
 
 			case IRP_MJ_DEVICE_CONTROL:
 				break;
 		}
-
-		if (fds && irp_file_descriptor(pending) >= 0)
-		{
-			FD_SET(irp_file_descriptor(pending), fds);
-			plugin->nfds = MAX(plugin->nfds, irp_file_descriptor(pending));
-		}
 	}
+
+	if (event_loop_set_fds(plugin->loop, fds, read_count, fds + size - write_count, write_count) != 0)
+		LLOGLN(0, ("rdpdr_set_fds: event_loop_set_fds failed"));
+	xfree(fds);
 }
 
 static void
@@ -437,8 +439,6 @@ __rdpdr_check_fds(rdpdrPlugin * plugin)
 	int out_size, error;
 	uint32 result = 0;
 
-	memset(&plugin->tv, 0, sizeof(struct timeval));
-
 	/* scan every pending */
 	pending = irp_queue_first(plugin->queue);
 	while (pending)
@@ -448,7 +448,7 @@ __rdpdr_check_fds(rdpdrPlugin * plugin)
 		switch (pending->majorFunction)
 		{
 			case IRP_MJ_READ:
-				if (FD_ISSET(irp_file_descriptor(pending), &plugin->readfds))
+				if (event_loop_ready(plugin->loop, irp_file_descriptor(pending)) & EVENT_READ)
 				{
 					irp_process_read_request(pending, NULL, 0);
 					isset = 1;
@@ -456,7 +456,7 @@ __rdpdr_check_fds(rdpdrPlugin * plugin)
 				break;
 
 			case IRP_MJ_WRITE:
-				if (FD_ISSET(irp_file_descriptor(pending), &plugin->writefds))
+				if (event_loop_ready(plugin->loop, irp_file_descriptor(pending)) & EVENT_WRITE)
 				{
 					irp_process_write_request(pending, NULL, 0);
 					isset = 1;
@@ -497,15 +497,20 @@ __rdpdr_check_fds(rdpdrPlugin * plugin)
 static int
 rdpdr_check_fds(rdpdrPlugin * plugin)
 {
+	int timeout;
+
 	if (irp_queue_size(plugin->queue) == 0)
 		return 1;
 
 	rdpdr_set_fds(plugin);
 
-	switch (select(plugin->nfds + 1, &plugin->readfds, &plugin->writefds, NULL, &plugin->tv))
+	/* default timeout */
+	timeout = plugin->select_timeout ? plugin->select_timeout : 60000;
+
+	switch (event_loop_wait(plugin->loop, timeout))
 	{
 		case -1:
-			LLOGLN(0, ("rdpdr_check_fds: select has returned -1 with error: %s", strerror(errno)));
+			LLOGLN(0, ("rdpdr_check_fds: event_loop_wait has returned -1 with error: %s", strerror(errno)));
 			return 0;
 
 		case 0:
@@ -585,6 +590,9 @@ rdpdr_process_irp(rdpdrPlugin * plugin, char* data, int data_size)
 
 		case IRP_MJ_CLOSE:
 			LLOGLN(10, ("IRP_MJ_CLOSE"));
+			/* the next create may get the same fd number back */
+			if (irp_file_descriptor(&irp) >= 0)
+				event_loop_remove(plugin->loop, irp_file_descriptor(&irp));
 			irp_process_close_request(&irp, &data[20], data_size - 20);
 			break;
 
@@ -880,6 +888,7 @@ thread_func(void * arg)
 
 	plugin = (rdpdrPlugin *) arg;
 	plugin->queue = irp_queue_new();
+	plugin->loop = event_loop_new();
 	plugin->thread_status = 1;
 
 	scard_srv = devman_get_service_by_type(plugin->devman, RDPDR_DTYP_SMARTCARD);
@@ -901,13 +910,6 @@ thread_func(void * arg)
 		numobj = 3;
 		wait_obj_select(listobj, numobj, NULL, 0, -1);
 
-		plugin->nfds = 1;
-		FD_ZERO(&plugin->readfds);
-		FD_ZERO(&plugin->writefds);
-
-		/* default timeout */
-		plugin->tv.tv_sec = 60;
-		plugin->tv.tv_usec = 0;
 		plugin->select_timeout = 0;
 
 		if (wait_obj_is_set(plugin->term_event))
@@ -929,6 +931,7 @@ thread_func(void * arg)
 
 	LLOGLN(10, ("thread_func: out"));
 	plugin->thread_status = -1;
+	event_loop_free(plugin->loop);
 	irp_queue_free(plugin->queue);
 	return 0;
 }
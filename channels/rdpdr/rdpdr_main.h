@@ -24,6 +24,7 @@
 #include <sys/select.h>
 #include "rdpdr_types.h"
 #include <freerdp/utils/chan_plugin.h>
+#include <freerdp/utils/event_loop.h>
 
 struct data_in_item
 {
@@ -59,9 +60,7 @@ struct rdpdr_plugin
 
 	/* Async IO stuff */
 	IRPQueue * queue;
-	fd_set readfds, writefds;
-	int nfds;
-	struct timeval tv;
+	EVENT_LOOP * loop;
 	uint32 select_timeout;
 	uint32 timeout_fd;
 };
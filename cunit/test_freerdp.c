@@ -17,14 +17,58 @@
    limitations under the License.
 */
 
+#include <stdlib.h>
 #include "CUnit/Basic.h"
 
 #include "test_color.h"
 #include "test_libgdi.h"
 #include "test_librfx.h"
+#include "test_license.h"
 #include "test_ntlmssp.h"
+#include "test_pstcache.h"
+#include "test_security.h"
 #include "test_freerdp.h"
 
+int malloc_counting = 0;
+int malloc_count = 0;
+
+#ifdef WITH_MALLOC_WRAP
+
+/*
+ * count heap allocations while malloc_counting is set, the test program is
+ * linked with -Wl,--wrap for malloc, calloc and realloc (see Makefile.am)
+ */
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t nmemb, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size)
+{
+	if (malloc_counting)
+		malloc_count++;
+
+	return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t nmemb, size_t size)
+{
+	if (malloc_counting)
+		malloc_count++;
+
+	return __real_calloc(nmemb, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+	if (malloc_counting)
+		malloc_count++;
+
+	return __real_realloc(ptr, size);
+}
+
+#endif
+
 void dump_data(unsigned char * p, int len, int width, char* name)
 {
 	unsigned char *line = p;
@@ -64,7 +108,10 @@ int main(int argc, char* argv[])
 		add_color_suite();
 		add_libgdi_suite();
 		add_librfx_suite();
+		add_license_suite();
 		add_ntlmssp_suite();
+		add_pstcache_suite();
+		add_security_suite();
 	}
 	else
 	{
@@ -82,10 +129,22 @@ int main(int argc, char* argv[])
 			{
 				add_librfx_suite();
 			}
+			else if (strcmp("license", argv[*pindex]) == 0)
+			{
+				add_license_suite();
+			}
 			else if (strcmp("ntlmssp", argv[*pindex]) == 0)
 			{
 				add_ntlmssp_suite();
 			}
+			else if (strcmp("pstcache", argv[*pindex]) == 0)
+			{
+				add_pstcache_suite();
+			}
+			else if (strcmp("security", argv[*pindex]) == 0)
+			{
+				add_security_suite();
+			}
 
 			*pindex = *pindex + 1;
 		}
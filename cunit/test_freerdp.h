@@ -32,4 +32,9 @@
 		CU_cleanup_registry(); return CU_get_error(); \
 	}
 
+/* heap allocations counted while malloc_counting is set, only when the
+   tests are built with WITH_MALLOC_WRAP */
+extern int malloc_counting;
+extern int malloc_count;
+
 void dump_data(unsigned char * p, int len, int width, char* name);
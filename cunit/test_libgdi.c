@@ -33,6 +33,13 @@
 #include "gdi_palette.h"
 #include "gdi_drawing.h"
 #include "gdi_clipping.h"
+#include "gdi_rop3.h"
+#include "gdi_band.h"
+
+#ifdef WITH_SSE
+#include "sse/gdi_sse2.h"
+#include "sse/gdi_avx2.h"
+#endif
 
 #include "test_libgdi.h"
 
@@ -72,6 +79,16 @@ int add_libgdi_suite(void)
 	add_test_function(gdi_BitBlt_8bpp);
 	add_test_function(gdi_ClipCoords);
 	add_test_function(gdi_InvalidateRegion);
+	add_test_function(gdi_InvalidateRegionRects);
+	add_test_function(gdi_LineToInvalidate);
+	add_test_function(gdi_rops);
+	add_test_function(gdi_rop3);
+#ifdef WITH_MALLOC_WRAP
+	add_test_function(gdi_ui_allocations);
+#endif
+	add_test_function(gdi_bands);
+	add_test_function(gdi_bands_clamp);
+	add_test_function(gdi_brush_palette);
 
 	return 0;
 }
@@ -2859,6 +2876,7 @@ void test_gdi_InvalidateRegion(void)
 	gdi_SetNullClipRgn(hdc);
 
 	hdc->hwnd = (HGDI_WND) malloc(sizeof(GDI_WND));
+	memset(hdc->hwnd, 0, sizeof(GDI_WND));
 	hdc->hwnd->invalid = gdi_CreateRectRgn(0, 0, 0, 0);
 	hdc->hwnd->invalid->null = 1;
 	invalid = hdc->hwnd->invalid;
@@ -2980,3 +2998,777 @@ void test_gdi_InvalidateRegion(void)
 	gdi_InvalidateRegion(hdc, rgn1->x, rgn1->y, rgn1->w, rgn1->h);
 	CU_ASSERT(gdi_EqualRgn(invalid, rgn2) == 1);
 }
+
+static int test_invalid_area(HGDI_WND hwnd)
+{
+	int i;
+	int area = 0;
+
+	for (i = 0; i < hwnd->ninvalid; i++)
+		area += hwnd->cinvalid[i].w * hwnd->cinvalid[i].h;
+
+	return area;
+}
+
+static int test_invalid_disjoint(HGDI_WND hwnd)
+{
+	int i, j;
+	HGDI_RGN a, b;
+
+	for (i = 0; i < hwnd->ninvalid; i++)
+	{
+		for (j = i + 1; j < hwnd->ninvalid; j++)
+		{
+			a = &hwnd->cinvalid[i];
+			b = &hwnd->cinvalid[j];
+			if (a->x < b->x + b->w && b->x < a->x + a->w &&
+				a->y < b->y + b->h && b->y < a->y + a->h)
+				return 0;
+		}
+	}
+
+	return 1;
+}
+
+void test_gdi_InvalidateRegionRects(void)
+{
+	int i;
+	HGDI_DC hdc;
+	HGDI_WND hwnd;
+	HGDI_BITMAP bmp;
+
+	hdc = gdi_GetDC();
+	hdc->bytesPerPixel = 4;
+	hdc->bitsPerPixel = 32;
+	bmp = gdi_CreateBitmap(1024, 768, 4, NULL);
+	gdi_SelectObject(hdc, (HGDIOBJECT) bmp);
+	gdi_SetNullClipRgn(hdc);
+
+	hwnd = (HGDI_WND) malloc(sizeof(GDI_WND));
+	memset(hwnd, 0, sizeof(GDI_WND));
+	hwnd->invalid = gdi_CreateRectRgn(0, 0, 0, 0);
+	hwnd->invalid->null = 1;
+	hwnd->count = 4;
+	hwnd->cinvalid = (HGDI_RGN) malloc(sizeof(GDI_RGN) * hwnd->count);
+	hwnd->mergeCost = GDI_INVALID_MERGE_COST;
+	hdc->hwnd = hwnd;
+
+	/* opposite corners stay apart */
+	gdi_InvalidateRegion(hdc, 0, 0, 16, 16);
+	gdi_InvalidateRegion(hdc, 1008, 752, 16, 16);
+	CU_ASSERT(hwnd->ninvalid == 2);
+	CU_ASSERT(test_invalid_area(hwnd) == 2 * 16 * 16);
+	CU_ASSERT(hwnd->invalid->w == 1024 && hwnd->invalid->h == 768);
+
+	/* an overlapping rectangle is merged */
+	gdi_InvalidateRegion(hdc, 8, 8, 16, 16);
+	CU_ASSERT(hwnd->ninvalid == 2);
+	CU_ASSERT(test_invalid_disjoint(hwnd));
+
+	/* a neighbour close enough is merged, the region is clipped */
+	gdi_InvalidateRegion(hdc, 1000, 740, 100, 12);
+	CU_ASSERT(hwnd->ninvalid == 2);
+	CU_ASSERT(test_invalid_disjoint(hwnd));
+	for (i = 0; i < hwnd->ninvalid; i++)
+	{
+		CU_ASSERT(hwnd->cinvalid[i].x + hwnd->cinvalid[i].w <= 1024);
+		CU_ASSERT(hwnd->cinvalid[i].y + hwnd->cinvalid[i].h <= 768);
+	}
+
+	/* a full list folds rectangles together instead of growing */
+	for (i = 0; i < 8; i++)
+		gdi_InvalidateRegion(hdc, 100 + i * 100, 100 + (i % 2) * 400, 10, 10);
+	CU_ASSERT(hwnd->ninvalid <= hwnd->count);
+	CU_ASSERT(test_invalid_disjoint(hwnd));
+
+	/* nothing left after a new update begins */
+	hwnd->ninvalid = 0;
+	gdi_InvalidateRegion(hdc, -10, -10, 20, 20);
+	CU_ASSERT(hwnd->ninvalid == 1);
+	CU_ASSERT(test_invalid_area(hwnd) == 10 * 10);
+
+	gdi_DeleteObject((HGDIOBJECT) bmp);
+	gdi_DeleteDC(hdc);
+}
+
+void test_gdi_LineToInvalidate(void)
+{
+	HGDI_DC hdc;
+	HGDI_PEN pen;
+	HGDI_WND hwnd;
+	HGDI_BITMAP bmp;
+
+	hdc = gdi_GetDC();
+	hdc->bytesPerPixel = 4;
+	hdc->bitsPerPixel = 32;
+	bmp = gdi_CreateCompatibleBitmap(hdc, 64, 64);
+	gdi_SelectObject(hdc, (HGDIOBJECT) bmp);
+	gdi_SetNullClipRgn(hdc);
+
+	pen = gdi_CreatePen(1, 1, 0);
+	gdi_SelectObject(hdc, (HGDIOBJECT) pen);
+
+	hwnd = (HGDI_WND) malloc(sizeof(GDI_WND));
+	memset(hwnd, 0, sizeof(GDI_WND));
+	hwnd->invalid = gdi_CreateRectRgn(0, 0, 0, 0);
+	hwnd->invalid->null = 1;
+	hwnd->count = 4;
+	hwnd->cinvalid = (HGDI_RGN) malloc(sizeof(GDI_RGN) * hwnd->count);
+	hwnd->mergeCost = GDI_INVALID_MERGE_COST;
+	hdc->hwnd = hwnd;
+
+	/* a line invalidates the bounding box of its end points */
+	gdi_MoveToEx(hdc, 40, 25, NULL);
+	gdi_LineTo(hdc, 10, 20);
+	CU_ASSERT(hwnd->ninvalid == 1);
+	CU_ASSERT(hwnd->cinvalid[0].x == 10 && hwnd->cinvalid[0].y == 20);
+	CU_ASSERT(hwnd->cinvalid[0].w == 31 && hwnd->cinvalid[0].h == 6);
+	CU_ASSERT(hwnd->invalid->null == 0);
+
+	/* the box is clipped to the clipping region */
+	hwnd->ninvalid = 0;
+	gdi_SetClipRgn(hdc, 0, 0, 16, 16);
+	gdi_MoveToEx(hdc, 0, 0, NULL);
+	gdi_LineTo(hdc, 63, 63);
+	CU_ASSERT(hwnd->ninvalid == 1);
+	CU_ASSERT(hwnd->cinvalid[0].x == 0 && hwnd->cinvalid[0].y == 0);
+	CU_ASSERT(hwnd->cinvalid[0].w == 16 && hwnd->cinvalid[0].h == 16);
+
+	/* a line outside of the clipping region invalidates nothing */
+	hwnd->ninvalid = 0;
+	gdi_MoveToEx(hdc, 32, 32, NULL);
+	gdi_LineTo(hdc, 48, 40);
+	CU_ASSERT(hwnd->ninvalid == 0);
+
+	gdi_DeleteObject((HGDIOBJECT) pen);
+	gdi_DeleteObject((HGDIOBJECT) bmp);
+	gdi_DeleteDC(hdc);
+}
+
+/* odd widths so that every kernel also runs its scalar tail */
+#define ROP_TEST_WIDTH	67
+
+static void fill_random(uint8* data, int size)
+{
+	int i;
+
+	for (i = 0; i < size; i++)
+		data[i] = rand() & 0xFF;
+}
+
+/* apply the same row operation with both tables and compare the results */
+static int test_rops_equal(HGDI_ROPS rops, HGDI_ROPS ref)
+{
+	int rop;
+	int width;
+	int failed = 0;
+	uint8 glyph[ROP_TEST_WIDTH];
+	uint32 src32[ROP_TEST_WIDTH];
+	uint32 dst32[2][ROP_TEST_WIDTH];
+	uint16 src16[ROP_TEST_WIDTH];
+	uint16 dst16[2][ROP_TEST_WIDTH];
+
+	for (width = 0; width <= ROP_TEST_WIDTH; width++)
+	{
+		for (rop = 0; rop < 7; rop++)
+		{
+			fill_random(glyph, sizeof(glyph));
+			fill_random((uint8*) src32, sizeof(src32));
+			fill_random((uint8*) dst32[0], sizeof(dst32[0]));
+			memcpy(dst32[1], dst32[0], sizeof(dst32[0]));
+			fill_random((uint8*) src16, sizeof(src16));
+			fill_random((uint8*) dst16[0], sizeof(dst16[0]));
+			memcpy(dst16[1], dst16[0], sizeof(dst16[0]));
+
+			switch (rop)
+			{
+				case 0:
+					rops->SRCAND_32bpp(dst32[0], src32, width);
+					ref->SRCAND_32bpp(dst32[1], src32, width);
+					rops->SRCAND_16bpp(dst16[0], src16, width);
+					ref->SRCAND_16bpp(dst16[1], src16, width);
+					break;
+
+				case 1:
+					rops->SRCPAINT_32bpp(dst32[0], src32, width);
+					ref->SRCPAINT_32bpp(dst32[1], src32, width);
+					rops->SRCPAINT_16bpp(dst16[0], src16, width);
+					ref->SRCPAINT_16bpp(dst16[1], src16, width);
+					break;
+
+				case 2:
+					rops->SRCINVERT_32bpp(dst32[0], src32, width);
+					ref->SRCINVERT_32bpp(dst32[1], src32, width);
+					rops->SRCINVERT_16bpp(dst16[0], src16, width);
+					ref->SRCINVERT_16bpp(dst16[1], src16, width);
+					break;
+
+				case 3:
+					rops->DSTINVERT_32bpp(dst32[0], width);
+					ref->DSTINVERT_32bpp(dst32[1], width);
+					rops->DSTINVERT_16bpp(dst16[0], width);
+					ref->DSTINVERT_16bpp(dst16[1], width);
+					break;
+
+				case 4:
+					rops->PATCOPY_32bpp(dst32[0], src32[0], width);
+					ref->PATCOPY_32bpp(dst32[1], src32[0], width);
+					rops->PATCOPY_16bpp(dst16[0], src16[0], width);
+					ref->PATCOPY_16bpp(dst16[1], src16[0], width);
+					break;
+
+				case 5:
+					rops->PATINVERT_32bpp(dst32[0], src32[0], width);
+					ref->PATINVERT_32bpp(dst32[1], src32[0], width);
+					rops->PATINVERT_16bpp(dst16[0], src16[0], width);
+					ref->PATINVERT_16bpp(dst16[1], src16[0], width);
+					break;
+
+				case 6:
+					rops->DSPDxax_32bpp(dst32[0], glyph, src32[0], width);
+					ref->DSPDxax_32bpp(dst32[1], glyph, src32[0], width);
+					rops->DSPDxax_16bpp(dst16[0], glyph, src16[0], width);
+					ref->DSPDxax_16bpp(dst16[1], glyph, src16[0], width);
+					break;
+			}
+
+			if (memcmp(dst32[0], dst32[1], sizeof(dst32[0])) != 0 ||
+			    memcmp(dst16[0], dst16[1], sizeof(dst16[0])) != 0)
+			{
+				printf("raster operation %d differs at width %d\n", rop, width);
+				failed++;
+			}
+		}
+	}
+
+	return failed;
+}
+
+void test_gdi_rops(void)
+{
+	uint8 glyph[2] = { 0xFF, 0x00 };
+	uint32 dst32[2] = { 0x11223344, 0x55667788 };
+	uint32 src32[2] = { 0xAABBCCDD, 0xAABBCCDD };
+#ifdef WITH_SSE
+	GDI_ROPS rops;
+#endif
+
+	/* 32bpp kernels leave the alpha byte of the destination alone */
+	gdi_rops_generic.SRCINVERT_32bpp(dst32, src32, 2);
+	CU_ASSERT(dst32[0] == 0x1199FF99);
+	CU_ASSERT(dst32[1] == 0x55DDBB55);
+
+	gdi_rops_generic.DSPDxax_32bpp(dst32, glyph, 0xFF102030, 2);
+	CU_ASSERT(dst32[0] == 0x11102030);
+	CU_ASSERT(dst32[1] == 0x55DDBB55);
+
+#ifdef WITH_SSE
+	memcpy(&rops, &gdi_rops_generic, sizeof(GDI_ROPS));
+	gdi_init_rops_sse2(&rops);
+	CU_ASSERT(test_rops_equal(&rops, &gdi_rops_generic) == 0);
+
+	if (gdi_cpu_has_avx2())
+	{
+		gdi_init_rops_avx2(&rops);
+		CU_ASSERT(test_rops_equal(&rops, &gdi_rops_generic) == 0);
+	}
+#endif
+}
+
+/* wide enough to span several chunks of the ternary raster operation engine */
+#define ROP3_TEST_WIDTH		150
+#define ROP3_TEST_HEIGHT	3
+
+/* evaluate a ternary raster operation one bit at a time */
+static uint8 rop3_reference(uint8 code, uint8 p, uint8 s, uint8 d)
+{
+	int bit;
+	int index;
+	uint8 r = 0;
+
+	for (bit = 0; bit < 8; bit++)
+	{
+		index = (((p >> bit) & 1) << 2) | (((s >> bit) & 1) << 1) | ((d >> bit) & 1);
+		r |= ((code >> index) & 1) << bit;
+	}
+
+	return r;
+}
+
+static int test_rop3_bpp(int bpp)
+{
+	int i, x, y;
+	int code;
+	int failed = 0;
+	int bytesPerPixel;
+	int size, patSize;
+	uint8 *src, *dst, *org, *pat;
+	uint8 p, expected;
+	HGDI_DC hdcSrc;
+	HGDI_DC hdcDst;
+	HGDI_BRUSH hBrush;
+	HGDI_BITMAP hBmpSrc;
+	HGDI_BITMAP hBmpDst;
+	HGDI_BITMAP hBmpPat;
+
+	bytesPerPixel = bpp / 8;
+	size = ROP3_TEST_WIDTH * ROP3_TEST_HEIGHT * bytesPerPixel;
+	patSize = 8 * 8 * bytesPerPixel;
+
+	src = (uint8*) malloc(size);
+	dst = (uint8*) malloc(size);
+	org = (uint8*) malloc(size);
+	pat = (uint8*) malloc(patSize);
+
+	for (i = 0; i < size; i++)
+	{
+		src[i] = rand() & 0xFF;
+		org[i] = rand() & 0xFF;
+	}
+
+	for (i = 0; i < patSize; i++)
+		pat[i] = rand() & 0xFF;
+
+	hdcSrc = gdi_GetDC();
+	hdcSrc->bytesPerPixel = bytesPerPixel;
+	hdcSrc->bitsPerPixel = bpp;
+	hBmpSrc = gdi_CreateBitmap(ROP3_TEST_WIDTH, ROP3_TEST_HEIGHT, bpp, src);
+	gdi_SelectObject(hdcSrc, (HGDIOBJECT) hBmpSrc);
+
+	hdcDst = gdi_GetDC();
+	hdcDst->bytesPerPixel = bytesPerPixel;
+	hdcDst->bitsPerPixel = bpp;
+	hBmpDst = gdi_CreateBitmap(ROP3_TEST_WIDTH, ROP3_TEST_HEIGHT, bpp, dst);
+	gdi_SelectObject(hdcDst, (HGDIOBJECT) hBmpDst);
+
+	hBmpPat = gdi_CreateBitmap(8, 8, bpp, pat);
+	hBrush = gdi_CreatePatternBrush(hBmpPat);
+	gdi_SelectObject(hdcDst, (HGDIOBJECT) hBrush);
+
+	for (code = 0; code < 256; code++)
+	{
+		memcpy(dst, org, size);
+		gdi_rop3_blt(hdcDst, 0, 0, ROP3_TEST_WIDTH, ROP3_TEST_HEIGHT, hdcSrc, 0, 0, code << 16);
+
+		for (i = 0; i < size; i++)
+		{
+			x = (i / bytesPerPixel) % ROP3_TEST_WIDTH;
+			y = i / (ROP3_TEST_WIDTH * bytesPerPixel);
+			p = pat[(y % 8) * 8 * bytesPerPixel + (x % 8) * bytesPerPixel + (i % bytesPerPixel)];
+
+			/* the alpha byte of 32bpp pixels is never written */
+			if (bytesPerPixel == 4 && (i % 4) == 3)
+				expected = org[i];
+			else
+				expected = rop3_reference(code, p, src[i], org[i]);
+
+			if (dst[i] != expected)
+			{
+				printf("rop3 0x%02X differs at %d bpp, byte %d\n", code, bpp, i);
+				failed++;
+				break;
+			}
+		}
+	}
+
+	gdi_DeleteObject((HGDIOBJECT) hBrush);
+	gdi_DeleteObject((HGDIOBJECT) hBmpSrc);
+	gdi_DeleteObject((HGDIOBJECT) hBmpDst);
+	gdi_DeleteDC(hdcSrc);
+	gdi_DeleteDC(hdcDst);
+	free(org);
+
+	return failed;
+}
+
+void test_gdi_rop3(void)
+{
+	CU_ASSERT(gdi_rop3_uses_src(GDI_PATCOPY) == 0);
+	CU_ASSERT(gdi_rop3_uses_pat(GDI_PATCOPY) == 1);
+	CU_ASSERT(gdi_rop3_uses_src(GDI_SRCCOPY) == 1);
+	CU_ASSERT(gdi_rop3_uses_pat(GDI_SRCCOPY) == 0);
+	CU_ASSERT(gdi_rop3_uses_src(GDI_DSTINVERT) == 0);
+	CU_ASSERT(gdi_rop3_uses_pat(GDI_DSTINVERT) == 0);
+
+	CU_ASSERT(test_rop3_bpp(8) == 0);
+	CU_ASSERT(test_rop3_bpp(16) == 0);
+	CU_ASSERT(test_rop3_bpp(32) == 0);
+}
+
+void test_gdi_ui_allocations(void)
+{
+	int i;
+	int pass;
+	GDI *gdi;
+	rdpSet settings;
+	rdpInst inst;
+	RD_PEN pen;
+	RD_BRUSH brush;
+	RD_BRUSHDATA bd;
+	RD_RECT rects[2];
+	RD_POINT points[3];
+	RD_HGLYPH glyph;
+	uint8* converted;
+	uint16 bitmap[16 * 16];
+	uint8 mono[8] = { 0xAA, 0x55, 0xAA, 0x55, 0xAA, 0x55, 0xAA, 0x55 };
+	uint8 glyphData[16] = { 0x18, 0x00, 0x3C, 0x00, 0x66, 0x00, 0xC3, 0x00,
+				0xC3, 0x00, 0x66, 0x00, 0x3C, 0x00, 0x18, 0x00 };
+
+	memset(&inst, 0, sizeof(rdpInst));
+	memset(&settings, 0, sizeof(rdpSet));
+	settings.width = 64;
+	settings.height = 64;
+	settings.server_depth = 16;
+	inst.settings = &settings;
+
+	gdi_init(&inst, CLRCONV_ALPHA | CLRBUF_32BPP);
+	gdi = GET_GDI(&inst);
+
+	for (i = 0; i < 16 * 16; i++)
+		bitmap[i] = (uint16) (i * 0x0101);
+
+	memset(&pen, 0, sizeof(RD_PEN));
+	pen.color = 0xF800;
+	pen.width = 1;
+
+	memset(&bd, 0, sizeof(RD_BRUSHDATA));
+	bd.color_code = 1;
+	bd.data = mono;
+
+	memset(&brush, 0, sizeof(RD_BRUSH));
+	brush.style = GDI_BS_PATTERN;
+	brush.bd = &bd;
+
+	rects[0].x = 1; rects[0].y = 2; rects[0].width = 5; rects[0].height = 3;
+	rects[1].x = 20; rects[1].y = 30; rects[1].width = 7; rects[1].height = 9;
+	points[0].x = 4; points[0].y = 4;
+	points[1].x = 10; points[1].y = 0;
+	points[2].x = 0; points[2].y = 10;
+
+	glyph = inst.ui_create_glyph(&inst, 8, 8, glyphData);
+
+	/* bitmaps are converted straight into the primary surface */
+	converted = gdi_image_convert((uint8*) bitmap, NULL, 16, 16, 16, 32, gdi->clrconv);
+	inst.ui_paint_bitmap(&inst, 8, 8, 16, 16, 16, 16, (uint8*) bitmap);
+
+	for (i = 0; i < 16; i++)
+	{
+		CU_ASSERT(memcmp(gdi_get_bitmap_pointer(gdi->primary->hdc, 8, 8 + i),
+				converted + i * 16 * 4, 16 * 4) == 0);
+	}
+
+	free(converted);
+
+	/* the first pass may still grow the scratch arena, the second must not allocate */
+	for (pass = 0; pass < 2; pass++)
+	{
+		malloc_count = 0;
+		malloc_counting = (pass == 1);
+
+		inst.ui_paint_bitmap(&inst, 56, 56, 16, 16, 16, 16, (uint8*) bitmap);
+		inst.ui_paint_bitmap(&inst, 0, 0, 12, 10, 16, 16, (uint8*) bitmap);
+		inst.ui_rect(&inst, 3, 3, 10, 10, 0x07E0);
+		inst.ui_rects(&inst, rects, 2, 0x001F);
+		inst.ui_line(&inst, 13, 0, 0, 30, 20, &pen);
+		inst.ui_polyline(&inst, 13, points, 3, &pen);
+		inst.ui_patblt(&inst, 0xF0, 10, 10, 20, 20, &brush, 0x0000, 0xFFFF);
+
+		brush.style = GDI_BS_SOLID;
+		inst.ui_patblt(&inst, 0xF0, 30, 10, 20, 20, &brush, 0x0000, 0x1234);
+		brush.style = GDI_BS_PATTERN;
+
+		inst.ui_start_draw_glyphs(&inst, 0x0000, 0xFFFF);
+		inst.ui_draw_glyph(&inst, 40, 40, 8, 8, glyph);
+		inst.ui_end_draw_glyphs(&inst, 40, 40, 8, 8);
+
+		malloc_counting = 0;
+	}
+
+	CU_ASSERT(malloc_count == 0);
+
+	inst.ui_destroy_glyph(&inst, glyph);
+	gdi_free(&inst);
+}
+
+#define BANDS_TEST_ORDERS	400
+
+static int bands_test_random(int range)
+{
+	return rand() % range;
+}
+
+/* pick a raster operation using only the given operands */
+static uint8 bands_test_opcode(int src, int pat)
+{
+	uint8 opcode;
+
+	do
+	{
+		opcode = bands_test_random(256);
+	}
+	while ((!src && gdi_rop3_uses_src(gdi_rop3_code(opcode))) ||
+		(!pat && gdi_rop3_uses_pat(gdi_rop3_code(opcode))));
+
+	return opcode;
+}
+
+static void bands_test_orders(RD_ORDER* orders, int count, RD_HBITMAP src, RD_BRUSHDATA* mono, RD_BRUSHDATA* color)
+{
+	int i;
+	RD_ORDER* order;
+
+	srand(1);
+	memset(orders, 0, sizeof(RD_ORDER) * count);
+
+	for (i = 0; i < count; i++)
+	{
+		order = &orders[i];
+		order->type = bands_test_random(RD_ORDER_RECT + 1);
+		order->x = bands_test_random(140) - 10;
+		order->y = bands_test_random(140) - 10;
+		order->cx = bands_test_random(60) + 1;
+		order->cy = bands_test_random(60) + 1;
+
+		switch (order->type)
+		{
+			case RD_ORDER_DESTBLT:
+				order->opcode = bands_test_opcode(0, 0);
+				break;
+
+			case RD_ORDER_PATBLT:
+				order->opcode = bands_test_opcode(0, 1);
+				order->u.patblt.bgcolor = bands_test_random(0x10000);
+				order->u.patblt.fgcolor = bands_test_random(0x10000);
+
+				switch (bands_test_random(3))
+				{
+					case 0:
+						order->u.patblt.brush.style = GDI_BS_SOLID;
+						break;
+					case 1:
+						order->u.patblt.brush.style = GDI_BS_PATTERN;
+						order->u.patblt.brush.bd = mono;
+						break;
+					default:
+						order->u.patblt.brush.style = GDI_BS_PATTERN;
+						order->u.patblt.brush.bd = color;
+				}
+				break;
+
+			case RD_ORDER_SCREENBLT:
+				order->opcode = bands_test_opcode(1, 0);
+				order->u.screenblt.srcx = bands_test_random(100);
+				order->u.screenblt.srcy = bands_test_random(100);
+				order->cx = bands_test_random(128 - order->u.screenblt.srcx) + 1;
+				order->cy = bands_test_random(128 - order->u.screenblt.srcy) + 1;
+				break;
+
+			case RD_ORDER_MEMBLT:
+				order->opcode = bands_test_opcode(1, 0);
+				order->u.memblt.src = src;
+				order->u.memblt.srcx = bands_test_random(16);
+				order->u.memblt.srcy = bands_test_random(16);
+				order->cx = bands_test_random(32 - order->u.memblt.srcx) + 1;
+				order->cy = bands_test_random(32 - order->u.memblt.srcy) + 1;
+				break;
+
+			case RD_ORDER_LINE:
+				/* without a clipping region lines are not clipped to the surface */
+				order->opcode = bands_test_random(16) + 1;
+				order->x = bands_test_random(128);
+				order->y = bands_test_random(128);
+				order->u.line.endx = bands_test_random(128);
+				order->u.line.endy = bands_test_random(128);
+				order->u.line.pen.color = bands_test_random(0x10000);
+				order->u.line.pen.width = 1;
+				break;
+
+			case RD_ORDER_RECT:
+				order->u.rect.color = bands_test_random(0x10000);
+				break;
+		}
+	}
+}
+
+void test_gdi_bands(void)
+{
+	int i;
+	int count;
+	int threads;
+	rdpSet settings[2];
+	rdpInst inst[2];
+	RD_HBITMAP src[2];
+	RD_BRUSHDATA mono[2];
+	RD_BRUSHDATA color[2];
+	RD_ORDER* orders[2];
+	uint16 bitmap[32 * 32];
+	uint16 pattern[8 * 8];
+	uint8 monoPattern[8] = { 0x81, 0x42, 0x24, 0x18, 0x18, 0x24, 0x42, 0x81 };
+	GDI* gdi[2];
+
+	for (i = 0; i < 32 * 32; i++)
+		bitmap[i] = (uint16) (i * 37);
+
+	for (i = 0; i < 8 * 8; i++)
+		pattern[i] = (uint16) (i * 1031);
+
+	/* the first instance draws serially, the second across four bands */
+	for (threads = 0; threads < 2; threads++)
+	{
+		memset(&inst[threads], 0, sizeof(rdpInst));
+		memset(&settings[threads], 0, sizeof(rdpSet));
+		settings[threads].width = 128;
+		settings[threads].height = 128;
+		settings[threads].server_depth = 16;
+		settings[threads].software_gdi_threads = threads * 4;
+		inst[threads].settings = &settings[threads];
+
+		gdi_init(&inst[threads], CLRCONV_ALPHA | CLRBUF_32BPP);
+		gdi[threads] = GET_GDI(&inst[threads]);
+		memset(gdi[threads]->primary_buffer, 0, 128 * 128 * 4);
+
+		src[threads] = inst[threads].ui_create_bitmap(&inst[threads], 32, 32, (uint8*) bitmap);
+
+		memset(&mono[threads], 0, sizeof(RD_BRUSHDATA));
+		mono[threads].color_code = 1;
+		mono[threads].data = monoPattern;
+
+		memset(&color[threads], 0, sizeof(RD_BRUSHDATA));
+		color[threads].color_code = 2;
+		color[threads].data = (uint8*) pattern;
+
+		orders[threads] = (RD_ORDER*) malloc(sizeof(RD_ORDER) * BANDS_TEST_ORDERS);
+		bands_test_orders(orders[threads], BANDS_TEST_ORDERS, src[threads], &mono[threads], &color[threads]);
+	}
+
+	CU_ASSERT(inst[0].ui_draw_orders == NULL);
+	CU_ASSERT(inst[1].ui_draw_orders != NULL);
+
+	for (i = 0; i < BANDS_TEST_ORDERS; i++)
+		gdi_draw_order(&inst[0], &orders[0][i]);
+
+	/* hand the orders over in batches of different sizes */
+	for (i = 0; i < BANDS_TEST_ORDERS; i += count)
+	{
+		count = (i % 3 == 0) ? 1 : 37;
+
+		if (i + count > BANDS_TEST_ORDERS)
+			count = BANDS_TEST_ORDERS - i;
+
+		inst[1].ui_draw_orders(&inst[1], &orders[1][i], count);
+	}
+
+	CU_ASSERT(memcmp(gdi[0]->primary_buffer, gdi[1]->primary_buffer, 128 * 128 * 4) == 0);
+	CU_ASSERT(gdi[0]->drawing->hdc->clip->null == gdi[1]->drawing->hdc->clip->null);
+
+	for (threads = 0; threads < 2; threads++)
+	{
+		free(orders[threads]);
+		free(color[threads].ui_data);
+		inst[threads].ui_destroy_bitmap(&inst[threads], src[threads]);
+		gdi_free(&inst[threads]);
+	}
+}
+
+void test_gdi_bands_clamp(void)
+{
+	rdpSet settings;
+	rdpInst inst;
+	GDI* gdi;
+
+	/* no more bands than rows */
+	memset(&inst, 0, sizeof(rdpInst));
+	memset(&settings, 0, sizeof(rdpSet));
+	settings.width = 16;
+	settings.height = 2;
+	settings.server_depth = 16;
+	settings.software_gdi_threads = 8;
+	inst.settings = &settings;
+
+	gdi_init(&inst, CLRCONV_ALPHA | CLRBUF_32BPP);
+	gdi = GET_GDI(&inst);
+	CU_ASSERT(gdi->bands != NULL);
+	if (gdi->bands != NULL)
+		CU_ASSERT(gdi->bands->count == 2);
+	CU_ASSERT(inst.ui_draw_orders != NULL);
+	gdi_free(&inst);
+
+	/* a single row is drawn serially */
+	memset(&inst, 0, sizeof(rdpInst));
+	settings.height = 1;
+	inst.settings = &settings;
+
+	gdi_init(&inst, CLRCONV_ALPHA | CLRBUF_32BPP);
+	gdi = GET_GDI(&inst);
+	CU_ASSERT(gdi->bands == NULL);
+	CU_ASSERT(inst.ui_draw_orders == NULL);
+	gdi_free(&inst);
+}
+
+/* a color brush cached at 8bpp is converted again after a palette change */
+void test_gdi_brush_palette(void)
+{
+	GDI *gdi;
+	rdpSet settings;
+	rdpInst inst;
+	RD_BRUSH brush;
+	RD_BRUSHDATA bd;
+	RD_PALETTE palette;
+	RD_PALETTEENTRY entries[2];
+	RD_HPALETTE red;
+	RD_HPALETTE blue;
+	uint32 first;
+	uint32 second;
+	uint8* expected;
+	uint8 pattern[8 * 8];
+
+	memset(&inst, 0, sizeof(rdpInst));
+	memset(&settings, 0, sizeof(rdpSet));
+	settings.width = 16;
+	settings.height = 16;
+	settings.server_depth = 8;
+	inst.settings = &settings;
+
+	gdi_init(&inst, CLRCONV_ALPHA | CLRBUF_32BPP);
+	gdi = GET_GDI(&inst);
+
+	memset(entries, 0, sizeof(entries));
+	palette.count = 2;
+	palette.entries = entries;
+	entries[1].red = 0xFF;
+	red = inst.ui_create_palette(&inst, &palette);
+	entries[1].red = 0;
+	entries[1].blue = 0xFF;
+	blue = inst.ui_create_palette(&inst, &palette);
+
+	memset(pattern, 1, sizeof(pattern));
+	memset(&bd, 0, sizeof(RD_BRUSHDATA));
+	bd.color_code = 3;
+	bd.data = pattern;
+
+	memset(&brush, 0, sizeof(RD_BRUSH));
+	brush.style = GDI_BS_PATTERN;
+	brush.bd = &bd;
+
+	inst.ui_set_palette(&inst, red);
+	inst.ui_patblt(&inst, 0xF0, 0, 0, 8, 8, &brush, 0, 0);
+	first = *((uint32*) gdi_get_bitmap_pointer(gdi->primary->hdc, 4, 4));
+	expected = gdi_image_convert(pattern, NULL, 8, 8, 8, 32, gdi->clrconv);
+	CU_ASSERT(first == *((uint32*) expected));
+	free(expected);
+
+	inst.ui_set_palette(&inst, blue);
+	inst.ui_patblt(&inst, 0xF0, 0, 0, 8, 8, &brush, 0, 0);
+	second = *((uint32*) gdi_get_bitmap_pointer(gdi->primary->hdc, 4, 4));
+	expected = gdi_image_convert(pattern, NULL, 8, 8, 8, 32, gdi->clrconv);
+	CU_ASSERT(second == *((uint32*) expected));
+	free(expected);
+	CU_ASSERT(second != first);
+
+	free(bd.ui_data);
+	gdi_free(&inst);
+	free(((HGDI_PALETTE) red)->entries);
+	free(red);
+	free(((HGDI_PALETTE) blue)->entries);
+	free(blue);
+}
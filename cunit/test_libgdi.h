@@ -45,3 +45,11 @@ void test_gdi_BitBlt_16bpp(void);
 void test_gdi_BitBlt_8bpp(void);
 void test_gdi_ClipCoords(void);
 void test_gdi_InvalidateRegion(void);
+void test_gdi_InvalidateRegionRects(void);
+void test_gdi_LineToInvalidate(void);
+void test_gdi_rops(void);
+void test_gdi_rop3(void);
+void test_gdi_ui_allocations(void);
+void test_gdi_bands(void);
+void test_gdi_bands_clamp(void);
+void test_gdi_brush_palette(void);
@@ -0,0 +1,240 @@
+/*
+   FreeRDP: A Remote Desktop Protocol client.
+   Licensing Unit Tests
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <freerdp/freerdp.h>
+#include <freerdp/rdpset.h>
+#include <freerdp/utils/memory.h>
+#include <freerdp/constants/license.h>
+#include "frdp.h"
+#include "rdp.h"
+#include "network.h"
+#include "security.h"
+#include "license.h"
+#include "test_license.h"
+
+/* the cache lives below $HOME, point it at a scratch directory */
+static char test_home[64];
+static char * saved_home;
+static rdpSet test_settings;
+static rdpRdp test_rdp;
+static rdpNetwork test_net;
+static rdpLicense * test_license;
+static uint8 test_blob[300];
+
+int init_license_suite(void)
+{
+	int i;
+
+	strcpy(test_home, "/tmp/test_licenseXXXXXX");
+	if (mkdtemp(test_home) == NULL)
+		return -1;
+	saved_home = getenv("HOME");
+	setenv("HOME", test_home, 1);
+
+	memset(&test_settings, 0, sizeof(test_settings));
+	strcpy(test_settings.hostname, "client1");
+	strcpy(test_settings.server, "rds.example.com");
+	memset(&test_rdp, 0, sizeof(test_rdp));
+	test_rdp.settings = &test_settings;
+	memset(&test_net, 0, sizeof(test_net));
+	test_net.rdp = &test_rdp;
+
+	for (i = 0; i < sizeof(test_blob); i++)
+		test_blob[i] = (uint8) (i * 13);
+
+	return 0;
+}
+
+int clean_license_suite(void)
+{
+	DIR * dir;
+	struct dirent * entry;
+	char path[192];
+
+	if (saved_home != NULL)
+		setenv("HOME", saved_home, 1);
+
+	/* the suite only ever writes license files below .freerdp/licenses */
+	snprintf(path, sizeof(path), "%s/.freerdp/licenses", test_home);
+	dir = opendir(path);
+	if (dir != NULL)
+	{
+		while ((entry = readdir(dir)) != NULL)
+		{
+			if (entry->d_name[0] == '.')
+				continue;
+			snprintf(path, sizeof(path), "%s/.freerdp/licenses/%s", test_home, entry->d_name);
+			unlink(path);
+		}
+		closedir(dir);
+	}
+
+	snprintf(path, sizeof(path), "%s/.freerdp/licenses", test_home);
+	rmdir(path);
+	snprintf(path, sizeof(path), "%s/.freerdp", test_home);
+	rmdir(path);
+	return rmdir(test_home);
+}
+
+int add_license_suite(void)
+{
+	add_test_suite(license);
+
+	add_test_function(license_cache);
+	add_test_function(license_new_license);
+	add_test_function(license_error_alert);
+
+	return 0;
+}
+
+void test_license_cache(void)
+{
+	uint8 * data;
+	int length;
+
+	test_license = license_new(&test_net);
+
+	CU_ASSERT(license_cache_load(test_license, &data) == 0);
+
+	license_cache_save(test_license, test_blob, sizeof(test_blob));
+	length = license_cache_load(test_license, &data);
+	CU_ASSERT(length == sizeof(test_blob));
+	if (length == sizeof(test_blob))
+	{
+		CU_ASSERT(memcmp(data, test_blob, length) == 0);
+		xfree(data);
+	}
+
+	/* licenses are per client hostname */
+	license_free(test_license);
+	strcpy(test_settings.hostname, "client2");
+	test_license = license_new(&test_net);
+	CU_ASSERT(license_cache_load(test_license, &data) == 0);
+	license_free(test_license);
+	strcpy(test_settings.hostname, "client1");
+
+	/* a damaged file is dropped */
+	save_license("client1-rds.example.com", test_blob, 20);
+	test_license = license_new(&test_net);
+	CU_ASSERT(license_cache_load(test_license, &data) == 0);
+	CU_ASSERT(load_license("client1-rds.example.com", &data) == 0);
+	license_free(test_license);
+}
+
+/* Play the server side: RC4-encrypted New License Information */
+void test_license_new_license(void)
+{
+	struct stream s;
+	uint8 buffer[512];
+	uint8 * info;
+	uint8 * data;
+	int length;
+	int info_length;
+	CryptoRc4 rc4;
+
+	test_license = license_new(&test_net);
+	memset(test_license->license_key, 0x5A, 16);
+
+	memset(&s, 0, sizeof(s));
+	s.data = s.p = buffer;
+	s.size = sizeof(buffer);
+	s.end = buffer + sizeof(buffer);
+
+	out_uint8(&s, NEW_LICENSE);
+	out_uint8(&s, 2);
+	out_uint16_le(&s, 0);				/* wMsgSize, set below */
+	out_uint16_le(&s, 9);				/* BB_ENCRYPTED_DATA_BLOB */
+	out_uint16_le(&s, 0);				/* wBlobLen, set below */
+	info = s.p;
+	out_uint16_le(&s, 6);				/* dwVersion */
+	out_uint16_le(&s, 0);
+	out_uint32_le(&s, 4);				/* cbScope */
+	out_uint8p(&s, "sco", 4);
+	out_uint32_le(&s, 4);				/* cbCompanyName */
+	out_uint8p(&s, "co\0", 4);
+	out_uint32_le(&s, 4);				/* cbProductId */
+	out_uint8p(&s, "A02", 4);
+	out_uint32_le(&s, sizeof(test_blob));		/* cbLicenseInfo */
+	out_uint8p(&s, test_blob, sizeof(test_blob));
+	info_length = s.p - info;
+	buffer[2] = (s.p - buffer) & 0xFF;
+	buffer[3] = (s.p - buffer) >> 8;
+	info[-2] = info_length & 0xFF;
+	info[-1] = info_length >> 8;
+	s.end = s.p;
+
+	rc4 = crypto_rc4_init(test_license->license_key, 16);
+	crypto_rc4(rc4, info_length, info, info);
+	crypto_rc4_free(rc4);
+
+	s.p = buffer;
+	license_process(test_license, &s);
+	CU_ASSERT(test_license->license_issued);
+
+	length = license_cache_load(test_license, &data);
+	CU_ASSERT(length == sizeof(test_blob));
+	if (length == sizeof(test_blob))
+	{
+		CU_ASSERT(memcmp(data, test_blob, length) == 0);
+		xfree(data);
+	}
+	license_free(test_license);
+}
+
+/* A rejected cached license is forgotten, an accepted one is kept */
+void test_license_error_alert(void)
+{
+	struct stream s;
+	uint8 buffer[16];
+	uint8 * data;
+	int length;
+
+	test_license = license_new(&test_net);
+	license_cache_save(test_license, test_blob, sizeof(test_blob));
+
+	memset(&s, 0, sizeof(s));
+	s.data = s.p = buffer;
+	s.size = sizeof(buffer);
+	s.end = buffer + sizeof(buffer);
+	out_uint8(&s, LICENSE_ERROR_ALERT);
+	out_uint8(&s, 2);
+	out_uint16_le(&s, 16);
+	out_uint32_le(&s, STATUS_VALID_CLIENT);
+	out_uint32_le(&s, 2);				/* ST_NO_TRANSITION */
+	out_uint16_le(&s, 4);				/* BB_ERROR_BLOB */
+	out_uint16_le(&s, 0);
+
+	test_license->license_presented = True;
+	s.p = buffer;
+	license_process(test_license, &s);
+	length = license_cache_load(test_license, &data);
+	CU_ASSERT(length == sizeof(test_blob));
+	if (length > 0)
+		xfree(data);
+
+	buffer[4] = ERR_INVALID_CLIENT;
+	test_license->license_presented = True;
+	s.p = buffer;
+	license_process(test_license, &s);
+	CU_ASSERT(license_cache_load(test_license, &data) == 0);
+	license_free(test_license);
+}
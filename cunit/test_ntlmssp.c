@@ -19,10 +19,34 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
 #include <freerdp/freerdp.h>
+#include "rdp.h"
 #include "ntlmssp.h"
 #include "test_ntlmssp.h"
 
+/* CHALLENGE_MESSAGE captured from a server, used by several tests */
+static uint8 challenge_message_data[278] =
+	"\x4e\x54\x4c\x4d\x53\x53\x50\x00\x02\x00\x00\x00\x16\x00\x16\x00"
+	"\x38\x00\x00\x00\x35\x82\x89\xe2\xed\x75\x9b\x8d\x1c\x2e\x3e\xc8"
+	"\x00\x00\x00\x00\x00\x00\x00\x00\xc8\x00\xc8\x00\x4e\x00\x00\x00"
+	"\x06\x01\xb0\x1d\x00\x00\x00\x0f\x41\x00\x57\x00\x41\x00\x4b\x00"
+	"\x45\x00\x43\x00\x4f\x00\x44\x00\x49\x00\x4e\x00\x47\x00\x02\x00"
+	"\x16\x00\x41\x00\x57\x00\x41\x00\x4b\x00\x45\x00\x43\x00\x4f\x00"
+	"\x44\x00\x49\x00\x4e\x00\x47\x00\x01\x00\x10\x00\x57\x00\x49\x00"
+	"\x4e\x00\x32\x00\x4b\x00\x38\x00\x52\x00\x32\x00\x04\x00\x24\x00"
+	"\x61\x00\x77\x00\x61\x00\x6b\x00\x65\x00\x63\x00\x6f\x00\x64\x00"
+	"\x69\x00\x6e\x00\x67\x00\x2e\x00\x61\x00\x74\x00\x68\x00\x2e\x00"
+	"\x63\x00\x78\x00\x03\x00\x36\x00\x57\x00\x49\x00\x4e\x00\x32\x00"
+	"\x4b\x00\x38\x00\x52\x00\x32\x00\x2e\x00\x61\x00\x77\x00\x61\x00"
+	"\x6b\x00\x65\x00\x63\x00\x6f\x00\x64\x00\x69\x00\x6e\x00\x67\x00"
+	"\x2e\x00\x61\x00\x74\x00\x68\x00\x2e\x00\x63\x00\x78\x00\x05\x00"
+	"\x24\x00\x61\x00\x77\x00\x61\x00\x6b\x00\x65\x00\x63\x00\x6f\x00"
+	"\x64\x00\x69\x00\x6e\x00\x67\x00\x2e\x00\x61\x00\x74\x00\x68\x00"
+	"\x2e\x00\x63\x00\x78\x00\x07\x00\x08\x00\xd1\x12\x78\x10\xde\xd2"
+	"\xcb\x01\x00\x00\x00\x00";
+
 int init_ntlmssp_suite(void)
 {
 	return 0;
@@ -40,6 +64,12 @@ int add_ntlmssp_suite(void)
 	add_test_function(ntlmssp_compute_lm_hash);
 	add_test_function(ntlmssp_compute_ntlm_hash);
 	add_test_function(ntlmssp_compute_ntlm_v2_hash);
+	add_test_function(ntlmssp_get_ntlm_v2_hash);
+	add_test_function(ntlmssp_ntowfv2_cache);
+#ifdef WITH_MALLOC_WRAP
+	add_test_function(ntlmssp_handshake_allocations);
+#endif
+	add_test_function(ntlmssp_ntowfv2_throughput);
 	add_test_function(ntlmssp_compute_lm_response);
 	add_test_function(ntlmssp_compute_lm_v2_response);
 	add_test_function(ntlmssp_compute_ntlm_v2_response);
@@ -125,6 +155,200 @@ void test_ntlmssp_compute_ntlm_v2_hash(void)
 	CU_ASSERT(ntlm_v2_hash_good == 1);
 }
 
+void test_ntlmssp_get_ntlm_v2_hash(void)
+{
+	NTLMSSP *ntlmssp;
+	char ntlm_v2_hash[16];
+	char other_ntlm_v2_hash[16];
+
+	char username[] = "User";
+	char password[] = "Password";
+	char domain[] = "Domain";
+	char expected_ntlm_v2_hash[16] = "\x0c\x86\x8a\x40\x3b\xfd\x7a\x93\xa3\x00\x1e\xf2\x2e\xf0\x2e\x3f";
+
+	/* the second call must return the hash kept from the first one */
+	ntlmssp = ntlmssp_new();
+	ntlmssp_set_password(ntlmssp, password);
+	ntlmssp_set_username(ntlmssp, username);
+	ntlmssp_set_domain(ntlmssp, domain);
+
+	ntlmssp_get_ntlm_v2_hash(ntlmssp, ntlm_v2_hash);
+	CU_ASSERT(memcmp(ntlm_v2_hash, expected_ntlm_v2_hash, 16) == 0);
+
+	ntlmssp_get_ntlm_v2_hash(ntlmssp, ntlm_v2_hash);
+	CU_ASSERT(memcmp(ntlm_v2_hash, expected_ntlm_v2_hash, 16) == 0);
+
+	/* a new password for the same user must not reuse the kept hash */
+	ntlmssp_set_password(ntlmssp, "Password2");
+	ntlmssp_get_ntlm_v2_hash(ntlmssp, other_ntlm_v2_hash);
+	CU_ASSERT(memcmp(other_ntlm_v2_hash, expected_ntlm_v2_hash, 16) != 0);
+
+	ntlmssp_free(ntlmssp);
+}
+
+void test_ntlmssp_ntowfv2_cache(void)
+{
+	NTLMSSP *ntlmssp;
+	struct rdp_ntowfv2 cache;
+	char ntlm_v2_hash[16];
+	char marked_ntlm_v2_hash[16] = "\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f\x10";
+	char expected_ntlm_v2_hash[16] = "\x0c\x86\x8a\x40\x3b\xfd\x7a\x93\xa3\x00\x1e\xf2\x2e\xf0\x2e\x3f";
+
+	memset(&cache, 0, sizeof(cache));
+
+	/* the first logon derives the hash and fills the cache */
+	ntlmssp = ntlmssp_new();
+	ntlmssp->ntowfv2_cache = &cache;
+	ntlmssp_set_password(ntlmssp, "Password");
+	ntlmssp_set_username(ntlmssp, "User");
+	ntlmssp_set_domain(ntlmssp, "Domain");
+	ntlmssp_get_ntlm_v2_hash(ntlmssp, ntlm_v2_hash);
+	ntlmssp_free(ntlmssp);
+
+	CU_ASSERT(memcmp(ntlm_v2_hash, expected_ntlm_v2_hash, 16) == 0);
+	CU_ASSERT(cache.valid == 1);
+	CU_ASSERT(memcmp(cache.ntlm_v2_hash, expected_ntlm_v2_hash, 16) == 0);
+
+	/* a reconnect with the same credentials is served from the cache */
+	memcpy(cache.ntlm_v2_hash, marked_ntlm_v2_hash, 16);
+	ntlmssp = ntlmssp_new();
+	ntlmssp->ntowfv2_cache = &cache;
+	ntlmssp_set_password(ntlmssp, "Password");
+	ntlmssp_set_username(ntlmssp, "User");
+	ntlmssp_set_domain(ntlmssp, "Domain");
+	ntlmssp_get_ntlm_v2_hash(ntlmssp, ntlm_v2_hash);
+	CU_ASSERT(memcmp(ntlm_v2_hash, marked_ntlm_v2_hash, 16) == 0);
+
+	/* a new password or username must be derived again */
+	ntlmssp_set_password(ntlmssp, "Password2");
+	ntlmssp_get_ntlm_v2_hash(ntlmssp, ntlm_v2_hash);
+	CU_ASSERT(memcmp(ntlm_v2_hash, marked_ntlm_v2_hash, 16) != 0);
+	CU_ASSERT(memcmp(ntlm_v2_hash, expected_ntlm_v2_hash, 16) != 0);
+
+	memcpy(cache.ntlm_v2_hash, marked_ntlm_v2_hash, 16);
+	ntlmssp_set_password(ntlmssp, "Password");
+	ntlmssp_set_username(ntlmssp, "User2");
+	ntlmssp_get_ntlm_v2_hash(ntlmssp, ntlm_v2_hash);
+	CU_ASSERT(memcmp(ntlm_v2_hash, marked_ntlm_v2_hash, 16) != 0);
+
+	ntlmssp_free(ntlmssp);
+	memset(&cache, 0, sizeof(cache));
+}
+
+/* client side of NEGOTIATE, CHALLENGE and AUTHENTICATE against a recorded CHALLENGE */
+static NTLMSSP* ntlmssp_test_handshake(struct rdp_ntowfv2* cache)
+{
+	NTLMSSP *ntlmssp;
+	struct stream stream;
+	STREAM s = &stream;
+	uint8 buffer[2048];
+
+	memset(&stream, 0, sizeof(stream));
+
+	ntlmssp = ntlmssp_new();
+	ntlmssp->ntowfv2_cache = cache;
+	ntlmssp_set_password(ntlmssp, "Password");
+	ntlmssp_set_username(ntlmssp, "User");
+	ntlmssp_set_domain(ntlmssp, "Domain");
+	ntlmssp_generate_client_challenge(ntlmssp);
+	ntlmssp_generate_random_session_key(ntlmssp);
+	ntlmssp_generate_exported_session_key(ntlmssp);
+
+	s->p = s->end = s->data = buffer;
+	s->size = sizeof(buffer);
+	ntlmssp_send(ntlmssp, s);
+
+	ntlmssp_prepare_ntlm_v2_hash(ntlmssp);
+
+	s->p = s->data = challenge_message_data;
+	s->end = s->p + sizeof(challenge_message_data);
+	s->size = sizeof(challenge_message_data);
+	ntlmssp_recv(ntlmssp, s);
+
+	s->p = s->end = s->data = buffer;
+	s->size = sizeof(buffer);
+	ntlmssp_send(ntlmssp, s);
+
+	return ntlmssp;
+}
+
+void test_ntlmssp_handshake_allocations(void)
+{
+	int cold;
+	int warm;
+	NTLMSSP *ntlmssp;
+	struct rdp_ntowfv2 cache;
+
+	memset(&cache, 0, sizeof(cache));
+
+	malloc_count = 0;
+	malloc_counting = 1;
+	ntlmssp = ntlmssp_test_handshake(&cache);
+	malloc_counting = 0;
+	cold = malloc_count;
+	ntlmssp_free(ntlmssp);
+
+	malloc_count = 0;
+	malloc_counting = 1;
+	ntlmssp = ntlmssp_test_handshake(&cache);
+	malloc_counting = 0;
+	warm = malloc_count;
+
+	CU_ASSERT(ntlmssp->state == NTLMSSP_STATE_FINAL);
+	ntlmssp_free(ntlmssp);
+
+	/* deriving NTOWFv2 takes no heap memory, cached or not; the exchange
+	   itself needs 26 allocations with the OpenSSL back-end */
+	CU_ASSERT(warm == cold);
+	CU_ASSERT(cold <= 32);
+
+	memset(&cache, 0, sizeof(cache));
+}
+
+static double get_seconds(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/* reports NTOWFv2 derivations per second with and without the cache */
+void test_ntlmssp_ntowfv2_throughput(void)
+{
+	int i;
+	int pass;
+	double start;
+	double elapsed[2];
+	NTLMSSP *ntlmssp;
+	struct rdp_ntowfv2 cache;
+	char ntlm_v2_hash[2][16];
+
+	memset(&cache, 0, sizeof(cache));
+
+	ntlmssp = ntlmssp_new();
+	ntlmssp_set_password(ntlmssp, "Password");
+	ntlmssp_set_username(ntlmssp, "User");
+	ntlmssp_set_domain(ntlmssp, "Domain");
+
+	for (pass = 0; pass < 2; pass++)
+	{
+		ntlmssp->ntowfv2_cache = (pass == 0) ? NULL : &cache;
+
+		start = get_seconds();
+		for (i = 0; i < 100000; i++)
+			ntlmssp_compute_ntlm_v2_hash(ntlmssp, ntlm_v2_hash[pass]);
+		elapsed[pass] = get_seconds() - start;
+	}
+
+	printf("\nNTOWFv2: derived %.0f/s, cached %.0f/s",
+		100000 / elapsed[0], 100000 / elapsed[1]);
+
+	CU_ASSERT(memcmp(ntlm_v2_hash[0], ntlm_v2_hash[1], 16) == 0);
+
+	ntlmssp_free(ntlmssp);
+	memset(&cache, 0, sizeof(cache));
+}
+
 void test_ntlmssp_compute_lm_response(void)
 {
 	int i;
@@ -387,26 +611,6 @@ void test_ntlmssp_compute_message_integrity_check(void)
 		"\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"
 		"\x06\x01\xb0\x1d\x00\x00\x00\x0f";
 
-	uint8 challenge_message_data[278] =
-		"\x4e\x54\x4c\x4d\x53\x53\x50\x00\x02\x00\x00\x00\x16\x00\x16\x00"
-		"\x38\x00\x00\x00\x35\x82\x89\xe2\xed\x75\x9b\x8d\x1c\x2e\x3e\xc8"
-		"\x00\x00\x00\x00\x00\x00\x00\x00\xc8\x00\xc8\x00\x4e\x00\x00\x00"
-		"\x06\x01\xb0\x1d\x00\x00\x00\x0f\x41\x00\x57\x00\x41\x00\x4b\x00"
-		"\x45\x00\x43\x00\x4f\x00\x44\x00\x49\x00\x4e\x00\x47\x00\x02\x00"
-		"\x16\x00\x41\x00\x57\x00\x41\x00\x4b\x00\x45\x00\x43\x00\x4f\x00"
-		"\x44\x00\x49\x00\x4e\x00\x47\x00\x01\x00\x10\x00\x57\x00\x49\x00"
-		"\x4e\x00\x32\x00\x4b\x00\x38\x00\x52\x00\x32\x00\x04\x00\x24\x00"
-		"\x61\x00\x77\x00\x61\x00\x6b\x00\x65\x00\x63\x00\x6f\x00\x64\x00"
-		"\x69\x00\x6e\x00\x67\x00\x2e\x00\x61\x00\x74\x00\x68\x00\x2e\x00"
-		"\x63\x00\x78\x00\x03\x00\x36\x00\x57\x00\x49\x00\x4e\x00\x32\x00"
-		"\x4b\x00\x38\x00\x52\x00\x32\x00\x2e\x00\x61\x00\x77\x00\x61\x00"
-		"\x6b\x00\x65\x00\x63\x00\x6f\x00\x64\x00\x69\x00\x6e\x00\x67\x00"
-		"\x2e\x00\x61\x00\x74\x00\x68\x00\x2e\x00\x63\x00\x78\x00\x05\x00"
-		"\x24\x00\x61\x00\x77\x00\x61\x00\x6b\x00\x65\x00\x63\x00\x6f\x00"
-		"\x64\x00\x69\x00\x6e\x00\x67\x00\x2e\x00\x61\x00\x74\x00\x68\x00"
-		"\x2e\x00\x63\x00\x78\x00\x07\x00\x08\x00\xd1\x12\x78\x10\xde\xd2"
-		"\xcb\x01\x00\x00\x00\x00";
-
 	uint8 authenticate_message_data[504] =
 		"\x4e\x54\x4c\x4d\x53\x53\x50\x00\x03\x00\x00\x00\x18\x00\x18\x00"
 		"\x98\x00\x00\x00\x38\x01\x38\x01\xb0\x00\x00\x00\x16\x00\x16\x00"
@@ -26,6 +26,10 @@ int add_ntlmssp_suite(void);
 void test_ntlmssp_compute_lm_hash(void);
 void test_ntlmssp_compute_ntlm_hash(void);
 void test_ntlmssp_compute_ntlm_v2_hash(void);
+void test_ntlmssp_get_ntlm_v2_hash(void);
+void test_ntlmssp_ntowfv2_cache(void);
+void test_ntlmssp_handshake_allocations(void);
+void test_ntlmssp_ntowfv2_throughput(void);
 void test_ntlmssp_compute_lm_response(void);
 void test_ntlmssp_compute_lm_v2_response(void);
 void test_ntlmssp_compute_ntlm_v2_response(void);
@@ -0,0 +1,169 @@
+/*
+   FreeRDP: A Remote Desktop Protocol client.
+   Persistent Bitmap Cache Unit Tests
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <freerdp/freerdp.h>
+#include <freerdp/rdpset.h>
+#include "frdp.h"
+#include "rdp.h"
+#include "cache.h"
+#include "pstcache.h"
+#include "test_pstcache.h"
+
+#define TEST_CELLS	4
+
+/* the cache files live below $HOME, point it at a scratch directory */
+static char test_home[64];
+static char * saved_home;
+static rdpSet test_settings;
+static rdpInst test_inst;
+static rdpRdp test_rdp;
+static int loaded_pixel;
+
+static RD_HBITMAP test_create_bitmap(rdpInst * inst, int width, int height, uint8 * data)
+{
+	loaded_pixel = data[0];
+	return (RD_HBITMAP) 1;
+}
+
+static void test_destroy_bitmap(rdpInst * inst, RD_HBITMAP bmp)
+{
+}
+
+int init_pstcache_suite(void)
+{
+	strcpy(test_home, "/tmp/test_pstcacheXXXXXX");
+	if (mkdtemp(test_home) == NULL)
+		return -1;
+	saved_home = getenv("HOME");
+	setenv("HOME", test_home, 1);
+
+	memset(&test_settings, 0, sizeof(test_settings));
+	test_settings.bitmap_cache = 1;
+	test_settings.bitmap_cache_persist_enable = 1;
+	test_settings.server_depth = 16;
+	memset(&test_inst, 0, sizeof(test_inst));
+	test_inst.ui_create_bitmap = test_create_bitmap;
+	test_inst.ui_destroy_bitmap = test_destroy_bitmap;
+	memset(&test_rdp, 0, sizeof(test_rdp));
+	test_rdp.settings = &test_settings;
+	test_rdp.inst = &test_inst;
+
+	return 0;
+}
+
+int clean_pstcache_suite(void)
+{
+	DIR * dir;
+	struct dirent * entry;
+	char path[192];
+
+	if (saved_home != NULL)
+		setenv("HOME", saved_home, 1);
+
+	/* the suite only ever writes cache files below .freerdp/cache */
+	snprintf(path, sizeof(path), "%s/.freerdp/cache", test_home);
+	dir = opendir(path);
+	if (dir != NULL)
+	{
+		while ((entry = readdir(dir)) != NULL)
+		{
+			if (entry->d_name[0] == '.')
+				continue;
+			snprintf(path, sizeof(path), "%s/.freerdp/cache/%s", test_home, entry->d_name);
+			unlink(path);
+		}
+		closedir(dir);
+	}
+
+	snprintf(path, sizeof(path), "%s/.freerdp/cache", test_home);
+	rmdir(path);
+	snprintf(path, sizeof(path), "%s/.freerdp", test_home);
+	rmdir(path);
+	return rmdir(test_home);
+}
+
+int add_pstcache_suite(void)
+{
+	add_test_suite(pstcache);
+
+	add_test_function(pstcache_scan_hole);
+
+	return 0;
+}
+
+void test_pstcache_scan_hole(void)
+{
+	int i, n;
+	int compress;
+	uint8 key[8];
+	uint8 data[8 * 8 * 2];
+	HASH_KEY keylist[BMPCACHE2_NUM_PSTCELLS];
+	rdpPcache * pcache;
+	CELLHEADER * index;
+
+	for (compress = 0; compress < 2; compress++)
+	{
+		test_settings.bitmap_cache_persist_compress = compress;
+		test_rdp.cache = cache_new(&test_rdp);
+
+		pcache = pcache_new(&test_rdp);
+		CU_ASSERT(pstcache_init(pcache, 2) == True);
+		for (i = 0; i < TEST_CELLS; i++)
+		{
+			memset(key, 0, sizeof(key));
+			key[0] = i + 1;
+			memset(data, i + 1, sizeof(data));
+			CU_ASSERT(pstcache_save_bitmap(pcache, 2, i, key, 8, 8, sizeof(data), data) == True);
+		}
+		pstcache_flush(pcache);
+
+		/* release the second cell the way an eviction does, leaving a hole in the index */
+		index = (CELLHEADER *) (pcache->pstcache_map[2] + sizeof(PSTCACHE_FILEHEADER));
+		memset(&index[1], 0, sizeof(CELLHEADER));
+		pcache_free(pcache);
+
+		/* the cells after the hole are still listed, and key n is found in cell n */
+		pcache = pcache_new(&test_rdp);
+		test_rdp.pcache = pcache;
+		CU_ASSERT(pstcache_init(pcache, 2) == True);
+		n = pstcache_enumerate(pcache, 2, keylist);
+		CU_ASSERT(n == TEST_CELLS - 1);
+		if (n == TEST_CELLS - 1)
+		{
+			CU_ASSERT(keylist[0][0] == 1);
+			CU_ASSERT(keylist[1][0] == 3);
+			CU_ASSERT(keylist[2][0] == 4);
+		}
+
+		for (i = 0; i < n; i++)
+		{
+			loaded_pixel = 0;
+			CU_ASSERT(pstcache_load_bitmap(pcache, 2, i) == True);
+			CU_ASSERT(loaded_pixel == keylist[i][0]);
+		}
+		CU_ASSERT(pstcache_load_bitmap(pcache, 2, TEST_CELLS - 1) == False);
+
+		cache_free(test_rdp.cache);
+		pcache_free(pcache);
+		test_rdp.pcache = NULL;
+	}
+}
@@ -0,0 +1,24 @@
+/*
+   FreeRDP: A Remote Desktop Protocol client.
+   Persistent Bitmap Cache Unit Tests
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "test_freerdp.h"
+
+int init_pstcache_suite(void);
+int clean_pstcache_suite(void);
+int add_pstcache_suite(void);
+
+void test_pstcache_scan_hole(void);
@@ -0,0 +1,165 @@
+/*
+   FreeRDP: A Remote Desktop Protocol client.
+   Standard RDP Security Unit Tests
+
+   Copyright 2026 agent <agent@local>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <freerdp/freerdp.h>
+#include "security.h"
+#include "test_security.h"
+
+static rdpSec test_sec;
+static uint8 test_data[1500];
+
+int init_security_suite(void)
+{
+	int i;
+	uint8 client_random[32];
+	uint8 server_random[32];
+
+	for (i = 0; i < 32; i++)
+	{
+		client_random[i] = i;
+		server_random[i] = 0x80 + i;
+	}
+
+	for (i = 0; i < sizeof(test_data); i++)
+		test_data[i] = (uint8) (i * 7);
+
+	memset(&test_sec, 0, sizeof(test_sec));
+	sec_generate_keys(&test_sec, client_random, server_random, 2);
+
+	return 0;
+}
+
+int clean_security_suite(void)
+{
+	crypto_rc4_clear(&test_sec.rc4_decrypt_state[0]);
+	crypto_rc4_clear(&test_sec.rc4_decrypt_state[1]);
+	crypto_rc4_clear(&test_sec.rc4_encrypt_state[0]);
+	crypto_rc4_clear(&test_sec.rc4_encrypt_state[1]);
+	crypto_sha1_discard(&test_sec.sign_sha1);
+	crypto_md5_discard(&test_sec.sign_md5);
+	return 0;
+}
+
+int add_security_suite(void)
+{
+	add_test_suite(security);
+
+	add_test_function(sec_sign_packet);
+	add_test_function(sec_sign_throughput);
+	add_test_function(sec_arc_verifier);
+
+	return 0;
+}
+
+void test_sec_sign_packet(void)
+{
+	int length;
+	int mismatches;
+	uint8 expected[8];
+	uint8 signature[8];
+
+	mismatches = 0;
+	for (length = 0; length <= sizeof(test_data); length += 13)
+	{
+		sec_sign(expected, 8, test_sec.sec_sign_key, test_sec.rc4_key_len, test_data, length);
+		sec_sign_packet(&test_sec, signature, 8, test_data, length);
+
+		if (memcmp(expected, signature, 8) != 0)
+			mismatches++;
+	}
+
+	CU_ASSERT(mismatches == 0);
+}
+
+static double get_seconds(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/* reports signed PDUs per second for a typical small input PDU and a full
+   size one, with and without the prefix state, which must agree */
+void test_sec_sign_throughput(void)
+{
+	int i;
+	int n;
+	int length;
+	int mismatches;
+	double start;
+	double full;
+	double prefix;
+	uint8 expected[8];
+	uint8 signature[8];
+	static const int lengths[] = { 16, 1400 };
+
+	mismatches = 0;
+	for (n = 0; n < 2; n++)
+	{
+		length = lengths[n];
+
+		start = get_seconds();
+		for (i = 0; i < 100000; i++)
+			sec_sign(expected, 8, test_sec.sec_sign_key, test_sec.rc4_key_len, test_data, length);
+		full = get_seconds() - start;
+
+		start = get_seconds();
+		for (i = 0; i < 100000; i++)
+		{
+			sec_sign_packet(&test_sec, signature, 8, test_data, length);
+			if (memcmp(expected, signature, 8) != 0)
+				mismatches++;
+		}
+		prefix = get_seconds() - start;
+
+		printf("\n%4d byte PDUs: sec_sign %.0f/s, sec_sign_packet %.0f/s",
+			length, 100000 / full, 100000 / prefix);
+	}
+
+	CU_ASSERT(test_sec.sign_prefix == True);
+	CU_ASSERT(mismatches == 0);
+}
+
+/* HMAC-MD5 of the client random keyed with the ArcRandomBits */
+static uint8 arc_verifier_expected[16] =
+{
+	0x6F, 0x1E, 0x8B, 0xD4, 0x22, 0x61, 0x96, 0x63,
+	0xD0, 0xDC, 0xBD, 0x82, 0xC9, 0x8B, 0x08, 0x6E
+};
+
+void test_sec_arc_verifier(void)
+{
+	int i;
+	rdpSec sec;
+	uint8 arc_random[16];
+	uint8 verifier[16];
+
+	memset(&sec, 0, sizeof(sec));
+	for (i = 0; i < 16; i++)
+		arc_random[i] = 3 * i + 1;
+	for (i = 0; i < 32; i++)
+		sec.sec_client_random[i] = 7 * i;
+
+	sec_arc_verifier(&sec, arc_random, verifier);
+	CU_ASSERT(memcmp(verifier, arc_verifier_expected, 16) == 0);
+}
@@ -55,6 +55,7 @@ l_ui_gdi_begin_update(struct rdp_inst * inst)
 {
 	GDI *gdi = GET_GDI(inst);
 	gdi->primary->hdc->hwnd->invalid->null = 1;
+	gdi->primary->hdc->hwnd->ninvalid = 0;
 }
 
 static void
@@ -592,11 +593,11 @@ dfb_get_fds(rdpInst * inst, void ** read_fds, int * read_count, void ** write_fd
 }
 
 int
-dfb_check_fds(rdpInst * inst, fd_set *set)
+dfb_check_fds(rdpInst * inst, EVENT_LOOP * loop)
 {
 	dfbInfo *dfbi = GET_DFBI(inst);
 
-	if (!FD_ISSET(dfbi->read_fds, set))
+	if (!(event_loop_ready(loop, dfbi->read_fds) & EVENT_READ))
 		return 0;
 
 	if (read(dfbi->read_fds, &(dfbi->event), sizeof(dfbi->event)) > 0)
@@ -21,6 +21,7 @@
 #define __DFB_WIN_H
 
 #include <freerdp/freerdp.h>
+#include <freerdp/utils/event_loop.h>
 
 void
 dfb_init(int *argc, char *(*argv[]));
@@ -34,7 +35,7 @@ int
 dfb_get_fds(rdpInst * inst, void ** read_fds, int * read_count,
 	void ** write_fds, int * write_count);
 int
-dfb_check_fds(rdpInst * inst, fd_set *set);
+dfb_check_fds(rdpInst * inst, EVENT_LOOP * loop);
 int
 dfb_err(rdpInst * inst);
 
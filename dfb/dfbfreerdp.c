@@ -507,11 +507,7 @@ run_dfbfreerdp(rdpSet * settings, rdpChanMan * chan_man)
 	void * write_fds[32];
 	int read_count;
 	int write_count;
-	int index;
-	int sck;
-	int max_sck;
-	fd_set rfds;
-	fd_set wfds;
+	EVENT_LOOP * loop;
 
 	memset(read_fds, 0, sizeof(read_fds));
 	memset(write_fds, 0, sizeof(write_fds));
@@ -560,7 +556,14 @@ run_dfbfreerdp(rdpSet * settings, rdpChanMan * chan_man)
 		printf("run_dfbfreerdp: dfb_post_connect failed\n");
 		return 1;
 	}
-	
+
+	loop = event_loop_new();
+	if (loop == NULL)
+	{
+		printf("run_dfbfreerdp: event_loop_new failed\n");
+		return 1;
+	}
+
 	/* program main loop */
 	while (1)
 	{
@@ -584,43 +587,23 @@ run_dfbfreerdp(rdpSet * settings, rdpChanMan * chan_man)
 			printf("run_dfbfreerdp: freerdp_chanman_get_fds failed\n");
 			break;
 		}
-		max_sck = 0;
-		/* setup read fds */
-		FD_ZERO(&rfds);
-		for (index = 0; index < read_count; index++)
+		/* register the fds, only changes reach the kernel */
+		if (event_loop_set_fds(loop, read_fds, read_count, write_fds, write_count) != 0)
 		{
-			sck = (int)(long) (read_fds[index]);
-			if (sck > max_sck)
-				max_sck = sck;
-			FD_SET(sck, &rfds);
-		}
-		/* setup write fds */
-		FD_ZERO(&wfds);
-		for (index = 0; index < write_count; index++)
-		{
-			sck = (int)(long) (write_fds[index]);
-			if (sck > max_sck)
-				max_sck = sck;
-			FD_SET(sck, &wfds);
+			printf("run_dfbfreerdp: event_loop_set_fds failed\n");
+			break;
 		}
 		/* exit if nothing to do */
-		if (max_sck == 0)
+		if (event_loop_count(loop) == 0)
 		{
-			printf("run_dfbfreerdp: max_sck is zero\n");
+			printf("run_dfbfreerdp: no fds to wait on\n");
 			break;
 		}
 		/* do the wait */
-		if (select(max_sck + 1, &rfds, &wfds, NULL, NULL) == -1)
+		if (event_loop_wait(loop, -1) < 0)
 		{
-			/* these are not really errors */
-			if (!((errno == EAGAIN) ||
-				(errno == EWOULDBLOCK) ||
-				(errno == EINPROGRESS) ||
-				(errno == EINTR))) /* signal occurred */
-			{
-				printf("run_dfbfreerdp: select failed\n");
-				break;
-			}
+			printf("run_dfbfreerdp: event_loop_wait failed\n");
+			break;
 		}
 		/* check the libfreerdp fds */
 		if (inst->rdp_check_fds(inst) != 0)
@@ -629,7 +612,7 @@ run_dfbfreerdp(rdpSet * settings, rdpChanMan * chan_man)
 			break;
 		}
 		/* check DirectFB fds */
-		if (dfb_check_fds(inst, &rfds) != 0)
+		if (dfb_check_fds(inst, loop) != 0)
 		{
 			printf("run_dfbfreerdp: dfb_check_fds failed\n");
 			break;
@@ -642,6 +625,7 @@ run_dfbfreerdp(rdpSet * settings, rdpChanMan * chan_man)
 		}
 	}
 	/* cleanup */
+	event_loop_free(loop);
 	inst->rdp_disconnect(inst);
 	dfb_uninit(inst);
 	freerdp_free(inst);
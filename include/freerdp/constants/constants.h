@@ -54,6 +54,10 @@
 #define BMPCACHE2_C2_CELLS	0x150
 #define BMPCACHE2_NUM_PSTCELLS	0x9f6
 
+/* RDP offscreen bitmap cache constants */
+#define OFFSCREEN_CACHE_SIZE	7680	/* in KB, the maximum allowed */
+#define OFFSCREEN_CACHE_ENTRIES	100
+
 /* User Data Header Types */
 #define CS_CORE         0xC001
 #define CS_SECURITY     0xC002
@@ -37,4 +37,15 @@
 #define LICENSE_TAG_USER    0x000f
 #define LICENSE_TAG_HOST    0x0010
 
+/* Licensing Error Message dwErrorCode */
+#define ERR_INVALID_SERVER_CERTIFICATE 0x00000001
+#define ERR_NO_LICENSE                 0x00000002
+#define ERR_INVALID_MAC                0x00000003
+#define ERR_INVALID_SCOPE              0x00000004
+#define ERR_NO_LICENSE_SERVER          0x00000006
+#define STATUS_VALID_CLIENT            0x00000007
+#define ERR_INVALID_CLIENT             0x00000008
+#define ERR_INVALID_PRODUCTID          0x0000000B
+#define ERR_INVALID_MESSAGE_LEN        0x0000000C
+
 #endif /* __CONSTANTS_LICENSE_H */
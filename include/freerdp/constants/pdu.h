@@ -135,6 +135,22 @@ enum RDP_REDIR_FLAGS
 	LB_TARGET_NET_ADDRESSES = 0x00000800
 };
 
+/* Save Session Info PDU Data infoType */
+enum RDP_SAVE_SESSION_INFO_TYPE
+{
+	INFOTYPE_LOGON = 0x00000000,
+	INFOTYPE_LOGON_LONG = 0x00000001,
+	INFOTYPE_LOGON_PLAINNOTIFY = 0x00000002,
+	INFOTYPE_LOGON_EXTENDED_INFO = 0x00000003
+};
+
+/* Logon Info Extended fieldsPresent */
+enum RDP_LOGON_EX_FIELDS
+{
+	LOGON_EX_AUTORECONNECTCOOKIE = 0x00000001,
+	LOGON_EX_LOGONERRORS = 0x00000002
+};
+
 /* Set Error Info PDU Data errorInfo */
 enum RDP_ERRORINFO
 {
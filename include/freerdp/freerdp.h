@@ -144,6 +144,17 @@ struct rdp_inst
 	int (* ui_decode)(rdpInst * inst, uint8 * data, int data_size);
 	RD_BOOL (* ui_check_certificate)(rdpInst * inst, const char * fingerprint,
 		const char * subject, const char * issuer, RD_BOOL verified);
+	/* optional, when set primary orders are queued and handed over in batches */
+	void (* ui_draw_orders)(rdpInst * inst, RD_ORDER * orders, int count);
+	/* optional, fills all rectangles of a multi opaque rect order at once */
+	void (* ui_rects)(rdpInst * inst, RD_RECT * rects, int count, uint32 color);
+	/* sends the input events held back by settings->input_latency */
+	int (* rdp_send_input_flush)(rdpInst * inst);
+	/* optional, the connection was replaced after a redirect or auto-reconnect;
+	   the new socket may reuse the number of the closed one */
+	void (* ui_reconnected)(rdpInst * inst);
+	/* usage of the offscreen surface cache and the number of refused surfaces */
+	void (* rdp_get_offscreen_stats)(rdpInst * inst, RD_OFFSCREEN_STATS * stats);
 };
 
 FREERDP_API rdpInst *
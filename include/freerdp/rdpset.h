@@ -93,6 +93,15 @@ struct rdp_set
 	struct rdp_ext_set extensions[16];
 	int num_monitors;
 	struct rdp_monitor monitors[16];
+	int bitmap_cache_persist_compress;
+	int tls_kernel_offload;
+	/* ms pointer moves may be held back to go out with later input,
+	   the ui calls rdp_send_input_flush once its input is handled */
+	int input_latency;
+	/* attempts to resume a dropped session with the auto-reconnect cookie */
+	int auto_reconnect;
+	/* threads the software gdi replays batched orders on, one band each */
+	int software_gdi_threads;
 };
 
 #endif
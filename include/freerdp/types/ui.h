@@ -66,6 +66,9 @@ typedef struct _RD_BRUSHDATA
 	uint32 color_code;
 	uint32 data_size;
 	uint8 *data;
+	/* pattern converted by the ui on first use, freed with the entry */
+	uint8 *ui_data;
+	uint32 ui_palette;	/* palette generation ui_data was converted with */
 }
 RD_BRUSHDATA;
 
@@ -95,6 +98,71 @@ typedef struct _RD_RECT
 }
 RD_RECT;
 
+/* offscreen surface cache usage, in bytes at the session color depth */
+typedef struct _RD_OFFSCREEN_STATS
+{
+	uint32 used;
+	uint32 peak;
+	uint32 limit;
+	int count;
+	int rejected;
+}
+RD_OFFSCREEN_STATS;
+
+/* primary drawing orders handed to ui_draw_orders in batches */
+enum RD_ORDER_TYPE
+{
+	RD_ORDER_SET_CLIP,
+	RD_ORDER_RESET_CLIP,
+	RD_ORDER_DESTBLT,
+	RD_ORDER_PATBLT,
+	RD_ORDER_SCREENBLT,
+	RD_ORDER_MEMBLT,
+	RD_ORDER_LINE,
+	RD_ORDER_RECT
+};
+
+typedef struct _RD_ORDER
+{
+	uint8 type;
+	uint8 opcode;
+	sint16 x;
+	sint16 y;
+	sint16 cx;
+	sint16 cy;
+	union
+	{
+		struct
+		{
+			uint32 color;
+		} rect;
+		struct
+		{
+			sint16 endx;
+			sint16 endy;
+			RD_PEN pen;
+		} line;
+		struct
+		{
+			uint32 bgcolor;
+			uint32 fgcolor;
+			RD_BRUSH brush;
+		} patblt;
+		struct
+		{
+			sint16 srcx;
+			sint16 srcy;
+		} screenblt;
+		struct
+		{
+			sint16 srcx;
+			sint16 srcy;
+			RD_HBITMAP src;
+		} memblt;
+	} u;
+}
+RD_ORDER;
+
 typedef struct _RD_EVENT RD_EVENT;
 
 typedef void (*RD_EVENT_CALLBACK) (RD_EVENT * event);
@@ -0,0 +1,53 @@
+/*
+   FreeRDP: A Remote Desktop Protocol client.
+   Event Loop
+
+   Copyright 2026 agent <agent@local>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __UTILS_EVENT_LOOP_H
+#define __UTILS_EVENT_LOOP_H
+
+/* event masks for event_loop_add and event_loop_ready */
+#define EVENT_READ	0x01
+#define EVENT_WRITE	0x02
+
+typedef struct _EVENT_LOOP EVENT_LOOP;
+typedef void (*EVENT_TIMER_CALLBACK)(void * arg);
+
+EVENT_LOOP * event_loop_new(void);
+void event_loop_free(EVENT_LOOP * loop);
+
+/* persistent registrations, kept across waits until removed; remove an fd
+   before closing it, a new fd with the same number is not noticed otherwise */
+int event_loop_add(EVENT_LOOP * loop, int fd, int events);
+int event_loop_remove(EVENT_LOOP * loop, int fd);
+/* replace the registrations with the fds returned by the *_get_fds
+   callbacks, only touching the kernel for fds that changed */
+int event_loop_set_fds(EVENT_LOOP * loop, void ** read_fds, int read_count,
+	void ** write_fds, int write_count);
+int event_loop_count(EVENT_LOOP * loop);
+
+/* periodic timers, interval in milliseconds; returns the timer id */
+int event_loop_add_timer(EVENT_LOOP * loop, int interval,
+	EVENT_TIMER_CALLBACK callback, void * arg);
+void event_loop_remove_timer(EVENT_LOOP * loop, int id);
+
+/* waits up to timeout milliseconds (-1 for ever) and runs the due timers;
+   returns the number of ready fds, 0 on timeout or signal, -1 on error */
+int event_loop_wait(EVENT_LOOP * loop, int timeout);
+int event_loop_ready(EVENT_LOOP * loop, int fd);
+
+#endif /* __UTILS_EVENT_LOOP_H */
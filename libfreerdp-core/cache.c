@@ -170,7 +170,7 @@ cache_evict_bitmap(rdpCache * cache, uint8 id)
 	cache->bmpcache_lru[id] = n_idx;
 	cache->bmpcache[id][n_idx].previous = NOT_SET;
 
-	pstcache_touch_bitmap(cache->rdp->pcache, id, idx, 0);
+	pstcache_touch_bitmap(cache->rdp->pcache, id, idx);
 }
 
 /* Retrieve a bitmap from the cache */
@@ -233,7 +233,7 @@ cache_put_bitmap(rdpCache * cache, uint8 id, uint16 idx, RD_HBITMAP bitmap)
 	}
 	else if ((id == 255) && (idx < NUM_ELEMENTS(cache->drawing_surface)))
 	{
-		cache->drawing_surface[idx] = bitmap;
+		cache_put_surface(cache, idx, bitmap, 0);
 	}
 	else
 	{
@@ -241,6 +241,78 @@ cache_put_bitmap(rdpCache * cache, uint8 id, uint16 idx, RD_HBITMAP bitmap)
 	}
 }
 
+/* Check if an offscreen surface of the given size fits in the cache, in place of the one at idx */
+RD_BOOL
+cache_check_surface(rdpCache * cache, uint16 idx, uint32 size)
+{
+	uint32 used;
+
+	if (idx >= NUM_ELEMENTS(cache->drawing_surface))
+		return False;
+
+	used = cache->offscreen_used - cache->drawing_surface_size[idx];
+	if (used + size > cache->offscreen_limit)
+	{
+		cache->offscreen_rejected++;
+		DEBUG_CACHE("offscreen surface %d of %d bytes rejected, %d of %d bytes in use",
+			idx, size, used, cache->offscreen_limit);
+		return False;
+	}
+	return True;
+}
+
+/* Store an offscreen surface taking size bytes, the surface previously at idx is not destroyed */
+void
+cache_put_surface(rdpCache * cache, uint16 idx, RD_HBITMAP surface, uint32 size)
+{
+	if (idx >= NUM_ELEMENTS(cache->drawing_surface))
+	{
+		ui_error(cache->rdp->inst, "put surface %d\n", idx);
+		return;
+	}
+
+	if (cache->drawing_surface[idx] != NULL)
+		cache->offscreen_count--;
+	if (surface != NULL)
+		cache->offscreen_count++;
+
+	cache->offscreen_used -= cache->drawing_surface_size[idx];
+	cache->offscreen_used += size;
+	if (cache->offscreen_used > cache->offscreen_peak)
+		cache->offscreen_peak = cache->offscreen_used;
+
+	cache->drawing_surface[idx] = surface;
+	cache->drawing_surface_size[idx] = size;
+
+	DEBUG_CACHE("offscreen surface %d: %d bytes, %d surfaces using %d bytes (peak %d)",
+		idx, size, cache->offscreen_count, cache->offscreen_used, cache->offscreen_peak);
+}
+
+/* Destroy all offscreen surfaces, the cache is left as a new session finds it */
+void
+cache_free_surfaces(rdpCache * cache)
+{
+	int idx;
+
+	for (idx = 0; idx < NUM_ELEMENTS(cache->drawing_surface); idx++)
+	{
+		if (cache->drawing_surface[idx] != NULL)
+			ui_destroy_surface(cache->rdp->inst, cache->drawing_surface[idx]);
+		cache_put_surface(cache, idx, NULL, 0);
+	}
+}
+
+/* Get the offscreen surface cache statistics */
+void
+cache_get_surface_stats(rdpCache * cache, RD_OFFSCREEN_STATS * stats)
+{
+	stats->used = cache->offscreen_used;
+	stats->peak = cache->offscreen_peak;
+	stats->limit = cache->offscreen_limit;
+	stats->count = cache->offscreen_count;
+	stats->rejected = cache->offscreen_rejected;
+}
+
 /* Updates the persistent bitmap cache MRU information on exit */
 void
 cache_save_state(rdpCache * cache)
@@ -252,10 +324,12 @@ cache_save_state(rdpCache * cache)
 		if (IS_PERSISTENT(id))
 		{
 			DEBUG_CACHE("Saving cache state for bitmap cache %d...", id);
+			/* walked from least to most recently used, so stamps go up */
 			idx = cache->bmpcache_lru[id];
 			while (idx >= 0)
 			{
-				pstcache_touch_bitmap(cache->rdp->pcache, id, idx, ++t);
+				pstcache_touch_bitmap(cache->rdp->pcache, id, idx);
+				t++;
 				idx = cache->bmpcache[id][idx].next;
 			}
 			DEBUG_CACHE(" %d stamps written.", t);
@@ -392,6 +466,10 @@ cache_put_brush_data(rdpCache * cache, uint8 color_code, uint8 idx, RD_BRUSHDATA
 		{
 			xfree(bd->data);
 		}
+		if (bd->ui_data != NULL)
+		{
+			xfree(bd->ui_data);
+		}
 		memcpy(bd, brush_data, sizeof(RD_BRUSHDATA));
 	}
 	else
@@ -416,6 +494,7 @@ cache_new(struct rdp_rdp * rdp)
 		self->bmpcache_mru[0] = NOT_SET;
 		self->bmpcache_mru[1] = NOT_SET;
 		self->bmpcache_mru[2] = NOT_SET;
+		self->offscreen_limit = OFFSCREEN_CACHE_SIZE * 1024;
 	}
 	return self;
 }
@@ -425,6 +504,9 @@ cache_free(rdpCache * cache)
 {
 	if (cache != NULL)
 	{
+		DEBUG_CACHE("offscreen cache: peak %d of %d bytes, %d surfaces rejected",
+			cache->offscreen_peak, cache->offscreen_limit, cache->offscreen_rejected);
+
 		{
 			int color_code, idx;
 			RD_BRUSHDATA * bd;
@@ -438,6 +520,10 @@ cache_free(rdpCache * cache)
 					{
 						xfree(bd->data);
 					}
+					if (bd->ui_data != NULL)
+					{
+						xfree(bd->ui_data);
+					}
 				}
 			}
 		}
@@ -21,6 +21,7 @@
 #define __CACHE_H
 
 #include "orders.h"
+#include <freerdp/constants/constants.h>
 #include <freerdp/utils/debug.h>
 #include <freerdp/utils/memory.h>
 #include <freerdp/utils/datablob.h>
@@ -37,7 +38,13 @@ struct rdp_cache
 	struct rdp_rdp * rdp;
 	struct bmpcache_entry bmpcache[3][0xa00];
 	RD_HBITMAP volatile_bc[3];
-	RD_HBITMAP drawing_surface[100];
+	RD_HBITMAP drawing_surface[OFFSCREEN_CACHE_ENTRIES];
+	uint32 drawing_surface_size[OFFSCREEN_CACHE_ENTRIES];
+	uint32 offscreen_used; /* bytes held by offscreen surfaces */
+	uint32 offscreen_peak;
+	uint32 offscreen_limit;
+	int offscreen_count;
+	int offscreen_rejected;
 	int bmpcache_lru[3];
 	int bmpcache_mru[3];
 	int bmpcache_count[3];
@@ -58,6 +65,14 @@ RD_HBITMAP
 cache_get_bitmap(rdpCache * cache, uint8 id, uint16 idx);
 void
 cache_put_bitmap(rdpCache * cache, uint8 id, uint16 idx, RD_HBITMAP bitmap);
+RD_BOOL
+cache_check_surface(rdpCache * cache, uint16 idx, uint32 size);
+void
+cache_put_surface(rdpCache * cache, uint16 idx, RD_HBITMAP surface, uint32 size);
+void
+cache_free_surfaces(rdpCache * cache);
+void
+cache_get_surface_stats(rdpCache * cache, RD_OFFSCREEN_STATS * stats);
 void
 cache_save_state(rdpCache * cache);
 FONTGLYPH *
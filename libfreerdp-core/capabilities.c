@@ -711,8 +711,8 @@ void rdp_out_offscreenscache_capset(STREAM s)
 
 	header = rdp_skip_capset_header(s);
 	out_uint32_le(s, 1); /* offscreenSupportLevel, either TRUE (0x1) or FALSE (0x0) */
-	out_uint16_le(s, 7680); /* offscreenCacheSize, maximum is 7680 (in KB) */
-	out_uint16_le(s, 100); /* offscreenCacheEntries, maximum is 500 entries */
+	out_uint16_le(s, OFFSCREEN_CACHE_SIZE); /* offscreenCacheSize, maximum is 7680 (in KB) */
+	out_uint16_le(s, OFFSCREEN_CACHE_ENTRIES); /* offscreenCacheEntries, maximum is 500 entries */
 	rdp_out_capset_header(s, header, CAPSET_TYPE_OFFSCREENCACHE);
 }
 
@@ -1202,8 +1202,14 @@ void rdp_process_bitmap_codecs_capset(rdpRdp * rdp, STREAM s, int size)
 	}
 }
 
+/* latency the unacknowledged frames may add up to, in ms */
+#define FRAME_ACK_LATENCY_BUDGET	100
+#define FRAME_ACK_MAX_IN_FLIGHT		8
+
 /**
  * Output frame acknowledge capability set.\n
+ * The in flight frame count follows the decode and present time measured
+ * so far, it is renegotiated on every reactivation.
  * @param rdp
  * @param s
  */
@@ -1211,12 +1217,25 @@ void rdp_process_bitmap_codecs_capset(rdpRdp * rdp, STREAM s, int size)
 void rdp_out_frame_ack_capset(rdpRdp * rdp, STREAM s)
 {
 	capsetHeaderRef header;
+	uint32 in_flight;
+
+	in_flight = 2;
+	if (rdp->frames_acked > 0)
+	{
+		if (rdp->frame_time > 0)
+			in_flight = FRAME_ACK_LATENCY_BUDGET * 16 / rdp->frame_time;
+		else
+			in_flight = FRAME_ACK_MAX_IN_FLIGHT;
+		in_flight = MAX(1, MIN(in_flight, FRAME_ACK_MAX_IN_FLIGHT));
+	}
 
 	//printf("rdp_out_frame_ack_capset:\n");
 	header = rdp_skip_capset_header(s);
-	out_uint32_le(s, 2); /* in flight frames */
+	out_uint32_le(s, in_flight); /* in flight frames */
 	rdp_out_capset_header(s, header, CAPSET_TYPE_FRAME_ACKNOWLEDGE);
 	rdp->send_frame_ack = 1;
+	rdp->frames_in_flight = in_flight;
+	rdp->frames_pending = 0;
 }
 
 /**
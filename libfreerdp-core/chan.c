@@ -22,6 +22,7 @@
 #include "mcs.h"
 #include "rdp.h"
 #include "security.h"
+#include "network.h"
 #include <freerdp/rdpset.h>
 #include <freerdp/utils/memory.h>
 #include <freerdp/constants/vchan.h>
@@ -49,6 +50,7 @@ vchan_send(rdpChannels * chan, int mcs_id, char * data, int total_length)
 	chan_flags = CHANNEL_FLAG_FIRST;
 	sent = 0;
 	sec_flags = settings->encryption ? SEC_ENCRYPT : 0;
+	network_begin_batch(chan->mcs->net);
 	while (sent < total_length)
 	{
 		length = MIN(CHANNEL_CHUNK_LENGTH, total_length);
@@ -70,6 +72,7 @@ vchan_send(rdpChannels * chan, int mcs_id, char * data, int total_length)
 		sent += length;
 		chan_flags = 0;
 	}
+	network_end_batch(chan->mcs->net);
 	return sent;
 }
 
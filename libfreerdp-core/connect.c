@@ -309,6 +309,7 @@ connect_input_server_security_data(rdpSec * sec, STREAM s)
 
 	DEBUG_SEC("Generating client random");
 	generate_random(client_random);
+	memcpy(sec->sec_client_random, client_random, SEC_RANDOM_SIZE);
 	sec_reverse_copy(client_random_rev, client_random, SEC_RANDOM_SIZE);
 	crypto_rsa_encrypt(SEC_RANDOM_SIZE, client_random_rev, crypted_random_rev,
 			sec->server_public_key_len, modulus, exponent);
@@ -77,6 +77,9 @@ void credssp_ntlmssp_init(rdpCredssp *credssp)
 		ntlmssp_set_domain(ntlmssp, NULL);
 	}
 
+	/* the NTOWFv2 of the last logon survives reconnects with the rdp instance */
+	ntlmssp->ntowfv2_cache = &credssp->net->rdp->ntowfv2;
+
 	ntlmssp_generate_client_challenge(ntlmssp);
 	ntlmssp_generate_random_session_key(ntlmssp);
 	ntlmssp_generate_exported_session_key(ntlmssp);
@@ -114,24 +117,34 @@ int credssp_get_public_key(rdpCredssp *credssp)
 
 int credssp_authenticate(rdpCredssp *credssp)
 {
+	struct stream stream;
+	STREAM s = &stream;
 	NTLMSSP *ntlmssp = credssp->ntlmssp;
-	STREAM s = xmalloc(sizeof(struct stream));
-	uint8* negoTokenBuffer = (uint8*) xmalloc(2048);
+	uint8 negoTokenBuffer[2048];
 
 	credssp_ntlmssp_init(credssp);
 
-	if (credssp_get_public_key(credssp) == 0)
-		return 0;
-
 	/* NTLMSSP NEGOTIATE MESSAGE */
 	s->p = s->end = s->data = negoTokenBuffer;
 	ntlmssp_send(ntlmssp, s);
 	credssp->negoToken.data = s->data;
 	credssp->negoToken.length = s->end - s->data;
 	credssp_send(credssp, &credssp->negoToken, NULL, NULL);
+	credssp->negoToken.data = NULL;
+	credssp->negoToken.length = 0;
+
+	/*
+	 * Neither the server public key nor the NTLMv2 hash depend on the
+	 * challenge, get them while the server prepares it.
+	 */
+	if (credssp_get_public_key(credssp) == 0)
+		return 0;
+
+	ntlmssp_prepare_ntlm_v2_hash(ntlmssp);
 
 	/* NTLMSSP CHALLENGE MESSAGE */
-	if (credssp_recv(credssp, &credssp->negoToken, NULL, NULL) < 0)
+	if (credssp_recv(credssp, &credssp->negoToken, NULL, NULL) < 0 ||
+		credssp->negoToken.data == NULL)
 		return -1;
 
 	s->p = s->data = credssp->negoToken.data;
@@ -149,12 +162,15 @@ int credssp_authenticate(rdpCredssp *credssp)
 	credssp->negoToken.length = s->end - s->data;
 	credssp_encrypt_public_key(credssp, &credssp->pubKeyAuth);
 	credssp_send(credssp, &credssp->negoToken, &credssp->pubKeyAuth, NULL);
+	credssp->negoToken.data = NULL;
+	credssp->negoToken.length = 0;
+	datablob_free(&credssp->pubKeyAuth);
 
 	/* Encrypted Public Key +1 */
 	if (credssp_recv(credssp, &credssp->negoToken, &credssp->pubKeyAuth, NULL) < 0)
 		return -1;
 
-	if (credssp_verify_public_key(credssp, &credssp->pubKeyAuth) == 0)
+	if (credssp->pubKeyAuth.data == NULL || credssp_verify_public_key(credssp, &credssp->pubKeyAuth) == 0)
 	{
 		/* Failed to verify server public key echo */
 		return 0; /* DO NOT SEND CREDENTIALS! */
@@ -168,8 +184,6 @@ int credssp_authenticate(rdpCredssp *credssp)
 	credssp_encrypt_ts_credentials(credssp, &credssp->authInfo);
 	credssp_send(credssp, NULL, NULL, &credssp->authInfo);
 
-	xfree(s);
-
 	return 1;
 }
 
@@ -418,13 +432,11 @@ void credssp_send(rdpCredssp *credssp, DATABLOB *negoToken, DATABLOB *pubKeyAuth
 int credssp_recv(rdpCredssp *credssp, DATABLOB *negoToken, DATABLOB *pubKeyAuth, DATABLOB *authInfo)
 {
 	int bytes_read;
-	int size = 2048;
-	char *recv_buffer;
+	char recv_buffer[2048];
 	asn_dec_rval_t dec_rval;
 	TSRequest_t *ts_request = 0;
 
-	recv_buffer = xmalloc(size);
-	bytes_read = tls_read(credssp->net->tls, recv_buffer, size);
+	bytes_read = tls_read(credssp->net->tls, recv_buffer, sizeof(recv_buffer));
 
 	if (bytes_read < 0)
 		return -1;
@@ -456,7 +468,6 @@ int credssp_recv(rdpCredssp *credssp, DATABLOB *negoToken, DATABLOB *pubKeyAuth,
 		asn_DEF_TSRequest.free_struct(&asn_DEF_TSRequest, ts_request, 0);
 	}
 
-	xfree(recv_buffer);
 	return 0;
 }
 
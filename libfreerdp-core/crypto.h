@@ -29,14 +29,65 @@ crypto_global_init(void);	/* returns True on success */
 void
 crypto_global_finish(void);
 
+/* The hash and rc4 contexts have a public size so that they can live on the
+   stack or inside a session instead of being allocated for every packet.
+   The layout of the state belongs to the back-end, which checks at compile
+   time that its own context fits. */
+#define CRYPTO_HASH_STATE_SIZE	320
+#define CRYPTO_RC4_STATE_SIZE	1088
+
+#define CRYPTO_STATE_CHECK(_name, _type, _size) \
+	typedef char _name[(sizeof(_type) <= (_size)) ? 1 : -1]
+
+struct crypto_sha1_struct
+{
+	union
+	{
+		uint8 data[CRYPTO_HASH_STATE_SIZE];
+		void * ptr;
+		uint64 align;
+	} state;
+};
+
+struct crypto_md5_struct
+{
+	union
+	{
+		uint8 data[CRYPTO_HASH_STATE_SIZE];
+		void * ptr;
+		uint64 align;
+	} state;
+};
+
+struct crypto_rc4_struct
+{
+	union
+	{
+		uint8 data[CRYPTO_RC4_STATE_SIZE];
+		void * ptr;
+		uint64 align;
+	} state;
+};
+
 typedef struct crypto_sha1_struct * CryptoSha1;
 
+/* init allocates a context and final frees it again */
 CryptoSha1
 crypto_sha1_init(void);
 void
 crypto_sha1_update(CryptoSha1 sha1, uint8 * data, uint32 len);
 void
 crypto_sha1_final(CryptoSha1 sha1, uint8 * out_data);
+/* start and finish work on caller owned contexts; copy returns False when
+   the back-end cannot clone a partial hash, discard drops an unfinished one */
+void
+crypto_sha1_start(CryptoSha1 sha1);
+void
+crypto_sha1_finish(CryptoSha1 sha1, uint8 * out_data);
+RD_BOOL
+crypto_sha1_copy(CryptoSha1 dst, CryptoSha1 src);
+void
+crypto_sha1_discard(CryptoSha1 sha1);
 
 typedef struct crypto_md5_struct * CryptoMd5;
 
@@ -46,6 +97,14 @@ void
 crypto_md5_update(CryptoMd5 md5, uint8 * data, uint32 len);
 void
 crypto_md5_final(CryptoMd5 md5, uint8 * out_data);
+void
+crypto_md5_start(CryptoMd5 md5);
+void
+crypto_md5_finish(CryptoMd5 md5, uint8 * out_data);
+RD_BOOL
+crypto_md5_copy(CryptoMd5 dst, CryptoMd5 src);
+void
+crypto_md5_discard(CryptoMd5 md5);
 
 typedef struct crypto_rc4_struct * CryptoRc4;
 
@@ -55,6 +114,11 @@ void
 crypto_rc4(CryptoRc4 rc4, uint32 len, uint8 * in_data, uint8 * out_data);
 void
 crypto_rc4_free(CryptoRc4 rc4);
+/* setup keys a caller owned context, clear releases what setup acquired */
+void
+crypto_rc4_setup(CryptoRc4 rc4, uint8 * key, uint32 len);
+void
+crypto_rc4_clear(CryptoRc4 rc4);
 
 typedef struct crypto_cert_struct * CryptoCert;
 
@@ -40,81 +40,146 @@ crypto_global_finish(void)
 	gnutls_global_deinit();
 }
 
-struct crypto_sha1_struct
+/* the hash and rc4 states only hold the gnutls handle */
+#define HASH_STATE(_h) (*(gnutls_hash_hd_t *) &(_h)->state.ptr)
+#define CIPHER_STATE(_c) (*(gnutls_cipher_hd_t *) &(_c)->state.ptr)
+
+CRYPTO_STATE_CHECK(crypto_hash_state_fits, gnutls_hash_hd_t, sizeof(void *));
+CRYPTO_STATE_CHECK(crypto_cipher_state_fits, gnutls_cipher_hd_t, sizeof(void *));
+
+static RD_BOOL
+crypto_hash_copy(void ** dst, void * src)
 {
-	gnutls_hash_hd_t dig;
-};
+#if GNUTLS_VERSION_NUMBER >= 0x030609
+	*dst = gnutls_hash_copy(src);
+	return *dst != NULL;
+#else
+	/* partial hashes can not be cloned before gnutls 3.6.9 */
+	*dst = NULL;
+	return False;
+#endif
+}
 
 CryptoSha1
 crypto_sha1_init(void)
 {
 	CryptoSha1 sha1 = xmalloc(sizeof(*sha1));
-	int x = gnutls_hash_init(&sha1->dig, GNUTLS_DIG_SHA1);
-	ASSERT(!x);
+	crypto_sha1_start(sha1);
 	return sha1;
 }
 
+void
+crypto_sha1_start(CryptoSha1 sha1)
+{
+	int x = gnutls_hash_init(&HASH_STATE(sha1), GNUTLS_DIG_SHA1);
+	ASSERT(!x);
+}
+
 void
 crypto_sha1_update(CryptoSha1 sha1, uint8 * data, uint32 len)
 {
-	int x = gnutls_hash(sha1->dig, data, len);
+	int x = gnutls_hash(HASH_STATE(sha1), data, len);
 	ASSERT(!x);
 }
 
+void
+crypto_sha1_finish(CryptoSha1 sha1, uint8 * out_data)
+{
+	gnutls_hash_deinit(HASH_STATE(sha1), out_data);
+	sha1->state.ptr = NULL;
+}
+
 void
 crypto_sha1_final(CryptoSha1 sha1, uint8 * out_data)
 {
-	gnutls_hash_deinit(sha1->dig, out_data);
+	crypto_sha1_finish(sha1, out_data);
 	xfree(sha1);
 }
 
-struct crypto_md5_struct
+RD_BOOL
+crypto_sha1_copy(CryptoSha1 dst, CryptoSha1 src)
 {
-	gnutls_hash_hd_t dig;
-};
+	return crypto_hash_copy(&dst->state.ptr, src->state.ptr);
+}
+
+void
+crypto_sha1_discard(CryptoSha1 sha1)
+{
+	if (sha1->state.ptr != NULL)
+		gnutls_hash_deinit(HASH_STATE(sha1), NULL);
+	sha1->state.ptr = NULL;
+}
 
 CryptoMd5
 crypto_md5_init(void)
 {
 	CryptoMd5 md5 = xmalloc(sizeof(*md5));
-	int x = gnutls_hash_init(&md5->dig, GNUTLS_DIG_MD5);
-	ASSERT(!x);
+	crypto_md5_start(md5);
 	return md5;
 }
 
+void
+crypto_md5_start(CryptoMd5 md5)
+{
+	int x = gnutls_hash_init(&HASH_STATE(md5), GNUTLS_DIG_MD5);
+	ASSERT(!x);
+}
+
 void
 crypto_md5_update(CryptoMd5 md5, uint8 * data, uint32 len)
 {
-	int x = gnutls_hash(md5->dig, data, len);
+	int x = gnutls_hash(HASH_STATE(md5), data, len);
 	ASSERT(!x);
 }
 
 void
-crypto_md5_final(CryptoMd5 md5, uint8 * out_data)
+crypto_md5_finish(CryptoMd5 md5, uint8 * out_data)
 {
 	/* Assuming out_data has room for gnutls_hash_get_len(GNUTLS_DIG_MD5) */
-	gnutls_hash_deinit(md5->dig, out_data);
+	gnutls_hash_deinit(HASH_STATE(md5), out_data);
+	md5->state.ptr = NULL;
+}
+
+void
+crypto_md5_final(CryptoMd5 md5, uint8 * out_data)
+{
+	crypto_md5_finish(md5, out_data);
 	xfree(md5);
 }
 
-struct crypto_rc4_struct
+RD_BOOL
+crypto_md5_copy(CryptoMd5 dst, CryptoMd5 src)
 {
-	gnutls_cipher_hd_t handle;
-};
+	return crypto_hash_copy(&dst->state.ptr, src->state.ptr);
+}
+
+void
+crypto_md5_discard(CryptoMd5 md5)
+{
+	if (md5->state.ptr != NULL)
+		gnutls_hash_deinit(HASH_STATE(md5), NULL);
+	md5->state.ptr = NULL;
+}
 
 CryptoRc4
 crypto_rc4_init(uint8 * key, uint32 len)
 {
 	CryptoRc4 rc4 = xmalloc(sizeof(*rc4));
+	crypto_rc4_setup(rc4, key, len);
+	return rc4;
+}
+
+void
+crypto_rc4_setup(CryptoRc4 rc4, uint8 * key, uint32 len)
+{
 	gnutls_datum_t key_datum;
 	key_datum.size = len;
 	key_datum.data = key;
 	gnutls_datum_t iv_datum;
 	iv_datum.size = 0;
 	iv_datum.data = NULL;
-	int x = gnutls_cipher_init(&rc4->handle, GNUTLS_CIPHER_ARCFOUR_40, &key_datum, &iv_datum);
+	int x = gnutls_cipher_init(&CIPHER_STATE(rc4), GNUTLS_CIPHER_ARCFOUR_40, &key_datum, &iv_datum);
 	ASSERT(!x);
-	return rc4;
 }
 
 void
@@ -122,14 +187,22 @@ crypto_rc4(CryptoRc4 rc4, uint32 len, uint8 * in_data, uint8 * out_data)
 {
 	if (out_data != in_data)
 		memcpy(out_data, in_data, len);
-	int x = gnutls_cipher_encrypt (rc4->handle, out_data, len);
+	int x = gnutls_cipher_encrypt (CIPHER_STATE(rc4), out_data, len);
 	ASSERT(!x);
 }
 
+void
+crypto_rc4_clear(CryptoRc4 rc4)
+{
+	if (rc4->state.ptr != NULL)
+		gnutls_cipher_deinit(CIPHER_STATE(rc4));
+	rc4->state.ptr = NULL;
+}
+
 void
 crypto_rc4_free(CryptoRc4 rc4)
 {
-	gnutls_cipher_deinit(rc4->handle);
+	crypto_rc4_clear(rc4);
 	xfree(rc4);
 }
 
@@ -57,81 +57,207 @@ void check(SECStatus s, char* msg) {
 	}
 }
 
-struct crypto_sha1_struct
+/*
+ * A hash state holds its PK11Context. A state that gets copied, like the
+ * packet MAC prefix, also keeps its saved state and a spare context. The
+ * copy is restored into the spare instead of cloning a new context, so
+ * signing a packet does not create one. The spare is lent to one copy at
+ * a time and a state must outlive its copies.
+ */
+struct nss_hash
 {
 	PK11Context * context;
+	PK11Context * spare;
+	struct nss_hash * owner;	/* in a copy holding the spare of owner */
+	unsigned char * saved;
+	unsigned int saved_len;
+	PRBool lent;
 };
 
+#define NSS_HASH(_hash) ((struct nss_hash *) (_hash)->state.data)
+
+CRYPTO_STATE_CHECK(crypto_hash_state_fits, struct nss_hash, CRYPTO_HASH_STATE_SIZE);
+
+static void
+nss_hash_start(struct nss_hash * hash, SECOidTag oid, char * msg)
+{
+	memset(hash, 0, sizeof(*hash));
+	hash->context = PK11_CreateDigestContext(oid);
+	SECStatus s = PK11_DigestBegin(hash->context);
+	check(s, msg);
+}
+
+static void
+nss_hash_update(struct nss_hash * hash, uint8 * data, uint32 len, char * msg)
+{
+	/* a saved state no longer matches */
+	if (hash->saved != NULL)
+	{
+		PORT_ZFree(hash->saved, hash->saved_len);
+		hash->saved = NULL;
+	}
+
+	SECStatus s = PK11_DigestOp(hash->context, data, len);
+	check(s, msg);
+}
+
+static void
+nss_hash_discard(struct nss_hash * hash)
+{
+	/* a borrowed spare goes back to its owner */
+	if (hash->owner != NULL)
+		hash->owner->lent = PR_FALSE;
+	else if (hash->context != NULL)
+		PK11_DestroyContext(hash->context, PR_TRUE);
+
+	if (hash->spare != NULL)
+		PK11_DestroyContext(hash->spare, PR_TRUE);
+	if (hash->saved != NULL)
+		PORT_ZFree(hash->saved, hash->saved_len);
+
+	memset(hash, 0, sizeof(*hash));
+}
+
+static void
+nss_hash_finish(struct nss_hash * hash, uint8 * out_data, unsigned int out_len, char * msg)
+{
+	unsigned int len;
+	SECStatus s = PK11_DigestFinal(hash->context, out_data, &len, out_len);
+	check(s, msg);
+	ASSERT(len == out_len);
+	nss_hash_discard(hash);
+}
+
+static RD_BOOL
+nss_hash_copy(struct nss_hash * dst, struct nss_hash * src, SECOidTag oid)
+{
+	memset(dst, 0, sizeof(*dst));
+
+	if (src->saved == NULL)
+		src->saved = PK11_SaveContextAlloc(src->context, NULL, 0, &src->saved_len);
+
+	if (src->saved != NULL && !src->lent)
+	{
+		if (src->spare == NULL)
+			src->spare = PK11_CreateDigestContext(oid);
+
+		if (src->spare != NULL &&
+		    PK11_RestoreContext(src->spare, src->saved, src->saved_len) == SECSuccess)
+		{
+			src->lent = PR_TRUE;
+			dst->context = src->spare;
+			dst->owner = src;
+			return True;
+		}
+	}
+
+	dst->context = PK11_CloneContext(src->context);
+	return dst->context != NULL;
+}
+
 CryptoSha1
 crypto_sha1_init(void)
 {
 	CryptoSha1 sha1 = xmalloc(sizeof(*sha1));
-	sha1->context = PK11_CreateDigestContext(SEC_OID_SHA1);
-	SECStatus s = PK11_DigestBegin(sha1->context);
-	check(s, "Error initializing sha1");
+	crypto_sha1_start(sha1);
 	return sha1;
 }
 
+void
+crypto_sha1_start(CryptoSha1 sha1)
+{
+	nss_hash_start(NSS_HASH(sha1), SEC_OID_SHA1, "Error initializing sha1");
+}
+
 void
 crypto_sha1_update(CryptoSha1 sha1, uint8 * data, uint32 len)
 {
-	SECStatus s = PK11_DigestOp(sha1->context, data, len);
-	check(s, "Error updating sha1");
+	nss_hash_update(NSS_HASH(sha1), data, len, "Error updating sha1");
+}
+
+void
+crypto_sha1_finish(CryptoSha1 sha1, uint8 * out_data)
+{
+	nss_hash_finish(NSS_HASH(sha1), out_data, 20, "Error finalizing sha1");
 }
 
 void
 crypto_sha1_final(CryptoSha1 sha1, uint8 * out_data)
 {
-	unsigned int len;
-	SECStatus s = PK11_DigestFinal(sha1->context, out_data, &len, 20);
-	check(s, "Error finalizing sha1");
-	ASSERT(len == 20);
-	PK11_DestroyContext(sha1->context, PR_TRUE);
+	crypto_sha1_finish(sha1, out_data);
 	xfree(sha1);
 }
 
-struct crypto_md5_struct
+RD_BOOL
+crypto_sha1_copy(CryptoSha1 dst, CryptoSha1 src)
 {
-	PK11Context * context;
-};
+	return nss_hash_copy(NSS_HASH(dst), NSS_HASH(src), SEC_OID_SHA1);
+}
+
+void
+crypto_sha1_discard(CryptoSha1 sha1)
+{
+	nss_hash_discard(NSS_HASH(sha1));
+}
 
 CryptoMd5
 crypto_md5_init(void)
 {
 	CryptoMd5 md5 = xmalloc(sizeof(*md5));
-	md5->context = PK11_CreateDigestContext(SEC_OID_MD5);
-	SECStatus s = PK11_DigestBegin(md5->context);
-	check(s, "Error initializing md5");
+	crypto_md5_start(md5);
 	return md5;
 }
 
+void
+crypto_md5_start(CryptoMd5 md5)
+{
+	nss_hash_start(NSS_HASH(md5), SEC_OID_MD5, "Error initializing md5");
+}
+
 void
 crypto_md5_update(CryptoMd5 md5, uint8 * data, uint32 len)
 {
-	SECStatus s = PK11_DigestOp(md5->context, data, len);
-	check(s, "Error updating md5");
+	nss_hash_update(NSS_HASH(md5), data, len, "Error updating md5");
+}
+
+void
+crypto_md5_finish(CryptoMd5 md5, uint8 * out_data)
+{
+	nss_hash_finish(NSS_HASH(md5), out_data, 16, "Error finalizing md5");
 }
 
 void
 crypto_md5_final(CryptoMd5 md5, uint8 * out_data)
 {
-	unsigned int len;
-	SECStatus s = PK11_DigestFinal(md5->context, out_data, &len, 16);
-	check(s, "Error finalizing md5");
-	ASSERT(len == 16);
-	PK11_DestroyContext(md5->context, PR_TRUE);
+	crypto_md5_finish(md5, out_data);
 	xfree(md5);
 }
 
-struct crypto_rc4_struct
+RD_BOOL
+crypto_md5_copy(CryptoMd5 dst, CryptoMd5 src)
 {
-	PK11Context * context;
-};
+	return nss_hash_copy(NSS_HASH(dst), NSS_HASH(src), SEC_OID_MD5);
+}
+
+void
+crypto_md5_discard(CryptoMd5 md5)
+{
+	nss_hash_discard(NSS_HASH(md5));
+}
+
+/* the rc4 state only holds the PK11Context pointer */
 
 CryptoRc4
 crypto_rc4_init(uint8 * key, uint32 len)
 {
 	CryptoRc4 rc4 = xmalloc(sizeof(*rc4));
+	crypto_rc4_setup(rc4, key, len);
+	return rc4;
+}
+
+void
+crypto_rc4_setup(CryptoRc4 rc4, uint8 * key, uint32 len)
+{
 	CK_MECHANISM_TYPE cipherMech = CKM_RC4;
 
 	PK11SlotInfo* slot = PK11_GetInternalKeySlot();
@@ -148,14 +274,12 @@ crypto_rc4_init(uint8 * key, uint32 len)
 	SECItem* secParam = PK11_ParamFromIV(cipherMech, NULL);
 	ASSERT(secParam);
 
-	rc4->context = PK11_CreateContextBySymKey(cipherMech, CKA_ENCRYPT, symKey, secParam);
-	ASSERT(rc4->context);
+	rc4->state.ptr = PK11_CreateContextBySymKey(cipherMech, CKA_ENCRYPT, symKey, secParam);
+	ASSERT(rc4->state.ptr);
 
 	PK11_FreeSymKey(symKey);
 	SECITEM_FreeItem(secParam, PR_TRUE);
 	PK11_FreeSlot(slot);
-
-	return rc4;
 }
 
 void
@@ -163,19 +287,30 @@ crypto_rc4(CryptoRc4 rc4, uint32 len, uint8 * in_data, uint8 * out_data)
 {
 	int outlen;
 	/* valgrind "Invalid read"? See http://groups.google.com/group/mozilla.dev.tech.crypto/browse_thread/thread/361c017b4aa5226f/43badd163bef22f2 */
-	SECStatus s = PK11_CipherOp(rc4->context, out_data, &outlen, len, in_data, len);
+	SECStatus s = PK11_CipherOp(rc4->state.ptr, out_data, &outlen, len, in_data, len);
 	check(s, "Error in rc4 encryption");
 	ASSERT(outlen == len);
 }
 
 void
-crypto_rc4_free(CryptoRc4 rc4)
+crypto_rc4_clear(CryptoRc4 rc4)
 {
 	unsigned int outLen;
-	SECStatus s = PK11_DigestFinal(rc4->context, NULL, &outLen, 0);
+
+	if (rc4->state.ptr == NULL)
+		return;
+
+	SECStatus s = PK11_DigestFinal(rc4->state.ptr, NULL, &outLen, 0);
 	check(s, "Error finalizing rc4");
 	ASSERT(!outLen);
-	PK11_DestroyContext(rc4->context, PR_TRUE);
+	PK11_DestroyContext(rc4->state.ptr, PR_TRUE);
+	rc4->state.ptr = NULL;
+}
+
+void
+crypto_rc4_free(CryptoRc4 rc4)
+{
+	crypto_rc4_clear(rc4);
 	xfree(rc4);
 }
 
@@ -21,7 +21,6 @@
 #include "crypto.h"
 #include <freerdp/types/base.h>
 #include <freerdp/utils/memory.h>
-#include <freerdp/utils/usleep.h>
 #include <freerdp/constants/constants.h>
 
 #include "tls.h"
@@ -40,65 +39,129 @@ crypto_global_finish(void)
 {
 }
 
+CRYPTO_STATE_CHECK(crypto_sha1_state_fits, SHA_CTX, CRYPTO_HASH_STATE_SIZE);
+CRYPTO_STATE_CHECK(crypto_md5_state_fits, MD5_CTX, CRYPTO_HASH_STATE_SIZE);
+CRYPTO_STATE_CHECK(crypto_rc4_state_fits, RC4_KEY, CRYPTO_RC4_STATE_SIZE);
+
 CryptoSha1
 crypto_sha1_init(void)
 {
 	CryptoSha1 sha1 = xmalloc(sizeof(*sha1));
-	SHA1_Init(&sha1->sha_ctx);
+	crypto_sha1_start(sha1);
 	return sha1;
 }
 
+void
+crypto_sha1_start(CryptoSha1 sha1)
+{
+	SHA1_Init(SHA1_STATE(sha1));
+}
+
 void
 crypto_sha1_update(CryptoSha1 sha1, uint8 * data, uint32 len)
 {
-	SHA1_Update(&sha1->sha_ctx, data, len);
+	SHA1_Update(SHA1_STATE(sha1), data, len);
+}
+
+void
+crypto_sha1_finish(CryptoSha1 sha1, uint8 * out_data)
+{
+	SHA1_Final(out_data, SHA1_STATE(sha1));
 }
 
 void
 crypto_sha1_final(CryptoSha1 sha1, uint8 * out_data)
 {
-	SHA1_Final(out_data, &sha1->sha_ctx);
+	crypto_sha1_finish(sha1, out_data);
 	xfree(sha1);
 }
 
+RD_BOOL
+crypto_sha1_copy(CryptoSha1 dst, CryptoSha1 src)
+{
+	*SHA1_STATE(dst) = *SHA1_STATE(src);
+	return True;
+}
+
+void
+crypto_sha1_discard(CryptoSha1 sha1)
+{
+}
+
 CryptoMd5
 crypto_md5_init(void)
 {
 	CryptoMd5 md5 = xmalloc(sizeof(*md5));
-	MD5_Init(&md5->md5_ctx);
+	crypto_md5_start(md5);
 	return md5;
 }
 
+void
+crypto_md5_start(CryptoMd5 md5)
+{
+	MD5_Init(MD5_STATE(md5));
+}
+
 void
 crypto_md5_update(CryptoMd5 md5, uint8 * data, uint32 len)
 {
-	MD5_Update(&md5->md5_ctx, data, len);
+	MD5_Update(MD5_STATE(md5), data, len);
+}
+
+void
+crypto_md5_finish(CryptoMd5 md5, uint8 * out_data)
+{
+	MD5_Final(out_data, MD5_STATE(md5));
 }
 
 void
 crypto_md5_final(CryptoMd5 md5, uint8 * out_data)
 {
-	MD5_Final(out_data, &md5->md5_ctx);
+	crypto_md5_finish(md5, out_data);
 	xfree(md5);
 }
 
+RD_BOOL
+crypto_md5_copy(CryptoMd5 dst, CryptoMd5 src)
+{
+	*MD5_STATE(dst) = *MD5_STATE(src);
+	return True;
+}
+
+void
+crypto_md5_discard(CryptoMd5 md5)
+{
+}
+
 CryptoRc4
 crypto_rc4_init(uint8 * key, uint32 len)
 {
 	CryptoRc4 rc4 = xmalloc(sizeof(*rc4));
-	RC4_set_key(&rc4->rc4_key, len, key);
+	crypto_rc4_setup(rc4, key, len);
 	return rc4;
 }
 
+void
+crypto_rc4_setup(CryptoRc4 rc4, uint8 * key, uint32 len)
+{
+	RC4_set_key(RC4_STATE(rc4), len, key);
+}
+
 void
 crypto_rc4(CryptoRc4 rc4, uint32 len, uint8 * in_data, uint8 * out_data)
 {
-	RC4(&rc4->rc4_key, len, in_data, out_data);
+	RC4(RC4_STATE(rc4), len, in_data, out_data);
+}
+
+void
+crypto_rc4_clear(CryptoRc4 rc4)
+{
 }
 
 void
 crypto_rc4_free(CryptoRc4 rc4)
 {
+	crypto_rc4_clear(rc4);
 	xfree(rc4);
 }
 
@@ -351,6 +414,8 @@ struct rdp_tls
 {
 	SSL_CTX * ctx;
 	SSL * ssl;
+	int sockfd;
+	RD_BOOL ktls;
 };
 
 RD_BOOL
@@ -401,16 +466,56 @@ tls_printf(char *func, SSL *connection, int val)
 	}
 }
 
+/* Wait on the socket for what the last SSL call asked for, returns False if it was not a retry */
+static RD_BOOL
+tls_wait(rdpTls * tls, int status)
+{
+	switch (SSL_get_error(tls->ssl, status))
+	{
+		case SSL_ERROR_WANT_READ:
+			tcp_can_recv(tls->sockfd, 100);
+			return True;
+		case SSL_ERROR_WANT_WRITE:
+			tcp_can_send(tls->sockfd, 100);
+			return True;
+		default:
+			return False;
+	}
+}
+
 /* Create TLS context */
 rdpTls *
-tls_new(void)
+tls_new(RD_BOOL ktls)
 {
 	rdpTls * tls;
 
 	tls = (rdpTls *) malloc(sizeof(rdpTls));
 	memset(tls, 0, sizeof(rdpTls));
 
-	tls->ctx = SSL_CTX_new(TLSv1_client_method());
+#ifdef SSL_OP_ENABLE_KTLS
+	/*
+	 * The kernel can not take over TLS 1.0 records, so kernel TLS allows the
+	 * version to be negotiated up to TLS 1.2. OpenSSL moves the record layer
+	 * into the kernel after the handshake when the kernel supports the cipher,
+	 * and keeps doing it in user space otherwise.
+	 */
+	if (ktls)
+	{
+		tls->ctx = SSL_CTX_new(TLS_client_method());
+		if (tls->ctx != NULL)
+		{
+			SSL_CTX_set_max_proto_version(tls->ctx, TLS1_2_VERSION);
+			SSL_CTX_set_options(tls->ctx, SSL_OP_ENABLE_KTLS);
+			tls->ktls = True;
+		}
+	}
+#else
+	if (ktls)
+		printf("kernel TLS is not supported by this OpenSSL version\n");
+#endif
+
+	if (tls->ctx == NULL)
+		tls->ctx = SSL_CTX_new(TLSv1_client_method());
 
 	if (tls->ctx == NULL)
 	{
@@ -460,12 +565,14 @@ tls_connect(rdpTls * tls, int sockfd)
 		return False;
 	}
 
+	tls->sockfd = sockfd;
+
 	do
 	{
-		/* SSL_WANT_READ errors are normal, just try again if it happens */
+		/* the socket is non-blocking, wait until the handshake can go on */
 		connection_status = SSL_connect(tls->ssl);
 	}
-	while (SSL_get_error(tls->ssl, connection_status) == SSL_ERROR_WANT_READ);
+	while (connection_status <= 0 && tls_wait(tls, connection_status));
 
 	if (connection_status < 0)
 	{
@@ -475,6 +582,15 @@ tls_connect(rdpTls * tls, int sockfd)
 
 	printf("TLS connection established\n");
 
+#ifdef BIO_get_ktls_send
+	if (tls->ktls)
+	{
+		printf("kernel TLS: send %s, receive %s\n",
+			BIO_get_ktls_send(SSL_get_wbio(tls->ssl)) ? "on" : "off",
+			BIO_get_ktls_recv(SSL_get_rbio(tls->ssl)) ? "on" : "off");
+	}
+#endif
+
 	return True;
 }
 
@@ -492,6 +608,8 @@ tls_disconnect(rdpTls * tls)
 		ret = SSL_shutdown(tls->ssl);
 		if (ret >= 0)
 			break;
+		if (tls_wait(tls, ret))
+			continue;
 		if (tls_printf("ssl_disconnect", tls->ssl, ret))
 			break;
 	}
@@ -516,8 +634,9 @@ tls_write(rdpTls * tls, char* b, int length)
 				bytesWritten += write_status;
 				break;
 
+			case SSL_ERROR_WANT_READ:
 			case SSL_ERROR_WANT_WRITE:
-				freerdp_usleep(1000);
+				tls_wait(tls, write_status);
 				break;
 
 			default:
@@ -546,7 +665,8 @@ tls_read(rdpTls * tls, char* b, int length)
 				break;
 
 			case SSL_ERROR_WANT_READ:
-				freerdp_usleep(1000);
+			case SSL_ERROR_WANT_WRITE:
+				tls_wait(tls, status);
 				break;
 
 			default:
@@ -559,6 +679,17 @@ tls_read(rdpTls * tls, char* b, int length)
 	return 0;
 }
 
+/* True when tls_read can return data without waiting on the socket */
+RD_BOOL
+tls_pending(rdpTls * tls)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+	return SSL_has_pending(tls->ssl);
+#else
+	return SSL_pending(tls->ssl) > 0;
+#endif
+}
+
 CryptoCert
 tls_get_certificate(rdpTls * tls)
 {
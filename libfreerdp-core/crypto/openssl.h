@@ -35,20 +35,9 @@
 #define D2I_X509_CONST
 #endif
 
-struct crypto_sha1_struct
-{
-	SHA_CTX sha_ctx;
-};
-
-struct crypto_md5_struct
-{
-	MD5_CTX md5_ctx;
-};
-
-struct crypto_rc4_struct
-{
-	RC4_KEY rc4_key;
-};
+#define SHA1_STATE(_sha1) ((SHA_CTX *) (_sha1)->state.data)
+#define MD5_STATE(_md5) ((MD5_CTX *) (_md5)->state.data)
+#define RC4_STATE(_rc4) ((RC4_KEY *) (_rc4)->state.data)
 
 struct crypto_cert_struct
 {
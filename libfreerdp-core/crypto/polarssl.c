@@ -40,82 +40,135 @@ crypto_global_finish(void)
 }
 
 
-struct crypto_sha1_struct
-{
-	sha1_context ctx;
-};
+#define SHA1_STATE(_sha1) ((sha1_context *) (_sha1)->state.data)
+#define MD5_STATE(_md5) ((md5_context *) (_md5)->state.data)
+#define RC4_STATE(_rc4) ((arc4_context *) (_rc4)->state.data)
+
+CRYPTO_STATE_CHECK(crypto_sha1_state_fits, sha1_context, CRYPTO_HASH_STATE_SIZE);
+CRYPTO_STATE_CHECK(crypto_md5_state_fits, md5_context, CRYPTO_HASH_STATE_SIZE);
+CRYPTO_STATE_CHECK(crypto_rc4_state_fits, arc4_context, CRYPTO_RC4_STATE_SIZE);
 
 CryptoSha1
 crypto_sha1_init(void)
 {
 	CryptoSha1 sha1 = xmalloc(sizeof(*sha1));
-	sha1_starts(&sha1->ctx);
+	crypto_sha1_start(sha1);
 	return sha1;
 }
 
+void
+crypto_sha1_start(CryptoSha1 sha1)
+{
+	sha1_starts(SHA1_STATE(sha1));
+}
+
 void
 crypto_sha1_update(CryptoSha1 sha1, uint8 * data, uint32 len)
 {
-	sha1_update(&sha1->ctx, data, len);
+	sha1_update(SHA1_STATE(sha1), data, len);
+}
+
+void
+crypto_sha1_finish(CryptoSha1 sha1, uint8 * out_data)
+{
+	sha1_finish(SHA1_STATE(sha1), out_data);
 }
 
 void
 crypto_sha1_final(CryptoSha1 sha1, uint8 * out_data)
 {
-	sha1_finish(&sha1->ctx, out_data);
+	crypto_sha1_finish(sha1, out_data);
 	xfree(sha1);
 }
 
+RD_BOOL
+crypto_sha1_copy(CryptoSha1 dst, CryptoSha1 src)
+{
+	*SHA1_STATE(dst) = *SHA1_STATE(src);
+	return True;
+}
 
-struct crypto_md5_struct
+void
+crypto_sha1_discard(CryptoSha1 sha1)
 {
-	md5_context ctx;
-};
+}
+
 
 CryptoMd5
 crypto_md5_init(void)
 {
 	CryptoMd5 md5 = xmalloc(sizeof(*md5));
-	md5_starts(&md5->ctx);
+	crypto_md5_start(md5);
 	return md5;
 }
 
+void
+crypto_md5_start(CryptoMd5 md5)
+{
+	md5_starts(MD5_STATE(md5));
+}
+
 void
 crypto_md5_update(CryptoMd5 md5, uint8 * data, uint32 len)
 {
-	md5_update(&md5->ctx, data, len);
+	md5_update(MD5_STATE(md5), data, len);
+}
+
+void
+crypto_md5_finish(CryptoMd5 md5, uint8 * out_data)
+{
+	md5_finish(MD5_STATE(md5), out_data);
 }
 
 void
 crypto_md5_final(CryptoMd5 md5, uint8 * out_data)
 {
-	md5_finish(&md5->ctx, out_data);
+	crypto_md5_finish(md5, out_data);
 	xfree(md5);
 }
 
+RD_BOOL
+crypto_md5_copy(CryptoMd5 dst, CryptoMd5 src)
+{
+	*MD5_STATE(dst) = *MD5_STATE(src);
+	return True;
+}
 
-struct crypto_rc4_struct
+void
+crypto_md5_discard(CryptoMd5 md5)
 {
-	arc4_context ctx;
-};
+}
+
 
 CryptoRc4
 crypto_rc4_init(uint8 * key, uint32 len)
 {
 	CryptoRc4 rc4 = xmalloc(sizeof(*rc4));
-	arc4_setup(&rc4->ctx, key, len);
+	crypto_rc4_setup(rc4, key, len);
 	return rc4;
 }
 
+void
+crypto_rc4_setup(CryptoRc4 rc4, uint8 * key, uint32 len)
+{
+	arc4_setup(RC4_STATE(rc4), key, len);
+}
+
 void
 crypto_rc4(CryptoRc4 rc4, uint32 len, uint8 * in_data, uint8 * out_data)
 {
-	arc4_crypt(&rc4->ctx, len, in_data, out_data);
+	arc4_crypt(RC4_STATE(rc4), len, in_data, out_data);
+}
+
+void
+crypto_rc4_clear(CryptoRc4 rc4)
+{
 }
 
 void
 crypto_rc4_free(CryptoRc4 rc4)
 {
+	crypto_rc4_clear(rc4);
 	xfree(rc4);
 }
 
@@ -54,7 +54,7 @@ ui_warning(rdpInst * inst, char * format, ...);
 void
 ui_unimpl(rdpInst * inst, char * format, ...);
 int
-load_license(unsigned char ** data);
+load_license(char * name, unsigned char ** data);
 RD_BOOL
 rd_lock_file(int fd, int start, int len);
 int
@@ -69,10 +69,16 @@ int
 rd_read_file(int fd, void * ptr, int len);
 int
 rd_open_file(char * filename);
+void *
+rd_map_file(int fd, int size);
+void
+rd_unmap_file(void * map, int size);
 void
 generate_random(uint8 * random);
 void
-save_license(unsigned char * data, int length);
+save_license(char * name, unsigned char * data, int length);
+void
+delete_license(char * name);
 void
 ui_begin_update(rdpInst * inst);
 void
@@ -167,5 +173,11 @@ ui_decode(rdpInst * inst, uint8 * data, int data_size);
 RD_BOOL
 ui_check_certificate(rdpInst * inst, const char * fingerprint,
 		const char * subject, const char * issuer, RD_BOOL verified);
+void
+ui_draw_orders(rdpInst * inst, RD_ORDER * orders, int count);
+void
+ui_rects(rdpInst * inst, RD_RECT * rects, int count, uint32 color);
+void
+ui_reconnected(rdpInst * inst);
 
 #endif
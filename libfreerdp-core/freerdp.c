@@ -17,17 +17,27 @@
 */
 
 #include <stdarg.h>
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
 #include "frdp.h"
 #include "rdp.h"
 #include "security.h"
 #include "mcs.h"
 #include "iso.h"
 #include "tcp.h"
+#include "network.h"
 #include "chan.h"
+#include "cache.h"
 #include "ext.h"
 #include <freerdp/freerdp.h>
 #include <freerdp/utils/memory.h>
 #include <freerdp/utils/hexdump.h>
+#include <freerdp/utils/usleep.h>
 
 #define RDP_FROM_INST(_inst) ((rdpRdp *) (_inst->rdp))
 
@@ -91,12 +101,208 @@ ui_unimpl(rdpInst * inst, char * format, ...)
 	xfree(text2);
 }
 
+#ifndef _WIN32
+
+/* files are kept below ~/.freerdp */
+static int
+rd_get_path(char * path, int size, char * filename)
+{
+	char * home;
+
+	home = getenv("HOME");
+	if (home == NULL)
+		return 0;
+
+	if (filename == NULL)
+		snprintf(path, size, "%s/.freerdp", home);
+	else
+		snprintf(path, size, "%s/.freerdp/%s", home, filename);
+
+	return 1;
+}
+
+RD_BOOL
+rd_lock_file(int fd, int start, int len)
+{
+	struct flock lock;
+
+	lock.l_type = F_WRLCK;
+	lock.l_whence = SEEK_SET;
+	lock.l_start = start;
+	lock.l_len = len;
+
+	if (fcntl(fd, F_SETLK, &lock) == -1)
+		return False;
+
+	return True;
+}
+
 int
-load_license(unsigned char ** data)
+rd_lseek_file(int fd, int offset)
 {
-	return 0;
+	return lseek(fd, offset, SEEK_SET);
+}
+
+int
+rd_write_file(int fd, void * ptr, int len)
+{
+	return write(fd, ptr, len);
+}
+
+RD_BOOL
+rd_pstcache_mkdir(void)
+{
+	char path[256];
+
+	if (!rd_get_path(path, sizeof(path), NULL))
+		return False;
+
+	if ((mkdir(path, 0700) == -1) && (errno != EEXIST))
+		return False;
+
+	if (!rd_get_path(path, sizeof(path), "cache"))
+		return False;
+
+	if ((mkdir(path, 0700) == -1) && (errno != EEXIST))
+		return False;
+
+	return True;
+}
+
+void
+rd_close_file(int fd)
+{
+	close(fd);
+}
+
+int
+rd_read_file(int fd, void * ptr, int len)
+{
+	return read(fd, ptr, len);
+}
+
+int
+rd_open_file(char * filename)
+{
+	char path[256];
+
+	if (!rd_get_path(path, sizeof(path), filename))
+		return -1;
+
+	return open(path, O_RDWR | O_CREAT, 0600);
+}
+
+/* Map size bytes of a file, growing the file if needed */
+void *
+rd_map_file(int fd, int size)
+{
+	void * map;
+	struct stat st;
+
+	if (fstat(fd, &st) == -1)
+		return NULL;
+
+	if ((st.st_size < size) && (ftruncate(fd, size) == -1))
+		return NULL;
+
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		return NULL;
+
+	return map;
+}
+
+void
+rd_unmap_file(void * map, int size)
+{
+	munmap(map, size);
+}
+
+/* license blobs are kept in ~/.freerdp/licenses, one file per name */
+int
+load_license(char * name, unsigned char ** data)
+{
+	char path[256];
+	char filename[192];
+	struct stat st;
+	int length;
+	int fd;
+
+	snprintf(filename, sizeof(filename), "licenses/%s", name);
+	if (!rd_get_path(path, sizeof(path), filename))
+		return 0;
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1)
+		return 0;
+
+	length = 0;
+	if ((fstat(fd, &st) == 0) && (st.st_size > 0) && (st.st_size <= 0xFFFF))
+	{
+		*data = (unsigned char *) xmalloc(st.st_size);
+		length = read(fd, *data, st.st_size);
+		if (length != st.st_size)
+		{
+			xfree(*data);
+			length = 0;
+		}
+	}
+	close(fd);
+
+	return length;
+}
+
+/* Write to a temporary file first, a crash never leaves half a license */
+void
+save_license(char * name, unsigned char * data, int length)
+{
+	char path[256];
+	char tmp_path[260];
+	char filename[192];
+	int fd;
+
+	if (!rd_get_path(path, sizeof(path), NULL))
+		return;
+	if ((mkdir(path, 0700) == -1) && (errno != EEXIST))
+		return;
+	if (!rd_get_path(path, sizeof(path), "licenses"))
+		return;
+	if ((mkdir(path, 0700) == -1) && (errno != EEXIST))
+		return;
+
+	snprintf(filename, sizeof(filename), "licenses/%s", name);
+	if (!rd_get_path(path, sizeof(path), filename))
+		return;
+	snprintf(tmp_path, sizeof(tmp_path), "%s.new", path);
+
+	fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd == -1)
+		return;
+	if (write(fd, data, length) != length)
+	{
+		close(fd);
+		unlink(tmp_path);
+		return;
+	}
+	close(fd);
+
+	if (rename(tmp_path, path) == -1)
+		unlink(tmp_path);
 }
 
+void
+delete_license(char * name)
+{
+	char path[256];
+	char filename[192];
+
+	snprintf(filename, sizeof(filename), "licenses/%s", name);
+	if (rd_get_path(path, sizeof(path), filename))
+		unlink(path);
+}
+
+#else
+
 RD_BOOL
 rd_lock_file(int fd, int start, int len)
 {
@@ -138,6 +344,35 @@ rd_open_file(char * filename)
 	return 0;
 }
 
+void *
+rd_map_file(int fd, int size)
+{
+	return NULL;
+}
+
+void
+rd_unmap_file(void * map, int size)
+{
+}
+
+int
+load_license(char * name, unsigned char ** data)
+{
+	return 0;
+}
+
+void
+save_license(char * name, unsigned char * data, int length)
+{
+}
+
+void
+delete_license(char * name)
+{
+}
+
+#endif
+
 void
 generate_random(uint8 * random)
 {
@@ -151,11 +386,6 @@ generate_random(uint8 * random)
 	}
 }
 
-void
-save_license(unsigned char * data, int length)
-{
-}
-
 void
 ui_begin_update(rdpInst * inst)
 {
@@ -421,6 +651,25 @@ ui_check_certificate(rdpInst * inst, const char * fingerprint,
 	return inst->ui_check_certificate(inst, fingerprint, subject, issuer, verified);
 }
 
+void
+ui_draw_orders(rdpInst * inst, RD_ORDER * orders, int count)
+{
+	inst->ui_draw_orders(inst, orders, count);
+}
+
+void
+ui_rects(rdpInst * inst, RD_RECT * rects, int count, uint32 color)
+{
+	inst->ui_rects(inst, rects, count, color);
+}
+
+void
+ui_reconnected(rdpInst * inst)
+{
+	if (inst->ui_reconnected != NULL)
+		inst->ui_reconnected(inst);
+}
+
 /* returns error */
 static int
 l_rdp_connect(rdpInst * inst)
@@ -459,6 +708,38 @@ l_rdp_get_fds(rdpInst * inst, void ** read_fds, int * read_count,
 }
 
 /* Process receivable fds, return true if connection should live on */
+/* Only a dropped connection is resumed, not one the server or user ended */
+static RD_BOOL
+rdp_can_auto_reconnect(rdpRdp * rdp)
+{
+	return rdp->settings->auto_reconnect > 0 && rdp->arc_valid &&
+		!rdp->disconnect_requested && rdp->inst->disc_reason == 0;
+}
+
+/* Resume the session with the auto-reconnect cookie; the caches survive
+   rdp_reconnect so the server can refer to bitmaps it sent before */
+static int
+l_rdp_auto_reconnect(rdpRdp * rdp)
+{
+	int attempt;
+
+	for (attempt = 0; attempt < rdp->settings->auto_reconnect; attempt++)
+	{
+		if (attempt > 0)
+			freerdp_usleep(attempt * 500 * 1000);
+		ui_warning(rdp->inst, "connection lost, reconnecting (%d/%d)\n",
+			attempt + 1, rdp->settings->auto_reconnect);
+		if (rdp_reconnect(rdp))
+		{
+			ui_reconnected(rdp->inst);
+			return 0;
+		}
+		if (rdp->disconnect_requested)
+			break;
+	}
+	return 1;
+}
+
 static int
 l_rdp_check_fds(rdpInst * inst)
 {
@@ -471,21 +752,34 @@ l_rdp_check_fds(rdpInst * inst)
 	WSAResetEvent(rdp->net->tcp->wsa_event);
 #endif
 	rv = 0;
-	if (tcp_can_recv(rdp->net->tcp->sockfd, 0))
+	if (network_pending(rdp->net) > 0 || tcp_can_recv(rdp->net->tcp->sockfd, 0))
 	{
-		if (!rdp_loop(rdp, &deactivated))
+		/* PDUs already read ahead would not wake up the select on the socket */
+		network_begin_batch(rdp->net);
+		do
 		{
-			rv = 1;
+			if (!rdp_loop(rdp, &deactivated))
+			{
+				rv = 1;
+				break;
+			}
 		}
+		while (network_pending(rdp->net) > 0);
+		network_end_batch(rdp->net);
 	}
 	if ((rv != 0) && rdp->redirect)
 	{
 		rdp->redirect = False;
 		if (rdp_reconnect(rdp))
 		{
+			ui_reconnected(inst);
 			rv = 0;
 		}
 	}
+	else if ((rv != 0) && rdp_can_auto_reconnect(rdp))
+	{
+		rv = l_rdp_auto_reconnect(rdp);
+	}
 	return rv;
 }
 
@@ -525,6 +819,15 @@ l_rdp_sync_input(rdpInst * inst, int toggle_flags)
 	return 0;
 }
 
+static int
+l_rdp_send_input_flush(rdpInst * inst)
+{
+	rdpRdp * rdp;
+	rdp = RDP_FROM_INST(inst);
+	rdp_send_input_flush(rdp);
+	return 0;
+}
+
 static int
 l_rdp_channel_data(rdpInst * inst, int chan_id, char * data, int data_size)
 {
@@ -563,6 +866,14 @@ l_rdp_send_frame_ack(rdpInst * inst, int frame_id)
 	return 0;
 }
 
+static void
+l_rdp_get_offscreen_stats(rdpInst * inst, RD_OFFSCREEN_STATS * stats)
+{
+	rdpRdp * rdp;
+	rdp = RDP_FROM_INST(inst);
+	cache_get_surface_stats(rdp->cache, stats);
+}
+
 FREERDP_API RD_BOOL
 freerdp_global_init(void)
 {
@@ -581,6 +892,7 @@ freerdp_new(rdpSet * settings)
 	rdpInst * inst;
 
 	inst = (rdpInst *) xmalloc(sizeof(rdpInst));
+	memset(inst, 0, sizeof(rdpInst));
 	inst->version = FREERDP_INTERFACE_VERSION;
 	inst->size = sizeof(rdpInst);
 	inst->settings = settings;
@@ -595,6 +907,8 @@ freerdp_new(rdpSet * settings)
 	inst->rdp_suppress_output = l_rdp_suppress_output;
 	inst->rdp_disconnect = l_rdp_disconnect;
 	inst->rdp_send_frame_ack = l_rdp_send_frame_ack;
+	inst->rdp_send_input_flush = l_rdp_send_input_flush;
+	inst->rdp_get_offscreen_stats = l_rdp_get_offscreen_stats;
 	inst->rdp = (void *) rdp_new(settings, inst);
 	inst->disc_reason = 0;
 	return inst;
@@ -305,13 +305,13 @@ iso_send(rdpIso * iso, STREAM s)
 
 /* Send an fast path data PDU */
 void
-iso_fp_send(rdpIso * iso, STREAM s, uint32 flags)
+iso_fp_send(rdpIso * iso, STREAM s, uint32 flags, int num_events)
 {
 	int fp_flags;
 	int len;
 	int index;
 
-	fp_flags = (1 << 2) | 0;	/* one event, fast path */
+	fp_flags = (num_events << 2) | 0;	/* numberEvents, fast path */
 	if (flags & SEC_ENCRYPT)
 	{
 		fp_flags |= 2 << 6;	/* FASTPATH_INPUT_ENCRYPTED */
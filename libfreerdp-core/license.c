@@ -17,6 +17,8 @@
    limitations under the License.
 */
 
+#include <time.h>
+#include <ctype.h>
 #include "frdp.h"
 #include "crypto.h"
 #include "security.h"
@@ -26,6 +28,98 @@
 
 #include "license.h"
 
+/* cached license file: magic, version, save time and length, then the blob */
+#define LICENSE_CACHE_MAGIC	0x4C435246	/* "FRCL" */
+#define LICENSE_CACHE_VERSION	1
+#define LICENSE_CACHE_HEADER	16
+/* temporary CALs last 90 days and the server upgrades a presented license
+   before it runs out, anything older would only be refused */
+#define LICENSE_CACHE_MAX_AGE	(90 * 24 * 60 * 60)
+
+/* Name of the cached license of this server for this client hostname */
+static char *
+license_cache_name(rdpLicense * license)
+{
+	rdpRdp * rdp;
+	char * server;
+	char * p;
+
+	if (license->cache_name[0] == 0)
+	{
+		rdp = license->net->rdp;
+		server = rdp->redirect_server ? rdp->redirect_server : rdp->settings->server;
+		snprintf(license->cache_name, sizeof(license->cache_name), "%s-%s",
+			rdp->settings->hostname, server);
+		for (p = license->cache_name; *p != 0; p++)
+		{
+			if (!isalnum((unsigned char) *p) && (*p != '.') && (*p != '-') && (*p != '_'))
+				*p = '_';
+		}
+	}
+	return license->cache_name;
+}
+
+/* Load the cached license blob, a corrupt or expired one is removed */
+int
+license_cache_load(rdpLicense * license, uint8 ** data)
+{
+	struct stream s;
+	uint8 * file;
+	int size;
+	uint32 magic;
+	uint32 version;
+	uint32 saved;
+	uint32 length;
+	uint32 now;
+
+	size = load_license(license_cache_name(license), &file);
+	if (size <= 0)
+		return 0;
+
+	magic = version = saved = length = 0;
+	if (size >= LICENSE_CACHE_HEADER)
+	{
+		s.data = s.p = file;
+		s.size = size;
+		s.end = file + size;
+		in_uint32_le(&s, magic);
+		in_uint32_le(&s, version);
+		in_uint32_le(&s, saved);
+		in_uint32_le(&s, length);
+	}
+
+	now = (uint32) time(NULL);
+	if ((magic != LICENSE_CACHE_MAGIC) || (version != LICENSE_CACHE_VERSION) ||
+		(length == 0) || (length != size - LICENSE_CACHE_HEADER) ||
+		(now - saved > LICENSE_CACHE_MAX_AGE))
+	{
+		DEBUG_LICENSE("dropping cached license %s", license->cache_name);
+		delete_license(license->cache_name);
+		xfree(file);
+		return 0;
+	}
+
+	*data = (uint8 *) xmalloc(length);
+	memcpy(*data, file + LICENSE_CACHE_HEADER, length);
+	xfree(file);
+	return length;
+}
+
+void
+license_cache_save(rdpLicense * license, uint8 * data, int length)
+{
+	uint8 * file;
+
+	file = (uint8 *) xmalloc(LICENSE_CACHE_HEADER + length);
+	buf_out_uint32(file, LICENSE_CACHE_MAGIC);
+	buf_out_uint32(file + 4, LICENSE_CACHE_VERSION);
+	buf_out_uint32(file + 8, (uint32) time(NULL));
+	buf_out_uint32(file + 12, length);
+	memcpy(file + LICENSE_CACHE_HEADER, data, length);
+	save_license(license_cache_name(license), file, LICENSE_CACHE_HEADER + length);
+	xfree(file);
+}
+
 /* Generate a session key and RC4 keys, given client and server randoms */
 static void
 license_generate_keys(rdpLicense * license, uint8 * client_random, uint8 * server_random,
@@ -190,7 +284,10 @@ license_process_request(rdpLicense * license, STREAM s)
 	memset(null_data, 0, sizeof(null_data));
 	license_generate_keys(license, null_data, server_random, null_data);
 
-	license_size = load_license(&license_data);
+	/* A cached license goes into Client License Information instead of a
+	   New License Request. The server still sends a Platform Challenge,
+	   but answers the response without issuing a new license */
+	license_size = license_cache_load(license, &license_data);
 	if (license_size > 0)
 	{
 		/* Generate a signature for the HWID buffer */
@@ -203,6 +300,7 @@ license_process_request(rdpLicense * license, STREAM s)
 		crypto_rc4_free(crypt_key);
 
 		license_present(license, null_data, null_data, license_data, license_size, hwid, signature);
+		license->license_presented = True;
 		xfree(license_data);
 		return;
 	}
@@ -300,7 +398,7 @@ license_process_platform_challenge(rdpLicense * license, STREAM s)
 	license_send_authresp(license, out_token, crypt_hwid, out_sig);
 }
 
-/* Process a Server New (or Upgrade) License packet */
+/* Process a Server New (or Upgrade) License packet, both have the same layout */
 static void
 license_process_new_license(rdpLicense * license, STREAM s)
 {
@@ -340,7 +438,7 @@ license_process_new_license(rdpLicense * license, STREAM s)
 	if (!s_check_rem(s, length))
 		return;
 	license->license_issued = True;
-	save_license(s->p, length);
+	license_cache_save(license, s->p, length);
 }
 
 /* Process a Licensing packet */
@@ -377,6 +475,7 @@ license_process(rdpLicense * license, STREAM s)
 
 		case UPGRADE_LICENSE:
 			DEBUG_LICENSE("UPGRADE_LICENSE");
+			license_process_new_license(license, s);
 			break;
 
 		case LICENSE_ERROR_ALERT:
@@ -387,6 +486,12 @@ license_process(rdpLicense * license, STREAM s)
 				in_uint32_le(s, dwErrorCode);
 				in_uint32_le(s, dwStateTransition);
 				DEBUG_LICENSE("dwErrorCode %x dwStateTransition %x", dwErrorCode, dwStateTransition);
+				if ((dwErrorCode != STATUS_VALID_CLIENT) && license->license_presented)
+				{
+					/* the server did not take the cached license, get a new one next time */
+					delete_license(license_cache_name(license));
+					license->license_presented = False;
+				}
 				in_uint16_le(s, wBlobType);
 				in_uint16_le(s, wBlobLen);
 				DEBUG_LICENSE("bbErrorInfo: wBlobType %x wBlobLen %x", wBlobType, wBlobLen);
@@ -31,9 +31,15 @@ struct rdp_license
 	uint8 license_key[16];
 	uint8 license_sign_key[16];
 	RD_BOOL license_issued;
+	RD_BOOL license_presented; /* a cached license was sent */
+	char cache_name[128];
 };
 typedef struct rdp_license rdpLicense;
 
+int
+license_cache_load(rdpLicense * license, uint8 ** data);
+void
+license_cache_save(rdpLicense * license, uint8 * data, int length);
 void
 license_process(rdpLicense * license, STREAM s);
 rdpLicense *
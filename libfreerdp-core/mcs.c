@@ -291,9 +291,9 @@ mcs_send(rdpMcs * mcs, STREAM s)
 
 /* Send a fast path data packet to the global channel */
 void
-mcs_fp_send(rdpMcs * mcs, STREAM s, uint32 flags)
+mcs_fp_send(rdpMcs * mcs, STREAM s, uint32 flags, int num_events)
 {
-	iso_fp_send(mcs->iso, s, flags);
+	iso_fp_send(mcs->iso, s, flags, num_events);
 }
 
 /* Receive an MCS transport data packet */
@@ -324,6 +324,10 @@ mcs_recv(rdpMcs * mcs, isoRecvType * ptype, uint16 * channel)
 			{
 				ui_error(mcs->net->rdp->inst, "expected data, got %d\n", pduType);
 			}
+			else
+			{
+				mcs->net->rdp->disconnect_requested = True;
+			}
 			return NULL;
 		}
 
@@ -42,7 +42,7 @@ mcs_send_to_channel(rdpMcs * mcs, STREAM s, uint16 channel);
 void
 mcs_send(rdpMcs * mcs, STREAM s);
 void
-mcs_fp_send(rdpMcs * mcs, STREAM s, uint32 flags);
+mcs_fp_send(rdpMcs * mcs, STREAM s, uint32 flags, int num_events);
 STREAM
 mcs_recv(rdpMcs * mcs, isoRecvType * ptype, uint16 * channel);
 RD_BOOL
@@ -22,6 +22,12 @@
 
 #include "network.h"
 
+/* Received bytes are read ahead into this buffer and the PDUs taken out of it */
+#define NETWORK_RECV_BUFFER_SIZE	0x10000
+
+/* Batched PDUs are written once this much is queued, the size of a TLS record */
+#define NETWORK_SEND_BATCH_SIZE		0x4000
+
 /* Initialize and return STREAM.
  * The stream will have room for at least min_size.
  * The tcp layers out stream will be used. */
@@ -111,7 +117,7 @@ RD_BOOL
 network_connect_tls(rdpNetwork * net)
 {
 	RD_BOOL status = False;
-	net->tls = tls_new();
+	net->tls = tls_new(net->rdp->settings->tls_kernel_offload);
 
 	if (!tls_connect(net->tls, net->tcp->sockfd))
 		return False;
@@ -133,7 +139,7 @@ network_connect_nla(rdpNetwork * net)
 	/* TLS with NLA was successfully negotiated */
 
 	RD_BOOL status = 1;
-	net->tls = tls_new();
+	net->tls = tls_new(net->rdp->settings->tls_kernel_offload);
 
 	if (!tls_connect(net->tls, net->tcp->sockfd))
 		return False;
@@ -173,6 +179,7 @@ network_connect(rdpNetwork * net, char* server, char* username, int port)
 	net->server = server;
 	net->username = username;
 	net->license->license_issued = 0;
+	net->recv_p = net->recv_end = net->recv_buf;
 
 	if (net->rdp->settings->nla_security)
 		nego->enabled_protocols[PROTOCOL_NLA] = 1;
@@ -214,21 +221,124 @@ network_disconnect(rdpNetwork * net)
 		tls_disconnect(net->tls);
 #endif
 	tcp_disconnect(net->tcp);
+	net->recv_p = net->recv_end = net->recv_buf;
+	net->send_length = 0;
+	net->send_batch = 0;
+}
+
+static void
+network_write(rdpNetwork * net, uint8 * b, int length)
+{
+#ifndef DISABLE_TLS
+	if (net->tls_connected)
+	{
+		tls_write(net->tls, (char*) b, length);
+	}
+	else
+#endif
+	{
+		tcp_write(net->tcp, (char*) b, length);
+	}
+}
+
+/* Write the batched PDUs in one go */
+void
+network_flush(rdpNetwork * net)
+{
+	if (net->send_length > 0)
+	{
+		network_write(net, net->send_buf, net->send_length);
+		net->send_length = 0;
+	}
+}
+
+/* PDUs sent until the matching network_end_batch are written together */
+void
+network_begin_batch(rdpNetwork * net)
+{
+	net->send_batch++;
+}
+
+void
+network_end_batch(rdpNetwork * net)
+{
+	if (--net->send_batch == 0)
+		network_flush(net);
 }
 
 void
 network_send(rdpNetwork * net, STREAM s)
 {
+	int length = s->end - s->data;
+
+	if (net->send_batch == 0)
+	{
+		network_flush(net);
+		network_write(net, s->data, length);
+		return;
+	}
+
+	if (net->send_length + length > net->send_size)
+	{
+		net->send_size = net->send_length + length;
+		net->send_buf = (uint8 *) xrealloc(net->send_buf, net->send_size);
+	}
+
+	memcpy(net->send_buf + net->send_length, s->data, length);
+	net->send_length += length;
+
+	if (net->send_length >= NETWORK_SEND_BATCH_SIZE)
+		network_flush(net);
+}
+
+/* Read what the transport has, up to length bytes */
+static int
+network_read(rdpNetwork * net, uint8 * b, int length)
+{
+	/* the peer may be waiting for what is batched before it sends more */
+	network_flush(net);
+
 #ifndef DISABLE_TLS
 	if (net->tls_connected)
 	{
-		tls_write(net->tls, (char*) s->data, s->end - s->data);
+		/* wait in the ui like tcp_read does, unless a record is already buffered */
+		if (!tls_pending(net->tls) && !ui_select(net->rdp->inst, net->tcp->sockfd))
+			return -1; /* user quit */
+
+		return tls_read(net->tls, (char*) b, length);
 	}
-	else
 #endif
+	return tcp_read(net->tcp, (char*) b, length);
+}
+
+/* Refill the receive buffer with one read, the unread bytes are moved to the front first */
+static RD_BOOL
+network_fill(rdpNetwork * net)
+{
+	int rcvd;
+	int unread;
+
+	unread = net->recv_end - net->recv_p;
+	if (net->recv_p != net->recv_buf)
 	{
-		tcp_write(net->tcp, (char*) s->data, s->end - s->data);
+		memmove(net->recv_buf, net->recv_p, unread);
+		net->recv_p = net->recv_buf;
+		net->recv_end = net->recv_buf + unread;
 	}
+
+	rcvd = network_read(net, net->recv_end, NETWORK_RECV_BUFFER_SIZE - unread);
+	if (rcvd < 0)
+		return False;
+
+	net->recv_end += rcvd;
+	return True;
+}
+
+/* Number of received bytes not yet taken by network_recv */
+int
+network_pending(rdpNetwork * net)
+{
+	return net->recv_end - net->recv_p;
 }
 
 STREAM
@@ -268,20 +378,27 @@ network_recv(rdpNetwork * net, STREAM s, uint32 length)
 
 	while (length > 0)
 	{
-#ifndef DISABLE_TLS
-		if (net->tls_connected)
+		if (net->recv_p == net->recv_end)
 		{
-			rcvd = tls_read(net->tls, (char*) s->end, length);
+			/* large PDUs are read in place once the buffer is empty */
+			if (length >= NETWORK_RECV_BUFFER_SIZE / 2)
+			{
+				rcvd = network_read(net, s->end, length);
+				if (rcvd < 0)
+					return NULL;
+
+				s->end += rcvd;
+				length -= rcvd;
+				continue;
+			}
+
+			if (!network_fill(net))
+				return NULL;
 		}
-		else
-#endif
-		{
-			rcvd = tcp_read(net->tcp, (char*) s->end, length);
-		}
-
-		if (rcvd < 0)
-			return NULL;
 
+		rcvd = MIN(net->recv_end - net->recv_p, length);
+		memcpy(s->end, net->recv_p, rcvd);
+		net->recv_p += rcvd;
 		s->end += rcvd;
 		length -= rcvd;
 	}
@@ -313,6 +430,9 @@ network_new(rdpRdp * rdp)
 
 		self->out.size = 4096;
 		self->out.data = (uint8 *) xmalloc(self->out.size);
+
+		self->recv_buf = (uint8 *) xmalloc(NETWORK_RECV_BUFFER_SIZE);
+		self->recv_p = self->recv_end = self->recv_buf;
 	}
 
 	return self;
@@ -325,6 +445,8 @@ network_free(rdpNetwork * net)
 	{
 		xfree(net->in.data);
 		xfree(net->out.data);
+		xfree(net->recv_buf);
+		xfree(net->send_buf);
 
 		if (net->tcp != NULL)
 			tcp_free(net->tcp);
@@ -40,6 +40,13 @@ struct rdp_network
 	char* username;
 	struct stream in;
 	struct stream out;
+	uint8 * recv_buf;
+	uint8 * recv_p;
+	uint8 * recv_end;
+	uint8 * send_buf;
+	int send_size;
+	int send_length;
+	int send_batch;
 	int tls_connected;
 	struct _NEGO * nego;
 	struct rdp_rdp * rdp;
@@ -62,6 +69,14 @@ network_disconnect(rdpNetwork * net);
 
 void
 network_send(rdpNetwork * net, STREAM s);
+void
+network_flush(rdpNetwork * net);
+void
+network_begin_batch(rdpNetwork * net);
+void
+network_end_batch(rdpNetwork * net);
+int
+network_pending(rdpNetwork * net);
 STREAM
 network_recv(rdpNetwork * net, STREAM s, uint32 length);
 
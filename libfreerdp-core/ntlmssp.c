@@ -31,6 +31,7 @@
 #include <freerdp/utils/memory.h>
 #include <freerdp/utils/hexdump.h>
 
+#include "rdp.h"
 #include "ntlmssp.h"
 
 #define NTLMSSP_INDEX_NEGOTIATE_56				0
@@ -101,6 +102,7 @@ const char server_seal_magic[] = "session key to server-to-client sealing key ma
 void ntlmssp_set_username(NTLMSSP *ntlmssp, char* username)
 {
 	datablob_free(&ntlmssp->username);
+	ntlmssp->ntlm_v2_hash_valid = 0;
 
 	if (username != NULL)
 	{
@@ -117,6 +119,7 @@ void ntlmssp_set_username(NTLMSSP *ntlmssp, char* username)
 void ntlmssp_set_domain(NTLMSSP *ntlmssp, char* domain)
 {
 	datablob_free(&ntlmssp->domain);
+	ntlmssp->ntlm_v2_hash_valid = 0;
 
 	if (domain != NULL)
 	{
@@ -133,6 +136,7 @@ void ntlmssp_set_domain(NTLMSSP *ntlmssp, char* domain)
 void ntlmssp_set_password(NTLMSSP *ntlmssp, char* password)
 {
 	datablob_free(&ntlmssp->password);
+	ntlmssp->ntlm_v2_hash_valid = 0;
 
 	if (password != NULL)
 	{
@@ -443,26 +447,75 @@ void ntlmssp_compute_ntlm_hash(DATABLOB* password, char* hash)
 
 void ntlmssp_compute_ntlm_v2_hash(NTLMSSP *ntlmssp, char* hash)
 {
-	char* p;
-	DATABLOB blob;
+	uint8* p;
+	int length;
 	char ntlm_hash[16];
+	uint8 identity[NTOWFV2_MAX_IDENTITY];
+	struct rdp_ntowfv2* cache = ntlmssp->ntowfv2_cache;
 
-	datablob_alloc(&blob, ntlmssp->username.length + ntlmssp->domain.length);
-	p = (char*) blob.data;
+	length = ntlmssp->username.length + ntlmssp->domain.length;
+	p = (length <= sizeof(identity)) ? identity : (uint8*) xmalloc(length);
 
 	/* First, compute the NTLMv1 hash of the password */
 	ntlmssp_compute_ntlm_hash(&ntlmssp->password, ntlm_hash);
 
 	/* Concatenate(Uppercase(username),domain)*/
 	memcpy(p, ntlmssp->username.data, ntlmssp->username.length);
-	freerdp_uniconv_uppercase(ntlmssp->uniconv, p, ntlmssp->username.length / 2);
+	freerdp_uniconv_uppercase(ntlmssp->uniconv, (char*) p, ntlmssp->username.length / 2);
 
 	memcpy(&p[ntlmssp->username.length], ntlmssp->domain.data, ntlmssp->domain.length);
 
-	/* Compute the HMAC-MD5 hash of the above value using the NTLMv1 hash as the key, the result is the NTLMv2 hash */
-	HMAC(EVP_md5(), (void*) ntlm_hash, 16, blob.data, blob.length, (void*) hash, NULL);
+	/* An earlier logon with the same username, domain and password already derived it */
+	if (cache != NULL && cache->valid && cache->length == length &&
+		memcmp(cache->identity, p, length) == 0 && memcmp(cache->ntlm_hash, ntlm_hash, 16) == 0)
+	{
+		memcpy(hash, cache->ntlm_v2_hash, 16);
+	}
+	else
+	{
+		/* Compute the HMAC-MD5 hash of the above value using the NTLMv1 hash as the key, the result is the NTLMv2 hash */
+		HMAC(EVP_md5(), (void*) ntlm_hash, 16, p, length, (void*) hash, NULL);
 
-	datablob_free(&blob);
+		if (cache != NULL && length <= sizeof(cache->identity))
+		{
+			cache->valid = 1;
+			cache->length = length;
+			memcpy(cache->identity, p, length);
+			memcpy(cache->ntlm_hash, ntlm_hash, 16);
+			memcpy(cache->ntlm_v2_hash, hash, 16);
+		}
+	}
+
+	memset(ntlm_hash, 0, sizeof(ntlm_hash));
+
+	if (p != identity)
+		xfree(p);
+}
+
+/**
+ * Derive the NTLMv2 hash (NTOWFv2) of the current credentials ahead of its first use.
+ * @param ntlmssp
+ */
+
+void ntlmssp_prepare_ntlm_v2_hash(NTLMSSP *ntlmssp)
+{
+	if (!ntlmssp->ntlm_v2_hash_valid)
+	{
+		ntlmssp_compute_ntlm_v2_hash(ntlmssp, (char*) ntlmssp->ntlm_v2_hash);
+		ntlmssp->ntlm_v2_hash_valid = 1;
+	}
+}
+
+/**
+ * Get the NTLMv2 hash (NTOWFv2) of the current credentials, computing it on the first use only.
+ * @param ntlmssp
+ * @param hash 16-byte buffer
+ */
+
+void ntlmssp_get_ntlm_v2_hash(NTLMSSP *ntlmssp, char* hash)
+{
+	ntlmssp_prepare_ntlm_v2_hash(ntlmssp);
+	memcpy(hash, ntlmssp->ntlm_v2_hash, 16);
 }
 
 void ntlmssp_compute_lm_response(char* password, char* challenge, char* response)
@@ -500,7 +553,7 @@ void ntlmssp_compute_lm_v2_response(NTLMSSP *ntlmssp)
 	char ntlm_v2_hash[16];
 
 	/* Compute the NTLMv2 hash */
-	ntlmssp_compute_ntlm_v2_hash(ntlmssp, ntlm_v2_hash);
+	ntlmssp_get_ntlm_v2_hash(ntlmssp, ntlm_v2_hash);
 
 	/* Concatenate the server and client challenges */
 	memcpy(value, ntlmssp->server_challenge, 8);
@@ -537,7 +590,7 @@ void ntlmssp_compute_ntlm_v2_response(NTLMSSP *ntlmssp)
 	blob = (uint8*) ntlm_v2_temp.data;
 
 	/* Compute the NTLMv2 hash */
-	ntlmssp_compute_ntlm_v2_hash(ntlmssp, (char*) ntlm_v2_hash);
+	ntlmssp_get_ntlm_v2_hash(ntlmssp, (char*) ntlm_v2_hash);
 
 #ifdef WITH_DEBUG_NLA
 	printf("Password (length = %d)\n", ntlmssp->password.length);
@@ -1694,6 +1747,8 @@ void ntlmssp_uninit(NTLMSSP *ntlmssp)
 	datablob_free(&ntlmssp->username);
 	datablob_free(&ntlmssp->password);
 	datablob_free(&ntlmssp->domain);
+	memset(ntlmssp->ntlm_v2_hash, '\0', 16);
+	ntlmssp->ntlm_v2_hash_valid = 0;
 
 	datablob_free(&ntlmssp->spn);
 	datablob_free(&ntlmssp->workstation);
@@ -89,6 +89,9 @@ struct _NTLMSSP
 	uint8 timestamp[8];
 	uint8 server_challenge[8];
 	uint8 client_challenge[8];
+	uint8 ntlm_v2_hash[16];
+	int ntlm_v2_hash_valid;
+	struct rdp_ntowfv2* ntowfv2_cache; /* optional, outlives the handshake */
 	uint8 session_base_key[16];
 	uint8 key_exchange_key[16];
 	uint8 random_session_key[16];
@@ -133,6 +136,8 @@ void ntlmssp_init_rc4_seal_states(NTLMSSP *ntlmssp);
 void ntlmssp_compute_lm_hash(char* password, char* hash);
 void ntlmssp_compute_ntlm_hash(DATABLOB* password, char* hash);
 void ntlmssp_compute_ntlm_v2_hash(NTLMSSP *ntlmssp, char* hash);
+void ntlmssp_prepare_ntlm_v2_hash(NTLMSSP *ntlmssp);
+void ntlmssp_get_ntlm_v2_hash(NTLMSSP *ntlmssp, char* hash);
 
 void ntlmssp_compute_lm_response(char* password, char* challenge, char* response);
 void ntlmssp_compute_lm_v2_response(NTLMSSP *ntlmssp);
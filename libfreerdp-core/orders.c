@@ -23,9 +23,210 @@
 #include "cache.h"
 #include "bitmap.h"
 #include <freerdp/rdpset.h>
+#include <freerdp/freerdp.h>
 
 #include "orders.h"
 
+/* Hand the queued primary orders over to the ui */
+static void
+flush_orders(rdpOrders * orders)
+{
+	if (orders->batch_count > 0)
+	{
+		ui_draw_orders(orders->rdp->inst, orders->batch, orders->batch_count);
+		orders->batch_count = 0;
+	}
+}
+
+/* Get the next free batch entry, or NULL when the ui draws orders one by one */
+static RD_ORDER *
+queue_order(rdpOrders * orders, uint8 type)
+{
+	RD_ORDER * order;
+
+	if (orders->rdp->inst->ui_draw_orders == NULL)
+		return NULL;
+
+	if (orders->batch_count >= orders->batch_size)
+	{
+		orders->batch_size *= 2;
+		orders->batch = (RD_ORDER *) xrealloc(orders->batch, sizeof(RD_ORDER) * orders->batch_size);
+	}
+
+	order = &orders->batch[orders->batch_count++];
+	order->type = type;
+	return order;
+}
+
+static void
+queue_set_clip(rdpOrders * orders, int x, int y, int cx, int cy)
+{
+	RD_ORDER * order;
+
+	if (orders->discard)
+		return;
+
+	order = queue_order(orders, RD_ORDER_SET_CLIP);
+	if (order == NULL)
+	{
+		ui_set_clip(orders->rdp->inst, x, y, cx, cy);
+		return;
+	}
+	order->x = x;
+	order->y = y;
+	order->cx = cx;
+	order->cy = cy;
+}
+
+static void
+queue_reset_clip(rdpOrders * orders)
+{
+	if (orders->discard)
+		return;
+
+	if (queue_order(orders, RD_ORDER_RESET_CLIP) == NULL)
+		ui_reset_clip(orders->rdp->inst);
+}
+
+static void
+queue_destblt(rdpOrders * orders, uint8 opcode, int x, int y, int cx, int cy)
+{
+	RD_ORDER * order;
+
+	if (orders->discard)
+		return;
+
+	order = queue_order(orders, RD_ORDER_DESTBLT);
+	if (order == NULL)
+	{
+		ui_destblt(orders->rdp->inst, opcode, x, y, cx, cy);
+		return;
+	}
+	order->opcode = opcode;
+	order->x = x;
+	order->y = y;
+	order->cx = cx;
+	order->cy = cy;
+}
+
+static void
+queue_patblt(rdpOrders * orders, uint8 opcode, int x, int y, int cx, int cy,
+	RD_BRUSH * brush, uint32 bgcolor, uint32 fgcolor)
+{
+	RD_ORDER * order;
+
+	if (orders->discard)
+		return;
+
+	order = queue_order(orders, RD_ORDER_PATBLT);
+	if (order == NULL)
+	{
+		ui_patblt(orders->rdp->inst, opcode, x, y, cx, cy, brush, bgcolor, fgcolor);
+		return;
+	}
+	order->opcode = opcode;
+	order->x = x;
+	order->y = y;
+	order->cx = cx;
+	order->cy = cy;
+	order->u.patblt.bgcolor = bgcolor;
+	order->u.patblt.fgcolor = fgcolor;
+	memcpy(&order->u.patblt.brush, brush, sizeof(RD_BRUSH));
+}
+
+static void
+queue_screenblt(rdpOrders * orders, uint8 opcode, int x, int y, int cx, int cy,
+	int srcx, int srcy)
+{
+	RD_ORDER * order;
+
+	if (orders->discard)
+		return;
+
+	order = queue_order(orders, RD_ORDER_SCREENBLT);
+	if (order == NULL)
+	{
+		ui_screenblt(orders->rdp->inst, opcode, x, y, cx, cy, srcx, srcy);
+		return;
+	}
+	order->opcode = opcode;
+	order->x = x;
+	order->y = y;
+	order->cx = cx;
+	order->cy = cy;
+	order->u.screenblt.srcx = srcx;
+	order->u.screenblt.srcy = srcy;
+}
+
+static void
+queue_memblt(rdpOrders * orders, uint8 opcode, int x, int y, int cx, int cy,
+	RD_HBITMAP src, int srcx, int srcy)
+{
+	RD_ORDER * order;
+
+	if (orders->discard)
+		return;
+
+	order = queue_order(orders, RD_ORDER_MEMBLT);
+	if (order == NULL)
+	{
+		ui_memblt(orders->rdp->inst, opcode, x, y, cx, cy, src, srcx, srcy);
+		return;
+	}
+	order->opcode = opcode;
+	order->x = x;
+	order->y = y;
+	order->cx = cx;
+	order->cy = cy;
+	order->u.memblt.src = src;
+	order->u.memblt.srcx = srcx;
+	order->u.memblt.srcy = srcy;
+}
+
+static void
+queue_line(rdpOrders * orders, uint8 opcode, int startx, int starty, int endx, int endy,
+	RD_PEN * pen)
+{
+	RD_ORDER * order;
+
+	if (orders->discard)
+		return;
+
+	order = queue_order(orders, RD_ORDER_LINE);
+	if (order == NULL)
+	{
+		ui_line(orders->rdp->inst, opcode, startx, starty, endx, endy, pen);
+		return;
+	}
+	order->opcode = opcode;
+	order->x = startx;
+	order->y = starty;
+	order->u.line.endx = endx;
+	order->u.line.endy = endy;
+	memcpy(&order->u.line.pen, pen, sizeof(RD_PEN));
+}
+
+static void
+queue_rect(rdpOrders * orders, int x, int y, int cx, int cy, uint32 color)
+{
+	RD_ORDER * order;
+
+	if (orders->discard)
+		return;
+
+	order = queue_order(orders, RD_ORDER_RECT);
+	if (order == NULL)
+	{
+		ui_rect(orders->rdp->inst, x, y, cx, cy, color);
+		return;
+	}
+	order->x = x;
+	order->y = y;
+	order->cx = cx;
+	order->cy = cy;
+	order->u.rect.color = color;
+}
+
 /* Read field indicating which parameters are present */
 static void
 rdp_in_present(STREAM s, uint32 * present, uint8 flags, int size)
@@ -248,7 +449,7 @@ process_dstblt(rdpOrders * orders, STREAM s, DSTBLT_ORDER * os, uint32 present,
 	DEBUG_ORDERS("DESTBLT(op=0x%x,x=%d,y=%d,cx=%d,cy=%d)",
 	      os->opcode, os->x, os->y, os->cx, os->cy);
 
-	ui_destblt(orders->rdp->inst, os->opcode, os->x, os->y, os->cx, os->cy);
+	queue_destblt(orders, os->opcode, os->x, os->y, os->cx, os->cy);
 }
 
 /* Process a pattern blt order */
@@ -285,7 +486,7 @@ process_patblt(rdpOrders * orders, STREAM s, PATBLT_ORDER * os, uint32 present,
 
 	setup_brush(orders, &brush, &os->brush);
 
-	ui_patblt(orders->rdp->inst, os->opcode, os->x, os->y, os->cx, os->cy,
+	queue_patblt(orders, os->opcode, os->x, os->y, os->cx, os->cy,
 		  &brush, os->bgcolor, os->fgcolor);
 }
 
@@ -377,7 +578,7 @@ process_multipatblt(rdpOrders * orders, STREAM s, MULTIPATBLT_ORDER * os, uint32
 
 		flags <<= 4;
 
-		ui_patblt(orders->rdp->inst, os->opcode, rects[next].l, rects[next].t,
+		queue_patblt(orders, os->opcode, rects[next].l, rects[next].t,
 			rects[next].w, rects[next].h, &brush, os->bgcolor, os->fgcolor);
 	}
 }
@@ -410,7 +611,7 @@ process_scrblt(rdpOrders * orders, STREAM s, SCRBLT_ORDER * os, uint32 present,
 	DEBUG_ORDERS("SCRBLT(op=0x%x,x=%d,y=%d,cx=%d,cy=%d,srcx=%d,srcy=%d)",
 	       os->opcode, os->x, os->y, os->cx, os->cy, os->srcx, os->srcy);
 
-	ui_screenblt(orders->rdp->inst, os->opcode, os->x, os->y, os->cx, os->cy,
+	queue_screenblt(orders, os->opcode, os->x, os->y, os->cx, os->cy,
 		     os->srcx, os->srcy);
 }
 
@@ -450,7 +651,7 @@ process_lineto(rdpOrders * orders, STREAM s, LINETO_ORDER * os, uint32 present,
 		return;
 	}
 
-	ui_line(orders->rdp->inst, os->opcode, os->startx, os->starty, os->endx,
+	queue_line(orders, os->opcode, os->startx, os->starty, os->endx,
 		os->endy, &os->pen);
 }
 
@@ -492,7 +693,7 @@ process_opaquerect(rdpOrders * orders, STREAM s, OPAQUERECT_ORDER * os, uint32 p
 
 	DEBUG_ORDERS("OPAQUERECT(x=%d,y=%d,cx=%d,cy=%d,fg=0x%x)", os->x, os->y, os->cx, os->cy, os->color);
 
-	ui_rect(orders->rdp->inst, os->x, os->y, os->cx, os->cy, os->color);
+	queue_rect(orders, os->x, os->y, os->cx, os->cy, os->color);
 }
 
 /* Process a multi opaque rectangle order */
@@ -503,7 +704,7 @@ process_multiopaquerect(rdpOrders * orders, STREAM s, MULTIOPAQUERECT_ORDER * os
 	size_t size;
 	int index, data, next;
 	uint8 flags = 0;
-	RECTANGLE *rects;
+	RD_RECT *rects;
 
 	if (present & 0x001)
 		rdp_in_coord(s, &os->x, delta);
@@ -547,14 +748,14 @@ process_multiopaquerect(rdpOrders * orders, STREAM s, MULTIOPAQUERECT_ORDER * os
 	DEBUG_ORDERS("MULTIOPAQUERECT(x=%d,y=%d,cx=%d,cy=%d,fg=0x%x,ne=%d,n=%d)", os->x, os->y, os->cx, os->cy,
 		os->color, os->nentries, os->datasize);
 
-	size = (os->nentries + 1) * sizeof(RECTANGLE);
+	size = (os->nentries + 1) * sizeof(RD_RECT);
 	if (size > orders->buffer_size)
 	{
 		orders->buffer = xrealloc(orders->buffer, size);
 		orders->buffer_size = size;
 	}
 
-	rects = (RECTANGLE *) orders->buffer;
+	rects = (RD_RECT *) orders->buffer;
 	memset(rects, 0, size);
 
 	index = 0;
@@ -565,31 +766,42 @@ process_multiopaquerect(rdpOrders * orders, STREAM s, MULTIOPAQUERECT_ORDER * os
 			flags = os->data[index++];
 
 		if (~flags & 0x80)
-			rects[next].l = parse_delta(os->data, &data);
+			rects[next].x = parse_delta(os->data, &data);
 
 		if (~flags & 0x40)
-			rects[next].t = parse_delta(os->data, &data);
+			rects[next].y = parse_delta(os->data, &data);
 
 		if (~flags & 0x20)
-			rects[next].w = parse_delta(os->data, &data);
+			rects[next].width = parse_delta(os->data, &data);
 		else
-			rects[next].w = rects[next - 1].w;
+			rects[next].width = rects[next - 1].width;
 
 		if (~flags & 0x10)
-			rects[next].h = parse_delta(os->data, &data);
+			rects[next].height = parse_delta(os->data, &data);
 		else
-			rects[next].h = rects[next - 1].h;
+			rects[next].height = rects[next - 1].height;
 
-		rects[next].l = rects[next].l + rects[next - 1].l;
-		rects[next].t = rects[next].t + rects[next - 1].t;
+		rects[next].x = rects[next].x + rects[next - 1].x;
+		rects[next].y = rects[next].y + rects[next - 1].y;
 
 		DEBUG_ORDERS("rect (%d, %d, %d, %d)",
-			rects[next].l, rects[next].t, rects[next].w, rects[next].h);
+			rects[next].x, rects[next].y, rects[next].width, rects[next].height);
 
 		flags <<= 4;
+	}
+
+	/* rects[0] is the zero origin the first delta is relative to */
+	if (orders->rdp->inst->ui_rects != NULL && !orders->discard)
+	{
+		flush_orders(orders);
+		ui_rects(orders->rdp->inst, &rects[1], next - 1, os->color);
+		return;
+	}
 
-		ui_rect(orders->rdp->inst, rects[next].l, rects[next].t,
-			rects[next].w, rects[next].h, os->color);
+	for (index = 1; index < next; index++)
+	{
+		queue_rect(orders, rects[index].x, rects[index].y,
+			rects[index].width, rects[index].height, os->color);
 	}
 }
 
@@ -624,6 +836,9 @@ process_savebitmap(rdpOrders * orders, STREAM s, SAVEBITMAP_ORDER * os, uint32 p
 	width = os->right - os->left + 1;
 	height = os->bottom - os->top + 1;
 
+	if (orders->discard)
+		return;
+
 	inst = orders->rdp->inst;
 	if (os->action == 0)
 		ui_desktop_save(inst, os->offset, os->left, os->top, width, height);
@@ -674,7 +889,7 @@ process_memblt(rdpOrders * orders, STREAM s, MEMBLT_ORDER * os, uint32 present,
 	if (bitmap == NULL)
 		return;
 
-	ui_memblt(orders->rdp->inst, os->opcode, os->x, os->y, os->cx, os->cy,
+	queue_memblt(orders, os->opcode, os->x, os->y, os->cx, os->cy,
 		  bitmap, os->srcx, os->srcy);
 }
 
@@ -731,7 +946,7 @@ process_mem3blt(rdpOrders * orders, STREAM s, MEM3BLT_ORDER * os, uint32 present
 	       os->brush.style, os->bgcolor, os->fgcolor);
 
 	bitmap = cache_get_bitmap(orders->rdp->cache, os->cache_id, os->cache_idx);
-	if (bitmap == NULL)
+	if (bitmap == NULL || orders->discard)
 		return;
 
 	setup_brush(orders, &brush, &os->brush);
@@ -812,6 +1027,9 @@ process_polygon_sc(rdpOrders * orders, STREAM s, POLYGON_SC_ORDER* os, uint32 pr
 		flags <<= 2;
 	}
 
+	if (orders->discard)
+		return;
+
 	if (next - 1 == os->npoints)
 		ui_polygon(orders->rdp->inst, os->opcode, os->fillmode, points,
 			   os->npoints + 1, NULL, 0, os->fgcolor);
@@ -900,6 +1118,9 @@ process_polygon_cb(rdpOrders * orders, STREAM s, POLYGON_CB_ORDER * os, uint32 p
 		flags <<= 2;
 	}
 
+	if (orders->discard)
+		return;
+
 	if (next - 1 == os->npoints)
 		ui_polygon(orders->rdp->inst, os->opcode, os->fillmode, points,
 			   os->npoints + 1, &brush, os->bgcolor, os->fgcolor);
@@ -979,6 +1200,9 @@ process_polyline(rdpOrders * orders, STREAM s, POLYLINE_ORDER * os, uint32 prese
 		flags <<= 2;
 	}
 
+	if (orders->discard)
+		return;
+
 	if (next - 1 == os->lines)
 		ui_polyline(orders->rdp->inst, os->opcode, points, os->lines + 1, &pen);
 	else
@@ -1013,6 +1237,9 @@ process_ellipse_sc(rdpOrders * orders, STREAM s, ELLIPSE_SC_ORDER * os, uint32 p
 	DEBUG_ORDERS("ELLIPSE_SC(l=%d,t=%d,r=%d,b=%d,op=0x%x,fm=%d,fg=0x%x)", os->left, os->top,
 	       os->right, os->bottom, os->opcode, os->fillmode, os->fgcolor);
 
+	if (orders->discard)
+		return;
+
 	ui_ellipse(orders->rdp->inst, os->opcode, os->fillmode, os->left, os->top,
 		   os->right - os->left, os->bottom - os->top, NULL, 0, os->fgcolor);
 }
@@ -1053,6 +1280,9 @@ process_ellipse_cb(rdpOrders * orders, STREAM s, ELLIPSE_CB_ORDER * os, uint32 p
 	       os->left, os->top, os->right, os->bottom, os->opcode, os->fillmode, os->brush.style,
 	       os->bgcolor, os->fgcolor);
 
+	if (orders->discard)
+		return;
+
 	setup_brush(orders, &brush, &os->brush);
 
 	ui_ellipse(orders->rdp->inst, os->opcode, os->fillmode, os->left, os->top,
@@ -1089,8 +1319,9 @@ do_glyph(rdpOrders * orders, uint8 * ttext, int * index, int * x, int * y, uint8
 	{
 		gx = lx + glyph->offset;
 		gy = ly + glyph->baseline;
-		ui_draw_glyph(orders->rdp->inst, gx, gy, glyph->width, glyph->height,
-			      glyph->pixmap);
+		if (!orders->discard)
+			ui_draw_glyph(orders->rdp->inst, gx, gy, glyph->width, glyph->height,
+				      glyph->pixmap);
 		if (flags & TEXT2_IMPLICIT_X)
 			lx += glyph->width;
 	}
@@ -1117,15 +1348,19 @@ draw_text(rdpOrders * orders, uint8 font, uint8 flags, uint8 opcode, int mixmode
 	if (boxx + boxcx > orders->rdp->settings->width)
 		boxcx = orders->rdp->settings->width - boxx;
 
-	if (boxcx > 1)
+	/* text fragments are still cached while drawing is discarded */
+	if (!orders->discard)
 	{
-		ui_rect(orders->rdp->inst, boxx, boxy, boxcx, boxcy, bgcolor);
-	}
-	else if (mixmode == MIX_OPAQUE)
-	{
-		ui_rect(orders->rdp->inst, clipx, clipy, clipcx, clipcy, bgcolor);
+		if (boxcx > 1)
+		{
+			ui_rect(orders->rdp->inst, boxx, boxy, boxcx, boxcy, bgcolor);
+		}
+		else if (mixmode == MIX_OPAQUE)
+		{
+			ui_rect(orders->rdp->inst, clipx, clipy, clipcx, clipcy, bgcolor);
+		}
+		ui_start_draw_glyphs(orders->rdp->inst, bgcolor, fgcolor);
 	}
-	ui_start_draw_glyphs(orders->rdp->inst, bgcolor, fgcolor);
 	/* Paint text, character by character */
 	for (i = 0; i < length;)
 	{
@@ -1192,6 +1427,8 @@ draw_text(rdpOrders * orders, uint8 font, uint8 flags, uint8 opcode, int mixmode
 				break;
 		}
 	}
+	if (orders->discard)
+		return;
 	if (boxcx > 1)
 	{
 		ui_end_draw_glyphs(orders->rdp->inst, boxx, boxy, boxcx, boxcy);
@@ -1532,7 +1769,7 @@ process_fast_glyph(rdpOrders * orders, STREAM s, FAST_GLYPH_ORDER * os, uint32 p
 		cache_put_font(orders->rdp->cache, os->font, character, offset, baseline, width, height, gl);
 	}
 	ft = cache_get_font(orders->rdp->cache, os->font, character);
-	if (ft != NULL)
+	if (ft != NULL && !orders->discard)
 	{
 		gx = x + ft->offset;
 		gy = y + ft->baseline;
@@ -1873,6 +2110,8 @@ process_cache_brush(rdpOrders * orders, STREAM s, uint16 flags)
 	DEBUG_ORDERS("BRUSHCACHE(idx=%d,dp=%d,wd=%d,ht=%d,sz=%d)", cache_idx, color_code,
 	       width, height, size);
 
+	memset(&brush_data, 0, sizeof(RD_BRUSHDATA));
+
 	if ((width == 8) && (height == 8))
 	{
 		if (color_code == 1)
@@ -1930,10 +2169,23 @@ static void
 process_switch_surface(rdpOrders * orders, STREAM s)
 {
 	sint16 idx;
+	RD_HBITMAP bitmap;
 
 	in_uint16_le(s, idx);
-	ui_set_surface(orders->rdp->inst, idx >= 0 ?
-		cache_get_bitmap(orders->rdp->cache, 255, idx) : NULL);
+	orders->surface = idx;
+
+	if (idx < 0)
+	{
+		orders->discard = False;
+		ui_set_surface(orders->rdp->inst, NULL);
+		return;
+	}
+
+	/* a refused surface has no bitmap, its drawing is dropped until the next switch */
+	bitmap = cache_get_bitmap(orders->rdp->cache, 255, idx);
+	orders->discard = (bitmap == NULL);
+	if (bitmap != NULL)
+		ui_set_surface(orders->rdp->inst, bitmap);
 }
 
 /* Process a create off-screen bitmap alternate secondary drawing order */
@@ -1942,6 +2194,7 @@ process_create_offscr_bitmap(rdpOrders * orders, STREAM s)
 {
 	RD_HBITMAP bitmap;
 	uint16 idx, width, height, free_num, free_idx;
+	uint32 size;
 	int i;
 
 	in_uint16_le(s, idx);
@@ -1955,13 +2208,28 @@ process_create_offscr_bitmap(rdpOrders * orders, STREAM s)
 			in_uint16_le(s, free_idx);
 			bitmap = cache_get_bitmap(orders->rdp->cache, 255, free_idx);
 			ui_destroy_surface(orders->rdp->inst, bitmap);
-			cache_put_bitmap(orders->rdp->cache, 255, free_idx, NULL);
+			cache_put_surface(orders->rdp->cache, free_idx, NULL, 0);
 		}
 	}
 	idx &= ~0x8000;
 	bitmap = cache_get_bitmap(orders->rdp->cache, 255, idx);
+
+	/* surfaces are accounted at the session color depth, as the server does */
+	size = (uint32) width * height * ((orders->rdp->settings->server_depth + 7) / 8);
+	if (!cache_check_surface(orders->rdp->cache, idx, size))
+	{
+		ui_error(orders->rdp->inst, "offscreen surface %d (%dx%d) exceeds the "
+			"offscreen cache size\n", idx, width, height);
+		if (bitmap != NULL)
+			ui_destroy_surface(orders->rdp->inst, bitmap);
+		cache_put_surface(orders->rdp->cache, idx, NULL, 0);
+		if (orders->surface == idx)
+			orders->discard = True;
+		return;
+	}
+
 	bitmap = ui_create_surface(orders->rdp->inst, width, height, bitmap);
-	cache_put_bitmap(orders->rdp->cache, 255, idx, bitmap);
+	cache_put_surface(orders->rdp->cache, idx, bitmap, size);
 }
 
 /* Process a non-standard order */
@@ -2061,10 +2329,14 @@ process_orders(rdpOrders * orders, STREAM s, uint16 num_orders)
 
 		if (!(order_flags & RDP_ORDER_CTL_STANDARD))
 		{
+			/* surface switches must not overtake queued orders */
+			flush_orders(orders);
 			process_alternate_secondary_order(orders, s, order_flags);
 		}
 		else if (order_flags & RDP_ORDER_CTL_SECONDARY)
 		{
+			/* cache updates may replace bitmaps and brushes still referenced */
+			flush_orders(orders);
 			process_secondary_order(orders, s);
 		}
 		else
@@ -2104,7 +2376,7 @@ process_orders(rdpOrders * orders, STREAM s, uint16 num_orders)
 				if (!(order_flags & RDP_ORDER_CTL_ZERO_BOUNDS_DELTA))
 					rdp_parse_bounds(s, &os->bounds);
 
-				ui_set_clip(orders->rdp->inst, os->bounds.left,
+				queue_set_clip(orders, os->bounds.left,
 					    os->bounds.top,
 					    os->bounds.right -
 					    os->bounds.left + 1,
@@ -2113,6 +2385,23 @@ process_orders(rdpOrders * orders, STREAM s, uint16 num_orders)
 
 			delta = order_flags & RDP_ORDER_CTL_DELTA_COORDINATES;
 
+			switch (os->order_type)
+			{
+				case RDP_ORDER_DSTBLT:
+				case RDP_ORDER_PATBLT:
+				case RDP_ORDER_MULTIPATBLT:
+				case RDP_ORDER_SCRBLT:
+				case RDP_ORDER_LINETO:
+				case RDP_ORDER_OPAQUERECT:
+				case RDP_ORDER_MULTIOPAQUERECT:
+				case RDP_ORDER_MEMBLT:
+					break;
+
+				default:
+					/* drawn directly, everything queued so far goes first */
+					flush_orders(orders);
+			}
+
 			switch (os->order_type)
 			{
 				case RDP_ORDER_DSTBLT:
@@ -2193,11 +2482,13 @@ process_orders(rdpOrders * orders, STREAM s, uint16 num_orders)
 			}
 
 			if (order_flags & RDP_ORDER_CTL_BOUNDS)
-				ui_reset_clip(orders->rdp->inst);
+				queue_reset_clip(orders);
 		}
 
 		processed++;
 	}
+
+	flush_orders(orders);
 }
 
 /* Reset order state */
@@ -2208,6 +2499,8 @@ reset_order_state(rdpOrders * orders)
 
 	memset(os, 0, sizeof(RDP_ORDER_STATE));
 	os->order_type = RDP_ORDER_PATBLT;
+	orders->surface = -1;
+	orders->discard = False;
 	ui_set_surface(orders->rdp->inst, NULL);
 }
 
@@ -2221,6 +2514,7 @@ orders_new(struct rdp_rdp * rdp)
 	{
 		memset(self, 0, sizeof(rdpOrders));
 		self->rdp = rdp;
+		self->surface = -1;
 		/* orders_state is void * */
 		self->order_state = xmalloc(sizeof(RDP_ORDER_STATE));
 		memset(self->order_state, 0, sizeof(RDP_ORDER_STATE));
@@ -2228,6 +2522,9 @@ orders_new(struct rdp_rdp * rdp)
 		self->buffer_size = 4096;
 		self->buffer = xmalloc(self->buffer_size);
 		memset(self->buffer, 0, self->buffer_size);
+		/* primary order batch, grown on demand */
+		self->batch_size = 64;
+		self->batch = (RD_ORDER *) xmalloc(sizeof(RD_ORDER) * self->batch_size);
 	}
 	return self;
 }
@@ -2239,6 +2536,7 @@ orders_free(rdpOrders * orders)
 	{
 		xfree(orders->order_state);
 		xfree(orders->buffer);
+		xfree(orders->batch);
 		xfree(orders);
 	}
 }
@@ -53,6 +53,11 @@ struct rdp_orders
 	void *order_state;
 	void *buffer;
 	size_t buffer_size;
+	RD_ORDER *batch;
+	int batch_count;
+	int batch_size;
+	int surface; /* offscreen surface drawn to, -1 for the screen */
+	RD_BOOL discard; /* the surface was refused, drawing orders are dropped */
 };
 typedef struct rdp_orders rdpOrders;
 
@@ -24,33 +24,695 @@
 
 #include "pstcache.h"
 
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
+
 #define MAX_CELL_SIZE		0x1000	/* pixels */
+#define PSTCACHE_PAGE_SIZE	0x1000
+#define PSTCACHE_BLOCK_SIZE	0x80
+#define PSTCACHE_POOL_RATIO	4	/* compressed pool is this much smaller than the fixed cells */
+#define PSTCACHE_EVICT_TRIES	8
 
 #define IS_PERSISTENT(id) (id < 8 && pcache->pstcache_fd[id] > 0)
 
-/* Update mru stamp/index for a bitmap */
+#ifndef _WIN32
+#define PSTCACHE_LOCK(pcache) pthread_mutex_lock(&(pcache)->lock)
+#define PSTCACHE_UNLOCK(pcache) pthread_mutex_unlock(&(pcache)->lock)
+#else
+#define PSTCACHE_LOCK(pcache)
+#define PSTCACHE_UNLOCK(pcache)
+#endif
+
+/* Offset of the first cell, the header and index are padded to a page */
+#define PSTCACHE_DATA_OFFSET \
+	((sizeof(PSTCACHE_FILEHEADER) + BMPCACHE2_NUM_PSTCELLS * sizeof(CELLHEADER) + \
+	PSTCACHE_PAGE_SIZE - 1) & ~(PSTCACHE_PAGE_SIZE - 1))
+
+#define PSTCACHE_CELL_SIZE(pcache) ((pcache)->pstcache_Bpp * MAX_CELL_SIZE)
+#define PSTCACHE_BLOCKS(size) (((size) + PSTCACHE_BLOCK_SIZE - 1) / PSTCACHE_BLOCK_SIZE)
+
+/* LZ77 codec, a token byte holds the literal count and the match length - 4 */
+#define LZ_MIN_MATCH		4
+#define LZ_HASH_BITS		12
+#define LZ_LAST_LITERALS	5
+
+static CELLHEADER *
+pstcache_cell_header(rdpPcache * pcache, uint8 cache_id, uint16 cache_idx)
+{
+	CELLHEADER * index;
+
+	index = (CELLHEADER *) (pcache->pstcache_map[cache_id] + sizeof(PSTCACHE_FILEHEADER));
+	return &index[cache_idx];
+}
+
+/* Offset in the file of the data of a cell */
+static int
+pstcache_cell_pos(rdpPcache * pcache, uint16 cache_idx, uint32 offset)
+{
+	if (pcache->pstcache_compress)
+		return PSTCACHE_DATA_OFFSET + offset * PSTCACHE_BLOCK_SIZE;
+
+	return PSTCACHE_DATA_OFFSET + cache_idx * PSTCACHE_CELL_SIZE(pcache);
+}
+
+static uint8 *
+pstcache_cell_data(rdpPcache * pcache, uint8 cache_id, uint16 cache_idx)
+{
+	return pcache->pstcache_map[cache_id] + pstcache_cell_pos(pcache, cache_idx,
+		pstcache_cell_header(pcache, cache_id, cache_idx)->offset);
+}
+
+/* Check a cell header read from the file, the pixels must fit the cell and lie inside the mapping */
+static RD_BOOL
+pstcache_check_cell(rdpPcache * pcache, uint8 cache_id, uint16 cache_idx, CELLHEADER * cellhdr)
+{
+	if (cellhdr->width * cellhdr->height * pcache->pstcache_Bpp != cellhdr->length)
+		return False;
+
+	if (cellhdr->length > PSTCACHE_CELL_SIZE(pcache))
+		return False;
+
+	if ((cellhdr->flags & PSTCACHE_CELL_LZ) && !pcache->pstcache_compress)
+		return False;
+
+	if ((cellhdr->flags & PSTCACHE_CELL_LZ) ? cellhdr->stored > cellhdr->length :
+	    cellhdr->stored != cellhdr->length)
+		return False;
+
+	if (pcache->pstcache_compress &&
+	    cellhdr->offset + PSTCACHE_BLOCKS(cellhdr->stored) > pcache->pstcache_num_blocks)
+		return False;
+
+	return pstcache_cell_pos(pcache, cache_idx, cellhdr->offset) + cellhdr->stored <=
+		pcache->pstcache_map_size[cache_id];
+}
+
+static uint32
+lz_hash(uint8 * p)
+{
+	uint32 v;
+
+	memcpy(&v, p, 4);
+	return (v * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+static uint8 *
+lz_put_length(uint8 * op, int len)
+{
+	while (len >= 255)
+	{
+		*op++ = 255;
+		len -= 255;
+	}
+	*op++ = len;
+	return op;
+}
+
+/* Compress into at most out_size bytes, returns the compressed size or 0 if it does not fit */
+static int
+lz_compress(uint8 * in, int in_size, uint8 * out, int out_size)
+{
+	int lit, len;
+	uint32 h;
+	uint8 * ip = in;
+	uint8 * anchor = in;
+	uint8 * limit = in + in_size - LZ_LAST_LITERALS;
+	uint8 * ref;
+	uint8 * op = out;
+	uint8 * oend = out + out_size;
+	uint16 table[1 << LZ_HASH_BITS];
+
+	memset(table, 0, sizeof(table));
+
+	while (ip + LZ_MIN_MATCH <= limit)
+	{
+		h = lz_hash(ip);
+		ref = in + table[h];
+		table[h] = ip - in;
+
+		if (ref >= ip || memcmp(ref, ip, LZ_MIN_MATCH) != 0)
+		{
+			ip++;
+			continue;
+		}
+
+		len = LZ_MIN_MATCH;
+		while (ip + len < limit && ref[len] == ip[len])
+			len++;
+
+		lit = ip - anchor;
+		if (op + 1 + lit / 255 + 1 + lit + 2 + len / 255 + 1 > oend)
+			return 0;
+
+		*op = ((lit < 15 ? lit : 15) << 4) | (len - LZ_MIN_MATCH < 15 ? len - LZ_MIN_MATCH : 15);
+		op++;
+		if (lit >= 15)
+			op = lz_put_length(op, lit - 15);
+		memcpy(op, anchor, lit);
+		op += lit;
+		*op++ = (ip - ref) & 0xff;
+		*op++ = (ip - ref) >> 8;
+		if (len - LZ_MIN_MATCH >= 15)
+			op = lz_put_length(op, len - LZ_MIN_MATCH - 15);
+
+		ip += len;
+		anchor = ip;
+	}
+
+	/* the rest goes out as literals without a match */
+	lit = in + in_size - anchor;
+	if (op + 1 + lit / 255 + 1 + lit > oend)
+		return 0;
+
+	*op++ = (lit < 15 ? lit : 15) << 4;
+	if (lit >= 15)
+		op = lz_put_length(op, lit - 15);
+	memcpy(op, anchor, lit);
+	op += lit;
+
+	return op - out;
+}
+
+static RD_BOOL
+lz_get_length(uint8 ** pip, uint8 * iend, int * len)
+{
+	uint8 * ip = *pip;
+	int b;
+
+	do
+	{
+		if (ip >= iend)
+			return False;
+		b = *ip++;
+		*len += b;
+	}
+	while (b == 255);
+
+	*pip = ip;
+	return True;
+}
+
+/* Decompress exactly out_size bytes, the input comes from disk and is checked */
+static RD_BOOL
+lz_decompress(uint8 * in, int in_size, uint8 * out, int out_size)
+{
+	int n, lit, len, offset;
+	uint8 * ip = in;
+	uint8 * iend = in + in_size;
+	uint8 * op = out;
+	uint8 * oend = out + out_size;
+	uint8 * ref;
+
+	while (ip < iend)
+	{
+		lit = *ip >> 4;
+		len = (*ip & 0x0f) + LZ_MIN_MATCH;
+		ip++;
+
+		if (lit == 15 && !lz_get_length(&ip, iend, &lit))
+			return False;
+		if (lit > iend - ip || lit > oend - op)
+			return False;
+		memcpy(op, ip, lit);
+		ip += lit;
+		op += lit;
+
+		if (ip >= iend)
+			break;
+
+		if (iend - ip < 2)
+			return False;
+		offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (len == 15 + LZ_MIN_MATCH && !lz_get_length(&ip, iend, &len))
+			return False;
+		if (offset == 0 || offset > op - out || len > oend - op)
+			return False;
+
+		/* an overlapping match repeats the last offset bytes, the copied span doubles each pass */
+		ref = op - offset;
+		while (len > 0)
+		{
+			n = (op - ref < len) ? op - ref : len;
+			memcpy(op, ref, n);
+			op += n;
+			len -= n;
+		}
+	}
+
+	return op == oend;
+}
+
+static void
+pstcache_mark_blocks(rdpPcache * pcache, uint8 cache_id, int first, int count, RD_BOOL used)
+{
+	uint8 * map = pcache->pstcache_free_map[cache_id];
+	int i;
+
+	for (i = first; i < first + count; i++)
+	{
+		if (used)
+			map[i >> 3] |= (1 << (i & 7));
+		else
+			map[i >> 3] &= ~(1 << (i & 7));
+	}
+}
+
+/* Find a run of free blocks, next fit from where the last one was taken */
+static int
+pstcache_alloc_blocks(rdpPcache * pcache, uint8 cache_id, int count)
+{
+	uint8 * map = pcache->pstcache_free_map[cache_id];
+	int num_blocks = pcache->pstcache_num_blocks;
+	int i, start, run, scanned;
+
+	i = pcache->pstcache_rover[cache_id];
+	start = i;
+	run = 0;
+
+	for (scanned = 0; scanned < num_blocks + count; scanned++, i++)
+	{
+		if (i == num_blocks)
+		{
+			/* runs do not wrap around the end of the pool */
+			i = 0;
+			start = 0;
+			run = 0;
+		}
+
+		if (run == 0 && (i & 7) == 0 && map[i >> 3] == 0xff && i + 8 <= num_blocks)
+		{
+			i += 7;
+			scanned += 7;
+			start = i + 1;
+			continue;
+		}
+
+		if (map[i >> 3] & (1 << (i & 7)))
+		{
+			start = i + 1;
+			run = 0;
+			continue;
+		}
+
+		if (++run == count)
+		{
+			pstcache_mark_blocks(pcache, cache_id, start, count, True);
+			pcache->pstcache_rover[cache_id] = start + count;
+			if (pcache->pstcache_rover[cache_id] >= num_blocks)
+				pcache->pstcache_rover[cache_id] = 0;
+			return start;
+		}
+	}
+
+	return -1;
+}
+
+/* Drop a cell from the file, its blocks go back to the pool */
+static void
+pstcache_release_cell(rdpPcache * pcache, uint8 cache_id, uint16 cache_idx)
+{
+	CELLHEADER * cellhdr;
+
+	cellhdr = pstcache_cell_header(pcache, cache_id, cache_idx);
+	if (memcmp(cellhdr->key, pcache->zero_key, sizeof(HASH_KEY)) == 0)
+		return;
+
+	if (pcache->pstcache_compress)
+		pstcache_mark_blocks(pcache, cache_id, cellhdr->offset, PSTCACHE_BLOCKS(cellhdr->stored), False);
+
+	memset(cellhdr, 0, sizeof(CELLHEADER));
+}
+
+/* Release the least recently used cell to make room in the pool */
+static RD_BOOL
+pstcache_evict_cell(rdpPcache * pcache, uint8 cache_id, uint16 keep_idx)
+{
+	int idx, lru_idx = -1;
+	uint32 lru_stamp = 0;
+	CELLHEADER * cellhdr;
+
+	cellhdr = pstcache_cell_header(pcache, cache_id, 0);
+	for (idx = 0; idx < BMPCACHE2_NUM_PSTCELLS; idx++, cellhdr++)
+	{
+		if (idx == keep_idx || memcmp(cellhdr->key, pcache->zero_key, sizeof(HASH_KEY)) == 0)
+			continue;
+
+		if (lru_idx < 0 || cellhdr->stamp < lru_stamp)
+		{
+			lru_idx = idx;
+			lru_stamp = cellhdr->stamp;
+		}
+	}
+
+	if (lru_idx < 0)
+		return False;
+
+	DEBUG_CACHE("evict persistent cell: id=%d, idx=%d", cache_id, lru_idx);
+	pstcache_release_cell(pcache, cache_id, lru_idx);
+	return True;
+}
+
+/* Pick what goes to the file, kept raw unless compression saves at least one block */
+static uint8 *
+pstcache_compress_cell(uint8 * data, uint16 length, uint8 * buf, uint16 * stored, uint16 * flags)
+{
+	int n;
+
+	n = lz_compress(data, length, buf, (PSTCACHE_BLOCKS(length) - 1) * PSTCACHE_BLOCK_SIZE);
+	if (n > 0)
+	{
+		*stored = n;
+		*flags = PSTCACHE_CELL_LZ;
+		return buf;
+	}
+
+	*stored = length;
+	*flags = 0;
+	return data;
+}
+
+/* Drop the old content of a cell and find room for the new one, returns the first block or -1 */
+static int
+pstcache_place_cell(rdpPcache * pcache, uint8 cache_id, uint16 cache_idx, int stored)
+{
+	int n, first;
+
+	pstcache_release_cell(pcache, cache_id, cache_idx);
+	if (!pcache->pstcache_compress)
+		return 0;
+
+	for (n = 0; (first = pstcache_alloc_blocks(pcache, cache_id, PSTCACHE_BLOCKS(stored))) < 0; n++)
+	{
+		if (n == PSTCACHE_EVICT_TRIES || !pstcache_evict_cell(pcache, cache_id, cache_idx))
+			return -1;
+	}
+
+	return first;
+}
+
+#ifndef _WIN32
+
+#define PSTCACHE_QUEUE_BUDGET	0x400000	/* bytes of bitmaps waiting for the writer */
+#define PSTCACHE_WRITE_IOV	64
+
+static int
+pstcache_save_cmp(const void * a, const void * b)
+{
+	const PSTCACHE_SAVE * sa = *(const PSTCACHE_SAVE **) a;
+	const PSTCACHE_SAVE * sb = *(const PSTCACHE_SAVE **) b;
+
+	if (sa->cache_id != sb->cache_id)
+		return sa->cache_id - sb->cache_id;
+
+	return sa->pos - sb->pos;
+}
+
+static void
+pstcache_free_save(PSTCACHE_SAVE * save)
+{
+	if (save->stored_data != save->data)
+		xfree(save->stored_data);
+	xfree(save->data);
+	xfree(save);
+}
+
+/* Write the data of a batch sorted by position, cells that follow each other go out in one call */
+static void
+pstcache_write_data(rdpPcache * pcache, PSTCACHE_SAVE ** batch, int count)
+{
+	int i, n;
+	int pos, end;
+	struct iovec iov[PSTCACHE_WRITE_IOV];
+
+	for (i = 0; i < count; i += n)
+	{
+		if (batch[i]->failed)
+		{
+			n = 1;
+			continue;
+		}
+
+		pos = batch[i]->pos;
+		end = pos;
+		for (n = 0; i + n < count && n < PSTCACHE_WRITE_IOV; n++)
+		{
+			if (batch[i + n]->failed || batch[i + n]->cache_id != batch[i]->cache_id ||
+			    batch[i + n]->pos != end)
+				break;
+
+			iov[n].iov_base = batch[i + n]->stored_data;
+			iov[n].iov_len = batch[i + n]->hdr.stored;
+			end += batch[i + n]->hdr.stored;
+		}
+
+		if (pwritev(pcache->pstcache_fd[batch[i]->cache_id], iov, n, pos) != end - pos)
+		{
+			DEBUG_CACHE("persistent cache write failed at %d", pos);
+			while (n-- > 0)
+				batch[i + n]->failed = True;
+			n = 1;
+		}
+	}
+}
+
+/* Place, write and index one batch taken off the queue */
+static void
+pstcache_write_batch(rdpPcache * pcache, PSTCACHE_SAVE * list)
+{
+	int i, count;
+	PSTCACHE_SAVE * save;
+	PSTCACHE_SAVE ** batch;
+
+	for (count = 0, save = list; save != NULL; save = save->next)
+		count++;
+
+	batch = (PSTCACHE_SAVE **) xmalloc(count * sizeof(PSTCACHE_SAVE *));
+	for (i = 0, save = list; save != NULL; save = save->next)
+	{
+		batch[i++] = save;
+
+		/* compression does not need the lock */
+		if (pcache->pstcache_compress)
+		{
+			save->stored_data = (uint8 *) xmalloc(save->hdr.length);
+			if (pstcache_compress_cell(save->data, save->hdr.length, save->stored_data,
+				&save->hdr.stored, &save->hdr.flags) == save->data)
+			{
+				xfree(save->stored_data);
+				save->stored_data = save->data;
+			}
+		}
+	}
+
+	/* the old cells are invalidated before their data is overwritten */
+	pthread_mutex_lock(&pcache->lock);
+	for (i = 0; i < count; i++)
+	{
+		save = batch[i];
+		save->hdr.offset = pstcache_place_cell(pcache, save->cache_id, save->cache_idx, save->hdr.stored);
+		save->failed = (save->hdr.offset == (uint32) -1);
+		save->pos = save->failed ? 0 : pstcache_cell_pos(pcache, save->cache_idx, save->hdr.offset);
+	}
+	pthread_mutex_unlock(&pcache->lock);
+
+	qsort(batch, count, sizeof(PSTCACHE_SAVE *), pstcache_save_cmp);
+	pstcache_write_data(pcache, batch, count);
+
+	pthread_mutex_lock(&pcache->lock);
+	for (i = 0; i < count; i++)
+	{
+		save = batch[i];
+		if (save->failed)
+		{
+			if (pcache->pstcache_compress && save->hdr.offset != (uint32) -1)
+				pstcache_mark_blocks(pcache, save->cache_id, save->hdr.offset,
+					PSTCACHE_BLOCKS(save->hdr.stored), False);
+		}
+		else
+		{
+			memcpy(pstcache_cell_header(pcache, save->cache_id, save->cache_idx),
+				&save->hdr, sizeof(CELLHEADER));
+		}
+
+		if (pcache->pending[save->cache_id][save->cache_idx] == save)
+			pcache->pending[save->cache_id][save->cache_idx] = NULL;
+		pcache->queue_bytes -= save->hdr.length;
+		pstcache_free_save(save);
+	}
+	pcache->writer_busy = False;
+	if (pcache->queue_head == NULL)
+		pthread_cond_broadcast(&pcache->drained_cond);
+	pthread_mutex_unlock(&pcache->lock);
+
+	xfree(batch);
+}
+
+/* Writer thread, takes the whole queue at a time until asked to stop with the queue empty */
+static void *
+pstcache_writer(void * arg)
+{
+	rdpPcache * pcache = (rdpPcache *) arg;
+	PSTCACHE_SAVE * list;
+	PSTCACHE_SAVE * save;
+
+	pthread_mutex_lock(&pcache->lock);
+	while (1)
+	{
+		while (pcache->queue_head == NULL && !pcache->writer_stop)
+			pthread_cond_wait(&pcache->writer_cond, &pcache->lock);
+
+		if (pcache->queue_head == NULL)
+			break;
+
+		list = pcache->queue_head;
+		pcache->queue_head = pcache->queue_tail = NULL;
+		for (save = list; save != NULL; save = save->next)
+			save->queued = False;
+		pcache->writer_busy = True;
+		pthread_mutex_unlock(&pcache->lock);
+
+		pstcache_write_batch(pcache, list);
+
+		pthread_mutex_lock(&pcache->lock);
+	}
+	pthread_mutex_unlock(&pcache->lock);
+
+	return NULL;
+}
+
+/* Queue a save for the writer, a waiting save of the same cell is replaced */
+static RD_BOOL
+pstcache_queue_save(rdpPcache * pcache, uint8 cache_id, uint16 cache_idx, CELLHEADER * hdr, uint8 * data)
+{
+	PSTCACHE_SAVE * save;
+	int queued = 0;
+
+	pthread_mutex_lock(&pcache->lock);
+
+	save = pcache->pending[cache_id][cache_idx];
+	if (save != NULL && save->queued)
+		queued = save->hdr.length;
+
+	/*
+	 * When the disk can not keep up the save is dropped. The cell on disk keeps
+	 * its previous key and data, which still belong together.
+	 */
+	if (pcache->queue_bytes - queued + hdr->length > PSTCACHE_QUEUE_BUDGET)
+	{
+		pcache->queue_dropped++;
+		DEBUG_CACHE("persistent cache queue full, save dropped: id=%d, idx=%d (%d dropped)",
+			cache_id, cache_idx, pcache->queue_dropped);
+		pthread_mutex_unlock(&pcache->lock);
+		return False;
+	}
+
+	if (queued)
+	{
+		xfree(save->data);
+	}
+	else
+	{
+		save = (PSTCACHE_SAVE *) xmalloc(sizeof(PSTCACHE_SAVE));
+		memset(save, 0, sizeof(PSTCACHE_SAVE));
+		save->cache_id = cache_id;
+		save->cache_idx = cache_idx;
+		save->queued = True;
+		if (pcache->queue_tail != NULL)
+			pcache->queue_tail->next = save;
+		else
+			pcache->queue_head = save;
+		pcache->queue_tail = save;
+		pcache->pending[cache_id][cache_idx] = save;
+	}
+
+	save->data = (uint8 *) xmalloc(hdr->length);
+	memcpy(save->data, data, hdr->length);
+	save->stored_data = save->data;
+	memcpy(&save->hdr, hdr, sizeof(CELLHEADER));
+	pcache->queue_bytes += hdr->length - queued;
+
+	pthread_cond_signal(&pcache->writer_cond);
+	pthread_mutex_unlock(&pcache->lock);
+
+	return True;
+}
+
+#endif
+
+/* Update mru stamp/index for a bitmap, later touches get higher stamps */
 void
-pstcache_touch_bitmap(rdpPcache * pcache, uint8 cache_id, uint16 cache_idx, uint32 stamp)
+pstcache_touch_bitmap(rdpPcache * pcache, uint8 cache_id, uint16 cache_idx)
 {
-	int fd;
+	uint32 stamp;
 
 	if (!IS_PERSISTENT(cache_id) || cache_idx >= BMPCACHE2_NUM_PSTCELLS)
 		return;
 
-	fd = pcache->pstcache_fd[cache_id];
-	rd_lseek_file(fd, 12 + cache_idx *
-			(pcache->pstcache_Bpp * MAX_CELL_SIZE + sizeof(CELLHEADER)));
-	rd_write_file(fd, &stamp, sizeof(stamp));
+	PSTCACHE_LOCK(pcache);
+	stamp = ++pcache->stamp;
+	pstcache_cell_header(pcache, cache_id, cache_idx)->stamp = stamp;
+#ifndef _WIN32
+	/* the header written for a pending save carries the latest stamp */
+	if (pcache->pending[cache_id] != NULL && pcache->pending[cache_id][cache_idx] != NULL)
+		pcache->pending[cache_id][cache_idx]->hdr.stamp = stamp;
+#endif
+	PSTCACHE_UNLOCK(pcache);
+}
+
+/* Find the pixels of a cell, a save still on its way to the disk is read from the queue */
+static uint8 *
+pstcache_read_cell(rdpPcache * pcache, uint8 cache_id, uint16 cache_idx, uint8 * width, uint8 * height)
+{
+	CELLHEADER * cellhdr;
+	uint8 * data;
+
+#ifndef _WIN32
+	if (pcache->pending[cache_id] != NULL && pcache->pending[cache_id][cache_idx] != NULL)
+	{
+		*width = pcache->pending[cache_id][cache_idx]->hdr.width;
+		*height = pcache->pending[cache_id][cache_idx]->hdr.height;
+		return pcache->pending[cache_id][cache_idx]->data;
+	}
+#endif
+
+	cellhdr = pstcache_cell_header(pcache, cache_id, cache_idx);
+	if (memcmp(cellhdr->key, pcache->zero_key, sizeof(HASH_KEY)) == 0)
+		return NULL;
+
+	if (!pstcache_check_cell(pcache, cache_id, cache_idx, cellhdr))
+	{
+		DEBUG_CACHE("invalid persistent cell: id=%d, idx=%d", cache_id, cache_idx);
+		pstcache_release_cell(pcache, cache_id, cache_idx);
+		return NULL;
+	}
+
+	/* raw pixels are passed straight from the mapping */
+	data = pstcache_cell_data(pcache, cache_id, cache_idx);
+	if (cellhdr->flags & PSTCACHE_CELL_LZ)
+	{
+		if (!lz_decompress(data, cellhdr->stored, pcache->pstcache_buf, cellhdr->length))
+		{
+			DEBUG_CACHE("corrupt persistent cell: id=%d, idx=%d", cache_id, cache_idx);
+			pstcache_release_cell(pcache, cache_id, cache_idx);
+			return NULL;
+		}
+		data = pcache->pstcache_buf;
+	}
+
+	*width = cellhdr->width;
+	*height = cellhdr->height;
+	return data;
 }
 
 /* Load a bitmap from the persistent cache */
 RD_BOOL
 pstcache_load_bitmap(rdpPcache * pcache, uint8 cache_id, uint16 cache_idx)
 {
-	uint8 *celldata;
-	int fd;
-	CELLHEADER cellhdr;
+	uint8 width, height;
 	RD_HBITMAP bitmap;
+	uint8 * data;
 
 	if (!(pcache->rdp->settings->bitmap_cache_persist_enable))
 		return False;
@@ -58,57 +720,261 @@ pstcache_load_bitmap(rdpPcache * pcache, uint8 cache_id, uint16 cache_idx)
 	if (!IS_PERSISTENT(cache_id) || cache_idx >= BMPCACHE2_NUM_PSTCELLS)
 		return False;
 
-	fd = pcache->pstcache_fd[cache_id];
-	rd_lseek_file(fd, cache_idx *
-			(pcache->pstcache_Bpp * MAX_CELL_SIZE + sizeof(CELLHEADER)));
-	rd_read_file(fd, &cellhdr, sizeof(CELLHEADER));
-	celldata = (uint8 *) xmalloc(cellhdr.length);
-	rd_read_file(fd, celldata, cellhdr.length);
+	PSTCACHE_LOCK(pcache);
+	data = pstcache_read_cell(pcache, cache_id, cache_idx, &width, &height);
+	if (data == NULL)
+	{
+		PSTCACHE_UNLOCK(pcache);
+		return False;
+	}
+
+	bitmap = ui_create_bitmap(pcache->rdp->inst, width, height, data);
+	PSTCACHE_UNLOCK(pcache);
 
-	bitmap = ui_create_bitmap(pcache->rdp->inst, cellhdr.width, cellhdr.height, celldata);
 	DEBUG_CACHE("Load bitmap from disk: id=%d, idx=%d, bmp=0x%x)",
 			cache_id, cache_idx, (unsigned int) bitmap);
 	cache_put_bitmap(pcache->rdp->cache, cache_id, cache_idx, bitmap);
 
-	xfree(celldata);
 	return True;
 }
 
-/* Store a bitmap in the persistent cache */
+/* Store a bitmap in the persistent cache, through the writer thread when it runs */
 RD_BOOL
 pstcache_save_bitmap(rdpPcache * pcache, uint8 cache_id, uint16 cache_idx, uint8 * key,
 		     uint8 width, uint8 height, uint16 length, uint8 * data)
 {
-	int fd;
-	CELLHEADER cellhdr;
+	int first;
+	CELLHEADER hdr;
 
 	if (!IS_PERSISTENT(cache_id) || cache_idx >= BMPCACHE2_NUM_PSTCELLS)
 		return False;
 
-	memcpy(cellhdr.key, key, sizeof(HASH_KEY));
-	cellhdr.width = width;
-	cellhdr.height = height;
-	cellhdr.length = length;
-	cellhdr.stamp = 0;
+	if (length > PSTCACHE_CELL_SIZE(pcache))
+		return False;
+
+	memset(&hdr, 0, sizeof(CELLHEADER));
+	memcpy(hdr.key, key, sizeof(HASH_KEY));
+	hdr.width = width;
+	hdr.height = height;
+	hdr.length = length;
+	hdr.stored = length;
+	hdr.stamp = ++pcache->stamp;
+
+#ifndef _WIN32
+	if (pcache->writer_running)
+		return pstcache_queue_save(pcache, cache_id, cache_idx, &hdr, data);
+#endif
+
+	if (pcache->pstcache_compress)
+		data = pstcache_compress_cell(data, length, pcache->pstcache_buf, &hdr.stored, &hdr.flags);
+
+	first = pstcache_place_cell(pcache, cache_id, cache_idx, hdr.stored);
+	if (first < 0)
+		return False;
 
-	fd = pcache->pstcache_fd[cache_id];
-	rd_lseek_file(fd, cache_idx *
-			(pcache->pstcache_Bpp * MAX_CELL_SIZE + sizeof(CELLHEADER)));
-	rd_write_file(fd, &cellhdr, sizeof(CELLHEADER));
-	rd_write_file(fd, data, length);
+	hdr.offset = first;
+	memcpy(pcache->pstcache_map[cache_id] + pstcache_cell_pos(pcache, cache_idx, first), data, hdr.stored);
+	memcpy(pstcache_cell_header(pcache, cache_id, cache_idx), &hdr, sizeof(CELLHEADER));
 
 	return True;
 }
 
+/* Wait until the queued saves are on disk */
+void
+pstcache_flush(rdpPcache * pcache)
+{
+#ifndef _WIN32
+	if (!pcache->writer_running)
+		return;
+
+	pthread_mutex_lock(&pcache->lock);
+	while (pcache->queue_head != NULL || pcache->writer_busy)
+		pthread_cond_wait(&pcache->drained_cond, &pcache->lock);
+	pthread_mutex_unlock(&pcache->lock);
+#endif
+}
+
+/* Sort cell indexes by ascending stamp, a stable radix sort one byte at a time */
+static void
+pstcache_sort_stamps(sint16 * idx, uint32 * stamp, int count)
+{
+	int i, b, n, sum, shift;
+	int pos[256];
+	sint16 tmp_idx[BMPCACHE2_NUM_PSTCELLS];
+	uint32 tmp_stamp[BMPCACHE2_NUM_PSTCELLS];
+
+	for (shift = 0; shift < 32; shift += 8)
+	{
+		memset(pos, 0, sizeof(pos));
+		for (i = 0; i < count; i++)
+			pos[(stamp[i] >> shift) & 0xff]++;
+
+		for (b = 0, sum = 0; b < 256; b++)
+		{
+			n = pos[b];
+			pos[b] = sum;
+			sum += n;
+		}
+
+		for (i = 0; i < count; i++)
+		{
+			b = (stamp[i] >> shift) & 0xff;
+			tmp_idx[pos[b]] = idx[i];
+			tmp_stamp[pos[b]] = stamp[i];
+			pos[b]++;
+		}
+
+		memcpy(idx, tmp_idx, count * sizeof(sint16));
+		memcpy(stamp, tmp_stamp, count * sizeof(uint32));
+	}
+}
+
+/* Number of most recently used cells loaded ahead of time, older ones would be evicted again */
+static int
+pstcache_precache_start(rdpPcache * pcache)
+{
+	int n;
+
+	if (!(pcache->rdp->settings->bitmap_cache_precache &&
+	      pcache->rdp->settings->server_depth > 8))
+		return pcache->scan_count;
+
+	n = pcache->scan_count - BMPCACHE2_C2_CELLS;
+	if (n < 0)
+		n = 0;
+
+	/* never used cells are not loaded */
+	while (n < pcache->scan_count && pcache->scan_mru_stamp[n] == 0)
+		n++;
+
+	return n;
+}
+
+/* Move a cell down into a hole left by a released cell, returns False if the cell was dropped */
+static RD_BOOL
+pstcache_move_cell(rdpPcache * pcache, uint8 cache_id, uint16 from_idx, uint16 to_idx)
+{
+	CELLHEADER * from = pstcache_cell_header(pcache, cache_id, from_idx);
+	CELLHEADER * to = pstcache_cell_header(pcache, cache_id, to_idx);
+
+	/* compressed cells keep their blocks, only the fixed slots have to be copied */
+	if (!pcache->pstcache_compress)
+	{
+		if (!pstcache_check_cell(pcache, cache_id, from_idx, from))
+		{
+			memset(from, 0, sizeof(CELLHEADER));
+			return False;
+		}
+
+		memcpy(pcache->pstcache_map[cache_id] + pstcache_cell_pos(pcache, to_idx, 0),
+			pcache->pstcache_map[cache_id] + pstcache_cell_pos(pcache, from_idx, 0), from->stored);
+	}
+
+	memcpy(to, from, sizeof(CELLHEADER));
+	memset(from, 0, sizeof(CELLHEADER));
+	return True;
+}
+
+/* Read the cell index of cache scan_id and fault in the cells to be precached */
+static void
+pstcache_scan(rdpPcache * pcache)
+{
+	int n;
+	int count;
+	int offset;
+	uint16 idx;
+	uint8 * data;
+	uint8 id = pcache->scan_id;
+	CELLHEADER * cellhdr;
+	CELLHEADER * kept;
+
+	/*
+	 * The server numbers the keys in the order they are listed, so the
+	 * cells after a hole left by a released cell are moved down and
+	 * the index stays dense.
+	 */
+	count = 0;
+	cellhdr = pstcache_cell_header(pcache, id, 0);
+	for (idx = 0; idx < BMPCACHE2_NUM_PSTCELLS; idx++, cellhdr++)
+	{
+		if (memcmp(cellhdr->key, pcache->zero_key, sizeof(HASH_KEY)) == 0)
+			continue;
+
+		if (idx != count && !pstcache_move_cell(pcache, id, idx, count))
+			continue;
+
+		kept = pstcache_cell_header(pcache, id, count);
+		memcpy(pcache->scan_keys[count], kept->key, sizeof(HASH_KEY));
+		pcache->scan_mru_idx[count] = count;
+		pcache->scan_mru_stamp[count] = kept->stamp;
+		count++;
+	}
+
+	pcache->scan_count = count;
+	pstcache_sort_stamps(pcache->scan_mru_idx, pcache->scan_mru_stamp, count);
+
+	/* touch one byte per page so the precache does not wait on the disk */
+	for (n = pstcache_precache_start(pcache); n < pcache->scan_count; n++)
+	{
+		idx = pcache->scan_mru_idx[n];
+		cellhdr = pstcache_cell_header(pcache, id, idx);
+		if (!pstcache_check_cell(pcache, id, idx, cellhdr))
+			continue;
+
+		data = pstcache_cell_data(pcache, id, idx);
+
+		for (offset = 0; offset < cellhdr->stored; offset += PSTCACHE_PAGE_SIZE)
+			(void) ((volatile uint8 *) data)[offset];
+	}
+}
+
+#ifndef _WIN32
+static void *
+pstcache_scan_thread(void * arg)
+{
+	pstcache_scan((rdpPcache *) arg);
+	return NULL;
+}
+#endif
+
+/* Start scanning the index of a cache in the background */
+static void
+pstcache_start_scan(rdpPcache * pcache, uint8 id)
+{
+	if (pcache->scan_running)
+		return;
+
+	pcache->scan_id = id;
+	pcache->scan_count = -1;
+#ifndef _WIN32
+	if (pthread_create(&pcache->scan_thread, NULL, pstcache_scan_thread, pcache) == 0)
+		pcache->scan_running = True;
+#endif
+}
+
+/* Wait for the background scan, or scan now if it was never started */
+static void
+pstcache_finish_scan(rdpPcache * pcache, uint8 id)
+{
+#ifndef _WIN32
+	if (pcache->scan_running)
+	{
+		pthread_join(pcache->scan_thread, NULL);
+		pcache->scan_running = False;
+	}
+#endif
+	if (pcache->scan_id != id || pcache->scan_count < 0)
+	{
+		pcache->scan_id = id;
+		pstcache_scan(pcache);
+	}
+}
+
 /* List the bitmap keys from the persistent cache file */
 int
 pstcache_enumerate(rdpPcache * pcache, uint8 id, HASH_KEY * keylist)
 {
-	int fd, n;
-	uint16 idx;
-	sint16 mru_idx[0xa00];
-	uint32 mru_stamp[0xa00];
-	CELLHEADER cellhdr;
+	int n;
 
 	if (!(pcache->rdp->settings->bitmap_cache &&
 	      pcache->rdp->settings->bitmap_cache_persist_enable &&
@@ -120,44 +986,106 @@ pstcache_enumerate(rdpPcache * pcache, uint8 id, HASH_KEY * keylist)
 		return 0;
 
 	DEBUG_CACHE("Persistent bitmap cache enumeration... ");
-	for (idx = 0; idx < BMPCACHE2_NUM_PSTCELLS; idx++)
-	{
-		fd = pcache->pstcache_fd[id];
-		rd_lseek_file(fd, idx *
-			(pcache->pstcache_Bpp * MAX_CELL_SIZE + sizeof(CELLHEADER)));
-		if (rd_read_file(fd, &cellhdr, sizeof(CELLHEADER)) <= 0)
-			break;
+	pstcache_finish_scan(pcache, id);
+	memcpy(keylist, pcache->scan_keys, pcache->scan_count * sizeof(HASH_KEY));
 
-		if (memcmp(cellhdr.key, pcache->zero_key, sizeof(HASH_KEY)) != 0)
-		{
-			memcpy(keylist[idx], cellhdr.key, sizeof(HASH_KEY));
+	/* Pre-cache (not possible for 8 bit color depth cause it needs a colormap) */
+	for (n = pstcache_precache_start(pcache); n < pcache->scan_count; n++)
+		pstcache_load_bitmap(pcache, id, pcache->scan_mru_idx[n]);
 
-			/* Pre-cache (not possible for 8 bit color depth cause it needs a colormap) */
-			if (pcache->rdp->settings->bitmap_cache_precache && cellhdr.stamp &&
-			    pcache->rdp->settings->server_depth > 8)
-				pstcache_load_bitmap(pcache, id, idx);
+	DEBUG_CACHE("%d cached bitmaps.", pcache->scan_count);
 
-			/* Sort by stamp */
-			for (n = idx; n > 0 && cellhdr.stamp < mru_stamp[n - 1]; n--)
-			{
-				mru_idx[n] = mru_idx[n - 1];
-				mru_stamp[n] = mru_stamp[n - 1];
-			}
+	cache_rebuild_bmpcache_linked_list(pcache->rdp->cache, id, pcache->scan_mru_idx, pcache->scan_count);
+	pcache->pstcache_enumerated = True;
+	return pcache->scan_count;
+}
+
+/* Rebuild the free block map from the index, cells that overlap or run past the pool are dropped */
+static void
+pstcache_load_free_map(rdpPcache * pcache, uint8 cache_id)
+{
+	int i, count;
+	uint16 idx;
+	uint8 * map;
+	CELLHEADER * cellhdr;
 
-			mru_idx[n] = idx;
-			mru_stamp[n] = cellhdr.stamp;
+	map = (uint8 *) xmalloc((pcache->pstcache_num_blocks + 7) / 8);
+	memset(map, 0, (pcache->pstcache_num_blocks + 7) / 8);
+	pcache->pstcache_free_map[cache_id] = map;
+	pcache->pstcache_rover[cache_id] = 0;
+
+	if (pcache->pstcache_buf == NULL)
+		pcache->pstcache_buf = (uint8 *) xmalloc(PSTCACHE_CELL_SIZE(pcache));
+
+	cellhdr = pstcache_cell_header(pcache, cache_id, 0);
+	for (idx = 0; idx < BMPCACHE2_NUM_PSTCELLS; idx++, cellhdr++)
+	{
+		if (memcmp(cellhdr->key, pcache->zero_key, sizeof(HASH_KEY)) == 0)
+			continue;
+
+		count = PSTCACHE_BLOCKS(cellhdr->stored);
+		if (!pstcache_check_cell(pcache, cache_id, idx, cellhdr))
+		{
+			memset(cellhdr, 0, sizeof(CELLHEADER));
+			continue;
 		}
-		else
+
+		for (i = cellhdr->offset; i < cellhdr->offset + count; i++)
 		{
-			break;
+			if (map[i >> 3] & (1 << (i & 7)))
+				break;
 		}
+
+		if (i < cellhdr->offset + count)
+			memset(cellhdr, 0, sizeof(CELLHEADER));
+		else
+			pstcache_mark_blocks(pcache, cache_id, cellhdr->offset, count, True);
 	}
+}
+
+/* Stamps handed out this session start above every stamp in the index */
+static void
+pstcache_load_stamps(rdpPcache * pcache, uint8 cache_id)
+{
+	uint16 idx;
+	CELLHEADER * cellhdr;
 
-	DEBUG_CACHE("%d cached bitmaps.", idx);
+	cellhdr = pstcache_cell_header(pcache, cache_id, 0);
+	for (idx = 0; idx < BMPCACHE2_NUM_PSTCELLS; idx++, cellhdr++)
+	{
+		if (cellhdr->stamp > pcache->stamp)
+			pcache->stamp = cellhdr->stamp;
+	}
+}
 
-	cache_rebuild_bmpcache_linked_list(pcache->rdp->cache, id, mru_idx, idx);
-	pcache->pstcache_enumerated = True;
-	return idx;
+/* Close a cache file opened at another color depth, before anything was saved to it */
+static void
+pstcache_close_file(rdpPcache * pcache, uint8 cache_id)
+{
+	pstcache_flush(pcache);
+#ifndef _WIN32
+	if (pcache->scan_running)
+	{
+		pthread_join(pcache->scan_thread, NULL);
+		pcache->scan_running = False;
+	}
+	xfree(pcache->pending[cache_id]);
+	pcache->pending[cache_id] = NULL;
+#endif
+	pcache->scan_count = -1;
+
+	rd_unmap_file(pcache->pstcache_map[cache_id], pcache->pstcache_map_size[cache_id]);
+	rd_close_file(pcache->pstcache_fd[cache_id]);
+	pcache->pstcache_map[cache_id] = NULL;
+	pcache->pstcache_map_size[cache_id] = 0;
+	pcache->pstcache_fd[cache_id] = 0;
+
+	xfree(pcache->pstcache_free_map[cache_id]);
+	pcache->pstcache_free_map[cache_id] = NULL;
+
+	/* the buffer holds a cell at the old depth */
+	xfree(pcache->pstcache_buf);
+	pcache->pstcache_buf = NULL;
 }
 
 /* initialise the persistent bitmap cache */
@@ -165,11 +1093,24 @@ RD_BOOL
 pstcache_init(rdpPcache * pcache, uint8 cache_id)
 {
 	int fd;
+	int size;
+	uint8 * map;
 	char filename[256];
+	PSTCACHE_FILEHEADER * header;
 
 	if (pcache->pstcache_enumerated)
 		return True;
 
+	/* the cache may have been opened before the color depth was negotiated */
+	if (pcache->pstcache_map[cache_id] != NULL)
+	{
+		if (pcache->pstcache_Bpp == (pcache->rdp->settings->server_depth + 7) / 8)
+			return True;
+
+		DEBUG_CACHE("color depth changed, reopening persistent bitmap cache %d", cache_id);
+		pstcache_close_file(pcache, cache_id);
+	}
+
 	pcache->pstcache_fd[cache_id] = 0;
 
 	if (!(pcache->rdp->settings->bitmap_cache &&
@@ -183,7 +1124,9 @@ pstcache_init(rdpPcache * pcache, uint8 cache_id)
 	}
 
 	pcache->pstcache_Bpp = (pcache->rdp->settings->server_depth + 7) / 8;
-	sprintf(filename, "cache/pstcache_%d_%d", cache_id, pcache->pstcache_Bpp);
+	pcache->pstcache_compress = pcache->rdp->settings->bitmap_cache_persist_compress;
+	sprintf(filename, "cache/pstcache_%d_%d%s", cache_id, pcache->pstcache_Bpp,
+		pcache->pstcache_compress ? "_z" : "");
 	DEBUG_CACHE("persistent bitmap cache file: %s", filename);
 
 	fd = rd_open_file(filename);
@@ -197,7 +1140,60 @@ pstcache_init(rdpPcache * pcache, uint8 cache_id)
 		return False;
 	}
 
+	if (pcache->pstcache_compress)
+	{
+		pcache->pstcache_num_blocks = BMPCACHE2_NUM_PSTCELLS *
+			PSTCACHE_BLOCKS(PSTCACHE_CELL_SIZE(pcache)) / PSTCACHE_POOL_RATIO;
+		size = PSTCACHE_DATA_OFFSET + pcache->pstcache_num_blocks * PSTCACHE_BLOCK_SIZE;
+	}
+	else
+	{
+		size = PSTCACHE_DATA_OFFSET + BMPCACHE2_NUM_PSTCELLS * PSTCACHE_CELL_SIZE(pcache);
+	}
+
+	map = (uint8 *) rd_map_file(fd, size);
+	if (map == NULL)
+	{
+		DEBUG_CACHE("failed to map the persistent bitmap cache file");
+		rd_close_file(fd);
+		return False;
+	}
+
+	/* files from older versions or other layouts start out empty */
+	header = (PSTCACHE_FILEHEADER *) map;
+	if (header->magic != PSTCACHE_MAGIC || header->version != PSTCACHE_VERSION ||
+	    header->Bpp != pcache->pstcache_Bpp || header->num_cells != BMPCACHE2_NUM_PSTCELLS ||
+	    header->flags != (pcache->pstcache_compress ? PSTCACHE_COMPRESSED : 0))
+	{
+		memset(map, 0, PSTCACHE_DATA_OFFSET);
+		header->magic = PSTCACHE_MAGIC;
+		header->version = PSTCACHE_VERSION;
+		header->Bpp = pcache->pstcache_Bpp;
+		header->num_cells = BMPCACHE2_NUM_PSTCELLS;
+		header->flags = pcache->pstcache_compress ? PSTCACHE_COMPRESSED : 0;
+	}
+
+	pcache->pstcache_map[cache_id] = map;
+	pcache->pstcache_map_size[cache_id] = size;
 	pcache->pstcache_fd[cache_id] = fd;
+
+	if (pcache->pstcache_compress)
+		pstcache_load_free_map(pcache, cache_id);
+
+	pstcache_load_stamps(pcache, cache_id);
+
+#ifndef _WIN32
+	pcache->pending[cache_id] = (PSTCACHE_SAVE **) xmalloc(BMPCACHE2_NUM_PSTCELLS * sizeof(PSTCACHE_SAVE *));
+	memset(pcache->pending[cache_id], 0, BMPCACHE2_NUM_PSTCELLS * sizeof(PSTCACHE_SAVE *));
+	if (!pcache->writer_running &&
+	    pthread_create(&pcache->writer_thread, NULL, pstcache_writer, pcache) == 0)
+		pcache->writer_running = True;
+#endif
+
+	/* the key list is only sent for the last cache */
+	if (cache_id == 2)
+		pstcache_start_scan(pcache, cache_id);
+
 	return True;
 }
 
@@ -211,6 +1207,11 @@ pcache_new(struct rdp_rdp * rdp)
 	{
 		memset(self, 0, sizeof(rdpPcache));
 		self->rdp = rdp;
+#ifndef _WIN32
+		pthread_mutex_init(&self->lock, NULL);
+		pthread_cond_init(&self->writer_cond, NULL);
+		pthread_cond_init(&self->drained_cond, NULL);
+#endif
 	}
 	return self;
 }
@@ -218,8 +1219,41 @@ pcache_new(struct rdp_rdp * rdp)
 void
 pcache_free(rdpPcache * pcache)
 {
+	int id;
+
 	if (pcache != NULL)
 	{
+#ifndef _WIN32
+		if (pcache->scan_running)
+			pthread_join(pcache->scan_thread, NULL);
+
+		/* the writer empties the queue before it stops */
+		if (pcache->writer_running)
+		{
+			pthread_mutex_lock(&pcache->lock);
+			pcache->writer_stop = True;
+			pthread_cond_signal(&pcache->writer_cond);
+			pthread_mutex_unlock(&pcache->lock);
+			pthread_join(pcache->writer_thread, NULL);
+		}
+#endif
+		for (id = 0; id < 8; id++)
+		{
+			if (pcache->pstcache_map[id] != NULL)
+				rd_unmap_file(pcache->pstcache_map[id], pcache->pstcache_map_size[id]);
+			if (pcache->pstcache_fd[id] > 0)
+				rd_close_file(pcache->pstcache_fd[id]);
+			xfree(pcache->pstcache_free_map[id]);
+#ifndef _WIN32
+			xfree(pcache->pending[id]);
+#endif
+		}
+		xfree(pcache->pstcache_buf);
+#ifndef _WIN32
+		pthread_mutex_destroy(&pcache->lock);
+		pthread_cond_destroy(&pcache->writer_cond);
+		pthread_cond_destroy(&pcache->drained_cond);
+#endif
 		xfree(pcache);
 	}
 }
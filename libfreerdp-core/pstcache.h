@@ -20,8 +20,37 @@
 #ifndef __PSTCACHE_H
 #define __PSTCACHE_H
 
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
 typedef uint8 HASH_KEY[8];
 
+#define PSTCACHE_MAGIC		0x43505246	/* "FRPC" */
+#define PSTCACHE_VERSION	3
+
+/* file header flags */
+#define PSTCACHE_COMPRESSED	0x0001
+
+/* cell header flags */
+#define PSTCACHE_CELL_LZ	0x0001
+
+/*
+ * The persistent bitmap cache file is mapped in memory and laid out as
+ * the file header, followed by the cell header index and the page
+ * aligned cell data. Without compression each cell has a fixed size
+ * slot. With compression the cells are stored in runs of blocks taken
+ * from a smaller shared pool, tracked by a free block map.
+ */
+typedef struct _PSTCACHE_FILEHEADER
+{
+	uint32 magic;
+	uint32 version;
+	uint32 Bpp;
+	uint32 num_cells;
+	uint32 flags;
+} PSTCACHE_FILEHEADER;
+
 /* Header for an entry in the persistent bitmap cache file */
 typedef struct _PSTCACHE_CELLHEADER
 {
@@ -29,20 +58,71 @@ typedef struct _PSTCACHE_CELLHEADER
 	uint8 width, height;
 	uint16 length;
 	uint32 stamp;
+	uint32 offset;		/* first block, compressed layout only */
+	uint16 stored;		/* bytes in the file */
+	uint16 flags;
 } CELLHEADER;
 
+#ifndef _WIN32
+/* A bitmap waiting for the persistent cache writer thread */
+typedef struct _PSTCACHE_SAVE PSTCACHE_SAVE;
+struct _PSTCACHE_SAVE
+{
+	PSTCACHE_SAVE * next;
+	uint8 cache_id;
+	uint16 cache_idx;
+	CELLHEADER hdr;
+	uint8 * data;		/* raw pixels */
+	uint8 * stored_data;	/* what goes to the file, data or a compressed copy */
+	int pos;
+	RD_BOOL queued;		/* not yet taken by the writer, may be replaced */
+	RD_BOOL failed;
+};
+#endif
+
 struct rdp_pcache
 {
 	struct rdp_rdp * rdp;
 	int pstcache_Bpp;
 	int pstcache_fd[8];
+	uint8 * pstcache_map[8];
+	int pstcache_map_size[8];
 	RD_BOOL pstcache_enumerated;
+	RD_BOOL pstcache_compress;
+	int pstcache_num_blocks;
+	uint8 * pstcache_free_map[8];
+	int pstcache_rover[8];
+	uint8 * pstcache_buf;
 	uint8 zero_key[8];
+	uint32 stamp;		/* last stamp handed out, above those read from the files */
+	/* index scan result, sorted by ascending stamp */
+	int scan_id;
+	int scan_count;
+	HASH_KEY scan_keys[BMPCACHE2_NUM_PSTCELLS];
+	sint16 scan_mru_idx[BMPCACHE2_NUM_PSTCELLS];
+	uint32 scan_mru_stamp[BMPCACHE2_NUM_PSTCELLS];
+	RD_BOOL scan_running;
+#ifndef _WIN32
+	pthread_t scan_thread;
+	/* write-behind queue */
+	PSTCACHE_SAVE * queue_head;
+	PSTCACHE_SAVE * queue_tail;
+	PSTCACHE_SAVE ** pending[8];
+	int queue_bytes;
+	int queue_dropped;
+	RD_BOOL writer_running;
+	RD_BOOL writer_busy;
+	RD_BOOL writer_stop;
+	pthread_t writer_thread;
+	pthread_mutex_t lock;
+	pthread_cond_t writer_cond;
+	pthread_cond_t drained_cond;
+#endif
 };
 typedef struct rdp_pcache rdpPcache;
 
 void
-pstcache_touch_bitmap(rdpPcache * pcache, uint8 cache_id, uint16 cache_idx, uint32 stamp);
+pstcache_touch_bitmap(rdpPcache * pcache, uint8 cache_id, uint16 cache_idx);
 RD_BOOL
 pstcache_load_bitmap(rdpPcache * pcache, uint8 cache_id, uint16 cache_idx);
 RD_BOOL
@@ -50,6 +130,8 @@ pstcache_save_bitmap(rdpPcache * pcache, uint8 cache_id, uint16 cache_idx, uint8
 		     uint8 width, uint8 height, uint16 length, uint8 * data);
 int
 pstcache_enumerate(rdpPcache * pcache, uint8 id, HASH_KEY * keylist);
+void
+pstcache_flush(rdpPcache * pcache);
 RD_BOOL
 pstcache_init(rdpPcache * pcache, uint8 cache_id);
 rdpPcache *
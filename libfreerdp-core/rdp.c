@@ -21,6 +21,7 @@
 #ifndef _WIN32
 #include <errno.h>
 #include <unistd.h>
+#include <sys/time.h>
 #endif
 #include "frdp.h"
 #include "iso.h"
@@ -203,21 +204,63 @@ rdp_send_data(rdpRdp * rdp, STREAM s, uint8 data_pdu_type)
 
 /* Send a fast path RDP data packet */
 static void
-rdp_fp_send(rdpRdp * rdp, STREAM s)
+rdp_fp_send(rdpRdp * rdp, STREAM s, int num_events)
 {
-	sec_fp_send(rdp->sec, s, rdp->settings->encryption ? SEC_ENCRYPT : 0);
+	sec_fp_send(rdp->sec, s, rdp->settings->encryption ? SEC_ENCRYPT : 0, num_events);
 }
 
+static uint32
+rdp_get_ticks(void)
+{
+#ifdef _WIN32
+	return GetTickCount();
+#else
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000 + tv.tv_usec / 1000;
+#endif
+}
+
+/* Acknowledge a frame once the ui has presented it @msdn{dd342475} */
 int
 rdp_send_frame_ack(rdpRdp * rdp, int frame_id)
 {
 	STREAM s;
+	uint32 now;
+	sint32 sample;
 
 	if (rdp->send_frame_ack == 0)
 	{
 		return 0;
 	}
-	printf("send_frame_ack: frame_id %d\n", frame_id);
+
+	/* the ack may come from inside ui_decode, count the decode so far */
+	now = rdp_get_ticks();
+	sample = rdp->frame_ticks;
+	if (rdp->in_decode)
+	{
+		sample += now - rdp->decode_ticks;
+		rdp->decode_ticks = now;
+	}
+	rdp->frame_ticks = 0;
+
+	/* running average over about eight frames, in 1/16 ms */
+	sample *= 16;
+	if (rdp->frames_acked == 0)
+		rdp->frame_time = sample;
+	else
+		rdp->frame_time += (sample - rdp->frame_time) / 8;
+	rdp->frames_acked++;
+
+	/* the server counts the frames in flight from the last id acked */
+	if ((uint32) frame_id == rdp->frame_last_end)
+		rdp->frames_pending = 0;
+	else if (rdp->frames_pending > 0)
+		rdp->frames_pending--;
+
+	DEBUG_RDP("frame_id %d pending %d frame time %d/16 ms",
+		frame_id, rdp->frames_pending, rdp->frame_time);
 	s = rdp_init_data(rdp, 4);
 	out_uint32_le(s, frame_id);
 	s_mark_end(s);
@@ -361,6 +404,9 @@ rdp_send_client_info(rdpRdp * rdp, uint32 flags, char *domain_name,
 	if (rdp->settings->rdp_version >= 5)
 		length += 180 + (2 * 4) + cbClientAddress + cbClientDir;
 
+	if (rdp->settings->rdp_version >= 5 && rdp->arc_valid)
+		length += 28;
+
 	sec_flags = SEC_INFO_PKT | (rdp->settings->encryption ? SEC_ENCRYPT : 0);
 	s = sec_init(rdp->sec, sec_flags, length);
 
@@ -413,8 +459,22 @@ rdp_send_client_info(rdpRdp * rdp, uint32 flags, char *domain_name,
 			rdp->settings->performanceflags |= PERF_ENABLE_DESKTOP_COMPOSITION;
 		}
 		out_uint32_le(s, rdp->settings->performanceflags);	/* performanceFlags */
-		out_uint16_le(s, 0);					/* cbAutoReconnectLen */
-		/* autoReconnectCookie */ /* FIXME: populate this field */
+		if (rdp->arc_valid)
+		{
+			/* resume the disconnected session without a new logon */
+			uint8 verifier[16];
+
+			sec_arc_verifier(rdp->sec, rdp->arc_random, verifier);
+			out_uint16_le(s, 28);				/* cbAutoReconnectLen */
+			out_uint32_le(s, 28);				/* cbLen */
+			out_uint32_le(s, 1);				/* version */
+			out_uint32_le(s, rdp->arc_logon_id);		/* logonId */
+			out_uint8p(s, verifier, 16);			/* securityVerifier */
+		}
+		else
+		{
+			out_uint16_le(s, 0);				/* cbAutoReconnectLen */
+		}
 		/* reserved1 (2 bytes) */
 		/* reserved2 (2 bytes) */
 	}
@@ -461,141 +521,155 @@ rdp_send_synchronize(rdpRdp * rdp)
 	rdp_send_data(rdp, s, RDP_DATA_PDU_SYNCHRONIZE);
 }
 
-/* Send a single keyboard input event, slowpath @msdn{cc240583} or fastpath @msdn{cc240591}.
- * keyCode is similar to a scancode but different. */
+/* Send the queued input events in one PDU, slowpath @msdn{cc746160} or fastpath @msdn{cc240589} */
 void
-rdp_send_input_scancode(rdpRdp * rdp, time_t time, RD_BOOL up, RD_BOOL extended, uint8 keyCode)
+rdp_send_input_flush(rdpRdp * rdp)
 {
 	STREAM s;
+	struct rdp_input_event * ev;
+	int index;
+
+	if (rdp->input_count == 0)
+		return;
 
 	if (rdp->use_input_fast_path)
 	{
-		/* @msdn{cc240592} */
-		uint8 fp_flags = FASTPATH_INPUT_EVENT_SCANCODE << 5 |
-				(up ? FASTPATH_INPUT_KBDFLAGS_RELEASE : 0) |
-				(extended ? FASTPATH_INPUT_KBDFLAGS_EXTENDED : 0);
-		s = rdp_fp_init(rdp, 2);
-		out_uint8(s, fp_flags);
-		out_uint8(s, keyCode);
+		s = rdp_fp_init(rdp, rdp->input_count * 7);
+		for (index = 0; index < rdp->input_count; index++)
+		{
+			ev = &rdp->input_queue[index];
+			switch (ev->type)
+			{
+				case RDP_INPUT_EVENT_SCANCODE:
+					/* @msdn{cc240592} */
+					out_uint8(s, FASTPATH_INPUT_EVENT_SCANCODE << 5 |
+						((ev->param1 & KBDFLAGS_RELEASE) ? FASTPATH_INPUT_KBDFLAGS_RELEASE : 0) |
+						((ev->param1 & KBDFLAGS_EXTENDED) ? FASTPATH_INPUT_KBDFLAGS_EXTENDED : 0));
+					out_uint8(s, ev->param2);
+					break;
+
+				case RDP_INPUT_EVENT_MOUSE:
+					/* @msdn{cc240594} */
+					out_uint8(s, FASTPATH_INPUT_EVENT_MOUSE << 5);
+					out_uint16_le(s, ev->param1);
+					out_uint16_le(s, ev->param2);
+					out_uint16_le(s, ev->param3);
+					break;
+
+				case RDP_INPUT_EVENT_SYNC:
+					/* FASTPATH_INPUT_SYNC_SCROLL_LOCK = KBD_SYNC_SCROLL_LOCK = 1
+					   FASTPATH_INPUT_SYNC_NUM_LOCK    = KBD_SYNC_NUM_LOCK    = 2
+					   FASTPATH_INPUT_SYNC_CAPS_LOCK   = KBD_SYNC_CAPS_LOCK   = 4
+					   FASTPATH_INPUT_SYNC_KANA_LOCK   = KBD_SYNC_KANA_LOCK   = 8 */
+					out_uint8(s, FASTPATH_INPUT_EVENT_SYNC << 5 | (ev->param2 & 0xf));
+					break;
+
+				case RDP_INPUT_EVENT_UNICODE:
+					out_uint8(s, FASTPATH_INPUT_EVENT_UNICODE << 5);
+					out_uint16_le(s, ev->param2);
+					break;
+			}
+		}
 		s_mark_end(s);
-		rdp_fp_send(rdp, s);
+		rdp_fp_send(rdp, s, rdp->input_count);
 	}
 	else
 	{
-		/* @msdn{cc240584} */
-		uint16 keyboardFlags =
-				(up ? KBDFLAGS_DOWN | KBDFLAGS_RELEASE : 0) |
-				(extended ? KBDFLAGS_EXTENDED : 0);
-		s = rdp_init_data(rdp, 16);
-		out_uint16_le(s, 1); /* number of events */
-		out_uint16_le(s, 0); /* pad */
-		out_uint32_le(s, (uint32)time);
-		out_uint16_le(s, RDP_INPUT_EVENT_SCANCODE);
-		out_uint16_le(s, keyboardFlags);
-		out_uint16_le(s, keyCode);
+		s = rdp_init_data(rdp, 4 + rdp->input_count * 12);
+		out_uint16_le(s, rdp->input_count); /* number of events */
 		out_uint16_le(s, 0); /* pad */
+		for (index = 0; index < rdp->input_count; index++)
+		{
+			/* the slow path events are all 12 bytes long */
+			ev = &rdp->input_queue[index];
+			out_uint32_le(s, ev->time); /* eventTime */
+			out_uint16_le(s, ev->type); /* messageType */
+			out_uint16_le(s, ev->param1);
+			out_uint16_le(s, ev->param2);
+			out_uint16_le(s, ev->param3);
+		}
 		s_mark_end(s);
 		rdp_send_data(rdp, s, RDP_DATA_PDU_INPUT);
 	}
+	rdp->input_count = 0;
+
+	/* input never waits in a batch of other PDUs */
+	network_flush(rdp->net);
 }
 
-/* Send a single mouse input event, slowpath or fastpath */
-void
-rdp_send_input_mouse(rdpRdp * rdp, time_t time, uint16 pointerFlags, uint16 xPos, uint16 yPos)
+/* Queue an input event, params are the three words of the slow path event.
+ * Pointer moves may wait up to settings->input_latency ms for more events,
+ * anything else goes out at once together with the moves before it. */
+static void
+rdp_queue_input(rdpRdp * rdp, time_t time, uint16 type, uint16 param1, uint16 param2, uint16 param3)
 {
-	STREAM s;
+	struct rdp_input_event * ev;
+	RD_BOOL move;
 
-	if (rdp->use_input_fast_path)
+	move = (type == RDP_INPUT_EVENT_MOUSE && param1 == PTRFLAGS_MOVE);
+	ev = (rdp->input_count > 0) ? &rdp->input_queue[rdp->input_count - 1] : NULL;
+	if (move && ev && ev->type == RDP_INPUT_EVENT_MOUSE && ev->param1 == PTRFLAGS_MOVE)
 	{
-		/* @msdn{cc240594} */
-		int fp_flags = FASTPATH_INPUT_EVENT_MOUSE << 5;
-		s = rdp_fp_init(rdp, 7);
-		out_uint8(s, fp_flags);
-		out_uint16_le(s, pointerFlags);
-		out_uint16_le(s, xPos);
-		out_uint16_le(s, yPos);
-		s_mark_end(s);
-		rdp_fp_send(rdp, s);
+		/* the server only needs the last of consecutive moves */
+		ev->time = (uint32) time;
+		ev->param2 = param2;
+		ev->param3 = param3;
 	}
 	else
 	{
-		/* @msdn{cc240586} */
-		s = rdp_init_data(rdp, 16);
-		out_uint16_le(s, 1); /* number of events */
-		out_uint16_le(s, 0); /* pad */
-		out_uint32_le(s, (uint32)time);
-		out_uint16_le(s, RDP_INPUT_EVENT_MOUSE);
-		out_uint16_le(s, pointerFlags);
-		out_uint16_le(s, xPos);
-		out_uint16_le(s, yPos);
-		s_mark_end(s);
-		rdp_send_data(rdp, s, RDP_DATA_PDU_INPUT);
+		if (rdp->input_count == RDP_INPUT_QUEUE_SIZE)
+			rdp_send_input_flush(rdp);
+		if (rdp->input_count == 0)
+			rdp->input_ticks = rdp_get_ticks();
+		ev = &rdp->input_queue[rdp->input_count++];
+		ev->time = (uint32) time;
+		ev->type = type;
+		ev->param1 = param1;
+		ev->param2 = param2;
+		ev->param3 = param3;
 	}
+
+	if (move && rdp->input_count < RDP_INPUT_QUEUE_SIZE &&
+		rdp_get_ticks() - rdp->input_ticks < (uint32) rdp->settings->input_latency)
+		return;
+
+	rdp_send_input_flush(rdp);
 }
 
-/* Send a single keyboard synchronize event */
+/* Send a keyboard input event, slowpath @msdn{cc240583} or fastpath @msdn{cc240591}.
+ * keyCode is similar to a scancode but different. */
 void
-rdp_sync_input(rdpRdp * rdp, time_t time, uint32 toggle_keys_state)
+rdp_send_input_scancode(rdpRdp * rdp, time_t time, RD_BOOL up, RD_BOOL extended, uint8 keyCode)
 {
-	STREAM s;
-	int fp_flags;
+	/* @msdn{cc240584} */
+	uint16 keyboardFlags =
+			(up ? KBDFLAGS_DOWN | KBDFLAGS_RELEASE : 0) |
+			(extended ? KBDFLAGS_EXTENDED : 0);
 
-	if (rdp->use_input_fast_path)
-	{
-		fp_flags = 3 << 5; /* FASTPATH_INPUT_EVENT_SYNC */
-		fp_flags |= toggle_keys_state & 0xf;
-		/* FASTPATH_INPUT_SYNC_SCROLL_LOCK = KBD_SYNC_SCROLL_LOCK = 1
-		   FASTPATH_INPUT_SYNC_NUM_LOCK    = KBD_SYNC_NUM_LOCK    = 2
-		   FASTPATH_INPUT_SYNC_CAPS_LOCK   = KBD_SYNC_CAPS_LOCK   = 4
-		   FASTPATH_INPUT_SYNC_KANA_LOCK   = KBD_SYNC_KANA_LOCK   = 8 */
-		s = rdp_fp_init(rdp, 1);
-		out_uint8(s, fp_flags);
-		s_mark_end(s);
-		rdp_fp_send(rdp, s);
-	}
-	else
-	{
-		s = rdp_init_data(rdp, 16);
-		out_uint16_le(s, 1); /* number of events */
-		out_uint16_le(s, 0); /* pad */
-		out_uint32_le(s, (uint32)time); /* eventTime */
-		out_uint16_le(s, RDP_INPUT_EVENT_SYNC); /* messageType */
-		out_uint16_le(s, 0); /* pad */
-		out_uint32_le(s, toggle_keys_state); /* toggleFlags */
-		s_mark_end(s);
-		rdp_send_data(rdp, s, RDP_DATA_PDU_INPUT);
-	}
+	rdp_queue_input(rdp, time, RDP_INPUT_EVENT_SCANCODE, keyboardFlags, keyCode, 0);
 }
 
-/* Send a single unicode character input event */
+/* Send a mouse input event, slowpath @msdn{cc240586} or fastpath */
 void
-rdp_send_input_unicode(rdpRdp * rdp, time_t time, uint16 unicode_character)
+rdp_send_input_mouse(rdpRdp * rdp, time_t time, uint16 pointerFlags, uint16 xPos, uint16 yPos)
 {
-	STREAM s;
-	int fp_flags;
+	rdp_queue_input(rdp, time, RDP_INPUT_EVENT_MOUSE, pointerFlags, xPos, yPos);
+}
 
-	if (rdp->use_input_fast_path)
-	{
-		fp_flags = 4 << 5; /* FASTPATH_INPUT_EVENT_UNICODE */
-		s = rdp_fp_init(rdp, 3);
-		out_uint8(s, fp_flags);
-		out_uint16_le(s, unicode_character);
-		s_mark_end(s);
-		rdp_fp_send(rdp, s);
-	}
-	else
-	{
-		s = rdp_init_data(rdp, 16);
-		out_uint16_le(s, 1); /* number of events */
-		out_uint16_le(s, 0); /* pad */
-		out_uint32_le(s, (uint32)time); /* eventTime */
-		out_uint16_le(s, RDP_INPUT_EVENT_UNICODE); /* messageType */
-		out_uint16_le(s, 0); /* pad */
-		out_uint16_le(s, unicode_character); /* Unicode character */
-		out_uint16_le(s, 0); /* pad */
-		s_mark_end(s);
-		rdp_send_data(rdp, s, RDP_DATA_PDU_INPUT);
-	}
+/* Send a keyboard synchronize event */
+void
+rdp_sync_input(rdpRdp * rdp, time_t time, uint32 toggle_keys_state)
+{
+	/* pad, then the 32 bit toggleFlags */
+	rdp_queue_input(rdp, time, RDP_INPUT_EVENT_SYNC, 0,
+		toggle_keys_state & 0xffff, toggle_keys_state >> 16);
+}
+
+/* Send a unicode character input event */
+void
+rdp_send_input_unicode(rdpRdp * rdp, time_t time, uint16 unicode_character)
+{
+	rdp_queue_input(rdp, time, RDP_INPUT_EVENT_UNICODE, 0, unicode_character, 0);
 }
 
 /* Send a client window information PDU */
@@ -1279,6 +1353,47 @@ process_set_error_info_pdu(STREAM s, struct rdp_inst *inst)
 	DEBUG_RDP("Received Set Error Information PDU with reason %x", inst->disc_reason);
 }
 
+/* Process Save Session Info PDU Data, keeping the auto-reconnect cookie */
+static void
+process_save_session_info_pdu(rdpRdp * rdp, STREAM s, uint8 * end)
+{
+	uint32 infoType;
+	uint32 fieldsPresent;
+	uint32 cbFieldData;
+	uint32 cbLen;
+	uint32 version;
+
+	if (end - s->p < 4)
+		return;
+	in_uint32_le(s, infoType);
+	if (infoType != INFOTYPE_LOGON_EXTENDED_INFO)
+		return; /* user logged on */
+
+	if (end - s->p < 6)
+		return;
+	in_uint8s(s, 2); /* length */
+	in_uint32_le(s, fieldsPresent);
+	if (!(fieldsPresent & LOGON_EX_AUTORECONNECTCOOKIE))
+		return;
+
+	if (end - s->p < 4 + 28)
+		return;
+	in_uint32_le(s, cbFieldData);
+	in_uint32_le(s, cbLen);
+	in_uint32_le(s, version);
+	if (cbFieldData < 28 || cbLen != 28 || version != 1)
+	{
+		DEBUG_RDP("ignoring auto-reconnect cookie version %d length %d", version, cbLen);
+		return;
+	}
+	in_uint32_le(s, rdp->arc_logon_id);
+	in_uint8a(s, rdp->arc_random, 16);
+	rdp->arc_valid = True;
+	DEBUG_RDP("auto-reconnect cookie for logon id %d", rdp->arc_logon_id);
+	/* logonErrors and the pad are not used */
+	s->p = end;
+}
+
 /* Process Data PDU */
 static RD_BOOL
 process_data_pdu(rdpRdp * rdp, STREAM s)
@@ -1349,7 +1464,7 @@ process_data_pdu(rdpRdp * rdp, STREAM s)
 
 		case RDP_DATA_PDU_SAVE_SESSION_INFO:
 			DEBUG_RDP("Received Logon PDU");
-			/* User logged on */
+			process_save_session_info_pdu(rdp, data_s, data_s_end);
 			break;
 
 		case RDP_DATA_PDU_FONTMAP:
@@ -1460,6 +1575,8 @@ process_redirect_pdu(rdpRdp * rdp, STREAM s)
 	{
 		printf("Redirecting to %s as %s@%s\n", rdp->redirect_server, rdp->redirect_username, rdp->redirect_domain);
 		rdp->redirect = True;
+		/* the cookie belongs to the session on the old server */
+		rdp->arc_valid = False;
 	}
 	/* TODO: LB_SMARTCARD_LOGON */
 
@@ -1469,6 +1586,28 @@ process_redirect_pdu(rdpRdp * rdp, STREAM s)
 }
 
 /* process fast path */
+/* Hand surface commands to the ui, timing it for the frame ack */
+static int
+rdp_ui_decode(rdpRdp * rdp, uint8 * data, int size)
+{
+	int rv;
+
+	rdp->in_decode = True;
+	rdp->decode_ticks = rdp_get_ticks();
+	rv = ui_decode(rdp->inst, data, size);
+	rdp->frame_ticks += rdp_get_ticks() - rdp->decode_ticks;
+	rdp->in_decode = False;
+
+	/* the server stops sending once the whole window is unacknowledged,
+	   ack for a ui that holds back its acks rather than stall the session */
+	if (rv == 0 && rdp->send_frame_ack && rdp->frames_pending >= rdp->frames_in_flight)
+	{
+		DEBUG_RDP("%d frames pending, acking frame %d", rdp->frames_pending, rdp->frame_last_end);
+		rdp_send_frame_ack(rdp, rdp->frame_last_end);
+	}
+	return rv;
+}
+
 static void
 process_fp(rdpRdp * rdp, STREAM s)
 {
@@ -1534,7 +1673,7 @@ process_fp(rdpRdp * rdp, STREAM s)
 			{
 				/* ui supports fragmented decoding */
 				size = (int) (ts->end - ts->p);
-				if (ui_decode(rdp->inst, ts->p, size) == 0)
+				if (rdp_ui_decode(rdp, ts->p, size) == 0)
 				{
 					continue;
 				}
@@ -1574,10 +1713,12 @@ process_fp(rdpRdp * rdp, STREAM s)
 			case FASTPATH_UPDATETYPE_SYNCHRONIZE:
 				break;
 			case FASTPATH_UPDATETYPE_SURFCMDS:
+				size = (int) (ts->end - ts->p);
+				if (rdp->send_frame_ack)
+					rdp->frames_pending += surface_frame_ends(ts->p, size, &rdp->frame_last_end);
 				if (rdp->settings->ui_decode_flags & 3)
 				{
-					size = (int) (ts->end - ts->p);
-					if (ui_decode(rdp->inst, ts->p, size) == 0)
+					if (rdp_ui_decode(rdp, ts->p, size) == 0)
 					{
 						break;
 					}
@@ -1678,6 +1819,9 @@ rdp_connect(rdpRdp * rdp)
 		connect_flags |= INFO_REMOTECONSOLEAUDIO;
 	}
 
+	/* the persistent bitmap cache keys are read while the connection is set up */
+	pstcache_init(rdp->pcache, 2);
+
 	if (!network_connect(rdp->net, rdp->settings->server, rdp->settings->username, rdp->settings->tcp_port_rdp))
 		return False;
 
@@ -1709,6 +1853,17 @@ rdp_reconnect(rdpRdp * rdp)
 	network_free(rdp->net);
 	sec_free(rdp->sec);
 
+	/* input and frames of the old connection are gone, the bitmap, glyph
+	   and persistent caches are kept and refilled by the server */
+	rdp->input_count = 0;
+	rdp->frames_pending = 0;
+	rdp->in_decode = False;
+
+	/* offscreen surfaces belong to the old connection, the new server
+	   creates its own within the whole offscreen cache size */
+	reset_order_state(rdp->orders);
+	cache_free_surfaces(rdp->cache);
+
 	rdp->sec = sec_new(rdp);
 	rdp->net = network_new(rdp);
 
@@ -1739,6 +1894,7 @@ rdp_reconnect(rdpRdp * rdp)
 void
 rdp_disconnect(rdpRdp * rdp)
 {
+	pstcache_flush(rdp->pcache);
 	sec_disconnect(rdp->sec);
 }
 
@@ -1796,6 +1952,7 @@ rdp_free(rdpRdp * rdp)
 			stream_delete(rdp->out_codec_caps[index]);
 		}
 		stream_delete(rdp->fragment_data);
+		memset(&rdp->ntowfv2, 0, sizeof(rdp->ntowfv2));
 		xfree(rdp);
 	}
 }
@@ -54,6 +54,30 @@ rdp_global_finish(void);
 
 #define MAX_BITMAP_CODECS 2
 
+/* the fast path input header counts events in 4 bits */
+#define RDP_INPUT_QUEUE_SIZE 15
+
+struct rdp_input_event
+{
+	uint32 time;
+	uint16 type;
+	uint16 param1;
+	uint16 param2;
+	uint16 param3;
+};
+
+/* NTOWFv2 of the last NLA logon, reused while the credentials stay the same */
+#define NTOWFV2_MAX_IDENTITY 512
+
+struct rdp_ntowfv2
+{
+	int valid;
+	int length;
+	uint8 identity[NTOWFV2_MAX_IDENTITY]; /* Uppercase(username) + domain */
+	uint8 ntlm_hash[16];
+	uint8 ntlm_v2_hash[16];
+};
+
 struct rdp_rdp
 {
 	uint8 * next_packet;
@@ -86,8 +110,17 @@ struct rdp_rdp
 	char* redirect_target_netbios_name;
 	char* redirect_target_net_addresses;
 	uint32 redirect_target_net_addresses_len;
+	/* auto-reconnect cookie from the last Save Session Info PDU */
+	RD_BOOL arc_valid;
+	uint32 arc_logon_id;
+	uint8 arc_random[16];
+	/* the server or the user ended the session, do not reconnect */
+	RD_BOOL disconnect_requested;
 	int input_flags;
 	int use_input_fast_path;
+	struct rdp_input_event input_queue[RDP_INPUT_QUEUE_SIZE];
+	int input_count;
+	uint32 input_ticks; /* when the first queued event came in */
 	rdpInst * inst;
 	void* buffer;
 	size_t buffer_size;
@@ -101,6 +134,14 @@ struct rdp_rdp
 	int got_frame_ack_caps;
 	int frame_ack;
 	int send_frame_ack;
+	int frames_in_flight; /* maxUnacknowledgedFrameCount we advertised */
+	int frames_pending; /* frames ended in the stream but not acked yet */
+	uint32 frame_last_end; /* id of the last frame ended in the stream */
+	int frames_acked;
+	sint32 frame_time; /* average decode and present time, 1/16 ms */
+	uint32 frame_ticks; /* decode time of the current frame so far */
+	uint32 decode_ticks;
+	RD_BOOL in_decode;
 	/* fragment */
 	int got_multifragmentupdate_caps;
 	int multifragmentupdate_request_size;
@@ -108,6 +149,8 @@ struct rdp_rdp
 	/* bitmap codecs */
 	int got_bitmap_codecs_caps;
 	STREAM out_codec_caps[MAX_BITMAP_CODECS];
+	/* kept across reconnects, wiped in rdp_free */
+	struct rdp_ntowfv2 ntowfv2;
 };
 typedef struct rdp_rdp rdpRdp;
 
@@ -126,6 +169,8 @@ rdp_sync_input(rdpRdp * rdp, time_t time, uint32 toggle_keys_state);
 void
 rdp_send_input_unicode(rdpRdp * rdp, time_t time, uint16 unicode_character);
 void
+rdp_send_input_flush(rdpRdp * rdp);
+void
 rdp_send_client_window_status(rdpRdp * rdp, int status);
 void
 process_color_pointer_pdu(rdpRdp * rdp, STREAM s);
@@ -36,6 +36,10 @@
 
 static RD_BOOL sec_global_initialized = False;
 
+static void
+sec_prepare_update(rdpSec * sec, uint8 * key, uint8 * update_key, uint8 * next_key,
+	CryptoRc4 next_rc4);
+
 RD_BOOL
 sec_global_init(void)
 {
@@ -71,6 +75,9 @@ static uint8 pad_92[48] = {
 	92, 92, 92, 92, 92, 92, 92, 92
 };
 
+/* decrypted bytes hashed at a time, small enough to still be in L1 */
+#define SEC_DECRYPT_CHUNK	4096
+
 /*
  * 48-byte transformation used to generate master secret (6.1) and key material (6.2.2).
  * Both SHA1 and MD5 algorithms are used.
@@ -165,9 +172,28 @@ sec_generate_keys(rdpSec * sec, uint8 * client_random, uint8 * server_random, in
 	memcpy(sec->sec_decrypt_update_key, sec->sec_decrypt_key, 16);
 	memcpy(sec->sec_encrypt_update_key, sec->sec_encrypt_key, 16);
 
-	/* Initialize RC4 state arrays */
-	sec->rc4_decrypt_key = crypto_rc4_init(sec->sec_decrypt_key, sec->rc4_key_len);
-	sec->rc4_encrypt_key = crypto_rc4_init(sec->sec_encrypt_key, sec->rc4_key_len);
+	/* Initialize RC4 state arrays, the second one holds the next key */
+	crypto_rc4_clear(&sec->rc4_decrypt_state[0]);
+	crypto_rc4_setup(&sec->rc4_decrypt_state[0], sec->sec_decrypt_key, sec->rc4_key_len);
+	sec->rc4_decrypt_key = &sec->rc4_decrypt_state[0];
+	sec_prepare_update(sec, sec->sec_decrypt_key, sec->sec_decrypt_update_key,
+		sec->sec_decrypt_next_key, &sec->rc4_decrypt_state[1]);
+	crypto_rc4_clear(&sec->rc4_encrypt_state[0]);
+	crypto_rc4_setup(&sec->rc4_encrypt_state[0], sec->sec_encrypt_key, sec->rc4_key_len);
+	sec->rc4_encrypt_key = &sec->rc4_encrypt_state[0];
+	sec_prepare_update(sec, sec->sec_encrypt_key, sec->sec_encrypt_update_key,
+		sec->sec_encrypt_next_key, &sec->rc4_encrypt_state[1]);
+
+	/* Absorb the MAC key and pads once, every packet signature starts from a copy */
+	crypto_sha1_discard(&sec->sign_sha1);
+	crypto_sha1_start(&sec->sign_sha1);
+	crypto_sha1_update(&sec->sign_sha1, sec->sec_sign_key, sec->rc4_key_len);
+	crypto_sha1_update(&sec->sign_sha1, pad_54, 40);
+	crypto_md5_discard(&sec->sign_md5);
+	crypto_md5_start(&sec->sign_md5);
+	crypto_md5_update(&sec->sign_md5, sec->sec_sign_key, sec->rc4_key_len);
+	crypto_md5_update(&sec->sign_md5, pad_92, 48);
+	sec->sign_prefix = True;
 }
 
 /* Output a uint32 into a buffer (little-endian) */
@@ -187,86 +213,230 @@ sec_sign(uint8 * signature, int siglen, uint8 * session_key, int keylen, uint8 *
 	uint8 shasig[20];
 	uint8 md5sig[16];
 	uint8 lenhdr[4];
-	CryptoSha1 sha1;
-	CryptoMd5 md5;
+	struct crypto_sha1_struct sha1;
+	struct crypto_md5_struct md5;
 
 	buf_out_uint32(lenhdr, datalen);
 
-	sha1 = crypto_sha1_init();
-	crypto_sha1_update(sha1, session_key, keylen);
-	crypto_sha1_update(sha1, pad_54, 40);
+	crypto_sha1_start(&sha1);
+	crypto_sha1_update(&sha1, session_key, keylen);
+	crypto_sha1_update(&sha1, pad_54, 40);
+	crypto_sha1_update(&sha1, lenhdr, 4);
+	crypto_sha1_update(&sha1, data, datalen);
+	crypto_sha1_finish(&sha1, shasig);
+
+	crypto_md5_start(&md5);
+	crypto_md5_update(&md5, session_key, keylen);
+	crypto_md5_update(&md5, pad_92, 48);
+	crypto_md5_update(&md5, shasig, 20);
+	crypto_md5_finish(&md5, md5sig);
+
+	memcpy(signature, md5sig, siglen);
+}
+
+/* Auto-reconnect SecurityVerifier (5.5), HMAC-MD5 of the client random
+   keyed with the ArcRandomBits of the last Save Session Info PDU */
+void
+sec_arc_verifier(rdpSec * sec, uint8 * arc_random, uint8 * verifier)
+{
+	int i;
+	uint8 ipad[64];
+	uint8 opad[64];
+	uint8 inner[16];
+	struct crypto_md5_struct md5;
+
+	memset(ipad, 0x36, sizeof(ipad));
+	memset(opad, 0x5c, sizeof(opad));
+	for (i = 0; i < 16; i++)
+	{
+		ipad[i] ^= arc_random[i];
+		opad[i] ^= arc_random[i];
+	}
+
+	crypto_md5_start(&md5);
+	crypto_md5_update(&md5, ipad, sizeof(ipad));
+	crypto_md5_update(&md5, sec->sec_client_random, SEC_RANDOM_SIZE);
+	crypto_md5_finish(&md5, inner);
+
+	crypto_md5_start(&md5);
+	crypto_md5_update(&md5, opad, sizeof(opad));
+	crypto_md5_update(&md5, inner, sizeof(inner));
+	crypto_md5_finish(&md5, verifier);
+}
+
+/* Start a packet MAC from the prefix computed in sec_generate_keys, or
+   from scratch when the back-end can not clone partial hashes */
+static void
+sec_mac_begin(rdpSec * sec, CryptoSha1 sha1, CryptoMd5 md5, int datalen)
+{
+	uint8 lenhdr[4];
+
+	if (sec->sign_prefix && !crypto_sha1_copy(sha1, &sec->sign_sha1))
+		sec->sign_prefix = False;
+
+	if (sec->sign_prefix && !crypto_md5_copy(md5, &sec->sign_md5))
+	{
+		crypto_sha1_discard(sha1);
+		sec->sign_prefix = False;
+	}
+
+	if (!sec->sign_prefix)
+	{
+		crypto_sha1_start(sha1);
+		crypto_sha1_update(sha1, sec->sec_sign_key, sec->rc4_key_len);
+		crypto_sha1_update(sha1, pad_54, 40);
+		crypto_md5_start(md5);
+		crypto_md5_update(md5, sec->sec_sign_key, sec->rc4_key_len);
+		crypto_md5_update(md5, pad_92, 48);
+	}
+
+	buf_out_uint32(lenhdr, datalen);
 	crypto_sha1_update(sha1, lenhdr, 4);
-	crypto_sha1_update(sha1, data, datalen);
-	crypto_sha1_final(sha1, shasig);
+}
+
+static void
+sec_mac_end(CryptoSha1 sha1, CryptoMd5 md5, uint8 * signature, int siglen)
+{
+	uint8 shasig[20];
+	uint8 md5sig[16];
 
-	md5 = crypto_md5_init();
-	crypto_md5_update(md5, session_key, keylen);
-	crypto_md5_update(md5, pad_92, 48);
+	crypto_sha1_finish(sha1, shasig);
 	crypto_md5_update(md5, shasig, 20);
-	crypto_md5_final(md5, md5sig);
+	crypto_md5_finish(md5, md5sig);
 
 	memcpy(signature, md5sig, siglen);
 }
 
+/* Sign a packet with the session MAC key, same result as sec_sign */
+void
+sec_sign_packet(rdpSec * sec, uint8 * signature, int siglen, uint8 * data, int datalen)
+{
+	struct crypto_sha1_struct sha1;
+	struct crypto_md5_struct md5;
+
+	sec_mac_begin(sec, &sha1, &md5, datalen);
+	crypto_sha1_update(&sha1, data, datalen);
+	sec_mac_end(&sha1, &md5, signature, siglen);
+}
+
 /* Update an encryption key */
 static void
 sec_update(rdpSec * sec, uint8 * key, uint8 * update_key)
 {
 	uint8 shasig[20];
-	CryptoSha1 sha1;
-	CryptoMd5 md5;
-	CryptoRc4 update;
-
-	sha1 = crypto_sha1_init();
-	crypto_sha1_update(sha1, update_key, sec->rc4_key_len);
-	crypto_sha1_update(sha1, pad_54, 40);
-	crypto_sha1_update(sha1, key, sec->rc4_key_len);
-	crypto_sha1_final(sha1, shasig);
-
-	md5 = crypto_md5_init();
-	crypto_md5_update(md5, update_key, sec->rc4_key_len);
-	crypto_md5_update(md5, pad_92, 48);
-	crypto_md5_update(md5, shasig, 20);
-	crypto_md5_final(md5, key);
-
-	update = crypto_rc4_init(key, sec->rc4_key_len);
-	crypto_rc4(update, sec->rc4_key_len, key, key);
-	crypto_rc4_free(update);
+	struct crypto_sha1_struct sha1;
+	struct crypto_md5_struct md5;
+	struct crypto_rc4_struct update;
+
+	crypto_sha1_start(&sha1);
+	crypto_sha1_update(&sha1, update_key, sec->rc4_key_len);
+	crypto_sha1_update(&sha1, pad_54, 40);
+	crypto_sha1_update(&sha1, key, sec->rc4_key_len);
+	crypto_sha1_finish(&sha1, shasig);
+
+	crypto_md5_start(&md5);
+	crypto_md5_update(&md5, update_key, sec->rc4_key_len);
+	crypto_md5_update(&md5, pad_92, 48);
+	crypto_md5_update(&md5, shasig, 20);
+	crypto_md5_finish(&md5, key);
+
+	crypto_rc4_setup(&update, key, sec->rc4_key_len);
+	crypto_rc4(&update, sec->rc4_key_len, key, key);
+	crypto_rc4_clear(&update);
 
 	if (sec->rc4_key_len == 8)
 		sec_make_40bit(key);
 }
 
+/* Derive the key that follows key and set it up in next_rc4, so that the
+   switch after 4096 packets is only a pointer swap */
+static void
+sec_prepare_update(rdpSec * sec, uint8 * key, uint8 * update_key, uint8 * next_key,
+	CryptoRc4 next_rc4)
+{
+	memcpy(next_key, key, 16);
+	sec_update(sec, next_key, update_key);
+	crypto_rc4_clear(next_rc4);
+	crypto_rc4_setup(next_rc4, next_key, sec->rc4_key_len);
+}
+
 /* Encrypt data using RC4 */
 static void
 sec_encrypt(rdpSec * sec, uint8 * data, int length)
 {
+	CryptoRc4 spare = NULL;
+
 	if (sec->sec_encrypt_use_count == 4096)
 	{
-		sec_update(sec, sec->sec_encrypt_key, sec->sec_encrypt_update_key);
-		crypto_rc4_free(sec->rc4_encrypt_key);
-		sec->rc4_encrypt_key = crypto_rc4_init(sec->sec_encrypt_key, sec->rc4_key_len);
+		spare = sec->rc4_encrypt_key;
+		sec->rc4_encrypt_key = (spare == &sec->rc4_encrypt_state[0]) ?
+			&sec->rc4_encrypt_state[1] : &sec->rc4_encrypt_state[0];
+		memcpy(sec->sec_encrypt_key, sec->sec_encrypt_next_key, 16);
 		sec->sec_encrypt_use_count = 0;
 	}
 
 	crypto_rc4(sec->rc4_encrypt_key, length, data, data);
 	sec->sec_encrypt_use_count++;
+
+	if (spare != NULL)
+		sec_prepare_update(sec, sec->sec_encrypt_key, sec->sec_encrypt_update_key,
+			sec->sec_encrypt_next_key, spare);
 }
 
-/* Decrypt data using RC4 */
-static void
-sec_decrypt(rdpSec * sec, uint8 * data, int length)
+/* Decrypt data using RC4 and check its MAC in the same pass, hashing each
+   chunk right after it is decrypted while it is still in the cache.
+   signature may be NULL to only decrypt. Returns False on a bad MAC. */
+static RD_BOOL
+sec_decrypt_verify(rdpSec * sec, uint8 * signature, uint8 * data, int length)
 {
+	int chunk;
+	int offset;
+	uint8 mac[8];
+	CryptoRc4 spare = NULL;
+	struct crypto_sha1_struct sha1;
+	struct crypto_md5_struct md5;
+
 	if (sec->sec_decrypt_use_count == 4096)
 	{
-		sec_update(sec, sec->sec_decrypt_key, sec->sec_decrypt_update_key);
-		crypto_rc4_free(sec->rc4_decrypt_key);
-		sec->rc4_decrypt_key = crypto_rc4_init(sec->sec_decrypt_key, sec->rc4_key_len);
+		spare = sec->rc4_decrypt_key;
+		sec->rc4_decrypt_key = (spare == &sec->rc4_decrypt_state[0]) ?
+			&sec->rc4_decrypt_state[1] : &sec->rc4_decrypt_state[0];
+		memcpy(sec->sec_decrypt_key, sec->sec_decrypt_next_key, 16);
 		sec->sec_decrypt_use_count = 0;
 	}
 
-	crypto_rc4(sec->rc4_decrypt_key, length, data, data);
+	if (signature != NULL)
+		sec_mac_begin(sec, &sha1, &md5, length);
+
+	for (offset = 0; offset < length; offset += chunk)
+	{
+		chunk = MIN(length - offset, SEC_DECRYPT_CHUNK);
+		crypto_rc4(sec->rc4_decrypt_key, chunk, data + offset, data + offset);
+		if (signature != NULL)
+			crypto_sha1_update(&sha1, data + offset, chunk);
+	}
 	sec->sec_decrypt_use_count++;
+
+	if (spare != NULL)
+		sec_prepare_update(sec, sec->sec_decrypt_key, sec->sec_decrypt_update_key,
+			sec->sec_decrypt_next_key, spare);
+
+	if (signature == NULL)
+		return True;
+
+	sec_mac_end(&sha1, &md5, mac, 8);
+	return memcmp(mac, signature, 8) == 0;
+}
+
+/* Decrypt a received packet, warning once per session about bad MACs */
+static void
+sec_decrypt(rdpSec * sec, uint8 * signature, uint8 * data, int length)
+{
+	if (!sec_decrypt_verify(sec, signature, data, length) && !sec->bad_mac_seen)
+	{
+		ui_warning(sec->rdp->inst, "packet signature mismatch\n");
+		sec->bad_mac_seen = True;
+	}
 }
 
 /* Initialize secure transport packet */
@@ -329,7 +499,7 @@ sec_send_to_channel(rdpSec * sec, STREAM s, uint32 flags, uint16 channel)
 			hexdump(s->p + 8, datalen);
 #endif
 
-			sec_sign(s->p, 8, sec->sec_sign_key, sec->rc4_key_len, s->p + 8, datalen);
+			sec_sign_packet(sec, s->p, 8, s->p + 8, datalen);
 			sec_encrypt(sec, s->p + 8, datalen);
 		}
 	}
@@ -347,17 +517,17 @@ sec_send(rdpSec * sec, STREAM s, uint32 flags)
 
 /* Transmit secure fast path packet */
 void
-sec_fp_send(rdpSec * sec, STREAM s, uint32 flags)
+sec_fp_send(rdpSec * sec, STREAM s, uint32 flags, int num_events)
 {
 	int datalen;
 	s_pop_layer(s, sec_hdr);
 	if (flags & SEC_ENCRYPT)
 	{
 		datalen = ((int) (s->end - s->p)) - 8;
-		sec_sign(s->p, 8, sec->sec_sign_key, sec->rc4_key_len, s->p + 8, datalen);
+		sec_sign_packet(sec, s->p, 8, s->p + 8, datalen);
 		sec_encrypt(sec, s->p + 8, datalen);
 	}
-	mcs_fp_send(sec->net->mcs, s, flags);
+	mcs_fp_send(sec->net->mcs, s, flags, num_events);
 }
 
 /* Transfer the client random to the server */
@@ -580,6 +750,7 @@ sec_recv(rdpSec * sec, secRecvType * type)
 	STREAM s;
 	uint16 channel;
 	uint32 sec_flags;
+	uint8 * signature;
 	isoRecvType iso_type;
 
 	while ((s = mcs_recv(sec->net->mcs, &iso_type, &channel)) != NULL)
@@ -590,8 +761,8 @@ sec_recv(rdpSec * sec, secRecvType * type)
 			*type = SEC_RECV_FAST_PATH;
 			if (iso_type == ISO_RECV_FAST_PATH_ENCRYPTED)
 			{
-				in_uint8s(s, 8);	/* dataSignature */ /* TODO: Check signature! */
-				sec_decrypt(sec, s->p, s->end - s->p);
+				in_uint8p(s, signature, 8);	/* dataSignature */
+				sec_decrypt(sec, signature, s->p, s->end - s->p);
 			}
 			return s;
 		}
@@ -607,8 +778,11 @@ sec_recv(rdpSec * sec, secRecvType * type)
 
 			if ((sec_flags & SEC_ENCRYPT) || (sec_flags & SEC_REDIRECTION_PKT))
 			{
-				in_uint8s(s, 8);	/* dataSignature */ /* TODO: Check signature! */
-				sec_decrypt(sec, s->p, s->end - s->p);
+				in_uint8p(s, signature, 8);	/* dataSignature */
+				/* salted MACs (5.3.6.1.1) are not checked */
+				if (sec_flags & SEC_SECURE_CHECKSUM)
+					signature = NULL;
+				sec_decrypt(sec, signature, s->p, s->end - s->p);
 			}
 
 			if (sec_flags & SEC_LICENSE_PKT)
@@ -644,12 +818,16 @@ sec_disconnect(rdpSec * sec)
 {
 	mcs_disconnect(sec->net->mcs);
 
-	if (sec->rc4_decrypt_key)
-		crypto_rc4_free(sec->rc4_decrypt_key);
+	crypto_rc4_clear(&sec->rc4_decrypt_state[0]);
+	crypto_rc4_clear(&sec->rc4_decrypt_state[1]);
 	sec->rc4_decrypt_key = NULL;
-	if (sec->rc4_encrypt_key)
-		crypto_rc4_free(sec->rc4_encrypt_key);
+	crypto_rc4_clear(&sec->rc4_encrypt_state[0]);
+	crypto_rc4_clear(&sec->rc4_encrypt_state[1]);
 	sec->rc4_encrypt_key = NULL;
+	crypto_sha1_discard(&sec->sign_sha1);
+	crypto_md5_discard(&sec->sign_md5);
+	sec->sign_prefix = False;
+	sec->bad_mac_seen = False;
 }
 
 rdpSec *
@@ -674,6 +852,12 @@ sec_free(rdpSec * sec)
 {
 	if (sec != NULL)
 	{
+		crypto_rc4_clear(&sec->rc4_decrypt_state[0]);
+		crypto_rc4_clear(&sec->rc4_decrypt_state[1]);
+		crypto_rc4_clear(&sec->rc4_encrypt_state[0]);
+		crypto_rc4_clear(&sec->rc4_encrypt_state[1]);
+		crypto_sha1_discard(&sec->sign_sha1);
+		crypto_md5_discard(&sec->sign_md5);
 		xfree(sec);
 	}
 }
@@ -42,13 +42,24 @@ struct rdp_sec
 	struct rdp_network * net;
 	CryptoRc4 rc4_decrypt_key;
 	CryptoRc4 rc4_encrypt_key;
+	/* in use and prepared for the next key update */
+	struct crypto_rc4_struct rc4_decrypt_state[2];
+	struct crypto_rc4_struct rc4_encrypt_state[2];
+	/* sec_sign_key and pads absorbed, see sec_sign_packet */
+	struct crypto_sha1_struct sign_sha1;
+	struct crypto_md5_struct sign_md5;
+	RD_BOOL sign_prefix;
+	RD_BOOL bad_mac_seen;
 	uint32 server_public_key_len;
 	uint8 sec_sign_key[16];
 	uint8 sec_decrypt_key[16];
 	uint8 sec_encrypt_key[16];
 	uint8 sec_decrypt_update_key[16];
 	uint8 sec_encrypt_update_key[16];
+	uint8 sec_decrypt_next_key[16];
+	uint8 sec_encrypt_next_key[16];
 	uint8 sec_crypted_random[SEC_MAX_MODULUS_SIZE];
+	uint8 sec_client_random[SEC_RANDOM_SIZE]; /* zero with TLS */
 	/* These values must be available to reset state - Session Directory */
 	int sec_encrypt_use_count;
 	int sec_decrypt_use_count;
@@ -73,6 +84,10 @@ buf_out_uint32(uint8 * buffer, uint32 value);
 void
 sec_sign(uint8 * signature, int siglen, uint8 * session_key, int keylen,
 	 uint8 * data, int datalen);
+void
+sec_sign_packet(rdpSec * sec, uint8 * signature, int siglen, uint8 * data, int datalen);
+void
+sec_arc_verifier(rdpSec * sec, uint8 * arc_random, uint8 * verifier);
 RD_BOOL
 sec_parse_public_key(rdpSec * sec, STREAM s, uint32 len, uint8 * modulus, uint8 * exponent);
 RD_BOOL
@@ -88,7 +103,7 @@ sec_send_to_channel(rdpSec * sec, STREAM s, uint32 flags, uint16 channel);
 void
 sec_send(rdpSec * sec, STREAM s, uint32 flags);
 void
-sec_fp_send(rdpSec * sec, STREAM s, uint32 flags);
+sec_fp_send(rdpSec * sec, STREAM s, uint32 flags, int num_events);
 void
 sec_reverse_copy(uint8 * out, uint8 * in, int len);
 RD_BOOL
@@ -22,6 +22,7 @@
 #include "stream.h"
 #include <freerdp/freerdp.h>
 #include <freerdp/utils/hexdump.h>
+#include <freerdp/utils/stream.h>
 
 #include "surface.h"
 
@@ -121,6 +122,7 @@ surface_cmd(rdpRdp * rdp, STREAM s)
 				//printf("    surface_cmd: CMDTYPE_FRAME_MARKER %d %d\n", frameAction, frameId);
 				if (frameAction == SURFACECMD_FRAMEACTION_END)
 				{
+					/* nothing here is decoded, the frame is done */
 					rdp_send_frame_ack(rdp, frameId);
 				}
 				break;
@@ -144,3 +146,38 @@ surface_cmd(rdpRdp * rdp, STREAM s)
 	}
 	return 0;
 }
+
+/* count the frames a run of surface commands finishes, last_id gets the last one */
+int
+surface_frame_ends(uint8 * data, int size, uint32 * last_id)
+{
+	int count;
+	int length;
+
+	count = 0;
+	while (size >= 8)
+	{
+		switch (GET_UINT16(data, 0))
+		{
+			case CMDTYPE_SET_SURFACE_BITS:
+			case CMDTYPE_STREAM_SURFACE_BITS:
+				if (size < 22)
+					return count;
+				length = 22 + GET_UINT32(data, 18);
+				break;
+			case CMDTYPE_FRAME_MARKER:
+				if (GET_UINT16(data, 2) == SURFACECMD_FRAMEACTION_END)
+				{
+					*last_id = GET_UINT32(data, 4);
+					count++;
+				}
+				length = 8;
+				break;
+			default:
+				return count;
+		}
+		data += length;
+		size -= length;
+	}
+	return count;
+}
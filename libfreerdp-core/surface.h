@@ -25,5 +25,7 @@ surface_codec_cap(rdpRdp * rdp, uint8 * codec_guid, int codec_id,
 	uint8 * codec_property, int codec_properties_size);
 int
 surface_cmd(rdpRdp * rdp, STREAM s);
+int
+surface_frame_ends(uint8 * data, int size, uint32 * last_id);
 
 #endif
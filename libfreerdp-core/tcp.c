@@ -164,7 +164,10 @@ tcp_read(rdpTcp * tcp, char* b, int length)
 	int rcvd = 0;
 
 	if (!ui_select(tcp->net->sec->rdp->inst, tcp->sockfd))
+	{
+		tcp->net->rdp->disconnect_requested = True;
 		return -1; /* user quit */
+	}
 
 	rcvd = recv(tcp->sockfd, b, length, 0);
 
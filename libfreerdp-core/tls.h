@@ -26,7 +26,7 @@ typedef struct rdp_tls rdpTls;
 #include "crypto.h"
 
 rdpTls *
-tls_new(void);
+tls_new(RD_BOOL ktls);
 void
 tls_free(rdpTls * tls);
 RD_BOOL
@@ -39,6 +39,8 @@ int
 tls_write(rdpTls * tls, char * b, int length);
 int
 tls_read(rdpTls * tls, char * b, int length);
+RD_BOOL
+tls_pending(rdpTls * tls);
 CryptoCert
 tls_get_certificate(rdpTls * tls);
 
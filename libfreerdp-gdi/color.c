@@ -638,12 +638,11 @@ uint8* gdi_image_convert(uint8* srcData, uint8* dstData, int width, int height,
 }
 
 uint8*
-gdi_glyph_convert(int width, int height, uint8* data)
+gdi_glyph_convert(int width, int height, uint8* data, uint8* dstData)
 {
 	int x, y;
 	uint8 *srcp;
 	uint8 *dstp;
-	uint8 *dstData;
 	int scanline;
 
 	/*
@@ -653,7 +652,9 @@ gdi_glyph_convert(int width, int height, uint8* data)
 	 */
 
 	scanline = (width + 7) / 8;
-	dstData = (uint8*) malloc(width * height);
+	if (dstData == NULL)
+		dstData = (uint8*) malloc(width * height);
+
 	memset(dstData, 0, width * height);
 	dstp = dstData;
 
@@ -676,12 +677,11 @@ gdi_glyph_convert(int width, int height, uint8* data)
 }
 
 
-uint8* gdi_mono_image_convert(uint8* srcData, int width, int height, int srcBpp, int dstBpp, uint32 bgcolor, uint32 fgcolor, HCLRCONV clrconv)
+uint8* gdi_mono_image_convert(uint8* srcData, uint8* dstData, int width, int height, int srcBpp, int dstBpp, uint32 bgcolor, uint32 fgcolor, HCLRCONV clrconv)
 {
 	int index;
 	uint16* dst16;
 	uint32* dst32;
-	uint8* dstData;
 	uint8 bitMask;
 	int bitIndex;
 	uint8 redBg, greenBg, blueBg;
@@ -735,7 +735,9 @@ uint8* gdi_mono_image_convert(uint8* srcData, int width, int height, int srcBpp,
 			}
 		}
 
-		dstData = (uint8*) malloc(width * height * 2);
+		if (dstData == NULL)
+			dstData = (uint8*) malloc(width * height * 2);
+
 		dst16 = (uint16*) dstData;
 		for(index = height; index > 0; index--)
 		{
@@ -759,7 +761,9 @@ uint8* gdi_mono_image_convert(uint8* srcData, int width, int height, int srcBpp,
 	}
 	else if(dstBpp == 32)
 	{
-		dstData = (uint8*) malloc(width * height * 4);
+		if (dstData == NULL)
+			dstData = (uint8*) malloc(width * height * 4);
+
 		dst32 = (uint32*) dstData;
 		for(index = height; index > 0; index--)
 		{
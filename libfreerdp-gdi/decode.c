@@ -125,13 +125,13 @@ int gdi_decode_surface_bits(GDI *gdi, uint8 * data, int size)
 	return length;
 }
 
-int gdi_decode_frame_marker(GDI *gdi, uint8 * data, int size)
+int gdi_decode_frame_marker(GDI *gdi, uint8 * data, int size, int * frame_end)
 {
 	uint16 frameAction;
 	uint32 frameId;
 
-	frameAction = GET_UINT16(data, 0); /* frameAction */
-	frameId = GET_UINT32(data, 2); /* frameId */
+	frameAction = GET_UINT16(data, 2); /* frameAction */
+	frameId = GET_UINT32(data, 4); /* frameId */
 
 	switch (frameAction)
 	{
@@ -139,6 +139,7 @@ int gdi_decode_frame_marker(GDI *gdi, uint8 * data, int size)
 			break;
 
 		case SURFACECMD_FRAMEACTION_END:
+			*frame_end = frameId;
 			break;
 
 		default:
@@ -148,10 +149,12 @@ int gdi_decode_frame_marker(GDI *gdi, uint8 * data, int size)
 	return 8;
 }
 
-void gdi_decode_data(GDI *gdi, uint8 * data, int size)
+/* returns the id of the last frame the data ends, -1 if none */
+int gdi_decode_data(GDI *gdi, uint8 * data, int size)
 {
 	int cmdLength;
 	uint16 cmdType;
+	int frame_end = -1;
 
 	while (size > 0)
 	{
@@ -165,7 +168,7 @@ void gdi_decode_data(GDI *gdi, uint8 * data, int size)
 				break;
 
 			case CMDTYPE_FRAME_MARKER:
-				cmdLength = gdi_decode_frame_marker(gdi, data, size);
+				cmdLength = gdi_decode_frame_marker(gdi, data, size, &frame_end);
 				break;
 
 			default:
@@ -176,4 +179,6 @@ void gdi_decode_data(GDI *gdi, uint8 * data, int size)
 		size -= cmdLength;
 		data += cmdLength;
 	}
+
+	return frame_end;
 }
@@ -26,6 +26,6 @@
 #include "gdi.h"
 
 void gdi_decode_bitmap_data(GDI *gdi, int x, int y, uint8 * data, uint32 length);
-void gdi_decode_data(GDI *gdi, uint8 * data, int size);
+int gdi_decode_data(GDI *gdi, uint8 * data, int size);
 
 #endif /* __DECODE_H */
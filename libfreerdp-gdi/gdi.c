@@ -26,6 +26,8 @@
 #include "libgdi.h"
 
 #include "gdi.h"
+#include "gdi_32bpp.h"
+#include "gdi_16bpp.h"
 
 /* Ternary Raster Operation Table */
 const uint32 rop3_code_table[] =
@@ -288,6 +290,25 @@ const uint32 rop3_code_table[] =
 	0x00FF0062  // 1
 };
 
+/* Portable raster operation kernels, replaced by GDI_INIT_SIMD when available */
+GDI_ROPS gdi_rops_generic =
+{
+	RopRow_SRCAND_32bpp,
+	RopRow_SRCPAINT_32bpp,
+	RopRow_SRCINVERT_32bpp,
+	RopRow_DSTINVERT_32bpp,
+	RopRow_PATCOPY_32bpp,
+	RopRow_PATINVERT_32bpp,
+	RopRow_DSPDxax_32bpp,
+	RopRow_SRCAND_16bpp,
+	RopRow_SRCPAINT_16bpp,
+	RopRow_SRCINVERT_16bpp,
+	RopRow_DSTINVERT_16bpp,
+	RopRow_PATCOPY_16bpp,
+	RopRow_PATINVERT_16bpp,
+	RopRow_DSPDxax_16bpp
+};
+
 /* GDI Helper Functions */
 
 uint32
@@ -346,6 +367,23 @@ gdi_get_bitmap_pointer(HGDI_DC hdcBmp, int x, int y)
 	}
 }
 
+/* Repeat a pattern row across n bytes, doubling the copied span on each pass */
+void
+gdi_fill_pattern_row(uint8 * d, uint8 * pattern, int size, int n)
+{
+	int len;
+
+	len = (size < n) ? size : n;
+	memcpy(d, pattern, len);
+
+	while (len < n)
+	{
+		size = (len < n - len) ? len : n - len;
+		memcpy(d + len, d, size);
+		len += size;
+	}
+}
+
 uint8*
 gdi_get_brush_pointer(HGDI_DC hdcBrush, int x, int y)
 {
@@ -384,6 +422,28 @@ gdi_is_mono_pixel_set(uint8* data, int x, int y, int width)
 	return (data[byte] & (0x80 >> shift)) != 0;
 }
 
+/**
+ * Get a scratch buffer of at least the given size.\n
+ * The buffer belongs to the GDI instance and only grows, so it may be used
+ * for temporaries that do not outlive the current drawing call.
+ * @param gdi current GDI instance
+ * @param size minimum buffer size in bytes
+ * @return scratch buffer
+ */
+
+uint8*
+gdi_get_scratch(GDI *gdi, int size)
+{
+	if (size > gdi->scratch_size)
+	{
+		free(gdi->scratch);
+		gdi->scratch = (uint8*) malloc(size);
+		gdi->scratch_size = size;
+	}
+
+	return gdi->scratch;
+}
+
 HGDI_BITMAP
 gdi_create_bitmap(GDI* gdi, int width, int height, int bpp, uint8* data)
 {
@@ -459,20 +519,34 @@ gdi_ui_desktop_restore(struct rdp_inst * inst, int offset, int x, int y, int cx,
 static RD_HGLYPH
 gdi_ui_create_glyph(struct rdp_inst * inst, int width, int height, uint8 * data)
 {
-	uint8* glyph;
+	GDI_GLYPH *gdi_glyph;
 	GDI_IMAGE *gdi_bmp;
 
 	DEBUG_GDI("gdi_ui_create_glyph: width:%d height:%d", width, height);
 
-	gdi_bmp = (GDI_IMAGE*) malloc(sizeof(GDI_IMAGE));
-	
-	gdi_bmp->hdc = gdi_GetDC();
+	/* the image, its DC, bitmap, clipping region and pixels share one block */
+	gdi_glyph = (GDI_GLYPH*) malloc(sizeof(GDI_GLYPH) + width * height);
+	memset(gdi_glyph, 0, sizeof(GDI_GLYPH));
+	gdi_bmp = &gdi_glyph->image;
+
+	gdi_bmp->hdc = &gdi_glyph->hdc;
 	gdi_bmp->hdc->bytesPerPixel = 1;
 	gdi_bmp->hdc->bitsPerPixel = 1;
-	glyph = gdi_glyph_convert(width, height, data);
-	gdi_bmp->bitmap = gdi_CreateBitmap(width, height, 1, glyph);
+	gdi_bmp->hdc->drawMode = GDI_R2_BLACK;
+	gdi_bmp->hdc->clip = &gdi_glyph->clip;
+	gdi_bmp->hdc->clip->objectType = GDIOBJECT_REGION;
+	gdi_bmp->hdc->clip->null = 1;
+	gdi_bmp->hdc->rops = &gdi_rops_generic;
+
+	gdi_bmp->bitmap = &gdi_glyph->bitmap;
+	gdi_bmp->bitmap->objectType = GDIOBJECT_BITMAP;
 	gdi_bmp->bitmap->bytesPerPixel = 1;
 	gdi_bmp->bitmap->bitsPerPixel = 1;
+	gdi_bmp->bitmap->width = width;
+	gdi_bmp->bitmap->height = height;
+	gdi_bmp->bitmap->scanline = width;
+	gdi_bmp->bitmap->data = gdi_glyph_convert(width, height, data, (uint8*) &gdi_glyph[1]);
+
 	gdi_SelectObject(gdi_bmp->hdc, (HGDIOBJECT) gdi_bmp->bitmap);
 	gdi_bmp->org_bitmap = NULL;
 
@@ -488,7 +562,8 @@ gdi_ui_create_glyph(struct rdp_inst * inst, int width, int height, uint8 * data)
 static void
 gdi_ui_destroy_glyph(struct rdp_inst * inst, RD_HGLYPH glyph)
 {
-	gdi_bitmap_free((GDI_IMAGE*) glyph);
+	/* the image is the first member of the glyph block */
+	free(glyph);
 }
 
 /**
@@ -528,14 +603,43 @@ gdi_ui_create_bitmap(struct rdp_inst * inst, int width, int height, uint8* data)
 static void
 gdi_ui_paint_bitmap(struct rdp_inst * inst, int x, int y, int cx, int cy, int width, int height, uint8 * data)
 {
-	GDI_IMAGE *gdi_bmp;
+	int i;
+	int srcx = 0;
+	int srcy = 0;
+	uint8* srcp;
+	uint8* dstp;
+	int srcBytesPerPixel;
+	HGDI_DC hdc;
 	GDI *gdi = GET_GDI(inst);
 
 	DEBUG_GDI("ui_paint_bitmap: x:%d y:%d cx:%d cy:%d", x, y, cx, cy);
 
-	gdi_bmp = (GDI_IMAGE*) inst->ui_create_bitmap(inst, width, height, data);
-	gdi_BitBlt(gdi->primary->hdc, x, y, cx, cy, gdi_bmp->hdc, 0, 0, GDI_SRCCOPY);
-	inst->ui_destroy_bitmap(inst, (RD_HBITMAP) gdi_bmp);
+	/* convert each visible row straight into the primary surface */
+	hdc = gdi->primary->hdc;
+	srcBytesPerPixel = (gdi->srcBpp + 7) / 8;
+
+	if (cx > width)
+		cx = width;
+	if (cy > height)
+		cy = height;
+
+	if (gdi_ClipCoords(hdc, &x, &y, &cx, &cy, &srcx, &srcy) == 0)
+		return;
+
+	gdi_InvalidateRegion(hdc, x, y, cx, cy);
+
+	for (i = 0; i < cy; i++)
+	{
+		srcp = data + ((srcy + i) * width + srcx) * srcBytesPerPixel;
+		dstp = gdi_get_bitmap_pointer(hdc, x, y + i);
+
+		if (dstp == 0)
+			continue;
+
+		/* unsupported conversions hand back the source untouched */
+		if (gdi_image_convert(srcp, dstp, cx, 1, gdi->srcBpp, gdi->dstBpp, gdi->clrconv) == srcp)
+			memcpy(dstp, srcp, cx * hdc->bytesPerPixel);
+	}
 }
 
 /**
@@ -565,25 +669,29 @@ gdi_ui_destroy_bitmap(struct rdp_inst * inst, RD_HBITMAP bmp)
 static void
 gdi_ui_line(struct rdp_inst * inst, uint8 opcode, int startx, int starty, int endx, int endy, RD_PEN * pen)
 {
-	HGDI_PEN hPen;
+	GDI_PEN hPen;
 	int cx, cy;
-	uint32 color;
+	HGDI_PEN originalPen;
 	GDI *gdi = GET_GDI(inst);
 
 	DEBUG_GDI("ui_line opcode:0x%02X startx:%d starty:%d endx:%d endy:%d", opcode, startx, starty, endx, endy);
 
 	cx = endx - startx + 1;
 	cy = endy - starty + 1;
-	
-	color = gdi_color_convert(pen->color, gdi->srcBpp, 32, gdi->clrconv);
-	hPen = gdi_CreatePen(pen->style, pen->width, (GDI_COLOR) color);
-	gdi_SelectObject(gdi->drawing->hdc, (HGDIOBJECT) hPen);
+
+	hPen.objectType = GDIOBJECT_PEN;
+	hPen.style = pen->style;
+	hPen.width = pen->width;
+	hPen.color = gdi_color_convert(pen->color, gdi->srcBpp, 32, gdi->clrconv);
+
+	originalPen = gdi->drawing->hdc->pen;
+	gdi_SelectObject(gdi->drawing->hdc, (HGDIOBJECT) &hPen);
 	gdi_SetROP2(gdi->drawing->hdc, opcode);
 
 	gdi_MoveToEx(gdi->drawing->hdc, startx, starty, NULL);
 	gdi_LineTo(gdi->drawing->hdc, endx, endy);
-	
-	gdi_DeleteObject((HGDIOBJECT) hPen);
+
+	gdi->drawing->hdc->pen = originalPen;
 }
 
 /**
@@ -600,18 +708,48 @@ static void
 gdi_ui_rect(struct rdp_inst * inst, int x, int y, int cx, int cy, uint32 color)
 {
 	GDI_RECT rect;
-	HGDI_BRUSH hBrush;
-	uint32 brush_color;
+	GDI_BRUSH hBrush;
 	GDI *gdi = GET_GDI(inst);
 
 	DEBUG_GDI("ui_rect: x:%d y:%d cx:%d cy:%d", x, y, cx, cy);
 
 	gdi_CRgnToRect(x, y, cx, cy, &rect);
-	brush_color = gdi_color_convert(color, gdi->srcBpp, 32, gdi->clrconv);
 
-	hBrush = gdi_CreateSolidBrush(brush_color);
-	gdi_FillRect(gdi->drawing->hdc, &rect, hBrush);
-	gdi_DeleteObject((HGDIOBJECT) hBrush);
+	hBrush.objectType = GDIOBJECT_BRUSH;
+	hBrush.style = GDI_BS_SOLID;
+	hBrush.color = gdi_color_convert(color, gdi->srcBpp, 32, gdi->clrconv);
+
+	gdi_FillRect(gdi->drawing->hdc, &rect, &hBrush);
+}
+
+/**
+ * Draw a series of rectangles using the same color.\n
+ * MultiOpaqueRect (MULTI_OPAQUE_RECT_ORDER)
+ * @param inst current instance
+ * @param rects array of rectangles
+ * @param count number of rectangles
+ * @param color color
+ */
+
+static void
+gdi_ui_rects(struct rdp_inst * inst, RD_RECT * rects, int count, uint32 color)
+{
+	int i;
+	GDI_RECT rect;
+	GDI_BRUSH hBrush;
+	GDI *gdi = GET_GDI(inst);
+
+	DEBUG_GDI("ui_rects: count:%d", count);
+
+	hBrush.objectType = GDIOBJECT_BRUSH;
+	hBrush.style = GDI_BS_SOLID;
+	hBrush.color = gdi_color_convert(color, gdi->srcBpp, 32, gdi->clrconv);
+
+	for (i = 0; i < count; i++)
+	{
+		gdi_CRgnToRect(rects[i].x, rects[i].y, rects[i].width, rects[i].height, &rect);
+		gdi_FillRect(gdi->drawing->hdc, &rect, &hBrush);
+	}
 }
 
 /**
@@ -648,17 +786,20 @@ static void
 gdi_ui_polyline(struct rdp_inst * inst, uint8 opcode, RD_POINT * points, int npoints, RD_PEN * pen)
 {
 	int i;
-	HGDI_PEN hPen;
+	GDI_PEN hPen;
 	int cx, cy;
-	uint32 color;
+	HGDI_PEN originalPen;
 	GDI *gdi = GET_GDI(inst);
 
 	DEBUG_GDI("ui_polyline: opcode:%d npoints:%d", opcode, npoints);
 
-	color = gdi_color_convert(pen->color, gdi->srcBpp, 32, gdi->clrconv);
+	hPen.objectType = GDIOBJECT_PEN;
+	hPen.style = pen->style;
+	hPen.width = pen->width;
+	hPen.color = gdi_color_convert(pen->color, gdi->srcBpp, 32, gdi->clrconv);
 
-	hPen = gdi_CreatePen(pen->style, pen->width, (GDI_COLOR) color);
-	gdi_SelectObject(gdi->drawing->hdc, (HGDIOBJECT) hPen);
+	originalPen = gdi->drawing->hdc->pen;
+	gdi_SelectObject(gdi->drawing->hdc, (HGDIOBJECT) &hPen);
 	gdi_SetROP2(gdi->drawing->hdc, opcode);
 
 	cx = points[0].x;
@@ -671,7 +812,7 @@ gdi_ui_polyline(struct rdp_inst * inst, uint8 opcode, RD_POINT * points, int npo
 		gdi_LineTo(gdi->drawing->hdc, cx, cy);
 	}
 
-	gdi_DeleteObject((HGDIOBJECT) hPen);
+	gdi->drawing->hdc->pen = originalPen;
 }
 
 /**
@@ -792,8 +933,9 @@ gdi_ui_patblt(struct rdp_inst * inst, uint8 opcode, int x, int y, int cx, int cy
 	
 	if (brush->style == GDI_BS_PATTERN)
 	{
-		uint8* data;
-		HGDI_BITMAP hBmp;
+		RD_BRUSHDATA* bd;
+		GDI_BITMAP pattern;
+		GDI_BRUSH patternBrush;
 
 		if (brush->bd == 0) /* RDP4 Brush */
 		{
@@ -801,36 +943,61 @@ gdi_ui_patblt(struct rdp_inst * inst, uint8 opcode, int x, int y, int cx, int cy
 		}
 		else
 		{
-			if (brush->bd->color_code > 1) /*  > 1 bpp */
+			bd = brush->bd;
+
+			if (bd->color_code > 1) /*  > 1 bpp */
 			{
-				data = gdi_image_convert(brush->bd->data, NULL, 8, 8, gdi->srcBpp, gdi->dstBpp, gdi->clrconv);
+				/* the converted pattern lives in the brush cache entry, until the palette changes */
+				if (bd->ui_data == NULL || bd->ui_palette != gdi->palette_generation)
+				{
+					if (bd->ui_data != NULL)
+						free(bd->ui_data);
+					bd->ui_data = gdi_image_convert(bd->data, NULL, 8, 8, gdi->srcBpp, gdi->dstBpp, gdi->clrconv);
+					bd->ui_palette = gdi->palette_generation;
+				}
+
+				pattern.data = bd->ui_data;
 			}
 			else
 			{
-				data = gdi_mono_image_convert(brush->bd->data, 8, 8, gdi->srcBpp, gdi->dstBpp, bgcolor, fgcolor, gdi->clrconv);
+				/* mono patterns depend on the order colors, expand them for this call only */
+				pattern.data = gdi_mono_image_convert(bd->data, gdi_get_scratch(gdi, 8 * 8 * gdi->bytesPerPixel),
+						8, 8, gdi->srcBpp, gdi->dstBpp, bgcolor, fgcolor, gdi->clrconv);
 			}
-			hBmp = gdi_CreateBitmap(8, 8, gdi->drawing->hdc->bitsPerPixel, data);
+
+			pattern.objectType = GDIOBJECT_BITMAP;
+			pattern.bitsPerPixel = gdi->drawing->hdc->bitsPerPixel;
+			pattern.bytesPerPixel = gdi->drawing->hdc->bytesPerPixel;
+			pattern.width = 8;
+			pattern.height = 8;
+			pattern.scanline = 8 * pattern.bytesPerPixel;
+
+			patternBrush.objectType = GDIOBJECT_BRUSH;
+			patternBrush.style = GDI_BS_PATTERN;
+			patternBrush.pattern = &pattern;
+			patternBrush.color = 0;
 
 			originalBrush = gdi->drawing->hdc->brush;
-			gdi->drawing->hdc->brush = gdi_CreatePatternBrush(hBmp);
+			gdi->drawing->hdc->brush = &patternBrush;
 
 			gdi_PatBlt(gdi->drawing->hdc, x, y, cx, cy, gdi_rop3_code(opcode));
 
-			gdi_DeleteObject((HGDIOBJECT) gdi->drawing->hdc->brush);
 			gdi->drawing->hdc->brush = originalBrush;
 		}
 	}
 	else if (brush->style == GDI_BS_SOLID)
 	{
-		uint32 color;
-		originalBrush = gdi->drawing->hdc->brush;
+		GDI_BRUSH solidBrush;
+
+		solidBrush.objectType = GDIOBJECT_BRUSH;
+		solidBrush.style = GDI_BS_SOLID;
+		solidBrush.color = gdi_color_convert(fgcolor, gdi->srcBpp, 32, gdi->clrconv);
 
-		color = gdi_color_convert(fgcolor, gdi->srcBpp, 32, gdi->clrconv);
-		gdi->drawing->hdc->brush = gdi_CreateSolidBrush(color);
+		originalBrush = gdi->drawing->hdc->brush;
+		gdi->drawing->hdc->brush = &solidBrush;
 
 		gdi_PatBlt(gdi->drawing->hdc, x, y, cx, cy, gdi_rop3_code(opcode));
 
-		gdi_DeleteObject((HGDIOBJECT) gdi->drawing->hdc->brush);
 		gdi->drawing->hdc->brush = originalBrush;
 	}
 	else
@@ -941,6 +1108,9 @@ gdi_ui_set_palette(struct rdp_inst * inst, RD_HPALETTE palette)
 	GDI *gdi = GET_GDI(inst);
 	DEBUG_GDI("gdi_ui_set_palette");
 	gdi->clrconv->palette = (RD_PALETTE*) palette;
+
+	/* brushes converted with the old palette are converted again */
+	gdi->palette_generation++;
 }
 
 /**
@@ -1057,10 +1227,78 @@ static int
 gdi_ui_decode(struct rdp_inst * inst, uint8 * data, int size)
 {
 	GDI *gdi = GET_GDI(inst);
-	gdi_decode_data(gdi, data, size);
+	int frame_id;
+
+	/* the frame is in the primary surface once decoded */
+	frame_id = gdi_decode_data(gdi, data, size);
+	if (frame_id >= 0)
+		inst->rdp_send_frame_ack(inst, frame_id);
 	return 0;
 }
 
+/**
+ * Draw a single queued primary drawing order.
+ * @param inst current instance
+ * @param order drawing order
+ */
+
+void
+gdi_draw_order(rdpInst * inst, RD_ORDER * order)
+{
+	switch (order->type)
+	{
+		case RD_ORDER_SET_CLIP:
+			gdi_ui_set_clipping_region(inst, order->x, order->y, order->cx, order->cy);
+			break;
+
+		case RD_ORDER_RESET_CLIP:
+			gdi_ui_reset_clipping_region(inst);
+			break;
+
+		case RD_ORDER_DESTBLT:
+			gdi_ui_destblt(inst, order->opcode, order->x, order->y, order->cx, order->cy);
+			break;
+
+		case RD_ORDER_PATBLT:
+			gdi_ui_patblt(inst, order->opcode, order->x, order->y, order->cx, order->cy,
+				&order->u.patblt.brush, order->u.patblt.bgcolor, order->u.patblt.fgcolor);
+			break;
+
+		case RD_ORDER_SCREENBLT:
+			gdi_ui_screenblt(inst, order->opcode, order->x, order->y, order->cx, order->cy,
+				order->u.screenblt.srcx, order->u.screenblt.srcy);
+			break;
+
+		case RD_ORDER_MEMBLT:
+			gdi_ui_memblt(inst, order->opcode, order->x, order->y, order->cx, order->cy,
+				order->u.memblt.src, order->u.memblt.srcx, order->u.memblt.srcy);
+			break;
+
+		case RD_ORDER_LINE:
+			gdi_ui_line(inst, order->opcode, order->x, order->y,
+				order->u.line.endx, order->u.line.endy, &order->u.line.pen);
+			break;
+
+		case RD_ORDER_RECT:
+			gdi_ui_rect(inst, order->x, order->y, order->cx, order->cy, order->u.rect.color);
+			break;
+	}
+}
+
+/**
+ * Draw a batch of primary drawing orders, split across the render bands.
+ * @param inst current instance
+ * @param orders array of orders
+ * @param count number of orders
+ */
+
+static void
+gdi_ui_draw_orders(struct rdp_inst * inst, RD_ORDER * orders, int count)
+{
+	GDI *gdi = GET_GDI(inst);
+	gdi_bands_draw_orders(gdi->bands, inst, orders, count);
+}
+
 /**
  * Register GDI callbacks with libfreerdp.
  * @param inst current instance
@@ -1077,6 +1315,7 @@ gdi_register_callbacks(rdpInst * inst)
 	inst->ui_destroy_bitmap = gdi_ui_destroy_bitmap;
 	inst->ui_line = gdi_ui_line;
 	inst->ui_rect = gdi_ui_rect;
+	inst->ui_rects = gdi_ui_rects;
 	inst->ui_polygon = gdi_ui_polygon;
 	inst->ui_polyline = gdi_ui_polyline;
 	inst->ui_ellipse = gdi_ui_ellipse;
@@ -1098,6 +1337,7 @@ gdi_register_callbacks(rdpInst * inst)
 	inst->ui_set_surface = gdi_ui_switch_surface;
 	inst->ui_destroy_surface = gdi_ui_destroy_surface;
 	inst->ui_decode = gdi_ui_decode;
+	inst->ui_draw_orders = NULL;
 	return 0;
 }
 
@@ -1110,6 +1350,7 @@ gdi_register_callbacks(rdpInst * inst)
 int
 gdi_init(rdpInst * inst, uint32 flags)
 {
+	int threads;
 	GDI *gdi = (GDI*) malloc(sizeof(GDI));
 	memset(gdi, 0, sizeof(GDI));
 	SET_GDI(inst, gdi);
@@ -1153,6 +1394,10 @@ gdi_init(rdpInst * inst, uint32 flags)
 	gdi->hdc->bitsPerPixel = gdi->dstBpp;
 	gdi->hdc->bytesPerPixel = gdi->bytesPerPixel;
 
+	/* every compatible DC shares this table, so GDI_INIT_SIMD reaches them all */
+	memcpy(&gdi->rops, &gdi_rops_generic, sizeof(GDI_ROPS));
+	gdi->hdc->rops = &gdi->rops;
+
 	gdi->clrconv = (HCLRCONV) malloc(sizeof(CLRCONV));
 	gdi->clrconv->palette = NULL;
 	gdi->clrconv->alpha = (flags & CLRCONV_ALPHA) ? 1 : 0;
@@ -1168,8 +1413,12 @@ gdi_init(rdpInst * inst, uint32 flags)
 	gdi->drawing = gdi->primary;
 
 	gdi->primary->hdc->hwnd = (HGDI_WND) malloc(sizeof(GDI_WND));
+	memset(gdi->primary->hdc->hwnd, 0, sizeof(GDI_WND));
 	gdi->primary->hdc->hwnd->invalid = gdi_CreateRectRgn(0, 0, 0, 0);
 	gdi->primary->hdc->hwnd->invalid->null = 1;
+	gdi->primary->hdc->hwnd->count = GDI_INVALID_RECTS;
+	gdi->primary->hdc->hwnd->cinvalid = (HGDI_RGN) malloc(sizeof(GDI_RGN) * GDI_INVALID_RECTS);
+	gdi->primary->hdc->hwnd->mergeCost = GDI_INVALID_MERGE_COST;
 
 	gdi->rfx_context = rfx_context_new();
 	gdi->tile = gdi_bitmap_new(gdi, 64, 64, 32, NULL);
@@ -1181,6 +1430,22 @@ gdi_init(rdpInst * inst, uint32 flags)
 
 	GDI_INIT_SIMD(gdi);
 
+	/* with render threads, primary orders come in batches replayed across bands */
+	threads = inst->settings->software_gdi_threads;
+
+	if (threads > gdi->height)
+		threads = gdi->height;
+
+	if (threads > 1)
+		gdi->bands = gdi_bands_new(gdi, threads);
+
+	/* draw serially when the threads could not be started */
+	if (gdi->bands != NULL)
+	{
+		inst->ui_draw_orders = gdi_ui_draw_orders;
+		inst->ui_rects = NULL;
+	}
+
 	return 0;
 }
 
@@ -1190,10 +1455,12 @@ void gdi_free(rdpInst* inst)
 
 	if (gdi)
 	{
+		gdi_bands_free(gdi->bands);
 		gdi_bitmap_free(gdi->tile);
 		rfx_context_free(gdi->rfx_context);
 		gdi_bitmap_free(gdi->primary);
 		gdi_DeleteObject((HGDIOBJECT) gdi->hdc);
+		free(gdi->scratch);
 		free(gdi->clrconv);
 		free(gdi);
 	}
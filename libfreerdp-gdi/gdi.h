@@ -193,13 +193,51 @@ struct _GDI_BRUSH
 typedef struct _GDI_BRUSH GDI_BRUSH;
 typedef GDI_BRUSH* HGDI_BRUSH;
 
+/* invalid rectangles kept per window and the pixels one is worth */
+#define GDI_INVALID_RECTS	32
+#define GDI_INVALID_MERGE_COST	(64 * 64)
+
 struct _GDI_WND
 {
-	HGDI_RGN invalid;
+	HGDI_RGN invalid; /* bounding box */
+	int count; /* size of cinvalid, 0 for the bounding box only */
+	int ninvalid;
+	HGDI_RGN cinvalid; /* disjoint rectangles covering the invalid area */
+	int mergeCost;
 };
 typedef struct _GDI_WND GDI_WND;
 typedef GDI_WND* HGDI_WND;
 
+/* row kernels behind the common raster operations, n counts pixels */
+typedef void (*p_gdi_rop_src_32bpp)(uint32* d, uint32* s, int n);
+typedef void (*p_gdi_rop_dst_32bpp)(uint32* d, int n);
+typedef void (*p_gdi_rop_pat_32bpp)(uint32* d, uint32 color, int n);
+typedef void (*p_gdi_rop_mask_32bpp)(uint32* d, uint8* s, uint32 color, int n);
+typedef void (*p_gdi_rop_src_16bpp)(uint16* d, uint16* s, int n);
+typedef void (*p_gdi_rop_dst_16bpp)(uint16* d, int n);
+typedef void (*p_gdi_rop_pat_16bpp)(uint16* d, uint16 color, int n);
+typedef void (*p_gdi_rop_mask_16bpp)(uint16* d, uint8* s, uint16 color, int n);
+
+struct _GDI_ROPS
+{
+	p_gdi_rop_src_32bpp SRCAND_32bpp;
+	p_gdi_rop_src_32bpp SRCPAINT_32bpp;
+	p_gdi_rop_src_32bpp SRCINVERT_32bpp;
+	p_gdi_rop_dst_32bpp DSTINVERT_32bpp;
+	p_gdi_rop_pat_32bpp PATCOPY_32bpp;
+	p_gdi_rop_pat_32bpp PATINVERT_32bpp;
+	p_gdi_rop_mask_32bpp DSPDxax_32bpp;
+	p_gdi_rop_src_16bpp SRCAND_16bpp;
+	p_gdi_rop_src_16bpp SRCPAINT_16bpp;
+	p_gdi_rop_src_16bpp SRCINVERT_16bpp;
+	p_gdi_rop_dst_16bpp DSTINVERT_16bpp;
+	p_gdi_rop_pat_16bpp PATCOPY_16bpp;
+	p_gdi_rop_pat_16bpp PATINVERT_16bpp;
+	p_gdi_rop_mask_16bpp DSPDxax_16bpp;
+};
+typedef struct _GDI_ROPS GDI_ROPS;
+typedef GDI_ROPS* HGDI_ROPS;
+
 struct _GDI_DC
 {
 	HGDIOBJECT selectedObject;
@@ -216,6 +254,7 @@ struct _GDI_DC
 	int alpha;
 	int invert;
 	int rgb555;
+	HGDI_ROPS rops;
 };
 typedef struct _GDI_DC GDI_DC;
 typedef GDI_DC* HGDI_DC;
@@ -229,6 +268,15 @@ struct _GDI_IMAGE
 typedef struct _GDI_IMAGE GDI_IMAGE;
 typedef GDI_IMAGE* HGDI_IMAGE;
 
+struct _GDI_GLYPH
+{
+	GDI_IMAGE image;
+	GDI_DC hdc;
+	GDI_BITMAP bitmap;
+	GDI_RGN clip;
+};
+typedef struct _GDI_GLYPH GDI_GLYPH;
+
 #include "gdi_dc.h"
 #include "gdi_pen.h"
 #include "gdi_line.h"
@@ -258,22 +306,33 @@ struct _GDI
 	GDI_COLOR textColor;
 	void * rfx_context;
 	GDI_IMAGE *tile;
+	uint8* scratch;
+	int scratch_size;
+	struct _GDI_BANDS* bands;
+	uint32 palette_generation;
 
 	/* callbacks */
 	p_gdi_BitBlt BitBlt;
 	p_gdi_image_convert gdi_image_convert;
+	GDI_ROPS rops;
 };
 typedef struct _GDI GDI;
 
 #include "decode.h"
+#include "gdi_band.h"
+
+extern GDI_ROPS gdi_rops_generic;
 
 uint32 gdi_rop3_code(uint8 code);
 void gdi_copy_mem(uint8 *d, uint8 *s, int n);
 void gdi_copy_memb(uint8 *d, uint8 *s, int n);
 uint8* gdi_get_bitmap_pointer(HGDI_DC hdcBmp, int x, int y);
 uint8* gdi_get_brush_pointer(HGDI_DC hdcBrush, int x, int y);
+void gdi_fill_pattern_row(uint8 * d, uint8 * pattern, int size, int n);
 int gdi_is_mono_pixel_set(uint8* data, int x, int y, int width);
 int gdi_init(rdpInst * inst, uint32 flags);
+uint8* gdi_get_scratch(GDI *gdi, int size);
+void gdi_draw_order(rdpInst * inst, RD_ORDER * order);
 GDI_IMAGE* gdi_bitmap_new(GDI *gdi, int width, int height, int bpp, uint8* data);
 void gdi_bitmap_free(GDI_IMAGE *gdi_bmp);
 void gdi_free(rdpInst* inst);
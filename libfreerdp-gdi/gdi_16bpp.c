@@ -29,6 +29,7 @@
 #include "gdi_region.h"
 #include "gdi_clipping.h"
 #include "gdi_drawing.h"
+#include "gdi_rop3.h"
 
 #include "gdi_16bpp.h"
 
@@ -99,6 +100,61 @@ int FillRect_16bpp(HGDI_DC hdc, HGDI_RECT rect, HGDI_BRUSH hbr)
 	return 0;
 }
 
+/* Row kernels, 16bpp pixels have no alpha so every ROP applies to both bytes */
+
+void RopRow_SRCAND_16bpp(uint16* d, uint16* s, int n)
+{
+	for (; n > 0; n--)
+		*d++ &= *s++;
+}
+
+void RopRow_SRCPAINT_16bpp(uint16* d, uint16* s, int n)
+{
+	for (; n > 0; n--)
+		*d++ |= *s++;
+}
+
+void RopRow_SRCINVERT_16bpp(uint16* d, uint16* s, int n)
+{
+	for (; n > 0; n--)
+		*d++ ^= *s++;
+}
+
+void RopRow_DSTINVERT_16bpp(uint16* d, int n)
+{
+	for (; n > 0; n--)
+	{
+		*d = ~(*d);
+		d++;
+	}
+}
+
+void RopRow_PATCOPY_16bpp(uint16* d, uint16 color, int n)
+{
+	for (; n > 0; n--)
+		*d++ = color;
+}
+
+void RopRow_PATINVERT_16bpp(uint16* d, uint16 color, int n)
+{
+	for (; n > 0; n--)
+		*d++ ^= color;
+}
+
+void RopRow_DSPDxax_16bpp(uint16* d, uint8* s, uint16 color, int n)
+{
+	uint16 mask;
+
+	for (; n > 0; n--)
+	{
+		/* the glyph byte masks both bytes of the pixel */
+		mask = (*s << 8) | *s;
+		*d = (mask & color) | (~mask & *d);
+		d++;
+		s++;
+	}
+}
+
 static int BitBlt_BLACKNESS_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight)
 {
 	int y;
@@ -200,113 +256,17 @@ static int BitBlt_SRCCOPY_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWi
 	return 0;
 }
 
-static int BitBlt_NOTSRCCOPY_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int x, y;
-	uint8 *srcp;
-	uint8 *dstp;
-	
-	for (y = 0; y < nHeight; y++)
-	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp = ~(*srcp);
-				srcp++;
-				dstp++;
-					
-				*dstp = ~(*srcp);
-				srcp++;
-				dstp++;
-			}
-		}
-	}
-
-	return 0;
-}
-
 static int BitBlt_DSTINVERT_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight)
 {
-	int x, y;
-	uint8 *dstp;
-		
-	for (y = 0; y < nHeight; y++)
-	{
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp = ~(*dstp);
-				dstp++;
-					
-				*dstp = ~(*dstp);
-				dstp++;
-			}
-		}
-	}
-
-	return 0;
-}
-
-static int BitBlt_SRCERASE_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int x, y;
-	uint8 *srcp;
-	uint8 *dstp;
-		
-	for (y = 0; y < nHeight; y++)
-	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp = *srcp & ~(*dstp);
-				srcp++;
-				dstp++;
-					
-				*dstp = *srcp & ~(*dstp);
-				srcp++;
-				dstp++;
-			}
-		}
-	}
-
-	return 0;
-}
-
-static int BitBlt_NOTSRCERASE_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int x, y;
-	uint8 *srcp;
+	int y;
 	uint8 *dstp;
 		
 	for (y = 0; y < nHeight; y++)
 	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
 		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
 
 		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp = ~(*srcp) & ~(*dstp);
-				srcp++;
-				dstp++;
-					
-				*dstp = ~(*srcp) & ~(*dstp);
-				srcp++;
-				dstp++;
-			}
-		}
+			hdcDest->rops->DSTINVERT_16bpp((uint16*) dstp, nWidth);
 	}
 
 	return 0;
@@ -314,7 +274,7 @@ static int BitBlt_NOTSRCERASE_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int
 
 static int BitBlt_SRCINVERT_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
 {
-	int x, y;
+	int y;
 	uint8 *srcp;
 	uint8 *dstp;
 		
@@ -324,18 +284,7 @@ static int BitBlt_SRCINVERT_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int n
 		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
 
 		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp ^= *srcp;
-				srcp++;
-				dstp++;
-					
-				*dstp ^= *srcp;
-				srcp++;
-				dstp++;
-			}
-		}
+			hdcDest->rops->SRCINVERT_16bpp((uint16*) dstp, (uint16*) srcp, nWidth);
 	}
 
 	return 0;
@@ -343,7 +292,7 @@ static int BitBlt_SRCINVERT_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int n
 
 static int BitBlt_SRCAND_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
 {
-	int x, y;
+	int y;
 	uint8 *srcp;
 	uint8 *dstp;
 		
@@ -353,18 +302,7 @@ static int BitBlt_SRCAND_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWid
 		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
 
 		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp &= *srcp;
-				srcp++;
-				dstp++;
-					
-				*dstp &= *srcp;
-				srcp++;
-				dstp++;
-			}
-		}
+			hdcDest->rops->SRCAND_16bpp((uint16*) dstp, (uint16*) srcp, nWidth);
 	}
 
 	return 0;
@@ -372,7 +310,7 @@ static int BitBlt_SRCAND_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWid
 
 static int BitBlt_SRCPAINT_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
 {
-	int x, y;
+	int y;
 	uint8 *srcp;
 	uint8 *dstp;
 		
@@ -382,18 +320,7 @@ static int BitBlt_SRCPAINT_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nW
 		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
 
 		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp |= *srcp;
-				srcp++;
-				dstp++;
-					
-				*dstp |= *srcp;
-				srcp++;
-				dstp++;
-			}
-		}
+			hdcDest->rops->SRCPAINT_16bpp((uint16*) dstp, (uint16*) srcp, nWidth);
 	}
 
 	return 0;
@@ -401,21 +328,16 @@ static int BitBlt_SRCPAINT_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nW
 
 static int BitBlt_DSPDxax_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
 {	
-	int x, y;
+	int y;
 	uint8 *srcp;
 	uint8 *dstp;
-	uint8 *patp;
 	uint16 color16;
-	HGDI_BITMAP hSrcBmp;
 
 	/* D = (S & P) | (~S & D) */
 	/* DSPDxax, used to draw glyphs */
 
 	color16 = gdi_get_color_16bpp(hdcDest, hdcDest->textColor);
 
-	hSrcBmp = (HGDI_BITMAP) hdcSrc->selectedObject;
-	srcp = hSrcBmp->data;
-
 	if (hdcSrc->bytesPerPixel != 1)
 	{
 		printf("BitBlt_DSPDxax expects 1 bpp, unimplemented for %d\n", hdcSrc->bytesPerPixel);
@@ -428,152 +350,12 @@ static int BitBlt_DSPDxax_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWi
 		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
 
 		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				patp = (uint8*) &color16;
-
-				*dstp = (*srcp & *patp) | (~(*srcp) & *dstp);
-				dstp++;
-				patp++;
-
-				*dstp = (*srcp & *patp) | (~(*srcp) & *dstp);
-				dstp++;
-				patp++;
-				srcp++;
-			}
-		}
+			hdcDest->rops->DSPDxax_16bpp((uint16*) dstp, srcp, color16, nWidth);
 	}
 
 	return 0;
 }
 
-static int BitBlt_SPna_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int x, y;
-	uint8 *srcp;
-	uint8 *dstp;
-	uint8 *patp;
-	
-	for (y = 0; y < nHeight; y++)
-	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);		
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				patp = gdi_get_brush_pointer(hdcDest, x, y);
-				
-				*dstp = *srcp & ~(*patp);
-				patp++;
-				srcp++;
-				dstp++;
-					
-				*dstp = *srcp & ~(*patp);
-				patp++;
-				srcp++;
-				dstp++;
-			}
-		}
-	}
-	
-	return 0;
-}
-
-static int BitBlt_DSna_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int x, y;
-	uint8 *srcp;
-	uint8 *dstp;
-
-	for (y = 0; y < nHeight; y++)
-	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp = ~(*srcp) & (*dstp);
-				srcp++;
-				dstp++;
-
-				*dstp = ~(*srcp) & (*dstp);
-				srcp++;
-				dstp++;
-			}
-		}
-	}
-
-	return 0;
-}
-
-
-static int BitBlt_MERGECOPY_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int x, y;
-	uint8 *srcp;
-	uint8 *dstp;
-	uint8 *patp;
-	
-	for (y = 0; y < nHeight; y++)
-	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				patp = gdi_get_brush_pointer(hdcDest, x, y);
-				
-				*dstp = *srcp & *patp;
-				patp++;
-				srcp++;
-				dstp++;
-					
-				*dstp = *srcp & *patp;
-				patp++;
-				srcp++;
-				dstp++;
-			}
-		}
-	}
-	
-	return 0;
-}
-
-static int BitBlt_MERGEPAINT_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int x, y;
-	uint8 *srcp;
-	uint8 *dstp;
-	
-	for (y = 0; y < nHeight; y++)
-	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{				
-				*dstp = ~(*srcp) | *dstp;
-				srcp++;
-				dstp++;
-					
-				*dstp = ~(*srcp) | *dstp;
-				srcp++;
-				dstp++;
-			}
-		}
-	}
-	
-	return 0;
-}
 
 static int BitBlt_PATCOPY_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight)
 {
@@ -592,12 +374,20 @@ static int BitBlt_PATCOPY_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWi
 			dstp16 = (uint16*) gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
 
 			if (dstp16 != 0)
+				hdcDest->rops->PATCOPY_16bpp(dstp16, color16, nWidth);
+		}
+	}
+	else if (hdcDest->brush->style == GDI_BS_PATTERN)
+	{
+		/* copy the pattern row once and replicate it across the span */
+		for (y = 0; y < nHeight; y++)
+		{
+			dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
+
+			if (dstp != 0)
 			{
-				for (x = 0; x < nWidth; x++)
-				{
-					*dstp16 = color16;
-					dstp16++;
-				}
+				patp = gdi_get_brush_pointer(hdcDest, 0, y);
+				gdi_fill_pattern_row(dstp, patp, hdcDest->brush->pattern->scanline, nWidth * 2);
 			}
 		}
 	}
@@ -645,13 +435,7 @@ static int BitBlt_PATINVERT_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int n
 			dstp16 = (uint16*) gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
 
 			if (dstp16 != 0)
-			{
-				for (x = 0; x < nWidth; x++)
-				{
-					*dstp16 ^= color16;
-					dstp16++;
-				}
-			}
+				hdcDest->rops->PATINVERT_16bpp(dstp16, color16, nWidth);
 		}
 	}
 	else
@@ -681,40 +465,6 @@ static int BitBlt_PATINVERT_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int n
 	return 0;
 }
 
-static int BitBlt_PATPAINT_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int x, y;
-	uint8 *srcp;
-	uint8 *dstp;
-	uint8 *patp;
-	
-	for (y = 0; y < nHeight; y++)
-	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				patp = gdi_get_brush_pointer(hdcDest, x, y);
-				
-				*dstp = *dstp | (*patp | ~(*srcp));
-				patp++;
-				srcp++;
-				dstp++;
-					
-				*dstp = *dstp | (*patp | ~(*srcp));
-				patp++;
-				srcp++;
-				dstp++;
-			}
-		}
-	}
-	
-	return 0;
-}
-
 int BitBlt_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc, int rop)
 {
 	if (hdcSrc != NULL)
@@ -744,34 +494,14 @@ int BitBlt_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeigh
 			return BitBlt_SRCCOPY_16bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
 			break;
 
-		case GDI_SPna:
-			return BitBlt_SPna_16bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
-
-		case GDI_DSna:
-			return BitBlt_DSna_16bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
-
 		case GDI_DSPDxax:
 			return BitBlt_DSPDxax_16bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
 			break;
 			
-		case GDI_NOTSRCCOPY:
-			return BitBlt_NOTSRCCOPY_16bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
-
 		case GDI_DSTINVERT:
 			return BitBlt_DSTINVERT_16bpp(hdcDest, nXDest, nYDest, nWidth, nHeight);
 			break;
 
-		case GDI_SRCERASE:
-			return BitBlt_SRCERASE_16bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
-
-		case GDI_NOTSRCERASE:
-			return BitBlt_NOTSRCERASE_16bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
-
 		case GDI_SRCINVERT:
 			return BitBlt_SRCINVERT_16bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
 			break;
@@ -784,14 +514,6 @@ int BitBlt_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeigh
 			return BitBlt_SRCPAINT_16bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
 			break;
 
-		case GDI_MERGECOPY:
-			return BitBlt_MERGECOPY_16bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
-
-		case GDI_MERGEPAINT:
-			return BitBlt_MERGEPAINT_16bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
-
 		case GDI_PATCOPY:
 			return BitBlt_PATCOPY_16bpp(hdcDest, nXDest, nYDest, nWidth, nHeight);
 			break;
@@ -799,14 +521,9 @@ int BitBlt_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeigh
 		case GDI_PATINVERT:
 			return BitBlt_PATINVERT_16bpp(hdcDest, nXDest, nYDest, nWidth, nHeight);
 			break;
-
-		case GDI_PATPAINT:
-			return BitBlt_PATPAINT_16bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
 	}
 	
-	printf("BitBlt: unknown rop: 0x%08X\n", rop);
-	return 1;
+	return gdi_rop3_blt(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc, rop);
 }
 
 int PatBlt_16bpp(HGDI_DC hdc, int nXLeft, int nYLeft, int nWidth, int nHeight, int rop)
@@ -839,8 +556,7 @@ int PatBlt_16bpp(HGDI_DC hdc, int nXLeft, int nYLeft, int nWidth, int nHeight, i
 			break;
 	}
 	
-	printf("PatBlt: unknown rop: 0x%08X", rop);
-	return 1;
+	return gdi_rop3_blt(hdc, nXLeft, nYLeft, nWidth, nHeight, NULL, 0, 0, rop);
 }
 
 void SetPixel_BLACK_16bpp(uint16 *pixel, uint16 *pen)
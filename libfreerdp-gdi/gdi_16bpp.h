@@ -22,6 +22,16 @@
 
 typedef void (*pSetPixel16_ROP2)(uint16 *pixel, uint16 *pen);
 
+uint16 gdi_get_color_16bpp(HGDI_DC hdc, GDI_COLOR color);
+
+void RopRow_SRCAND_16bpp(uint16* d, uint16* s, int n);
+void RopRow_SRCPAINT_16bpp(uint16* d, uint16* s, int n);
+void RopRow_SRCINVERT_16bpp(uint16* d, uint16* s, int n);
+void RopRow_DSTINVERT_16bpp(uint16* d, int n);
+void RopRow_PATCOPY_16bpp(uint16* d, uint16 color, int n);
+void RopRow_PATINVERT_16bpp(uint16* d, uint16 color, int n);
+void RopRow_DSPDxax_16bpp(uint16* d, uint8* s, uint16 color, int n);
+
 int FillRect_16bpp(HGDI_DC hdc, HGDI_RECT rect, HGDI_BRUSH hbr);
 int BitBlt_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc, int rop);
 int PatBlt_16bpp(HGDI_DC hdc, int nXLeft, int nYLeft, int nWidth, int nHeight, int rop);
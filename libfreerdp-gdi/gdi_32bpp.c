@@ -29,6 +29,7 @@
 #include "gdi_region.h"
 #include "gdi_clipping.h"
 #include "gdi_drawing.h"
+#include "gdi_rop3.h"
 
 #include "gdi_32bpp.h"
 
@@ -85,48 +86,112 @@ int FillRect_32bpp(HGDI_DC hdc, HGDI_RECT rect, HGDI_BRUSH hbr)
 	return 0;
 }
 
-static int BitBlt_BLACKNESS_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight)
+/* Row kernels, the alpha byte of a pixel is only touched by the pattern fills */
+
+void RopRow_SRCAND_32bpp(uint32* d, uint32* s, int n)
 {
-	if (hdcDest->alpha)
+	uint8* dstp = (uint8*) d;
+	uint8* srcp = (uint8*) s;
+
+	for (; n > 0; n--)
 	{
-		int x, y;
-		uint8 *dstp;
+		dstp[0] &= srcp[0];
+		dstp[1] &= srcp[1];
+		dstp[2] &= srcp[2];
+		dstp += 4;
+		srcp += 4;
+	}
+}
 
-		for (y = 0; y < nHeight; y++)
-		{
-			dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
+void RopRow_SRCPAINT_32bpp(uint32* d, uint32* s, int n)
+{
+	uint8* dstp = (uint8*) d;
+	uint8* srcp = (uint8*) s;
 
-			if (dstp != 0)
-			{
-				for (x = 0; x < nWidth; x++)
-				{
-					*dstp = 0;
-					dstp++;
+	for (; n > 0; n--)
+	{
+		dstp[0] |= srcp[0];
+		dstp[1] |= srcp[1];
+		dstp[2] |= srcp[2];
+		dstp += 4;
+		srcp += 4;
+	}
+}
 
-					*dstp = 0;
-					dstp++;
+void RopRow_SRCINVERT_32bpp(uint32* d, uint32* s, int n)
+{
+	uint8* dstp = (uint8*) d;
+	uint8* srcp = (uint8*) s;
 
-					*dstp = 0;
-					dstp++;
+	for (; n > 0; n--)
+	{
+		dstp[0] ^= srcp[0];
+		dstp[1] ^= srcp[1];
+		dstp[2] ^= srcp[2];
+		dstp += 4;
+		srcp += 4;
+	}
+}
 
-					*dstp = 0xFF;
-					dstp++;
-				}
-			}
-		}
+void RopRow_DSTINVERT_32bpp(uint32* d, int n)
+{
+	uint8* dstp = (uint8*) d;
+
+	for (; n > 0; n--)
+	{
+		dstp[0] = ~dstp[0];
+		dstp[1] = ~dstp[1];
+		dstp[2] = ~dstp[2];
+		dstp += 4;
 	}
-	else
+}
+
+void RopRow_PATCOPY_32bpp(uint32* d, uint32 color, int n)
+{
+	for (; n > 0; n--)
+		*d++ = color;
+}
+
+void RopRow_PATINVERT_32bpp(uint32* d, uint32 color, int n)
+{
+	for (; n > 0; n--)
+		*d++ ^= color;
+}
+
+void RopRow_DSPDxax_32bpp(uint32* d, uint8* s, uint32 color, int n)
+{
+	uint8* dstp = (uint8*) d;
+	uint8* patp = (uint8*) &color;
+
+	for (; n > 0; n--)
 	{
-		int y;
-		uint8 *dstp;
+		dstp[0] = (*s & patp[0]) | (~(*s) & dstp[0]);
+		dstp[1] = (*s & patp[1]) | (~(*s) & dstp[1]);
+		dstp[2] = (*s & patp[2]) | (~(*s) & dstp[2]);
+		dstp += 4;
+		s++;
+	}
+}
 
-		for (y = 0; y < nHeight; y++)
-		{
-			dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
+static int BitBlt_BLACKNESS_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight)
+{
+	int y;
+	uint8 *dstp;
+	uint32 color32;
 
-			if (dstp != 0)
-				memset(dstp, 0, nWidth * hdcDest->bytesPerPixel);
-		}
+	color32 = ARGB32(0xFF, 0, 0, 0);
+
+	for (y = 0; y < nHeight; y++)
+	{
+		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
+
+		if (dstp == 0)
+			continue;
+
+		if (hdcDest->alpha)
+			hdcDest->rops->PATCOPY_32bpp((uint32*) dstp, color32, nWidth);
+		else
+			memset(dstp, 0, nWidth * hdcDest->bytesPerPixel);
 	}
 
 	return 0;
@@ -217,128 +282,17 @@ static int BitBlt_SRCCOPY_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWi
 	return 0;
 }
 
-static int BitBlt_NOTSRCCOPY_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int x, y;
-	uint8 *srcp;
-	uint8 *dstp;
-	
-	for (y = 0; y < nHeight; y++)
-	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp = ~(*srcp);
-				srcp++;
-				dstp++;
-					
-				*dstp = ~(*srcp);
-				srcp++;
-				dstp++;
-
-				*dstp = ~(*srcp);
-				srcp += 2;
-				dstp += 2;
-			}
-		}
-	}
-
-	return 0;
-}
-
 static int BitBlt_DSTINVERT_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight)
 {
-	int x, y;
-	uint8 *dstp;
-		
-	for (y = 0; y < nHeight; y++)
-	{
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp = ~(*dstp);
-				dstp++;
-					
-				*dstp = ~(*dstp);
-				dstp++;
-
-				*dstp = ~(*dstp);
-				dstp += 2;
-			}
-		}
-	}
-
-	return 0;
-}
-
-static int BitBlt_SRCERASE_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int x, y;
-	uint8 *srcp;
-	uint8 *dstp;
-		
-	for (y = 0; y < nHeight; y++)
-	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp = *srcp & ~(*dstp);
-				srcp++;
-				dstp++;
-					
-				*dstp = *srcp & ~(*dstp);
-				srcp++;
-				dstp++;
-
-				*dstp = *srcp & ~(*dstp);
-				srcp += 2;
-				dstp += 2;
-			}
-		}
-	}
-
-	return 0;
-}
-
-static int BitBlt_NOTSRCERASE_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int x, y;
-	uint8 *srcp;
+	int y;
 	uint8 *dstp;
 		
 	for (y = 0; y < nHeight; y++)
 	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
 		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
 
 		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp = ~(*srcp) & ~(*dstp);
-				srcp++;
-				dstp++;
-					
-				*dstp = ~(*srcp) & ~(*dstp);
-				srcp++;
-				dstp++;
-
-				*dstp = ~(*srcp) & ~(*dstp);
-				srcp += 2;
-				dstp += 2;
-			}
-		}
+			hdcDest->rops->DSTINVERT_32bpp((uint32*) dstp, nWidth);
 	}
 
 	return 0;
@@ -346,7 +300,7 @@ static int BitBlt_NOTSRCERASE_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int
 
 static int BitBlt_SRCINVERT_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
 {
-	int x, y;
+	int y;
 	uint8 *srcp;
 	uint8 *dstp;
 		
@@ -356,22 +310,7 @@ static int BitBlt_SRCINVERT_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int n
 		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
 
 		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp ^= *srcp;
-				srcp++;
-				dstp++;
-					
-				*dstp ^= *srcp;
-				srcp++;
-				dstp++;
-
-				*dstp ^= *srcp;
-				srcp += 2;
-				dstp += 2;
-			}
-		}
+			hdcDest->rops->SRCINVERT_32bpp((uint32*) dstp, (uint32*) srcp, nWidth);
 	}
 
 	return 0;
@@ -379,7 +318,7 @@ static int BitBlt_SRCINVERT_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int n
 
 static int BitBlt_SRCAND_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
 {
-	int x, y;
+	int y;
 	uint8 *srcp;
 	uint8 *dstp;
 		
@@ -389,22 +328,7 @@ static int BitBlt_SRCAND_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWid
 		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
 
 		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp &= *srcp;
-				srcp++;
-				dstp++;
-					
-				*dstp &= *srcp;
-				srcp++;
-				dstp++;
-
-				*dstp &= *srcp;
-				srcp += 2;
-				dstp += 2;
-			}
-		}
+			hdcDest->rops->SRCAND_32bpp((uint32*) dstp, (uint32*) srcp, nWidth);
 	}
 
 	return 0;
@@ -412,7 +336,7 @@ static int BitBlt_SRCAND_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWid
 
 static int BitBlt_SRCPAINT_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
 {
-	int x, y;
+	int y;
 	uint8 *srcp;
 	uint8 *dstp;
 		
@@ -422,22 +346,7 @@ static int BitBlt_SRCPAINT_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nW
 		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
 
 		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp |= *srcp;
-				srcp++;
-				dstp++;
-					
-				*dstp |= *srcp;
-				srcp++;
-				dstp++;
-
-				*dstp |= *srcp;
-				srcp += 2;
-				dstp += 2;
-			}
-		}
+			hdcDest->rops->SRCPAINT_32bpp((uint32*) dstp, (uint32*) srcp, nWidth);
 	}
 
 	return 0;
@@ -445,21 +354,16 @@ static int BitBlt_SRCPAINT_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nW
 
 static int BitBlt_DSPDxax_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
 {	
-	int x, y;
+	int y;
 	uint8 *srcp;
 	uint8 *dstp;
-	uint8 *patp;
 	uint32 color32;
-	HGDI_BITMAP hSrcBmp;
 
 	/* D = (S & P) | (~S & D) */
 	/* DSPDxax, used to draw glyphs */
 
 	color32 = gdi_get_color_32bpp(hdcDest, hdcDest->textColor);
 
-	hSrcBmp = (HGDI_BITMAP) hdcSrc->selectedObject;
-	srcp = hSrcBmp->data;
-
 	if (hdcSrc->bytesPerPixel != 1)
 	{
 		printf("BitBlt_DSPDxax expects 1 bpp, unimplemented for %d\n", hdcSrc->bytesPerPixel);
@@ -472,171 +376,12 @@ static int BitBlt_DSPDxax_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWi
 		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
 
 		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				patp = (uint8*) &color32;
-
-				*dstp = (*srcp & *patp) | (~(*srcp) & *dstp);
-				dstp++;
-				patp++;
-
-				*dstp = (*srcp & *patp) | (~(*srcp) & *dstp);
-				dstp++;
-				patp++;
-
-				*dstp = (*srcp & *patp) | (~(*srcp) & *dstp);
-				dstp += 2;
-				srcp++;
-			}
-		}
+			hdcDest->rops->DSPDxax_32bpp((uint32*) dstp, srcp, color32, nWidth);
 	}
 
 	return 0;
 }
 
-static int BitBlt_SPna_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int x, y;
-	uint8 *srcp;
-	uint8 *dstp;
-	uint8 *patp;
-	
-	for (y = 0; y < nHeight; y++)
-	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);		
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				patp = gdi_get_brush_pointer(hdcDest, x, y);
-				
-				*dstp = *srcp & ~(*patp);
-				patp++;
-				srcp++;
-				dstp++;
-					
-				*dstp = *srcp & ~(*patp);
-				patp++;
-				srcp++;
-				dstp++;
-
-				*dstp = *srcp & ~(*patp);
-				srcp += 2;
-				dstp += 2;
-			}
-		}
-	}
-	
-	return 0;
-}
-
-static int BitBlt_DSna_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int x, y;
-	uint8 *srcp;
-	uint8 *dstp;
-
-	for (y = 0; y < nHeight; y++)
-	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp = ~(*srcp) & (*dstp);
-				srcp++;
-				dstp++;
-
-				*dstp = ~(*srcp) & (*dstp);
-				srcp++;
-				dstp++;
-
-				*dstp = ~(*srcp) & (*dstp);
-				srcp += 2;
-				dstp += 2;
-			}
-		}
-	}
-
-	return 0;
-}
-
-
-static int BitBlt_MERGECOPY_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int x, y;
-	uint8 *srcp;
-	uint8 *dstp;
-	uint8 *patp;
-	
-	for (y = 0; y < nHeight; y++)
-	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				patp = gdi_get_brush_pointer(hdcDest, x, y);
-				
-				*dstp = *srcp & *patp;
-				patp++;
-				srcp++;
-				dstp++;
-					
-				*dstp = *srcp & *patp;
-				patp++;
-				srcp++;
-				dstp++;
-
-				*dstp = *srcp & *patp;
-				dstp += 2;
-				srcp += 2;
-			}
-		}
-	}
-	
-	return 0;
-}
-
-static int BitBlt_MERGEPAINT_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int x, y;
-	uint8 *srcp;
-	uint8 *dstp;
-	
-	for (y = 0; y < nHeight; y++)
-	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{				
-				*dstp = ~(*srcp) | *dstp;
-				srcp++;
-				dstp++;
-					
-				*dstp = ~(*srcp) | *dstp;
-				srcp++;
-				dstp++;
-
-				*dstp = ~(*srcp) | *dstp;
-				dstp += 2;
-				srcp += 2;
-			}
-		}
-	}
-	
-	return 0;
-}
 
 static int BitBlt_PATCOPY_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight)
 {
@@ -655,12 +400,20 @@ static int BitBlt_PATCOPY_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWi
 			dstp32 = (uint32*) gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
 
 			if (dstp32 != 0)
+				hdcDest->rops->PATCOPY_32bpp(dstp32, color32, nWidth);
+		}
+	}
+	else if (hdcDest->brush->style == GDI_BS_PATTERN)
+	{
+		/* copy the pattern row once and replicate it across the span */
+		for (y = 0; y < nHeight; y++)
+		{
+			dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
+
+			if (dstp != 0)
 			{
-				for (x = 0; x < nWidth; x++)
-				{
-					*dstp32 = color32;
-					dstp32++;
-				}
+				patp = gdi_get_brush_pointer(hdcDest, 0, y);
+				gdi_fill_pattern_row(dstp, patp, hdcDest->brush->pattern->scanline, nWidth * 4);
 			}
 		}
 	}
@@ -711,13 +464,7 @@ static int BitBlt_PATINVERT_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int n
 			dstp32 = (uint32*) gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
 
 			if (dstp32 != 0)
-			{
-				for (x = 0; x < nWidth; x++)
-				{
-					*dstp32 ^= color32;
-					dstp32++;
-				}
-			}
+				hdcDest->rops->PATINVERT_32bpp(dstp32, color32, nWidth);
 		}
 	}
 	else
@@ -750,44 +497,6 @@ static int BitBlt_PATINVERT_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int n
 	return 0;
 }
 
-static int BitBlt_PATPAINT_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int x, y;
-	uint8 *srcp;
-	uint8 *dstp;
-	uint8 *patp;
-	
-	for (y = 0; y < nHeight; y++)
-	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				patp = gdi_get_brush_pointer(hdcDest, x, y);
-				
-				*dstp = *dstp | (*patp | ~(*srcp));
-				patp++;
-				srcp++;
-				dstp++;
-					
-				*dstp = *dstp | (*patp | ~(*srcp));
-				patp++;
-				srcp++;
-				dstp++;
-
-				*dstp = *dstp | (*patp | ~(*srcp));
-				dstp += 2;
-				srcp += 2;
-			}
-		}
-	}
-	
-	return 0;
-}
-
 int BitBlt_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc, int rop)
 {
 	if (hdcSrc != NULL)
@@ -817,34 +526,14 @@ int BitBlt_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeigh
 			return BitBlt_SRCCOPY_32bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
 			break;
 
-		case GDI_SPna:
-			return BitBlt_SPna_32bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
-
-		case GDI_DSna:
-			return BitBlt_DSna_32bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
-
 		case GDI_DSPDxax:
 			return BitBlt_DSPDxax_32bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
 			break;
 			
-		case GDI_NOTSRCCOPY:
-			return BitBlt_NOTSRCCOPY_32bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
-
 		case GDI_DSTINVERT:
 			return BitBlt_DSTINVERT_32bpp(hdcDest, nXDest, nYDest, nWidth, nHeight);
 			break;
 
-		case GDI_SRCERASE:
-			return BitBlt_SRCERASE_32bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
-
-		case GDI_NOTSRCERASE:
-			return BitBlt_NOTSRCERASE_32bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
-
 		case GDI_SRCINVERT:
 			return BitBlt_SRCINVERT_32bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
 			break;
@@ -857,14 +546,6 @@ int BitBlt_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeigh
 			return BitBlt_SRCPAINT_32bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
 			break;
 
-		case GDI_MERGECOPY:
-			return BitBlt_MERGECOPY_32bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
-
-		case GDI_MERGEPAINT:
-			return BitBlt_MERGEPAINT_32bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
-
 		case GDI_PATCOPY:
 			return BitBlt_PATCOPY_32bpp(hdcDest, nXDest, nYDest, nWidth, nHeight);
 			break;
@@ -872,14 +553,9 @@ int BitBlt_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeigh
 		case GDI_PATINVERT:
 			return BitBlt_PATINVERT_32bpp(hdcDest, nXDest, nYDest, nWidth, nHeight);
 			break;
-
-		case GDI_PATPAINT:
-			return BitBlt_PATPAINT_32bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
 	}
 	
-	printf("BitBlt: unknown rop: 0x%08X\n", rop);
-	return 1;
+	return gdi_rop3_blt(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc, rop);
 }
 
 int PatBlt_32bpp(HGDI_DC hdc, int nXLeft, int nYLeft, int nWidth, int nHeight, int rop)
@@ -912,8 +588,7 @@ int PatBlt_32bpp(HGDI_DC hdc, int nXLeft, int nYLeft, int nWidth, int nHeight, i
 			break;
 	}
 	
-	printf("PatBlt: unknown rop: 0x%08X", rop);
-	return 1;
+	return gdi_rop3_blt(hdc, nXLeft, nYLeft, nWidth, nHeight, NULL, 0, 0, rop);
 }
 
 void SetPixel_BLACK_32bpp(uint32 *pixel, uint32 *pen)
@@ -22,6 +22,16 @@
 
 typedef void (*pSetPixel32_ROP2)(uint32 *pixel, uint32 *pen);
 
+uint32 gdi_get_color_32bpp(HGDI_DC hdc, GDI_COLOR color);
+
+void RopRow_SRCAND_32bpp(uint32* d, uint32* s, int n);
+void RopRow_SRCPAINT_32bpp(uint32* d, uint32* s, int n);
+void RopRow_SRCINVERT_32bpp(uint32* d, uint32* s, int n);
+void RopRow_DSTINVERT_32bpp(uint32* d, int n);
+void RopRow_PATCOPY_32bpp(uint32* d, uint32 color, int n);
+void RopRow_PATINVERT_32bpp(uint32* d, uint32 color, int n);
+void RopRow_DSPDxax_32bpp(uint32* d, uint8* s, uint32 color, int n);
+
 int FillRect_32bpp(HGDI_DC hdc, HGDI_RECT rect, HGDI_BRUSH hbr);
 int BitBlt_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc, int rop);
 int PatBlt_32bpp(HGDI_DC hdc, int nXLeft, int nYLeft, int nWidth, int nHeight, int rop);
@@ -0,0 +1,429 @@
+/*
+   FreeRDP: A Remote Desktop Protocol client.
+   GDI Banded Rendering
+
+   Copyright 2026 agent <agent@local>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <freerdp/freerdp.h>
+
+#include "gdi.h"
+#include "gdi_region.h"
+#include "gdi_drawing.h"
+
+#include "gdi_band.h"
+
+/*
+ * A batch of primary drawing orders is replayed once per horizontal band of
+ * the drawing surface, each band on its own thread. A band draws through a
+ * private copy of the drawing DC whose clipping region is narrowed to the
+ * band rows, so bands write disjoint pixels and together produce exactly
+ * what drawing the batch serially would.
+ *
+ * Orders reading pixels that another band may be writing split the batch:
+ * screen to screen blits while drawing to the primary surface, and memory
+ * blits out of the drawing surface itself. Pattern brushes are aligned to
+ * the clipped origin of the blit, which a band would move, so pattern blits
+ * split the batch as well. The bands finish the orders before them, then
+ * the order is drawn on the calling thread.
+ */
+
+/**
+ * Narrow the clipping region of a band to the band rows.
+ * @param band band
+ */
+
+static void gdi_band_clip(GDI_BAND* band)
+{
+	int x, y, w, h;
+	HGDI_BITMAP bmp;
+	HGDI_RGN clip = band->hdc.clip;
+
+	bmp = (HGDI_BITMAP) band->hdc.selectedObject;
+
+	if (clip->null)
+	{
+		x = 0;
+		y = 0;
+		w = bmp->width;
+		h = bmp->height;
+	}
+	else
+	{
+		x = clip->x;
+		y = clip->y;
+		w = clip->w;
+		h = clip->h;
+	}
+
+	if (y < band->top)
+	{
+		h -= band->top - y;
+		y = band->top;
+	}
+
+	if (y + h > band->bottom)
+		h = band->bottom - y;
+
+	band->skip = (w <= 0 || h <= 0);
+
+	if (!band->skip)
+		gdi_SetRgn(clip, x, y, w, h);
+}
+
+/**
+ * Copy the current drawing state into a band before it replays a batch.
+ * @param band band
+ * @param inst current instance
+ */
+
+static void gdi_band_setup(GDI_BAND* band, rdpInst* inst)
+{
+	int index;
+	uint8* scratch;
+	int scratch_size;
+	HGDI_DC hdc;
+	HGDI_BITMAP bmp;
+	GDI_BANDS* bands = band->bands;
+	GDI* gdi = GET_GDI(inst);
+
+	hdc = gdi->drawing->hdc;
+	bmp = (HGDI_BITMAP) hdc->selectedObject;
+
+	/* the scratch arena is the only state a band keeps between batches */
+	scratch = band->gdi.scratch;
+	scratch_size = band->gdi.scratch_size;
+	memcpy(&band->gdi, gdi, sizeof(GDI));
+	band->gdi.scratch = scratch;
+	band->gdi.scratch_size = scratch_size;
+	band->gdi.bands = NULL;
+
+	memcpy(&band->hdc, hdc, sizeof(GDI_DC));
+	memcpy(&band->clip, hdc->clip, sizeof(GDI_RGN));
+	band->hdc.clip = &band->clip;
+
+	if (hdc->hwnd != NULL)
+	{
+		band->invalid.null = 1;
+		band->hwnd.invalid = &band->invalid;
+		band->hwnd.ninvalid = 0;
+		band->hwnd.mergeCost = hdc->hwnd->mergeCost;
+
+		if (hdc->hwnd->cinvalid != NULL)
+		{
+			band->hwnd.cinvalid = band->cinvalid;
+			band->hwnd.count = (hdc->hwnd->count < GDI_INVALID_RECTS) ? hdc->hwnd->count : GDI_INVALID_RECTS;
+		}
+		else
+		{
+			band->hwnd.cinvalid = NULL;
+			band->hwnd.count = 0;
+		}
+
+		band->hdc.hwnd = &band->hwnd;
+	}
+
+	memcpy(&band->image, gdi->drawing, sizeof(GDI_IMAGE));
+	band->image.hdc = &band->hdc;
+	band->gdi.drawing = &band->image;
+
+	if (gdi->drawing == gdi->primary)
+		band->gdi.primary = &band->image;
+
+	memcpy(&band->inst, inst, sizeof(rdpInst));
+	SET_GDI(&band->inst, &band->gdi);
+
+	index = band - bands->band;
+	band->top = bmp->height * index / bands->count;
+	band->bottom = bmp->height * (index + 1) / bands->count;
+
+	gdi_band_clip(band);
+}
+
+/**
+ * Replay the current batch within a band.
+ * @param band band
+ */
+
+static void gdi_band_draw(GDI_BAND* band)
+{
+	int index;
+	RD_ORDER* order;
+	GDI_BANDS* bands = band->bands;
+
+	for (index = 0; index < bands->norders; index++)
+	{
+		order = &bands->orders[index];
+
+		if (order->type == RD_ORDER_SET_CLIP || order->type == RD_ORDER_RESET_CLIP)
+		{
+			gdi_draw_order(&band->inst, order);
+			gdi_band_clip(band);
+		}
+		else if (!band->skip)
+		{
+			gdi_draw_order(&band->inst, order);
+		}
+	}
+}
+
+/**
+ * Add the area a band invalidated to the invalid area of the drawing DC.
+ * @param band band
+ * @param hdc drawing device context
+ */
+
+static void gdi_band_invalidate(GDI_BAND* band, HGDI_DC hdc)
+{
+	int index;
+	HGDI_RGN rgn;
+
+	if (band->invalid.null)
+		return;
+
+	if (band->hwnd.cinvalid == NULL)
+	{
+		rgn = &band->invalid;
+		gdi_InvalidateRegion(hdc, rgn->x, rgn->y, rgn->w, rgn->h);
+		return;
+	}
+
+	for (index = 0; index < band->hwnd.ninvalid; index++)
+	{
+		rgn = &band->cinvalid[index];
+		gdi_InvalidateRegion(hdc, rgn->x, rgn->y, rgn->w, rgn->h);
+	}
+}
+
+static void* gdi_band_thread(void* arg)
+{
+	int generation = 0;
+	GDI_BAND* band = (GDI_BAND*) arg;
+	GDI_BANDS* bands = band->bands;
+
+	pthread_mutex_lock(&bands->mutex);
+
+	while (1)
+	{
+		while (bands->generation == generation && !bands->quit)
+			pthread_cond_wait(&bands->start, &bands->mutex);
+
+		if (bands->quit)
+			break;
+
+		generation = bands->generation;
+		pthread_mutex_unlock(&bands->mutex);
+
+		gdi_band_draw(band);
+
+		pthread_mutex_lock(&bands->mutex);
+
+		if (--bands->pending == 0)
+			pthread_cond_signal(&bands->done);
+	}
+
+	pthread_mutex_unlock(&bands->mutex);
+
+	return NULL;
+}
+
+/**
+ * Check if an order reads pixels that may be written by another band.
+ * @param gdi current GDI instance
+ * @param order drawing order
+ * @return 1 if the order has to be drawn on its own, 0 otherwise
+ */
+
+static int gdi_bands_is_barrier(GDI* gdi, RD_ORDER* order)
+{
+	switch (order->type)
+	{
+		case RD_ORDER_SCREENBLT:
+			return (gdi->drawing == gdi->primary);
+
+		case RD_ORDER_MEMBLT:
+			return ((GDI_IMAGE*) order->u.memblt.src == gdi->drawing);
+
+		case RD_ORDER_PATBLT:
+			return (order->u.patblt.brush.style == GDI_BS_PATTERN);
+
+		default:
+			return 0;
+	}
+}
+
+/**
+ * Replay a run of orders across all bands and wait for them to finish.
+ * @param bands render bands
+ * @param inst current instance
+ * @param orders array of orders
+ * @param count number of orders
+ */
+
+static void gdi_bands_run(GDI_BANDS* bands, rdpInst* inst, RD_ORDER* orders, int count)
+{
+	int index;
+	HGDI_DC hdc;
+	GDI* gdi = GET_GDI(inst);
+
+	hdc = gdi->drawing->hdc;
+
+	for (index = 0; index < bands->count; index++)
+		gdi_band_setup(&bands->band[index], inst);
+
+	pthread_mutex_lock(&bands->mutex);
+	bands->orders = orders;
+	bands->norders = count;
+	bands->pending = bands->count - 1;
+	bands->generation++;
+	pthread_cond_broadcast(&bands->start);
+	pthread_mutex_unlock(&bands->mutex);
+
+	/* the calling thread takes the first band */
+	gdi_band_draw(&bands->band[0]);
+
+	pthread_mutex_lock(&bands->mutex);
+
+	while (bands->pending > 0)
+		pthread_cond_wait(&bands->done, &bands->mutex);
+
+	pthread_mutex_unlock(&bands->mutex);
+
+	/* leave the drawing DC in the state drawing the run serially would */
+	for (index = 0; index < count; index++)
+	{
+		if (orders[index].type == RD_ORDER_SET_CLIP || orders[index].type == RD_ORDER_RESET_CLIP)
+			gdi_draw_order(inst, &orders[index]);
+		else if (orders[index].type == RD_ORDER_LINE)
+			gdi_SetROP2(hdc, orders[index].opcode);
+	}
+
+	if (hdc->hwnd != NULL)
+	{
+		for (index = 0; index < bands->count; index++)
+			gdi_band_invalidate(&bands->band[index], hdc);
+	}
+}
+
+/**
+ * Draw a batch of primary drawing orders across the render bands.
+ * @param bands render bands
+ * @param inst current instance
+ * @param orders array of orders
+ * @param count number of orders
+ */
+
+void gdi_bands_draw_orders(GDI_BANDS* bands, rdpInst* inst, RD_ORDER* orders, int count)
+{
+	int next;
+	int index = 0;
+	GDI* gdi = GET_GDI(inst);
+
+	while (index < count)
+	{
+		for (next = index; next < count; next++)
+		{
+			if (gdi_bands_is_barrier(gdi, &orders[next]))
+				break;
+		}
+
+		if (next > index)
+			gdi_bands_run(bands, inst, &orders[index], next - index);
+
+		if (next < count)
+		{
+			gdi_draw_order(inst, &orders[next]);
+			next++;
+		}
+
+		index = next;
+	}
+}
+
+/**
+ * Create render bands and start a thread for each band but the first.
+ * @param gdi current GDI instance
+ * @param count number of bands
+ * @return new render bands, NULL if a thread could not be started
+ */
+
+GDI_BANDS* gdi_bands_new(GDI* gdi, int count)
+{
+	int index;
+	GDI_BANDS* bands;
+
+	bands = (GDI_BANDS*) malloc(sizeof(GDI_BANDS));
+	memset(bands, 0, sizeof(GDI_BANDS));
+
+	bands->count = count;
+	bands->band = (GDI_BAND*) malloc(sizeof(GDI_BAND) * count);
+	memset(bands->band, 0, sizeof(GDI_BAND) * count);
+
+	pthread_mutex_init(&bands->mutex, NULL);
+	pthread_cond_init(&bands->start, NULL);
+	pthread_cond_init(&bands->done, NULL);
+
+	for (index = 0; index < count; index++)
+	{
+		bands->band[index].bands = bands;
+
+		if (index > 0 && pthread_create(&bands->band[index].thread, NULL, gdi_band_thread, &bands->band[index]) != 0)
+		{
+			/* stop the threads started so far */
+			bands->count = index;
+			gdi_bands_free(bands);
+			return NULL;
+		}
+	}
+
+	return bands;
+}
+
+/**
+ * Stop the band threads and free render bands.
+ * @param bands render bands
+ */
+
+void gdi_bands_free(GDI_BANDS* bands)
+{
+	int index;
+
+	if (bands == NULL)
+		return;
+
+	pthread_mutex_lock(&bands->mutex);
+	bands->quit = 1;
+	pthread_cond_broadcast(&bands->start);
+	pthread_mutex_unlock(&bands->mutex);
+
+	for (index = 0; index < bands->count; index++)
+	{
+		if (index > 0)
+			pthread_join(bands->band[index].thread, NULL);
+
+		free(bands->band[index].gdi.scratch);
+	}
+
+	pthread_cond_destroy(&bands->done);
+	pthread_cond_destroy(&bands->start);
+	pthread_mutex_destroy(&bands->mutex);
+
+	free(bands->band);
+	free(bands);
+}
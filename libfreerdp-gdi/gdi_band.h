@@ -0,0 +1,68 @@
+/*
+   FreeRDP: A Remote Desktop Protocol client.
+   GDI Banded Rendering
+
+   Copyright 2026 agent <agent@local>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __GDI_BAND_H
+#define __GDI_BAND_H
+
+#include <pthread.h>
+#include <freerdp/freerdp.h>
+
+#include "gdi.h"
+
+struct _GDI_BANDS;
+
+/* a horizontal slice of the drawing surface with its own copy of the drawing state */
+struct _GDI_BAND
+{
+	int top;
+	int bottom;
+	int skip; /* clipping region does not reach into the band */
+	GDI gdi;
+	rdpInst inst;
+	GDI_IMAGE image;
+	GDI_DC hdc;
+	GDI_RGN clip;
+	GDI_WND hwnd;
+	GDI_RGN invalid;
+	GDI_RGN cinvalid[GDI_INVALID_RECTS];
+	pthread_t thread;
+	struct _GDI_BANDS* bands;
+};
+typedef struct _GDI_BAND GDI_BAND;
+
+struct _GDI_BANDS
+{
+	int count;
+	GDI_BAND* band;
+	RD_ORDER* orders;
+	int norders;
+	int generation;
+	int pending;
+	int quit;
+	pthread_mutex_t mutex;
+	pthread_cond_t start;
+	pthread_cond_t done;
+};
+typedef struct _GDI_BANDS GDI_BANDS;
+
+GDI_BANDS* gdi_bands_new(GDI* gdi, int count);
+void gdi_bands_free(GDI_BANDS* bands);
+void gdi_bands_draw_orders(GDI_BANDS* bands, rdpInst* inst, RD_ORDER* orders, int count);
+
+#endif /* __GDI_BAND_H */
@@ -44,6 +44,7 @@ HGDI_DC gdi_GetDC()
 	hDC->clip = gdi_CreateRectRgn(0, 0, 0, 0);
 	hDC->clip->null = 1;
 	hDC->hwnd = NULL;
+	hDC->rops = &gdi_rops_generic;
 	return hDC;
 }
 
@@ -66,6 +67,7 @@ HGDI_DC gdi_CreateCompatibleDC(HGDI_DC hdc)
 	hDC->alpha = hdc->alpha;
 	hDC->invert = hdc->invert;
 	hDC->rgb555 = hdc->rgb555;
+	hDC->rops = hdc->rops;
 	return hDC;
 }
 
@@ -180,6 +182,7 @@ int gdi_DeleteDC(HGDI_DC hdc)
 	if (hdc->hwnd)
 	{
 		free(hdc->hwnd->invalid);
+		free(hdc->hwnd->cinvalid);
 		free(hdc->hwnd);
 	}
 
@@ -27,6 +27,8 @@
 #include "gdi_32bpp.h"
 #include "gdi_16bpp.h"
 #include "gdi_8bpp.h"
+#include "gdi_region.h"
+#include "gdi_clipping.h"
 
 #include "gdi_line.h"
 
@@ -50,12 +52,22 @@ pLineTo LineTo_[5] =
 
 int gdi_LineTo(HGDI_DC hdc, int nXEnd, int nYEnd)
 {
+	int x, y, w, h;
 	pLineTo _LineTo = LineTo_[IBPP(hdc->bitsPerPixel)];
 
-	if (_LineTo != NULL)
-		return _LineTo(hdc, nXEnd, nYEnd);
-	else
+	if (_LineTo == NULL)
 		return 0;
+
+	/* the line is drawn within the clipped bounding box of its end points */
+	x = (hdc->pen->posX < nXEnd) ? hdc->pen->posX : nXEnd;
+	y = (hdc->pen->posY < nYEnd) ? hdc->pen->posY : nYEnd;
+	w = ((hdc->pen->posX > nXEnd) ? hdc->pen->posX : nXEnd) - x + 1;
+	h = ((hdc->pen->posY > nYEnd) ? hdc->pen->posY : nYEnd) - y + 1;
+
+	if (gdi_ClipCoords(hdc, &x, &y, &w, &h, NULL, NULL))
+		gdi_InvalidateRegion(hdc, x, y, w, h);
+
+	return _LineTo(hdc, nXEnd, nYEnd);
 }
 
 /**
@@ -26,6 +26,13 @@
 
 #include "gdi_region.h"
 
+#ifndef MIN
+#define MIN(x,y)	(((x) < (y)) ? (x) : (y))
+#endif
+#ifndef MAX
+#define MAX(x,y)	(((x) > (y)) ? (x) : (y))
+#endif
+
 /**
  * Create a region from rectangular coordinates.\n
  * @msdn{dd183514}
@@ -358,6 +365,95 @@ int gdi_PtInRect(HGDI_RECT rc, int x, int y)
 	return 0;
 }
 
+/**
+ * Pixels covered by the bounding box of two regions but by neither of them.
+ * @param a first region
+ * @param b second region
+ * @param u bounding box of both
+ * @return wasted pixels, negative when the regions overlap
+ */
+
+static int gdi_UnionWaste(HGDI_RGN a, HGDI_RGN b, HGDI_RGN u)
+{
+	int left, top, right, bottom;
+	int overlap;
+
+	left = MAX(a->x, b->x);
+	top = MAX(a->y, b->y);
+	right = MIN(a->x + a->w, b->x + b->w);
+	bottom = MIN(a->y + a->h, b->y + b->h);
+
+	if (right > left && bottom > top)
+		overlap = (right - left) * (bottom - top);
+	else
+		overlap = 0;
+
+	u->x = MIN(a->x, b->x);
+	u->y = MIN(a->y, b->y);
+	u->w = MAX(a->x + a->w, b->x + b->w) - u->x;
+	u->h = MAX(a->y + a->h, b->y + b->h) - u->y;
+	u->null = 0;
+
+	if (overlap > 0)
+		return -overlap;
+
+	return u->w * u->h - a->w * a->h - b->w * b->h;
+}
+
+/**
+ * Add a rectangle to the invalid rectangles of a window, keeping them disjoint.\n
+ * Overlapping rectangles are merged, as are neighbours whose bounding box wastes
+ * no more than mergeCost pixels; a full list folds into the cheapest neighbour.
+ * @param hwnd window
+ * @param rgn rectangle, clipped to the surface
+ */
+
+static void gdi_AddInvalidRect(HGDI_WND hwnd, HGDI_RGN rgn)
+{
+	GDI_RGN u;
+	int index;
+	int best;
+	int waste;
+	int bestWaste;
+
+	while (1)
+	{
+		/* the merged box may reach rectangles already looked at */
+		index = 0;
+		while (index < hwnd->ninvalid)
+		{
+			if (gdi_UnionWaste(&hwnd->cinvalid[index], rgn, &u) <= hwnd->mergeCost)
+			{
+				*rgn = u;
+				hwnd->cinvalid[index] = hwnd->cinvalid[--hwnd->ninvalid];
+				index = 0;
+				continue;
+			}
+			index++;
+		}
+
+		if (hwnd->ninvalid < hwnd->count)
+			break;
+
+		best = 0;
+		bestWaste = 0x7FFFFFFF;
+		for (index = 0; index < hwnd->ninvalid; index++)
+		{
+			waste = gdi_UnionWaste(&hwnd->cinvalid[index], rgn, &u);
+			if (waste < bestWaste)
+			{
+				bestWaste = waste;
+				best = index;
+			}
+		}
+		gdi_UnionWaste(&hwnd->cinvalid[best], rgn, &u);
+		*rgn = u;
+		hwnd->cinvalid[best] = hwnd->cinvalid[--hwnd->ninvalid];
+	}
+
+	hwnd->cinvalid[hwnd->ninvalid++] = *rgn;
+}
+
 /**
  * Invalidate a given region, such that it is redrawn on the next region update.\n
  * @msdn{dd145003}
@@ -385,6 +481,28 @@ int gdi_InvalidateRegion(HGDI_DC hdc, int x, int y, int w, int h)
 	invalid = hdc->hwnd->invalid;
 	bmp = (HGDI_BITMAP) hdc->selectedObject;
 
+	if (hdc->hwnd->cinvalid != NULL)
+	{
+		GDI_RGN cinv;
+
+		gdi_CRgnToRect(x, y, w, h, &rgn);
+		if (rgn.left < 0)
+			rgn.left = 0;
+		if (rgn.top < 0)
+			rgn.top = 0;
+		if (rgn.right >= bmp->width)
+			rgn.right = bmp->width - 1;
+		if (rgn.bottom >= bmp->height)
+			rgn.bottom = bmp->height - 1;
+
+		if (rgn.right >= rgn.left && rgn.bottom >= rgn.top)
+		{
+			gdi_RectToRgn(&rgn, &cinv);
+			cinv.null = 0;
+			gdi_AddInvalidRect(hdc->hwnd, &cinv);
+		}
+	}
+
 	if (invalid->null)
 	{
 		invalid->x = x;
@@ -0,0 +1,333 @@
+/*
+   FreeRDP: A Remote Desktop Protocol client.
+   GDI Ternary Raster Operations
+
+   Copyright 2026 agent <agent@local>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <freerdp/freerdp.h>
+
+#include "gdi.h"
+#include "gdi_32bpp.h"
+#include "gdi_16bpp.h"
+#include "gdi_region.h"
+
+#include "gdi_rop3.h"
+
+/*
+ * A ROP3 code is the truth table of its operation: bit (P << 2 | S << 1 | D)
+ * of the index byte is the result for that combination of pattern, source
+ * and destination bits. Since every bit of a pixel is independent, the same
+ * evaluation works for any color depth, applied to whole rows of bytes.
+ *
+ * Each of the 256 codes gets its own row kernel, generated below from one
+ * inline function with the code as a constant, so the compiler reduces the
+ * truth table to a short bitwise expression on a whole vector register.
+ */
+
+/* bytes of a row processed per kernel call, a multiple of the vector size */
+#define GDI_ROP3_CHUNK	512
+
+#if defined(__GNUC__)
+#if defined(__AVX2__)
+#define GDI_ROP3_VECTOR	32
+#else
+#define GDI_ROP3_VECTOR	16
+#endif
+typedef uint32 rop3_vec __attribute__ ((__vector_size__ (GDI_ROP3_VECTOR)));
+#define ROP3_INLINE static __inline __attribute__((__always_inline__))
+#else
+#define GDI_ROP3_VECTOR	4
+typedef uint32 rop3_vec;
+#define ROP3_INLINE static
+#endif
+
+typedef void (*p_gdi_rop3_row)(uint8* d, uint8* s, uint8* p, uint32 mask, int n);
+
+static const rop3_vec rop3_zero = { 0 };
+
+/* _m ? _a : _b for every bit */
+#define ROP3_SEL(_m, _a, _b) \
+	(((_m) & (_a)) | (~(_m) & (_b)))
+
+#define ROP3_BIT(_code, _bit, _one, _zero) \
+	((((_code) >> (_bit)) & 1) ? (_one) : (_zero))
+
+/* the low nibble of _code as a function of S and D */
+#define ROP3_SD(_code, _s, _d, _one, _zero) \
+	ROP3_SEL(_s, \
+		ROP3_SEL(_d, ROP3_BIT(_code, 3, _one, _zero), ROP3_BIT(_code, 2, _one, _zero)), \
+		ROP3_SEL(_d, ROP3_BIT(_code, 1, _one, _zero), ROP3_BIT(_code, 0, _one, _zero)))
+
+#define ROP3_PSD(_code, _p, _s, _d, _one, _zero) \
+	ROP3_SEL(_p, ROP3_SD((_code) >> 4, _s, _d, _one, _zero), ROP3_SD(_code, _s, _d, _one, _zero))
+
+/*
+ * mask selects the bytes of each group of four that may be written, which
+ * keeps the alpha byte of 32bpp pixels. The row must start on a pixel.
+ */
+ROP3_INLINE void gdi_rop3_row(uint8 code, uint8* d, uint8* s, uint8* p, uint32 mask, int n)
+{
+	int i;
+	uint8 r;
+	uint8* mb;
+	rop3_vec vd, vs, vp, vm;
+	rop3_vec one = ~rop3_zero;
+
+	vm = rop3_zero + mask;
+	mb = (uint8*) &mask;
+
+	for (i = 0; i + GDI_ROP3_VECTOR <= n; i += GDI_ROP3_VECTOR)
+	{
+		memcpy(&vd, d + i, GDI_ROP3_VECTOR);
+		memcpy(&vs, s + i, GDI_ROP3_VECTOR);
+		memcpy(&vp, p + i, GDI_ROP3_VECTOR);
+
+		vd = ROP3_SEL(vm, ROP3_PSD(code, vp, vs, vd, one, rop3_zero), vd);
+		memcpy(d + i, &vd, GDI_ROP3_VECTOR);
+	}
+
+	for (; i < n; i++)
+	{
+		r = ROP3_PSD(code, p[i], s[i], d[i], 0xFF, 0x00);
+		d[i] = ROP3_SEL(mb[i & 3], r, d[i]);
+	}
+}
+
+#define ROP3_KERNEL(_code) \
+static void gdi_rop3_row_##_code(uint8* d, uint8* s, uint8* p, uint32 mask, int n) \
+{ \
+	gdi_rop3_row(_code, d, s, p, mask, n); \
+}
+
+#define ROP3_KERNELS(_h) \
+	ROP3_KERNEL(_h##0) ROP3_KERNEL(_h##1) ROP3_KERNEL(_h##2) ROP3_KERNEL(_h##3) \
+	ROP3_KERNEL(_h##4) ROP3_KERNEL(_h##5) ROP3_KERNEL(_h##6) ROP3_KERNEL(_h##7) \
+	ROP3_KERNEL(_h##8) ROP3_KERNEL(_h##9) ROP3_KERNEL(_h##A) ROP3_KERNEL(_h##B) \
+	ROP3_KERNEL(_h##C) ROP3_KERNEL(_h##D) ROP3_KERNEL(_h##E) ROP3_KERNEL(_h##F)
+
+#define ROP3_ENTRIES(_h) \
+	gdi_rop3_row_##_h##0, gdi_rop3_row_##_h##1, gdi_rop3_row_##_h##2, gdi_rop3_row_##_h##3, \
+	gdi_rop3_row_##_h##4, gdi_rop3_row_##_h##5, gdi_rop3_row_##_h##6, gdi_rop3_row_##_h##7, \
+	gdi_rop3_row_##_h##8, gdi_rop3_row_##_h##9, gdi_rop3_row_##_h##A, gdi_rop3_row_##_h##B, \
+	gdi_rop3_row_##_h##C, gdi_rop3_row_##_h##D, gdi_rop3_row_##_h##E, gdi_rop3_row_##_h##F
+
+ROP3_KERNELS(0x0)
+ROP3_KERNELS(0x1)
+ROP3_KERNELS(0x2)
+ROP3_KERNELS(0x3)
+ROP3_KERNELS(0x4)
+ROP3_KERNELS(0x5)
+ROP3_KERNELS(0x6)
+ROP3_KERNELS(0x7)
+ROP3_KERNELS(0x8)
+ROP3_KERNELS(0x9)
+ROP3_KERNELS(0xA)
+ROP3_KERNELS(0xB)
+ROP3_KERNELS(0xC)
+ROP3_KERNELS(0xD)
+ROP3_KERNELS(0xE)
+ROP3_KERNELS(0xF)
+
+static const p_gdi_rop3_row rop3_row_table[256] =
+{
+	ROP3_ENTRIES(0x0), ROP3_ENTRIES(0x1), ROP3_ENTRIES(0x2), ROP3_ENTRIES(0x3),
+	ROP3_ENTRIES(0x4), ROP3_ENTRIES(0x5), ROP3_ENTRIES(0x6), ROP3_ENTRIES(0x7),
+	ROP3_ENTRIES(0x8), ROP3_ENTRIES(0x9), ROP3_ENTRIES(0xA), ROP3_ENTRIES(0xB),
+	ROP3_ENTRIES(0xC), ROP3_ENTRIES(0xD), ROP3_ENTRIES(0xE), ROP3_ENTRIES(0xF)
+};
+
+/* copy n bytes of a repeating pattern, starting offset bytes into it */
+static void gdi_rop3_fill_span(uint8* d, uint8* pattern, int period, int offset, int n)
+{
+	int len;
+
+	offset %= period;
+
+	while (n > 0)
+	{
+		len = period - offset;
+
+		if (len > n)
+			len = n;
+
+		memcpy(d, pattern + offset, len);
+		d += len;
+		n -= len;
+		offset = 0;
+	}
+}
+
+/**
+ * Check whether a raster operation reads the source.
+ * @param rop raster operation code
+ * @return 1 if the source is used, 0 otherwise
+ */
+
+int gdi_rop3_uses_src(int rop)
+{
+	uint8 code = (rop >> 16) & 0xFF;
+	return (((code >> 2) & 0x33) != (code & 0x33)) ? 1 : 0;
+}
+
+/**
+ * Check whether a raster operation reads the brush.
+ * @param rop raster operation code
+ * @return 1 if the brush is used, 0 otherwise
+ */
+
+int gdi_rop3_uses_pat(int rop)
+{
+	uint8 code = (rop >> 16) & 0xFF;
+	return (((code >> 4) & 0x0F) != (code & 0x0F)) ? 1 : 0;
+}
+
+/**
+ * Perform any ternary raster operation on already clipped coordinates.\n
+ * The source must have the color depth of the destination, and the alpha
+ * byte of 32bpp pixels is left unchanged.
+ * @param hdcDest destination device context
+ * @param nXDest destination x1
+ * @param nYDest destination y1
+ * @param nWidth width
+ * @param nHeight height
+ * @param hdcSrc source device context, NULL if the operation has none
+ * @param nXSrc source x1
+ * @param nYSrc source y1
+ * @param rop raster operation code
+ * @return 0 on success, 1 if the operation cannot be applied
+ */
+
+int gdi_rop3_blt(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc, int rop)
+{
+	int i, x, y;
+	int len, step;
+	int bpp, period;
+	int rowSize, lastChunk;
+	int usesSrc, usesPat;
+	int stageSrc, reverseX, reverseY;
+	uint8 *srcp, *dstp, *patp, *s;
+	uint8 pixel[4];
+	uint8 writeMask[4];
+	uint32 mask;
+	uint32 color32;
+	uint16 color16;
+	uint8 srcRow[GDI_ROP3_CHUNK];
+	uint8 patRow[GDI_ROP3_CHUNK];
+	p_gdi_rop3_row row;
+
+	row = rop3_row_table[(rop >> 16) & 0xFF];
+	usesSrc = gdi_rop3_uses_src(rop);
+	usesPat = gdi_rop3_uses_pat(rop);
+	bpp = hdcDest->bytesPerPixel;
+
+	stageSrc = reverseX = reverseY = 0;
+
+	if (usesSrc)
+	{
+		if (hdcSrc == NULL || hdcSrc->bytesPerPixel != bpp)
+		{
+			printf("gdi_rop3_blt: rop 0x%08X needs a %d bpp source\n", rop, bpp * 8);
+			return 1;
+		}
+
+		/* read overlapping rows and chunks before they are overwritten */
+		if (hdcSrc->selectedObject == hdcDest->selectedObject &&
+		    gdi_CopyOverlap(nXDest, nYDest, nWidth, nHeight, nXSrc, nYSrc))
+		{
+			stageSrc = 1;
+			reverseY = (nYSrc < nYDest) ? 1 : 0;
+			reverseX = (nYSrc == nYDest && nXSrc < nXDest) ? 1 : 0;
+		}
+	}
+
+	writeMask[0] = writeMask[1] = writeMask[2] = 0xFF;
+	writeMask[3] = (bpp == 4) ? 0x00 : 0xFF;
+	memcpy(&mask, writeMask, sizeof(mask));
+
+	rowSize = nWidth * bpp;
+	lastChunk = ((rowSize - 1) / GDI_ROP3_CHUNK) * GDI_ROP3_CHUNK;
+	period = 0;
+
+	if (usesPat)
+	{
+		if (hdcDest->brush->style == GDI_BS_PATTERN)
+		{
+			period = hdcDest->brush->pattern->width * bpp;
+		}
+		else
+		{
+			/* a solid brush is the same for every chunk of every row */
+			if (bpp == 4)
+			{
+				color32 = gdi_get_color_32bpp(hdcDest, hdcDest->brush->color);
+				memcpy(pixel, &color32, 4);
+			}
+			else if (bpp == 2)
+			{
+				color16 = gdi_get_color_16bpp(hdcDest, hdcDest->brush->color);
+				memcpy(pixel, &color16, 2);
+			}
+			else
+			{
+				pixel[0] = (hdcDest->brush->color >> 16) & 0xFF;
+			}
+
+			gdi_rop3_fill_span(patRow, pixel, bpp, 0, GDI_ROP3_CHUNK);
+		}
+	}
+
+	for (i = 0; i < nHeight; i++)
+	{
+		y = reverseY ? nHeight - 1 - i : i;
+
+		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
+		srcp = usesSrc ? gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y) : dstp;
+
+		if (dstp == 0 || srcp == 0)
+			continue;
+
+		patp = (period > 0) ? gdi_get_brush_pointer(hdcDest, 0, y) : NULL;
+
+		x = reverseX ? lastChunk : 0;
+		step = reverseX ? -GDI_ROP3_CHUNK : GDI_ROP3_CHUNK;
+
+		for (; x >= 0 && x < rowSize; x += step)
+		{
+			len = rowSize - x;
+
+			if (len > GDI_ROP3_CHUNK)
+				len = GDI_ROP3_CHUNK;
+
+			s = srcp + x;
+
+			if (stageSrc)
+			{
+				memcpy(srcRow, s, len);
+				s = srcRow;
+			}
+
+			if (patp != NULL)
+				gdi_rop3_fill_span(patRow, patp, period, x, len);
+
+			row(dstp + x, s, usesPat ? patRow : dstp + x, mask, len);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,29 @@
+/*
+   FreeRDP: A Remote Desktop Protocol client.
+   GDI Ternary Raster Operations
+
+   Copyright 2026 agent <agent@local>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __GDI_ROP3_H
+#define __GDI_ROP3_H
+
+#include "gdi.h"
+
+int gdi_rop3_uses_src(int rop);
+int gdi_rop3_uses_pat(int rop);
+int gdi_rop3_blt(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc, int rop);
+
+#endif /* __GDI_ROP3_H */
@@ -0,0 +1,38 @@
+/*
+   FreeRDP: A Remote Desktop Protocol client.
+   GDI AVX2 Raster Operations
+
+   Copyright 2026 agent <agent@local>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __GDI_AVX2_H
+#define __GDI_AVX2_H
+
+#include "gdi.h"
+
+void RopRow_SRCAND_32bpp_AVX2(uint32* d, uint32* s, int n);
+void RopRow_SRCPAINT_32bpp_AVX2(uint32* d, uint32* s, int n);
+void RopRow_SRCINVERT_32bpp_AVX2(uint32* d, uint32* s, int n);
+void RopRow_DSTINVERT_32bpp_AVX2(uint32* d, int n);
+void RopRow_PATCOPY_32bpp_AVX2(uint32* d, uint32 color, int n);
+void RopRow_PATINVERT_32bpp_AVX2(uint32* d, uint32 color, int n);
+void RopRow_DSPDxax_32bpp_AVX2(uint32* d, uint8* s, uint32 color, int n);
+
+void RopRow_DSPDxax_16bpp_AVX2(uint16* d, uint8* s, uint16 color, int n);
+
+int gdi_cpu_has_avx2(void);
+void gdi_init_rops_avx2(HGDI_ROPS rops);
+
+#endif /* __GDI_AVX2_H */
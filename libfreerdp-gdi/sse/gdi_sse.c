@@ -25,8 +25,17 @@
 #include "gdi.h"
 
 #include "gdi_sse.h"
+#include "gdi_sse2.h"
+#include "gdi_avx2.h"
 
 void gdi_init_sse(GDI* gdi)
 {
-
+	DEBUG_GDI("Using SSE2 optimizations");
+	gdi_init_rops_sse2(&gdi->rops);
+
+	if (gdi_cpu_has_avx2())
+	{
+		DEBUG_GDI("Using AVX2 optimizations");
+		gdi_init_rops_avx2(&gdi->rops);
+	}
 }
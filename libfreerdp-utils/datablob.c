@@ -43,5 +43,6 @@ void datablob_free(DATABLOB *datablob)
 	if (datablob->data)
 		xfree(datablob->data);
 	
+	datablob->data = NULL;
 	datablob->length = 0;
 }
@@ -0,0 +1,494 @@
+/*
+   FreeRDP: A Remote Desktop Protocol client.
+   Event Loop
+
+   Copyright 2026 agent <agent@local>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <freerdp/types/base.h>
+#include <freerdp/utils/memory.h>
+#include <freerdp/utils/event_loop.h>
+
+#ifdef __linux__
+#define EVENT_LOOP_EPOLL
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
+
+struct _EVENT_FD
+{
+	int fd;
+	int events;	/* registered with the kernel, 0 if not registered */
+	int want;	/* scratch for event_loop_set_fds */
+	int revents;	/* result of the last wait */
+	int always;	/* fd the kernel cannot wait on (regular file), always ready */
+};
+typedef struct _EVENT_FD EVENT_FD;
+
+struct _EVENT_TIMER
+{
+	int id;
+	int interval;
+	uint64 due;
+	EVENT_TIMER_CALLBACK callback;
+	void * arg;
+};
+typedef struct _EVENT_TIMER EVENT_TIMER;
+
+struct _EVENT_LOOP
+{
+	EVENT_FD * fds;
+	int num_fds;
+	int max_fds;
+	EVENT_TIMER * timers;
+	int num_timers;
+	int max_timers;
+	int next_timer_id;
+	int running_timers;	/* removed timers are only marked while set */
+#ifdef EVENT_LOOP_EPOLL
+	int epoll_fd;
+	struct epoll_event * events;
+#else
+	struct pollfd * pfds;
+#endif
+};
+
+static uint64
+event_loop_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int
+event_loop_ctl(EVENT_LOOP * loop, EVENT_FD * efd, int events)
+{
+#ifdef EVENT_LOOP_EPOLL
+	struct epoll_event ev;
+	int op;
+
+	if (efd->always)
+	{
+		efd->events = events;
+		return 0;
+	}
+	memset(&ev, 0, sizeof(ev));
+	ev.data.fd = efd->fd;
+	if (events & EVENT_READ)
+		ev.events |= EPOLLIN;
+	if (events & EVENT_WRITE)
+		ev.events |= EPOLLOUT;
+	if (events == 0)
+		op = EPOLL_CTL_DEL;
+	else if (efd->events == 0)
+		op = EPOLL_CTL_ADD;
+	else
+		op = EPOLL_CTL_MOD;
+	if (epoll_ctl(loop->epoll_fd, op, efd->fd, &ev) < 0)
+	{
+		/* a closed fd drops out of the epoll set, its number may come back */
+		if (op == EPOLL_CTL_MOD && errno == ENOENT)
+			op = EPOLL_CTL_ADD;
+		else if (op == EPOLL_CTL_ADD && errno == EEXIST)
+			op = EPOLL_CTL_MOD;
+		else
+			op = -1;
+		if (op != -1 && epoll_ctl(loop->epoll_fd, op, efd->fd, &ev) == 0)
+		{
+			efd->events = events;
+			return 0;
+		}
+		if (errno != EPERM)
+			return -1;
+		/* select and poll report regular files as ready, do the same */
+		efd->always = 1;
+	}
+#endif
+	efd->events = events;
+	return 0;
+}
+
+static EVENT_FD *
+event_loop_find(EVENT_LOOP * loop, int fd)
+{
+	int index;
+
+	/* the fd sets handed around by the get_fds callbacks are small */
+	for (index = 0; index < loop->num_fds; index++)
+	{
+		if (loop->fds[index].fd == fd)
+			return &loop->fds[index];
+	}
+	return NULL;
+}
+
+static EVENT_FD *
+event_loop_append(EVENT_LOOP * loop, int fd)
+{
+	EVENT_FD * efd;
+
+	if (loop->num_fds == loop->max_fds)
+	{
+		loop->max_fds = loop->max_fds ? loop->max_fds * 2 : 16;
+		loop->fds = (EVENT_FD *) xrealloc(loop->fds, loop->max_fds * sizeof(EVENT_FD));
+#ifdef EVENT_LOOP_EPOLL
+		loop->events = (struct epoll_event *) xrealloc(loop->events,
+			loop->max_fds * sizeof(struct epoll_event));
+#else
+		loop->pfds = (struct pollfd *) xrealloc(loop->pfds,
+			loop->max_fds * sizeof(struct pollfd));
+#endif
+	}
+	efd = &loop->fds[loop->num_fds++];
+	memset(efd, 0, sizeof(EVENT_FD));
+	efd->fd = fd;
+	return efd;
+}
+
+static void
+event_loop_delete(EVENT_LOOP * loop, EVENT_FD * efd)
+{
+	if (efd->events)
+		event_loop_ctl(loop, efd, 0);
+	*efd = loop->fds[--loop->num_fds];
+}
+
+EVENT_LOOP *
+event_loop_new(void)
+{
+	EVENT_LOOP * loop;
+
+	loop = (EVENT_LOOP *) xmalloc(sizeof(EVENT_LOOP));
+	memset(loop, 0, sizeof(EVENT_LOOP));
+	loop->next_timer_id = 1;
+#ifdef EVENT_LOOP_EPOLL
+	loop->epoll_fd = epoll_create(16);
+	if (loop->epoll_fd < 0)
+	{
+		perror("epoll_create");
+		xfree(loop);
+		return NULL;
+	}
+#endif
+	return loop;
+}
+
+void
+event_loop_free(EVENT_LOOP * loop)
+{
+	if (loop == NULL)
+		return;
+#ifdef EVENT_LOOP_EPOLL
+	close(loop->epoll_fd);
+	xfree(loop->events);
+#else
+	xfree(loop->pfds);
+#endif
+	xfree(loop->fds);
+	xfree(loop->timers);
+	xfree(loop);
+}
+
+int
+event_loop_add(EVENT_LOOP * loop, int fd, int events)
+{
+	EVENT_FD * efd;
+
+	if (fd < 0 || events == 0)
+		return -1;
+	efd = event_loop_find(loop, fd);
+	if (efd == NULL)
+		efd = event_loop_append(loop, fd);
+	else if (efd->events == events)
+		return 0;
+	if (event_loop_ctl(loop, efd, events) < 0)
+	{
+		event_loop_delete(loop, efd);
+		return -1;
+	}
+	return 0;
+}
+
+int
+event_loop_remove(EVENT_LOOP * loop, int fd)
+{
+	EVENT_FD * efd;
+
+	efd = event_loop_find(loop, fd);
+	if (efd == NULL)
+		return -1;
+	event_loop_delete(loop, efd);
+	return 0;
+}
+
+static void
+event_loop_want(EVENT_LOOP * loop, void ** fds, int count, int events)
+{
+	EVENT_FD * efd;
+	int index;
+	int fd;
+
+	for (index = 0; index < count; index++)
+	{
+		fd = (int) (long) fds[index];
+		if (fd < 0)
+			continue;
+		efd = event_loop_find(loop, fd);
+		if (efd == NULL)
+			efd = event_loop_append(loop, fd);
+		efd->want |= events;
+	}
+}
+
+int
+event_loop_set_fds(EVENT_LOOP * loop, void ** read_fds, int read_count,
+	void ** write_fds, int write_count)
+{
+	EVENT_FD * efd;
+	int index;
+	int rv;
+
+	for (index = 0; index < loop->num_fds; index++)
+		loop->fds[index].want = 0;
+	event_loop_want(loop, read_fds, read_count, EVENT_READ);
+	event_loop_want(loop, write_fds, write_count, EVENT_WRITE);
+
+	rv = 0;
+	index = 0;
+	while (index < loop->num_fds)
+	{
+		efd = &loop->fds[index];
+		if (efd->want == 0)
+		{
+			/* the last entry moves into this slot, look at it again */
+			event_loop_delete(loop, efd);
+			continue;
+		}
+		if (efd->want != efd->events && event_loop_ctl(loop, efd, efd->want) < 0)
+		{
+			perror("event_loop_set_fds");
+			rv = -1;
+		}
+		index++;
+	}
+	return rv;
+}
+
+int
+event_loop_count(EVENT_LOOP * loop)
+{
+	return loop->num_fds;
+}
+
+int
+event_loop_add_timer(EVENT_LOOP * loop, int interval,
+	EVENT_TIMER_CALLBACK callback, void * arg)
+{
+	EVENT_TIMER * timer;
+
+	if (loop->num_timers == loop->max_timers)
+	{
+		loop->max_timers = loop->max_timers ? loop->max_timers * 2 : 4;
+		loop->timers = (EVENT_TIMER *) xrealloc(loop->timers,
+			loop->max_timers * sizeof(EVENT_TIMER));
+	}
+	timer = &loop->timers[loop->num_timers++];
+	timer->id = loop->next_timer_id++;
+	timer->interval = interval > 0 ? interval : 1;
+	timer->due = event_loop_now() + timer->interval;
+	timer->callback = callback;
+	timer->arg = arg;
+	return timer->id;
+}
+
+void
+event_loop_remove_timer(EVENT_LOOP * loop, int id)
+{
+	int index;
+
+	for (index = 0; index < loop->num_timers; index++)
+	{
+		if (loop->timers[index].id == id)
+		{
+			if (loop->running_timers)
+			{
+				loop->timers[index].callback = NULL;
+				return;
+			}
+			loop->num_timers--;
+			memmove(&loop->timers[index], &loop->timers[index + 1],
+				(loop->num_timers - index) * sizeof(EVENT_TIMER));
+			return;
+		}
+	}
+}
+
+static void
+event_loop_run_timers(EVENT_LOOP * loop)
+{
+	EVENT_TIMER * timer;
+	EVENT_TIMER_CALLBACK callback;
+	uint64 now;
+	int index;
+	int count;
+
+	/* a callback may add timers, which can move the array, or remove
+	   timers, which are only marked until all callbacks have run */
+	now = event_loop_now();
+	loop->running_timers = 1;
+	for (index = 0; index < loop->num_timers; index++)
+	{
+		timer = &loop->timers[index];
+		if (timer->callback == NULL || timer->due > now)
+			continue;
+		timer->due += timer->interval;
+		if (timer->due <= now)
+			timer->due = now + timer->interval;
+		callback = timer->callback;
+		callback(timer->arg);
+	}
+	loop->running_timers = 0;
+
+	count = 0;
+	for (index = 0; index < loop->num_timers; index++)
+	{
+		if (loop->timers[index].callback != NULL)
+			loop->timers[count++] = loop->timers[index];
+	}
+	loop->num_timers = count;
+}
+
+static int
+event_loop_timeout(EVENT_LOOP * loop, int timeout)
+{
+	uint64 now;
+	int index;
+	int delay;
+
+	for (index = 0; index < loop->num_fds; index++)
+	{
+		if (loop->fds[index].always)
+			return 0;
+	}
+	if (loop->num_timers == 0)
+		return timeout;
+	now = event_loop_now();
+	for (index = 0; index < loop->num_timers; index++)
+	{
+		if (loop->timers[index].due <= now)
+			return 0;
+		delay = (int) (loop->timers[index].due - now);
+		if (timeout < 0 || delay < timeout)
+			timeout = delay;
+	}
+	return timeout;
+}
+
+int
+event_loop_wait(EVENT_LOOP * loop, int timeout)
+{
+	EVENT_FD * efd;
+	int index;
+	int count;
+	int num;
+
+	timeout = event_loop_timeout(loop, timeout);
+	for (index = 0; index < loop->num_fds; index++)
+		loop->fds[index].revents = 0;
+
+#ifdef EVENT_LOOP_EPOLL
+	num = epoll_wait(loop->epoll_fd, loop->events,
+		loop->max_fds > 0 ? loop->max_fds : 1, timeout);
+#else
+	for (index = 0; index < loop->num_fds; index++)
+	{
+		loop->pfds[index].fd = loop->fds[index].fd;
+		loop->pfds[index].events = 0;
+		loop->pfds[index].revents = 0;
+		if (loop->fds[index].events & EVENT_READ)
+			loop->pfds[index].events |= POLLIN;
+		if (loop->fds[index].events & EVENT_WRITE)
+			loop->pfds[index].events |= POLLOUT;
+	}
+	num = poll(loop->pfds, loop->num_fds, timeout);
+#endif
+	if (num < 0)
+	{
+		if (errno != EINTR && errno != EAGAIN)
+			return -1;
+		num = 0;
+	}
+
+	count = 0;
+#ifdef EVENT_LOOP_EPOLL
+	for (index = 0; index < num; index++)
+	{
+		efd = event_loop_find(loop, loop->events[index].data.fd);
+		if (efd == NULL)
+			continue;
+		/* like select, errors and hangups wake up readers */
+		if (loop->events[index].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+			efd->revents |= EVENT_READ;
+		if (loop->events[index].events & (EPOLLOUT | EPOLLERR))
+			efd->revents |= EVENT_WRITE;
+		efd->revents &= efd->events;
+		if (efd->revents)
+			count++;
+	}
+#else
+	for (index = 0; index < loop->num_fds && num > 0; index++)
+	{
+		efd = &loop->fds[index];
+		if (loop->pfds[index].revents & (POLLIN | POLLERR | POLLHUP | POLLNVAL))
+			efd->revents |= EVENT_READ;
+		if (loop->pfds[index].revents & (POLLOUT | POLLERR | POLLNVAL))
+			efd->revents |= EVENT_WRITE;
+		efd->revents &= efd->events;
+		if (efd->revents)
+			count++;
+	}
+#endif
+	for (index = 0; index < loop->num_fds; index++)
+	{
+		efd = &loop->fds[index];
+		if (efd->always && efd->revents == 0)
+		{
+			efd->revents = efd->events;
+			count++;
+		}
+	}
+
+	event_loop_run_timers(loop);
+	return count;
+}
+
+int
+event_loop_ready(EVENT_LOOP * loop, int fd)
+{
+	EVENT_FD * efd;
+
+	efd = event_loop_find(loop, fd);
+	if (efd == NULL)
+		return 0;
+	return efd->revents;
+}
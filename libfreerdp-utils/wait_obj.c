@@ -21,6 +21,8 @@
 #include <string.h>
 #include <netdb.h>
 #include <unistd.h>
+#include <poll.h>
+#include <freerdp/utils/memory.h>
 #include <freerdp/utils/wait_obj.h>
 
 #define LOG_LEVEL 1
@@ -75,15 +77,12 @@ wait_obj_free(struct wait_obj * obj)
 int
 wait_obj_is_set(struct wait_obj * obj)
 {
-	fd_set rfds;
-	int num_set;
-	struct timeval time;
-
-	FD_ZERO(&rfds);
-	FD_SET(obj->pipe_fd[0], &rfds);
-	memset(&time, 0, sizeof(time));
-	num_set = select(obj->pipe_fd[0] + 1, &rfds, 0, 0, &time);
-	return (num_set == 1);
+	struct pollfd pfd;
+
+	pfd.fd = obj->pipe_fd[0];
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	return (poll(&pfd, 1, 0) == 1);
 }
 
 int
@@ -125,48 +124,40 @@ int
 wait_obj_select(struct wait_obj ** listobj, int numobj, int * listr, int numr,
 	int timeout)
 {
-	int max;
-	int rv;
+	struct pollfd stack_pfds[8];
+	struct pollfd * pfds;
+	int count;
 	int index;
-	int sock;
-	struct timeval time;
-	struct timeval * ptime;
-	fd_set fds;
+	int rv;
 
-	ptime = 0;
-	if (timeout >= 0)
-	{
-		time.tv_sec = timeout / 1000;
-		time.tv_usec = (timeout * 1000) % 1000000;
-		ptime = &time;
-	}
-	max = 0;
-	FD_ZERO(&fds);
+	/* poll has no FD_SETSIZE ceiling on the descriptor values */
+	count = (listobj ? numobj : 0) + (listr ? numr : 0);
+	pfds = stack_pfds;
+	if (count > 8)
+		pfds = (struct pollfd *) xmalloc(count * sizeof(struct pollfd));
+	count = 0;
 	if (listobj)
 	{
 		for (index = 0; index < numobj; index++)
 		{
-			sock = listobj[index]->pipe_fd[0];
-			FD_SET(sock, &fds);
-			if (sock > max)
-			{
-				max = sock;
-			}
+			pfds[count].fd = listobj[index]->pipe_fd[0];
+			pfds[count].events = POLLIN;
+			pfds[count].revents = 0;
+			count++;
 		}
 	}
 	if (listr)
 	{
 		for (index = 0; index < numr; index++)
 		{
-			sock = listr[index];
-			FD_SET(sock, &fds);
-			if (sock > max)
-			{
-				max = sock;
-			}
+			pfds[count].fd = listr[index];
+			pfds[count].events = POLLIN;
+			pfds[count].revents = 0;
+			count++;
 		}
 	}
-	rv = select(max + 1, &fds, 0, 0, ptime);
+	rv = poll(pfds, count, timeout < 0 ? -1 : timeout);
+	if (pfds != stack_pfds)
+		xfree(pfds);
 	return rv;
 }
-